@@ -317,6 +317,48 @@ static struct gralloc_drm_handle_t *create_bo_handle(int width,
 	return handle;
 }
 
+/*
+ * Map a bo for CPU access to a rectangle.  Drivers with begin_cpu_access
+ * keep the bo mapped and only need to synchronize.
+ */
+static int bo_map(struct gralloc_drm_bo_t *bo, int x, int y, int w, int h,
+		int enable_write, void **addr)
+{
+	struct gralloc_drm_drv_t *drv = bo->drm->drv;
+	int err;
+
+	if (!drv->begin_cpu_access)
+		return drv->map(drv, bo, x, y, w, h, enable_write, addr);
+
+	if (!bo->map_addr) {
+		err = drv->map(drv, bo, 0, 0, bo->handle->width,
+				bo->handle->height, 1, &bo->map_addr);
+		if (err) {
+			bo->map_addr = NULL;
+			return err;
+		}
+	}
+
+	err = drv->begin_cpu_access(drv, bo, x, y, w, h, enable_write);
+	if (err)
+		return err;
+
+	*addr = bo->map_addr;
+
+	return 0;
+}
+
+static void bo_unmap(struct gralloc_drm_bo_t *bo, int x, int y, int w, int h,
+		int written)
+{
+	struct gralloc_drm_drv_t *drv = bo->drm->drv;
+
+	if (!drv->begin_cpu_access)
+		drv->unmap(drv, bo);
+	else if (drv->end_cpu_access)
+		drv->end_cpu_access(drv, bo, x, y, w, h, written);
+}
+
 /*
  * Create a bo.
  */
@@ -364,6 +406,11 @@ static void gralloc_drm_bo_destroy(struct gralloc_drm_bo_t *bo)
 
 	gralloc_drm_bo_rm_fb(bo);
 
+	if (bo->map_addr) {
+		bo->drm->drv->unmap(bo->drm->drv, bo);
+		bo->map_addr = NULL;
+	}
+
 	bo->drm->drv->free(bo->drm->drv, bo);
 	if (imported) {
 		handle->data_owner = 0;
@@ -455,12 +502,19 @@ int gralloc_drm_bo_lock(struct gralloc_drm_bo_t *bo,
 
 	usage |= bo->locked_for;
 
+	/* an empty rectangle means the whole buffer */
+	if (w <= 0 || h <= 0) {
+		x = 0;
+		y = 0;
+		w = bo->handle->width;
+		h = bo->handle->height;
+	}
+
 	if (usage & (GRALLOC_USAGE_SW_WRITE_MASK |
 		     GRALLOC_USAGE_SW_READ_MASK)) {
 		/* the driver is supposed to wait for the bo */
 		int write = !!(usage & GRALLOC_USAGE_SW_WRITE_MASK);
-		int err = bo->drm->drv->map(bo->drm->drv, bo,
-				x, y, w, h, write, addr);
+		int err = bo_map(bo, x, y, w, h, write, addr);
 		if (err)
 			return err;
 	}
@@ -468,6 +522,22 @@ int gralloc_drm_bo_lock(struct gralloc_drm_bo_t *bo,
 		/* kernel handles the synchronization here */
 	}
 
+	if (!bo->lock_count) {
+		bo->lock_x = x;
+		bo->lock_y = y;
+		bo->lock_w = w;
+		bo->lock_h = h;
+	}
+	else {
+		int x2 = MAX(bo->lock_x + bo->lock_w, x + w);
+		int y2 = MAX(bo->lock_y + bo->lock_h, y + h);
+
+		bo->lock_x = (x < bo->lock_x) ? x : bo->lock_x;
+		bo->lock_y = (y < bo->lock_y) ? y : bo->lock_y;
+		bo->lock_w = x2 - bo->lock_x;
+		bo->lock_h = y2 - bo->lock_y;
+	}
+
 	bo->lock_count++;
 	bo->locked_for |= usage;
 
@@ -486,7 +556,8 @@ void gralloc_drm_bo_unlock(struct gralloc_drm_bo_t *bo)
 		return;
 
 	if (mapped)
-		bo->drm->drv->unmap(bo->drm->drv, bo);
+		bo_unmap(bo, bo->lock_x, bo->lock_y, bo->lock_w, bo->lock_h,
+				!!(bo->locked_for & GRALLOC_USAGE_SW_WRITE_MASK));
 
 	bo->lock_count--;
 	if (!bo->lock_count)
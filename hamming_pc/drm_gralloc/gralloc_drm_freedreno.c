@@ -139,7 +139,9 @@ static int fd_map(struct gralloc_drm_drv_t *drv,
 		int enable_write, void **addr)
 {
 	struct fd_buffer *fd_buf = (struct fd_buffer *) bo;
-	if (fd_bo_map(fd_buf->bo))
+
+	*addr = fd_bo_map(fd_buf->bo);
+	if (*addr)
 		return 0;
 	return -errno;
 }
@@ -150,6 +152,29 @@ static void fd_unmap(struct gralloc_drm_drv_t *drv,
 	// TODO should add fd_bo_unmap() to libdrm_freedreno someday..
 }
 
+static int fd_begin_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		int x, int y, int w, int h, int enable_write)
+{
+	struct fd_buffer *fd_buf = (struct fd_buffer *) bo;
+	uint32_t op = DRM_FREEDRENO_PREP_READ;
+
+	if (enable_write)
+		op |= DRM_FREEDRENO_PREP_WRITE;
+
+	/* the msm backend doesn't need a pipe */
+	return fd_bo_cpu_prep(fd_buf->bo, NULL, op);
+}
+
+static void fd_end_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		int x, int y, int w, int h, int written)
+{
+	struct fd_buffer *fd_buf = (struct fd_buffer *) bo;
+
+	fd_bo_cpu_fini(fd_buf->bo);
+}
+
 static void fd_init_kms_features(struct gralloc_drm_drv_t *drv,
 		struct gralloc_drm_t *drm)
 {
@@ -202,6 +227,8 @@ struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_freedreno(int fd)
 	info->base.free = fd_free;
 	info->base.map = fd_map;
 	info->base.unmap = fd_unmap;
+	info->base.begin_cpu_access = fd_begin_cpu_access;
+	info->base.end_cpu_access = fd_end_cpu_access;
 
 	return &info->base;
 }
@@ -564,6 +564,13 @@ static void intel_free(struct gralloc_drm_drv_t *drv,
 	free(ib);
 }
 
+/* tiled and scanout bos are accessed through the GTT */
+static int intel_uses_gtt(const struct intel_buffer *ib)
+{
+	return (ib->tiling != I915_TILING_NONE ||
+		(ib->base.handle->usage & GRALLOC_USAGE_HW_FB));
+}
+
 static int intel_map(struct gralloc_drm_drv_t *drv,
 		struct gralloc_drm_bo_t *bo,
 		int x, int y, int w, int h,
@@ -572,8 +579,7 @@ static int intel_map(struct gralloc_drm_drv_t *drv,
 	struct intel_buffer *ib = (struct intel_buffer *) bo;
 	int err;
 
-	if (ib->tiling != I915_TILING_NONE ||
-	    (ib->base.handle->usage & GRALLOC_USAGE_HW_FB))
+	if (intel_uses_gtt(ib))
 		err = drm_intel_gem_bo_map_gtt(ib->ibo);
 	else
 		err = drm_intel_bo_map(ib->ibo, enable_write);
@@ -588,13 +594,57 @@ static void intel_unmap(struct gralloc_drm_drv_t *drv,
 {
 	struct intel_buffer *ib = (struct intel_buffer *) bo;
 
-	if (ib->tiling != I915_TILING_NONE ||
-	    (ib->base.handle->usage & GRALLOC_USAGE_HW_FB))
+	if (intel_uses_gtt(ib))
 		drm_intel_gem_bo_unmap_gtt(ib->ibo);
 	else
 		drm_intel_bo_unmap(ib->ibo);
 }
 
+/*
+ * The kernel tracks domains for whole bos only, so the rectangle is not
+ * used.  Moving a bo to the CPU domain waits for the GPU and clflushes it
+ * where the caches are not coherent.
+ */
+static int intel_begin_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		int x, int y, int w, int h, int enable_write)
+{
+	struct intel_info *info = (struct intel_info *) drv;
+	struct intel_buffer *ib = (struct intel_buffer *) bo;
+	struct drm_i915_gem_set_domain set_domain;
+
+	if (intel_uses_gtt(ib)) {
+		drm_intel_gem_bo_start_gtt_access(ib->ibo, enable_write);
+		return 0;
+	}
+
+	memset(&set_domain, 0, sizeof(set_domain));
+	set_domain.handle = ib->ibo->handle;
+	set_domain.read_domains = I915_GEM_DOMAIN_CPU;
+	set_domain.write_domain = (enable_write) ? I915_GEM_DOMAIN_CPU : 0;
+	if (drmIoctl(info->fd, DRM_IOCTL_I915_GEM_SET_DOMAIN, &set_domain))
+		return -errno;
+
+	return 0;
+}
+
+static void intel_end_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		int x, int y, int w, int h, int written)
+{
+	struct intel_info *info = (struct intel_info *) drv;
+	struct intel_buffer *ib = (struct intel_buffer *) bo;
+	struct drm_i915_gem_sw_finish sw_finish;
+
+	/* GTT writes are not cached */
+	if (!written || intel_uses_gtt(ib))
+		return;
+
+	memset(&sw_finish, 0, sizeof(sw_finish));
+	sw_finish.handle = ib->ibo->handle;
+	drmIoctl(info->fd, DRM_IOCTL_I915_GEM_SW_FINISH, &sw_finish);
+}
+
 #include "intel_chipset.h" /* for platform detection macros */
 static void intel_init_kms_features(struct gralloc_drm_drv_t *drv,
 		struct gralloc_drm_t *drm)
@@ -713,6 +763,8 @@ struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_intel(int fd)
 	info->base.free = intel_free;
 	info->base.map = intel_map;
 	info->base.unmap = intel_unmap;
+	info->base.begin_cpu_access = intel_begin_cpu_access;
+	info->base.end_cpu_access = intel_end_cpu_access;
 	info->base.blit = intel_blit;
 	info->base.resolve_format = intel_resolve_format;
 
@@ -298,6 +298,21 @@ static void nouveau_unmap(struct gralloc_drm_drv_t *drv,
 	/* The bo is implicitly unmapped at nouveau_bo_ref(NULL, bo) */
 }
 
+static int nouveau_begin_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		int x, int y, int w, int h, int enable_write)
+{
+	struct nouveau_info *info = (struct nouveau_info *) drv;
+	struct nouveau_buffer *nb = (struct nouveau_buffer *) bo;
+	uint32_t flags;
+
+	flags = NOUVEAU_BO_RD;
+	if (enable_write)
+		flags |= NOUVEAU_BO_WR;
+
+	return nouveau_bo_wait(nb->bo, flags, info->client);
+}
+
 static void nouveau_init_kms_features(struct gralloc_drm_drv_t *drv,
 		struct gralloc_drm_t *drm)
 {
@@ -461,6 +476,7 @@ gralloc_drm_drv_create_for_nouveau(int fd)
 	info->base.free = nouveau_free;
 	info->base.map = nouveau_map;
 	info->base.unmap = nouveau_unmap;
+	info->base.begin_cpu_access = nouveau_begin_cpu_access;
 
 	return &info->base;
 }
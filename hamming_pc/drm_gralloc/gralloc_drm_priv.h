@@ -171,6 +171,21 @@ struct gralloc_drm_drv_t {
 	void (*unmap)(struct gralloc_drm_drv_t *drv,
 		      struct gralloc_drm_bo_t *bo);
 
+	/*
+	 * Optional.  When set, the address returned by map stays valid until
+	 * unmap, and a bo is mapped on its first lock and unmapped when it is
+	 * freed.  Each lock then only calls begin_cpu_access to wait for the
+	 * GPU and make the CPU view of the locked rectangle coherent, and
+	 * each unlock calls end_cpu_access (also optional) to flush what was
+	 * written to it.
+	 */
+	int (*begin_cpu_access)(struct gralloc_drm_drv_t *drv,
+				struct gralloc_drm_bo_t *bo,
+				int x, int y, int w, int h, int enable_write);
+	void (*end_cpu_access)(struct gralloc_drm_drv_t *drv,
+			       struct gralloc_drm_bo_t *bo,
+			       int x, int y, int w, int h, int written);
+
 	/* blit between two bo's, used for DRM_SWAP_COPY and general blitting */
 	void (*blit)(struct gralloc_drm_drv_t *drv,
 		     struct gralloc_drm_bo_t *dst,
@@ -196,6 +211,10 @@ struct gralloc_drm_bo_t {
 
 	int lock_count;
 	int locked_for;
+	int lock_x, lock_y, lock_w, lock_h; /* union of the locked rectangles */
+
+	/* persistent CPU mapping, see begin_cpu_access */
+	void *map_addr;
 
 	unsigned int refcount;
 };
@@ -318,6 +318,16 @@ static void drm_gem_radeon_unmap(struct gralloc_drm_drv_t *drv,
 	radeon_bo_unmap(rbuf->rbo);
 }
 
+/* CPU mappings are coherent, only the GPU needs to be waited for */
+static int drm_gem_radeon_begin_cpu_access(struct gralloc_drm_drv_t *drv,
+		struct gralloc_drm_bo_t *bo,
+		int x, int y, int w, int h, int enable_write)
+{
+	struct radeon_buffer *rbuf = (struct radeon_buffer *) bo;
+
+	return radeon_bo_wait(rbuf->rbo);
+}
+
 static void drm_gem_radeon_init_kms_features(struct gralloc_drm_drv_t *drv,
 		struct gralloc_drm_t *drm)
 {
@@ -547,6 +557,7 @@ struct gralloc_drm_drv_t *gralloc_drm_drv_create_for_radeon(int fd)
 	info->base.free = drm_gem_radeon_free;
 	info->base.map = drm_gem_radeon_map;
 	info->base.unmap = drm_gem_radeon_unmap;
+	info->base.begin_cpu_access = drm_gem_radeon_begin_cpu_access;
 
 	return &info->base;
 }
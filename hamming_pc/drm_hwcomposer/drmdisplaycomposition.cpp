@@ -304,9 +304,12 @@ int DrmDisplayComposition::Plan(SquashState *squash,
   if (squash != NULL) {
     if (geometry_changed_) {
       squash->Init(layers_.data(), layers_.size());
+      damage_.generation = squash->generation_number();
+      damage_.history_index = squash->valid_history();
     } else {
       std::vector<bool> changed_regions;
-      squash->GenerateHistory(layers_.data(), layers_.size(), changed_regions);
+      bool have_history = squash->GenerateHistory(
+          layers_.data(), layers_.size(), changed_regions);
 
       std::vector<bool> stable_regions;
       squash->StableRegionsWithMarginalHistory(changed_regions, stable_regions);
@@ -318,6 +321,16 @@ int DrmDisplayComposition::Plan(SquashState *squash,
 
       squash->RecordHistory(layers_.data(), layers_.size(), changed_regions);
 
+      if (have_history) {
+        damage_.generation = squash->generation_number();
+        damage_.history_index = squash->valid_history();
+        damage_.full = false;
+        for (size_t i = 0; i < changed_regions.size(); i++) {
+          if (changed_regions[i])
+            damage_.rects.emplace_back(squash->regions()[i].rect);
+        }
+      }
+
       // Changes in which regions are squashed triggers a rerender via
       // squash_regions.
       bool render_squash = squash->RecordAndCompareSquashed(stable_regions);
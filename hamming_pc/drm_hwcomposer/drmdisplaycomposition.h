@@ -47,6 +47,17 @@ struct DrmCompositionRegion {
   std::vector<size_t> source_layers;
 };
 
+// The parts of the display which changed since the previous frame, as
+// derived from the SquashState change history. generation and
+// history_index identify the SquashState entry the damage was generated
+// from, so that the damage of consecutive frames can be accumulated.
+struct DrmCompositionDamage {
+  size_t generation = 0;  // 0 if there is no history to go by
+  unsigned history_index = 0;
+  bool full = true;
+  std::vector<DrmHwcRect<int>> rects;
+};
+
 class DrmCompositionPlane {
  public:
   enum class Type : int32_t {
@@ -147,6 +158,10 @@ class DrmDisplayComposition {
     return composition_planes_;
   }
 
+  const DrmCompositionDamage &damage() const {
+    return damage_;
+  }
+
   bool geometry_changed() const {
     return geometry_changed_;
   }
@@ -211,6 +226,7 @@ class DrmDisplayComposition {
   std::vector<DrmCompositionRegion> squash_regions_;
   std::vector<DrmCompositionRegion> pre_comp_regions_;
   std::vector<DrmCompositionPlane> composition_planes_;
+  DrmCompositionDamage damage_;
 
   uint64_t frame_no_ = 0;
 };
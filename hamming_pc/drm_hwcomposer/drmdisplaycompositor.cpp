@@ -19,6 +19,7 @@
 
 #include "drmdisplaycompositor.h"
 
+#include <algorithm>
 #include <pthread.h>
 #include <sched.h>
 #include <stdlib.h>
@@ -27,12 +28,14 @@
 #include <vector>
 
 #include <cutils/log.h>
+#include <cutils/properties.h>
 #include <drm/drm_mode.h>
 #include <sync/sync.h>
 #include <utils/Trace.h>
 
 #include "autolock.h"
 #include "drmcrtc.h"
+#include "drmeventlistener.h"
 #include "drmplane.h"
 #include "drmresources.h"
 #include "glworker.h"
@@ -65,13 +68,13 @@ void SquashState::Init(DrmHwcLayer *layers, size_t num_layers) {
   }
 }
 
-void SquashState::GenerateHistory(DrmHwcLayer *layers, size_t num_layers,
+bool SquashState::GenerateHistory(DrmHwcLayer *layers, size_t num_layers,
                                   std::vector<bool> &changed_regions) const {
   changed_regions.resize(regions_.size());
   if (num_layers != last_handles_.size()) {
     ALOGE("SquashState::GenerateHistory expected %zu layers but got %zu layers",
           last_handles_.size(), num_layers);
-    return;
+    return false;
   }
   std::bitset<kMaxLayers> changed_layers;
   for (size_t i = 0; i < last_handles_.size(); i++) {
@@ -85,6 +88,7 @@ void SquashState::GenerateHistory(DrmHwcLayer *layers, size_t num_layers,
   for (size_t i = 0; i < regions_.size(); i++) {
     changed_regions[i] = (regions_[i].layer_refs & changed_layers).any();
   }
+  return true;
 }
 
 void SquashState::StableRegionsWithMarginalHistory(
@@ -192,19 +196,24 @@ void DrmDisplayCompositor::FrameWorker::QueueFrame(
     std::unique_ptr<DrmDisplayComposition> composition, int status) {
   Lock();
 
-  // Block queue if it gets too large. Otherwise composition will
-  // start stacking up and eat limited resources (file descriptors)
-  // allocated for these.
-  while (frame_queue_.size() >= DRM_DISPLAY_COMPOSITOR_MAX_QUEUE_DEPTH) {
-    Unlock();
-    sched_yield();
-    Lock();
+  // Don't let compositions stack up and eat limited resources (file
+  // descriptors) allocated for these. Rather than blocking the caller until
+  // the display catches up, drop the oldest frame that hasn't been committed
+  // yet; signalling it hands its buffers straight back to the producer.
+  if (frame_queue_.size() >= kMaxFrameQueueDepth) {
+    FrameState &dropped = frame_queue_.front();
+    if (dropped.composition)
+      dropped.composition->SignalCompositionDone();
+    frame_queue_.pop();
+    ++compositor_->dump_frames_dropped_;
   }
 
   FrameState frame;
   frame.composition = std::move(composition);
   frame.status = status;
   frame_queue_.push(std::move(frame));
+  compositor_->dump_max_queue_depth_ =
+      std::max(compositor_->dump_max_queue_depth_, frame_queue_.size());
   SignalLocked();
   Unlock();
 }
@@ -243,18 +252,57 @@ void DrmDisplayCompositor::FrameWorker::Routine() {
   compositor_->ApplyFrame(std::move(frame.composition), frame.status);
 }
 
+// Shared between the compositor and its outstanding flip event handlers. A
+// flip we timed out on can still deliver its event after the compositor is
+// destroyed, so the handler only calls back while compositor is set.
+struct DrmDisplayCompositor::FlipTarget {
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  DrmDisplayCompositor *compositor = NULL;
+};
+
+class DrmDisplayCompositor::FlipDoneHandler : public DrmEventHandler {
+ public:
+  FlipDoneHandler(std::shared_ptr<FlipTarget> target, uint64_t sequence)
+      : target_(std::move(target)), sequence_(sequence) {
+  }
+
+  void HandleEvent(uint64_t /* timestamp_us */) override {
+    AutoLock lock(&target_->lock, "flip target");
+    if (lock.Lock())
+      return;
+    if (target_->compositor)
+      target_->compositor->FlipDone(sequence_);
+  }
+
+ private:
+  std::shared_ptr<FlipTarget> target_;
+  uint64_t sequence_;
+};
+
 DrmDisplayCompositor::DrmDisplayCompositor()
     : drm_(NULL),
       display_(-1),
       worker_(this),
       frame_worker_(this),
+      flip_target_(std::make_shared<FlipTarget>()),
+      flip_pending_(false),
+      flip_sequence_(0),
       initialized_(false),
       active_(false),
       use_hw_overlays_(true),
+      use_partial_pre_comp_(true),
+      use_nonblocking_commit_(true),
       framebuffer_index_(0),
       squash_framebuffer_index_(0),
       dump_frames_composited_(0),
+      dump_frames_dropped_(0),
+      dump_flip_timeouts_(0),
+      dump_max_queue_depth_(0),
+      dump_test_cache_hits_(0),
+      dump_test_cache_misses_(0),
       dump_last_timestamp_ns_(0) {
+  flip_target_->compositor = this;
+
   struct timespec ts;
   if (clock_gettime(CLOCK_MONOTONIC, &ts))
     return;
@@ -268,25 +316,34 @@ DrmDisplayCompositor::~DrmDisplayCompositor() {
   worker_.Exit();
   frame_worker_.Exit();
 
+  // A flip WaitForFlip gave up on may still complete later, make sure its
+  // handler doesn't call back into us
+  WaitForFlip();
+  {
+    AutoLock lock(&flip_target_->lock, "flip target");
+    if (!lock.Lock())
+      flip_target_->compositor = NULL;
+  }
+
   int ret = pthread_mutex_lock(&lock_);
   if (ret)
     ALOGE("Failed to acquire compositor lock %d", ret);
 
-  if (mode_.blob_id)
-    drm_->DestroyPropertyBlob(mode_.blob_id);
-  if (mode_.old_blob_id)
-    drm_->DestroyPropertyBlob(mode_.old_blob_id);
+  for (const ModeBlob &blob : mode_blobs_)
+    drm_->DestroyPropertyBlob(blob.blob_id);
 
   while (!composite_queue_.empty()) {
     composite_queue_.front().reset();
     composite_queue_.pop();
   }
   active_composition_.reset();
+  pending_composition_.reset();
 
   ret = pthread_mutex_unlock(&lock_);
   if (ret)
     ALOGE("Failed to acquire compositor lock %d", ret);
 
+  pthread_cond_destroy(&flip_cond_);
   pthread_mutex_destroy(&lock_);
 }
 
@@ -299,19 +356,36 @@ int DrmDisplayCompositor::Init(DrmResources *drm, int display) {
     ALOGE("Failed to initialize drm compositor lock %d\n", ret);
     return ret;
   }
+  ret = pthread_cond_init(&flip_cond_, NULL);
+  if (ret) {
+    pthread_mutex_destroy(&lock_);
+    ALOGE("Failed to initialize flip condition %d\n", ret);
+    return ret;
+  }
   ret = worker_.Init();
   if (ret) {
+    pthread_cond_destroy(&flip_cond_);
     pthread_mutex_destroy(&lock_);
     ALOGE("Failed to initialize compositor worker %d\n", ret);
     return ret;
   }
   ret = frame_worker_.Init();
   if (ret) {
+    pthread_cond_destroy(&flip_cond_);
     pthread_mutex_destroy(&lock_);
     ALOGE("Failed to initialize frame worker %d\n", ret);
     return ret;
   }
 
+  char use_partial_pre_comp_prop[PROPERTY_VALUE_MAX];
+  property_get("hwc.drm.use_partial_pre_comp", use_partial_pre_comp_prop, "1");
+  use_partial_pre_comp_ = atoi(use_partial_pre_comp_prop);
+
+  char use_nonblocking_commit_prop[PROPERTY_VALUE_MAX];
+  property_get("hwc.drm.use_nonblocking_commit", use_nonblocking_commit_prop,
+               "1");
+  use_nonblocking_commit_ = atoi(use_nonblocking_commit_prop);
+
   initialized_ = true;
   return 0;
 }
@@ -454,11 +528,61 @@ int DrmDisplayCompositor::ApplySquash(DrmDisplayComposition *display_comp) {
   return 0;
 }
 
+static bool SameRegions(const std::vector<DrmCompositionRegion> &a,
+                        const std::vector<DrmCompositionRegion> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (!(a[i].frame == b[i].frame) || a[i].source_layers != b[i].source_layers)
+      return false;
+  }
+  return true;
+}
+
+// Collects the damage accumulated since target was last pre-composited.
+// Returns false if the whole framebuffer needs to be redrawn instead.
+bool DrmDisplayCompositor::GetPreCompDamage(
+    const PreCompTarget &target, DrmFramebuffer &fb,
+    DrmDisplayComposition *display_comp,
+    std::vector<DrmHwcRect<int>> *damage) const {
+  const DrmCompositionDamage &current = display_comp->damage();
+
+  if (!use_partial_pre_comp_ || current.full || target.generation == 0 ||
+      target.generation != current.generation ||
+      target.history_index >= current.history_index ||
+      target.buffer != fb.buffer() ||
+      !SameRegions(target.regions, display_comp->pre_comp_regions()))
+    return false;
+
+  // Every frame in between must be accounted for, otherwise a change could
+  // slip through unnoticed.
+  unsigned frames_missing = current.history_index - target.history_index;
+  for (const DrmCompositionDamage &frame_damage : damage_history_) {
+    if (frame_damage.generation != current.generation ||
+        frame_damage.history_index <= target.history_index ||
+        frame_damage.history_index > current.history_index)
+      continue;
+    if (frame_damage.full)
+      return false;
+
+    frames_missing--;
+    // All damage rects of a generation come from the same set of separated
+    // SquashState regions, so they are either identical or disjoint.
+    for (const DrmHwcRect<int> &rect : frame_damage.rects) {
+      if (std::find(damage->begin(), damage->end(), rect) == damage->end())
+        damage->push_back(rect);
+    }
+  }
+
+  return frames_missing == 0;
+}
+
 int DrmDisplayCompositor::ApplyPreComposite(
     DrmDisplayComposition *display_comp) {
   int ret = 0;
 
   DrmFramebuffer &fb = framebuffers_[framebuffer_index_];
+  PreCompTarget &target = pre_comp_targets_[framebuffer_index_];
   ret = PrepareFramebuffer(fb, display_comp);
   if (ret) {
     ALOGE("Failed to prepare framebuffer for pre-composite %d", ret);
@@ -466,8 +590,15 @@ int DrmDisplayCompositor::ApplyPreComposite(
   }
 
   std::vector<DrmCompositionRegion> &regions = display_comp->pre_comp_regions();
+  std::vector<DrmHwcRect<int>> damage;
+  bool partial = GetPreCompDamage(target, fb, display_comp, &damage);
+
+  // Until it succeeds, the framebuffer contents are unknown
+  target.generation = 0;
+
   ret = pre_compositor_->Composite(display_comp->layers().data(),
-                                   regions.data(), regions.size(), fb.buffer());
+                                   regions.data(), regions.size(), fb.buffer(),
+                                   partial ? &damage : NULL);
   pre_compositor_->Finish();
 
   if (ret) {
@@ -475,6 +606,12 @@ int DrmDisplayCompositor::ApplyPreComposite(
     return ret;
   }
 
+  const DrmCompositionDamage &current = display_comp->damage();
+  target.buffer = fb.buffer();
+  target.generation = current.generation;
+  target.history_index = current.history_index;
+  target.regions = regions;
+
   ret = display_comp->CreateNextTimelineFence();
   if (ret <= 0) {
     ALOGE("Failed to create pre-composite framebuffer release fence %d", ret);
@@ -524,6 +661,10 @@ int DrmDisplayCompositor::DisablePlanes(DrmDisplayComposition *display_comp) {
 int DrmDisplayCompositor::PrepareFrame(DrmDisplayComposition *display_comp) {
   int ret = 0;
 
+  damage_history_.push_back(display_comp->damage());
+  if (damage_history_.size() > kDamageHistoryLength)
+    damage_history_.pop_front();
+
   std::vector<DrmHwcLayer> &layers = display_comp->layers();
   std::vector<DrmCompositionPlane> &comp_planes =
       display_comp->composition_planes();
@@ -610,7 +751,7 @@ int DrmDisplayCompositor::PrepareFrame(DrmDisplayComposition *display_comp) {
 }
 
 int DrmDisplayCompositor::CommitFrame(DrmDisplayComposition *display_comp,
-                                      bool test_only) {
+                                      bool test_only, bool nonblock) {
   ATRACE_CALL();
 
   int ret = 0;
@@ -800,15 +941,39 @@ int DrmDisplayCompositor::CommitFrame(DrmDisplayComposition *display_comp,
 out:
   if (!ret) {
     uint32_t flags = DRM_MODE_ATOMIC_ALLOW_MODESET;
+    void *user_data = drm_;
     if (test_only)
       flags |= DRM_MODE_ATOMIC_TEST_ONLY;
 
-    ret = drmModeAtomicCommit(drm_->fd(), pset, flags, drm_);
+    if (nonblock && !test_only) {
+      flags |= DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT;
+
+      // The event can arrive before drmModeAtomicCommit returns
+      AutoLock lock(&lock_, "compositor");
+      ret = lock.Lock();
+      if (ret) {
+        drmModeAtomicFree(pset);
+        return ret;
+      }
+      flip_pending_ = true;
+      user_data = new FlipDoneHandler(flip_target_, ++flip_sequence_);
+    }
+
+    ret = drmModeAtomicCommit(drm_->fd(), pset, flags, user_data);
     if (ret) {
       if (test_only)
         ALOGI("Commit test pset failed ret=%d\n", ret);
       else
         ALOGE("Failed to commit pset ret=%d\n", ret);
+
+      if (user_data != drm_) {
+        delete (FlipDoneHandler *)user_data;
+        AutoLock lock(&lock_, "compositor");
+        if (!lock.Lock()) {
+          flip_pending_ = false;
+          pthread_cond_broadcast(&flip_cond_);
+        }
+      }
       drmModeAtomicFree(pset);
       return ret;
     }
@@ -817,12 +982,8 @@ out:
     drmModeAtomicFree(pset);
 
   if (!test_only && mode_.needs_modeset) {
-    ret = drm_->DestroyPropertyBlob(mode_.old_blob_id);
-    if (ret) {
-      ALOGE("Failed to destroy old mode property blob %" PRIu32 "/%d",
-            mode_.old_blob_id, ret);
-      return ret;
-    }
+    // What the hardware accepts may well depend on the mode
+    ClearTestCache();
 
     /* TODO: Add dpms to the pset when the kernel supports it */
     ret = ApplyDpms(display_comp);
@@ -832,7 +993,6 @@ out:
     }
 
     connector->set_active_mode(mode_.mode);
-    mode_.old_blob_id = mode_.blob_id;
     mode_.blob_id = 0;
     mode_.needs_modeset = false;
   }
@@ -841,6 +1001,9 @@ out:
 }
 
 int DrmDisplayCompositor::ApplyDpms(DrmDisplayComposition *display_comp) {
+  // Don't turn the display off under a flip that is still outstanding
+  WaitForFlip();
+
   DrmConnector *conn = drm_->GetConnectorForDisplay(display_);
   if (!conn) {
     ALOGE("Failed to get DrmConnector for display %d", display_);
@@ -863,6 +1026,11 @@ std::tuple<int, uint32_t> DrmDisplayCompositor::CreateModeBlob(
   memset(&drm_mode, 0, sizeof(drm_mode));
   mode.ToDrmModeModeInfo(&drm_mode);
 
+  for (const ModeBlob &blob : mode_blobs_) {
+    if (!memcmp(&blob.mode, &drm_mode, sizeof(drm_mode)))
+      return std::make_tuple(0, blob.blob_id);
+  }
+
   uint32_t id = 0;
   int ret = drm_->CreatePropertyBlob(&drm_mode,
                                      sizeof(struct drm_mode_modeinfo), &id);
@@ -870,11 +1038,158 @@ std::tuple<int, uint32_t> DrmDisplayCompositor::CreateModeBlob(
     ALOGE("Failed to create mode property blob %d", ret);
     return std::make_tuple(ret, 0);
   }
-  ALOGE("Create blob_id %" PRIu32 "\n", id);
+  ALOGI("Create blob_id %" PRIu32 "\n", id);
+  mode_blobs_.push_back({drm_mode, id});
   return std::make_tuple(ret, id);
 }
 
+// Checks whether the kernel accepts the plane configuration of display_comp.
+// The answer only depends on which planes are used and on the format, layout
+// and geometry of what goes on them, so it is remembered for configurations
+// seen before instead of doing a TEST_ONLY commit again.
+int DrmDisplayCompositor::TestFrame(DrmDisplayComposition *display_comp) {
+  // Would be tested against the wrong mode
+  if (mode_.needs_modeset)
+    return CommitFrame(display_comp, true);
+
+  std::vector<DrmHwcLayer> &layers = display_comp->layers();
+  std::vector<uint64_t> key;
+  key.push_back(display_);
+  for (DrmCompositionPlane &comp_plane : display_comp->composition_planes()) {
+    key.push_back(comp_plane.plane()->id());
+    key.push_back((uint64_t)comp_plane.type());
+    if (comp_plane.type() == DrmCompositionPlane::Type::kDisable)
+      continue;
+
+    for (size_t i : comp_plane.source_layers()) {
+      if (i >= layers.size() || !layers[i].buffer)
+        return CommitFrame(display_comp, true);
+
+      DrmHwcLayer &layer = layers[i];
+      // Nothing to tell this buffer apart from one laid out differently
+      if (!layer.buffer->layout_known)
+        return CommitFrame(display_comp, true);
+
+      key.push_back(layer.buffer->format);
+      key.push_back(((uint64_t)layer.buffer->width << 32) |
+                    layer.buffer->height);
+      for (int p = 0; p < 4; p++) {
+        key.push_back(((uint64_t)layer.buffer->pitches[p] << 32) |
+                      layer.buffer->offsets[p]);
+        key.push_back(layer.buffer->modifiers[p]);
+      }
+      key.push_back(layer.buffer->usage);
+      for (int b = 0; b < 4; b++)
+        key.push_back((uint32_t)layer.display_frame.bounds[b]);
+      // 16.16 fixed point like the SRC_* properties, without dropping the
+      // fraction first
+      for (int b = 0; b < 4; b++)
+        key.push_back(
+            (uint32_t)(int64_t)(layer.source_crop.bounds[b] * 65536.0f));
+      key.push_back(layer.transform);
+      key.push_back((uint64_t)layer.blending << 8 | layer.alpha);
+    }
+  }
+
+  AutoLock lock(&lock_, "compositor");
+  int ret = lock.Lock();
+  if (ret)
+    return ret;
+  auto cached = test_cache_.find(key);
+  if (cached != test_cache_.end()) {
+    ++dump_test_cache_hits_;
+    return cached->second;
+  }
+  ++dump_test_cache_misses_;
+  lock.Unlock();
+
+  ret = CommitFrame(display_comp, true);
+
+  // Failures other than the kernel saying no aren't worth remembering
+  if (ret && ret != -EINVAL && ret != -ERANGE && ret != -ENOSPC)
+    return ret;
+
+  if (lock.Lock())
+    return ret;
+  if (test_cache_.size() >= kTestCacheSize)
+    test_cache_.clear();
+  test_cache_.emplace(std::move(key), ret);
+  return ret;
+}
+
+void DrmDisplayCompositor::ClearTestCache() {
+  AutoLock lock(&lock_, "compositor");
+  if (lock.Lock())
+    return;
+  test_cache_.clear();
+}
+
+void DrmDisplayCompositor::WaitForFlip() {
+  AutoLock lock(&lock_, "compositor");
+  int ret = lock.Lock();
+  if (ret)
+    return;
+
+  while (flip_pending_) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += kFlipTimeoutMs / 1000;
+    ts.tv_nsec += (kFlipTimeoutMs % 1000) * 1000 * 1000;
+    if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000 * 1000 * 1000;
+    }
+
+    ret = pthread_cond_timedwait(&flip_cond_, &lock_, &ts);
+    if (ret == ETIMEDOUT && flip_pending_) {
+      ALOGE("Timed out waiting for page flip %" PRIu64 " on display %d",
+            flip_sequence_, display_);
+      ++dump_flip_timeouts_;
+      std::unique_ptr<DrmDisplayComposition> old = CompleteFlipLocked();
+      lock.Unlock();
+      return;
+    }
+  }
+}
+
+void DrmDisplayCompositor::FlipDone(uint64_t sequence) {
+  AutoLock lock(&lock_, "compositor");
+  int ret = lock.Lock();
+  if (ret)
+    return;
+
+  // A flip we already gave up on in WaitForFlip
+  if (!flip_pending_ || sequence != flip_sequence_) {
+    ALOGW("Ignoring stale page flip %" PRIu64 " on display %d", sequence,
+          display_);
+    return;
+  }
+
+  std::unique_ptr<DrmDisplayComposition> old = CompleteFlipLocked();
+
+  // Don't tear down the old composition with the lock held
+  lock.Unlock();
+}
+
+// The pending composition is now on screen, so the buffers of the one it
+// replaced can be released. Returns the replaced composition.
+std::unique_ptr<DrmDisplayComposition>
+DrmDisplayCompositor::CompleteFlipLocked() {
+  if (active_composition_)
+    active_composition_->SignalCompositionDone();
+  ++dump_frames_composited_;
+
+  std::unique_ptr<DrmDisplayComposition> old = std::move(active_composition_);
+  active_composition_ = std::move(pending_composition_);
+  flip_pending_ = false;
+  pthread_cond_broadcast(&flip_cond_);
+  return old;
+}
+
 void DrmDisplayCompositor::ClearDisplay() {
+  // DisablePlanes would fail with -EBUSY while a flip is outstanding
+  WaitForFlip();
+
   AutoLock lock(&lock_, "compositor");
   int ret = lock.Lock();
   if (ret)
@@ -895,11 +1210,35 @@ void DrmDisplayCompositor::ApplyFrame(
     std::unique_ptr<DrmDisplayComposition> composition, int status) {
   int ret = status;
 
-  if (!ret)
+  // The kernel takes one non-blocking commit per crtc at a time
+  WaitForFlip();
+
+  // Modesets are rare and followed by a DPMS update, keep them blocking
+  bool nonblock = use_nonblocking_commit_ && !mode_.needs_modeset;
+  if (!ret && nonblock) {
+    DrmDisplayComposition *display_comp = composition.get();
+    ret = pthread_mutex_lock(&lock_);
+    if (!ret) {
+      pending_composition_ = std::move(composition);
+      pthread_mutex_unlock(&lock_);
+
+      // From here on the flip event completes the frame
+      ret = CommitFrame(display_comp, false, true);
+      if (!ret)
+        return;
+
+      pthread_mutex_lock(&lock_);
+      composition = std::move(pending_composition_);
+      pthread_mutex_unlock(&lock_);
+    }
+  } else if (!ret) {
     ret = CommitFrame(composition.get(), false);
+  }
 
   if (ret) {
     ALOGE("Composite failed for display %d", display_);
+    // The configuration may have passed a cached test that no longer holds
+    ClearTestCache();
     // Disable the hw used by the last active composition. This allows us to
     // signal the release fences from that composition to avoid hanging.
     ClearDisplay();
@@ -968,7 +1307,7 @@ int DrmDisplayCompositor::Composite() {
         // Send the composition to the kernel to ensure we can commit it. This
         // is just a test, it won't actually commit the frame. If rejected,
         // squash the frame into one layer and use the squashed composition
-        ret = CommitFrame(composition.get(), true);
+        ret = TestFrame(composition.get());
         if (ret)
           ALOGI("Commit test failed, squashing frame for display %d", display_);
         use_hw_overlays_ = !ret;
@@ -1000,8 +1339,6 @@ int DrmDisplayCompositor::Composite() {
       return ret;
     case DRM_COMPOSITION_TYPE_MODESET:
       mode_.mode = composition->display_mode();
-      if (mode_.blob_id)
-        drm_->DestroyPropertyBlob(mode_.blob_id);
       std::tie(ret, mode_.blob_id) = CreateModeBlob(mode_.mode);
       if (ret) {
         ALOGE("Failed to create mode blob for display %d", display_);
@@ -1044,14 +1381,18 @@ int DrmDisplayCompositor::SquashAll() {
   if (!active_composition_)
     return 0;
 
+  // A newer frame is on its way to the screen
+  if (flip_pending_)
+    return 0;
+
   std::unique_ptr<DrmDisplayComposition> comp = CreateComposition();
   ret = SquashFrame(active_composition_.get(), comp.get());
 
-  // ApplyFrame needs the lock
   lock.Unlock();
 
+  // Go through the frame worker so that commits stay in order
   if (!ret)
-    ApplyFrame(std::move(comp), 0);
+    frame_worker_.QueueFrame(std::move(comp), 0);
 
   return ret;
 }
@@ -1186,6 +1527,16 @@ void DrmDisplayCompositor::Dump(std::ostringstream *out) const {
 
   uint64_t num_frames = dump_frames_composited_;
   dump_frames_composited_ = 0;
+  uint64_t num_dropped = dump_frames_dropped_;
+  dump_frames_dropped_ = 0;
+  uint64_t num_flip_timeouts = dump_flip_timeouts_;
+  dump_flip_timeouts_ = 0;
+  size_t max_queue_depth = dump_max_queue_depth_;
+  dump_max_queue_depth_ = 0;
+  uint64_t num_test_hits = dump_test_cache_hits_;
+  dump_test_cache_hits_ = 0;
+  uint64_t num_test_misses = dump_test_cache_misses_;
+  dump_test_cache_misses_ = 0;
 
   struct timespec ts;
   ret = clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -1200,7 +1551,14 @@ void DrmDisplayCompositor::Dump(std::ostringstream *out) const {
 
   *out << "--DrmDisplayCompositor[" << display_
        << "]: num_frames=" << num_frames << " num_ms=" << num_ms
-       << " fps=" << fps << "\n";
+       << " fps=" << fps << " dropped=" << num_dropped
+       << " max_queue_depth=" << max_queue_depth
+       << " flip_timeouts=" << num_flip_timeouts
+       << " nonblocking_commit=" << use_nonblocking_commit_
+       << " flip_pending=" << flip_pending_ << "\n"
+       << "    test_cache: hits=" << num_test_hits
+       << " misses=" << num_test_misses << " size=" << test_cache_.size()
+       << " mode_blobs=" << mode_blobs_.size() << "\n";
 
   dump_last_timestamp_ns_ = cur_ts;
 
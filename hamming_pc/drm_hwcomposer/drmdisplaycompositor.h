@@ -24,6 +24,8 @@
 #include "separate_rects.h"
 
 #include <pthread.h>
+#include <deque>
+#include <map>
 #include <memory>
 #include <queue>
 #include <sstream>
@@ -61,8 +63,16 @@ class SquashState {
     return regions_;
   }
 
+  size_t generation_number() const {
+    return generation_number_;
+  }
+
+  unsigned valid_history() const {
+    return valid_history_;
+  }
+
   void Init(DrmHwcLayer *layers, size_t num_layers);
-  void GenerateHistory(DrmHwcLayer *layers, size_t num_layers,
+  bool GenerateHistory(DrmHwcLayer *layers, size_t num_layers,
                        std::vector<bool> &changed_regions) const;
   void StableRegionsWithMarginalHistory(
       const std::vector<bool> &changed_regions,
@@ -108,6 +118,9 @@ class DrmDisplayCompositor {
     int status = 0;
   };
 
+  struct FlipTarget;
+  class FlipDoneHandler;
+
   class FrameWorker : public Worker {
    public:
     FrameWorker(DrmDisplayCompositor *compositor);
@@ -125,11 +138,26 @@ class DrmDisplayCompositor {
     std::queue<FrameState> frame_queue_;
   };
 
+  // What was last pre-composited into one of framebuffers_, so that the
+  // next pre-composite into it only needs to redraw what changed since.
+  struct PreCompTarget {
+    sp<GraphicBuffer> buffer;
+    size_t generation = 0;  // 0 if the contents are unknown
+    unsigned history_index = 0;
+    std::vector<DrmCompositionRegion> regions;
+  };
+
   struct ModeState {
     bool needs_modeset = false;
     DrmMode mode;
     uint32_t blob_id = 0;
-    uint32_t old_blob_id = 0;
+  };
+
+  // A mode blob is created once per mode and kept until we go away, so
+  // switching back and forth between modes doesn't churn blobs.
+  struct ModeBlob {
+    struct drm_mode_modeinfo mode;
+    uint32_t blob_id;
   };
 
   DrmDisplayCompositor(const DrmDisplayCompositor &) = delete;
@@ -139,16 +167,40 @@ class DrmDisplayCompositor {
   static const int kAcquireWaitTries = 5;
   static const int kAcquireWaitTimeoutMs = 100;
 
+  // Number of frames of damage kept around for partial pre-compositing.
+  static const size_t kDamageHistoryLength = 8;
+
+  // Frames queued for commit beyond this drop the oldest queued frame, so a
+  // display that falls behind never stalls SurfaceFlinger.
+  static const size_t kMaxFrameQueueDepth = 3;
+
+  // How long a non-blocking commit may take to reach the screen before we
+  // give up on its page flip event and release the previous frame anyway.
+  static const int kFlipTimeoutMs = 1000;
+
+  // Number of plane configurations whose TEST_ONLY result is remembered.
+  static const size_t kTestCacheSize = 64;
+
   int PrepareFramebuffer(DrmFramebuffer &fb,
                          DrmDisplayComposition *display_comp);
   int ApplySquash(DrmDisplayComposition *display_comp);
   int ApplyPreComposite(DrmDisplayComposition *display_comp);
+  bool GetPreCompDamage(const PreCompTarget &target, DrmFramebuffer &fb,
+                        DrmDisplayComposition *display_comp,
+                        std::vector<DrmHwcRect<int>> *damage) const;
   int PrepareFrame(DrmDisplayComposition *display_comp);
-  int CommitFrame(DrmDisplayComposition *display_comp, bool test_only);
+  int CommitFrame(DrmDisplayComposition *display_comp, bool test_only,
+                  bool nonblock = false);
+  int TestFrame(DrmDisplayComposition *display_comp);
+  void ClearTestCache();
   int SquashFrame(DrmDisplayComposition *src, DrmDisplayComposition *dst);
   int ApplyDpms(DrmDisplayComposition *display_comp);
   int DisablePlanes(DrmDisplayComposition *display_comp);
 
+  void WaitForFlip();
+  void FlipDone(uint64_t sequence);
+  std::unique_ptr<DrmDisplayComposition> CompleteFlipLocked();
+
   void ClearDisplay();
   void ApplyFrame(std::unique_ptr<DrmDisplayComposition> composition,
                   int status);
@@ -164,14 +216,31 @@ class DrmDisplayCompositor {
   std::queue<std::unique_ptr<DrmDisplayComposition>> composite_queue_;
   std::unique_ptr<DrmDisplayComposition> active_composition_;
 
+  // The composition handed to the last non-blocking commit. It replaces
+  // active_composition_ once its page flip event arrives.
+  std::unique_ptr<DrmDisplayComposition> pending_composition_;
+  std::shared_ptr<FlipTarget> flip_target_;
+  bool flip_pending_;
+  uint64_t flip_sequence_;
+  pthread_cond_t flip_cond_;
+
   bool initialized_;
   bool active_;
   bool use_hw_overlays_;
+  bool use_partial_pre_comp_;
+  bool use_nonblocking_commit_;
 
   ModeState mode_;
+  std::vector<ModeBlob> mode_blobs_;
+
+  // TEST_ONLY commit results keyed by plane configuration, see TestFrame().
+  // Protected by lock_ since failed commits invalidate it.
+  std::map<std::vector<uint64_t>, int> test_cache_;
 
   int framebuffer_index_;
   DrmFramebuffer framebuffers_[DRM_DISPLAY_BUFFERS];
+  PreCompTarget pre_comp_targets_[DRM_DISPLAY_BUFFERS];
+  std::deque<DrmCompositionDamage> damage_history_;
   std::unique_ptr<GLWorkerCompositor> pre_compositor_;
 
   SquashState squash_state_;
@@ -184,6 +253,11 @@ class DrmDisplayCompositor {
   // State tracking progress since our last Dump(). These are mutable since
   // we need to reset them on every Dump() call.
   mutable uint64_t dump_frames_composited_;
+  mutable uint64_t dump_frames_dropped_;
+  mutable uint64_t dump_flip_timeouts_;
+  mutable size_t dump_max_queue_depth_;
+  mutable uint64_t dump_test_cache_hits_;
+  mutable uint64_t dump_test_cache_misses_;
   mutable uint64_t dump_last_timestamp_ns_;
 };
 }
@@ -19,6 +19,7 @@
 #include "drmeventlistener.h"
 #include "drmresources.h"
 
+#include <errno.h>
 #include <linux/netlink.h>
 #include <sys/socket.h>
 
@@ -33,7 +34,10 @@ DrmEventListener::DrmEventListener(DrmResources *drm)
 }
 
 int DrmEventListener::Init() {
-  uevent_fd_.Set(socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT));
+  // Non-blocking, so that draining the socket doesn't hold up page flip
+  // events on the drm fd
+  uevent_fd_.Set(socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK,
+                        NETLINK_KOBJECT_UEVENT));
   if (uevent_fd_.get() < 0) {
     ALOGE("Failed to open uevent socket %d", uevent_fd_.get());
     return uevent_fd_.get();
@@ -92,7 +96,8 @@ void DrmEventListener::UEventHandler() {
     if (ret == 0) {
       return;
     } else if (ret < 0) {
-      ALOGE("Got error reading uevent %d", ret);
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        ALOGE("Got error reading uevent %d", -errno);
       return;
     }
 
@@ -117,11 +122,14 @@ void DrmEventListener::UEventHandler() {
 
 void DrmEventListener::Routine() {
   int ret;
+  fd_set fds;
   do {
-    ret = select(max_fd_ + 1, &fds_, NULL, NULL, NULL);
+    // select() overwrites the set with the ready fds
+    fds = fds_;
+    ret = select(max_fd_ + 1, &fds, NULL, NULL, NULL);
   } while (ret == -1 && errno == EINTR);
 
-  if (FD_ISSET(drm_->fd(), &fds_)) {
+  if (FD_ISSET(drm_->fd(), &fds)) {
     drmEventContext event_context = {
         .version = DRM_EVENT_CONTEXT_VERSION,
         .vblank_handler = NULL,
@@ -129,7 +137,7 @@ void DrmEventListener::Routine() {
     drmHandleEvent(drm_->fd(), &event_context);
   }
 
-  if (FD_ISSET(uevent_fd_.get(), &fds_))
+  if (FD_ISSET(uevent_fd_.get(), &fds))
     UEventHandler();
 }
 }
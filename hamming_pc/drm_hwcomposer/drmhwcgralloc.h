@@ -62,6 +62,16 @@ typedef struct hwc_drm_bo {
   uint32_t fb_id;
   int acquire_fence_fd;
   void *priv;
+
+  /* What decides the memory layout of the buffer beyond its pitches and
+   * offsets, so that two buffers can be told apart when the kernel would
+   * treat them differently: the DRM_FORMAT_MOD_* the fb was added with, and
+   * the gralloc usage, which the tiling follows from for fbs added without
+   * modifiers. Both are only meaningful if layout_known is set.
+   */
+  uint64_t modifiers[4];
+  uint32_t usage;
+  int layout_known;
 } hwc_drm_bo_t;
 
 #endif  // ANDROID_DRMHWCGRALLOC_H_
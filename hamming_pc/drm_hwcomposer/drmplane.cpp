@@ -29,7 +29,10 @@
 namespace android {
 
 DrmPlane::DrmPlane(DrmResources *drm, drmModePlanePtr p)
-    : drm_(drm), id_(p->plane_id), possible_crtc_mask_(p->possible_crtcs) {
+    : drm_(drm),
+      id_(p->plane_id),
+      possible_crtc_mask_(p->possible_crtcs),
+      formats_(p->formats, p->formats + p->count_formats) {
 }
 
 int DrmPlane::Init() {
@@ -141,6 +144,10 @@ uint32_t DrmPlane::type() const {
   return type_;
 }
 
+const std::vector<uint32_t> &DrmPlane::formats() const {
+  return formats_;
+}
+
 const DrmProperty &DrmPlane::crtc_property() const {
   return crtc_property_;
 }
@@ -42,6 +42,8 @@ class DrmPlane {
 
   uint32_t type() const;
 
+  const std::vector<uint32_t> &formats() const;
+
   const DrmProperty &crtc_property() const;
   const DrmProperty &fb_property() const;
   const DrmProperty &crtc_x_property() const;
@@ -63,6 +65,8 @@ class DrmPlane {
 
   uint32_t type_;
 
+  std::vector<uint32_t> formats_;
+
   DrmProperty crtc_property_;
   DrmProperty fb_property_;
   DrmProperty crtc_x_property_;
@@ -549,10 +549,19 @@ GLWorkerCompositor::~GLWorkerCompositor() {
       ALOGE("Failed to destroy OpenGL ES Context: %s", GetEGLError());
 }
 
+static bool IntersectRects(const DrmHwcRect<int> &a, const DrmHwcRect<int> &b,
+                           DrmHwcRect<int> *out) {
+  *out = DrmHwcRect<int>(std::max(a.left, b.left), std::max(a.top, b.top),
+                         std::min(a.right, b.right),
+                         std::min(a.bottom, b.bottom));
+  return out->left < out->right && out->top < out->bottom;
+}
+
 int GLWorkerCompositor::Composite(DrmHwcLayer *layers,
                                   DrmCompositionRegion *regions,
                                   size_t num_regions,
-                                  const sp<GraphicBuffer> &framebuffer) {
+                                  const sp<GraphicBuffer> &framebuffer,
+                                  const std::vector<DrmHwcRect<int>> *damage) {
   ATRACE_CALL();
   int ret = 0;
   std::vector<AutoEGLImageAndGLTexture> layer_textures;
@@ -574,10 +583,32 @@ int GLWorkerCompositor::Composite(DrmHwcLayer *layers,
   std::unordered_set<size_t> layers_used_indices;
   for (size_t region_index = 0; region_index < num_regions; region_index++) {
     DrmCompositionRegion &region = regions[region_index];
-    layers_used_indices.insert(region.source_layers.begin(),
-                               region.source_layers.end());
-    commands.emplace_back();
-    ConstructCommand(layers, region, commands.back());
+    if (!damage) {
+      layers_used_indices.insert(region.source_layers.begin(),
+                                 region.source_layers.end());
+      commands.emplace_back();
+      ConstructCommand(layers, region, commands.back());
+      continue;
+    }
+
+    // The texture coordinates are derived from the region's frame, so
+    // clipping the frame to the damage redraws exactly those pixels.
+    for (const DrmHwcRect<int> &damage_rect : *damage) {
+      DrmCompositionRegion clipped;
+      if (!IntersectRects(region.frame, damage_rect, &clipped.frame))
+        continue;
+      clipped.source_layers = region.source_layers;
+      layers_used_indices.insert(region.source_layers.begin(),
+                                 region.source_layers.end());
+      commands.emplace_back();
+      ConstructCommand(layers, clipped, commands.back());
+    }
+  }
+
+  // Nothing changed since the framebuffer was last composited
+  if (commands.empty()) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return 0;
   }
 
   for (size_t layer_index = 0; layer_index < MAX_OVERLAPPING_LAYERS;
@@ -606,8 +637,12 @@ int GLWorkerCompositor::Composite(DrmHwcLayer *layers,
 
   glViewport(0, 0, frame_width, frame_height);
 
-  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-  glClear(GL_COLOR_BUFFER_BIT);
+  // Blending is disabled, so redrawn regions overwrite what was there and
+  // everything outside of the regions is still clear from the last time.
+  if (!damage) {
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
 
   glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_.get());
   glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4, NULL);
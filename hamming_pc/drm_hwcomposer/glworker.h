@@ -30,10 +30,10 @@
 #include <ui/GraphicBuffer.h>
 
 #include "autogl.h"
+#include "drmhwcomposer.h"
 
 namespace android {
 
-struct DrmHwcLayer;
 struct DrmCompositionRegion;
 
 class GLWorkerCompositor {
@@ -42,8 +42,12 @@ class GLWorkerCompositor {
   ~GLWorkerCompositor();
 
   int Init();
+  // If damage is non-NULL, framebuffer must already hold the result of
+  // compositing the same regions, and only the parts of the regions which
+  // intersect the damage rects are redrawn.
   int Composite(DrmHwcLayer *layers, DrmCompositionRegion *regions,
-                size_t num_regions, const sp<GraphicBuffer> &framebuffer);
+                size_t num_regions, const sp<GraphicBuffer> &framebuffer,
+                const std::vector<DrmHwcRect<int>> *damage = NULL);
   void Finish();
 
  private:
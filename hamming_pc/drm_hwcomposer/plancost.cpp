@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "plancost.h"
+
+#include <algorithm>
+#include <string>
+
+#include <drm/drm_fourcc.h>
+
+namespace android {
+
+// DrmHwcTransform bits which swap width and height
+static const uint32_t kTransformSwapXY = (1 << 2) | (1 << 4);
+
+static uint64_t FormatBitsPerPixel(uint32_t format) {
+  switch (format) {
+    case DRM_FORMAT_RGB565:
+    case DRM_FORMAT_BGR565:
+      return 16;
+    case DRM_FORMAT_RGB888:
+    case DRM_FORMAT_BGR888:
+      return 24;
+    case DRM_FORMAT_NV12:
+    case DRM_FORMAT_NV21:
+    case DRM_FORMAT_YUV420:
+    case DRM_FORMAT_YVU420:
+      return 12;
+    default:
+      return 32;
+  }
+}
+
+static bool RectsOverlap(const separate_rects::Rect<int> &a,
+                         const separate_rects::Rect<int> &b) {
+  return a.left < b.right && b.left < a.right && a.top < b.bottom &&
+         b.top < a.bottom;
+}
+
+uint64_t PlanCostModel::PrecompBytes(const PlanCostLayer &layer) {
+  // GL samples roughly one source texel per destination pixel
+  uint64_t area = std::max(layer.display_frame.area(), 0);
+  return area * FormatBitsPerPixel(layer.format) / 8;
+}
+
+bool PlanCostModel::CanScanout(const PlanCostLayer &layer,
+                               const PlanCostPlane &plane) {
+  if (!plane.formats.empty() && layer.format &&
+      std::find(plane.formats.begin(), plane.formats.end(), layer.format) ==
+          plane.formats.end())
+    return false;
+
+  if (layer.transform && !plane.can_rotate)
+    return false;
+
+  if (layer.alpha != 0xff && !plane.can_alpha)
+    return false;
+
+  // Most display controllers can't scale on the primary plane
+  float crop_w = layer.source_crop.width();
+  float crop_h = layer.source_crop.height();
+  if (layer.transform & kTransformSwapXY)
+    std::swap(crop_w, crop_h);
+  bool scaled = crop_w != layer.display_frame.width() ||
+                crop_h != layer.display_frame.height();
+  if (scaled && plane.primary)
+    return false;
+
+  return true;
+}
+
+bool PlanCostModel::IsValid(const std::vector<PlanCostLayer> &layers,
+                            const std::vector<PlanCostPlane> &planes,
+                            bool have_precomp,
+                            const std::vector<size_t> &dedicated) {
+  if (dedicated.size() > planes.size())
+    return false;
+  if (!have_precomp && dedicated.size() != layers.size())
+    return false;
+
+  std::vector<bool> is_dedicated(layers.size(), false);
+  for (size_t i = 0; i < dedicated.size(); i++) {
+    if (i > 0 && dedicated[i] <= dedicated[i - 1])
+      return false;
+    if (!CanScanout(layers[dedicated[i]], planes[i]))
+      return false;
+    is_dedicated[dedicated[i]] = true;
+  }
+
+  // The precomposition plane sits above all dedicated planes. Where a
+  // precomposited layer is below a dedicated one, the precomposition gets a
+  // hole punched through it, which is only correct if the dedicated layer
+  // hides whatever is below it.
+  for (size_t d : dedicated) {
+    if (layers[d].opaque)
+      continue;
+    for (size_t p = 0; p < d; p++) {
+      if (!is_dedicated[p] &&
+          RectsOverlap(layers[p].display_frame, layers[d].display_frame))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+uint64_t PlanCostModel::Cost(const std::vector<PlanCostLayer> &layers,
+                             const std::vector<size_t> &dedicated) {
+  uint64_t cost = 0;
+  size_t next = 0;
+  for (size_t i = 0; i < layers.size(); i++) {
+    bool is_dedicated = next < dedicated.size() && dedicated[next] == i;
+    if (is_dedicated)
+      next++;
+    else
+      cost += PrecompBytes(layers[i]);
+
+    if (is_dedicated != layers[i].dedicated_last_frame)
+      cost += PrecompBytes(layers[i]) / kSwitchPenaltyDivisor;
+  }
+  return cost;
+}
+
+namespace {
+
+struct Search {
+  const std::vector<PlanCostLayer> &layers;
+  const std::vector<PlanCostPlane> &planes;
+  bool have_precomp;
+
+  std::vector<size_t> current;
+  std::vector<size_t> best;
+  uint64_t best_cost;
+  bool found;
+
+  // Tries layers[pos..] both on and off a dedicated plane, dedicating first
+  // so that among equally good plans the one closest to greedy wins.
+  void Visit(size_t pos) {
+    if (pos == layers.size()) {
+      if (!PlanCostModel::IsValid(layers, planes, have_precomp, current))
+        return;
+      uint64_t cost = PlanCostModel::Cost(layers, current);
+      if (!found || cost < best_cost) {
+        best = current;
+        best_cost = cost;
+        found = true;
+      }
+      return;
+    }
+
+    if (current.size() < planes.size() &&
+        PlanCostModel::CanScanout(layers[pos], planes[current.size()])) {
+      current.push_back(pos);
+      Visit(pos + 1);
+      current.pop_back();
+    }
+
+    if (have_precomp)
+      Visit(pos + 1);
+  }
+};
+}
+
+bool PlanCostModel::Choose(const std::vector<PlanCostLayer> &layers,
+                           const std::vector<PlanCostPlane> &planes,
+                           bool have_precomp, std::vector<size_t> *dedicated) {
+  dedicated->clear();
+
+  if (layers.size() > kMaxSearchLayers) {
+    ChooseGreedy(layers, planes, have_precomp, dedicated);
+    if (IsValid(layers, planes, have_precomp, *dedicated))
+      return true;
+    dedicated->clear();
+    return have_precomp;
+  }
+
+  Search search{layers, planes, have_precomp, {}, {}, 0, false};
+  search.Visit(0);
+  if (!search.found)
+    return false;
+
+  *dedicated = std::move(search.best);
+  return true;
+}
+
+void PlanCostModel::ChooseGreedy(const std::vector<PlanCostLayer> &layers,
+                                 const std::vector<PlanCostPlane> &planes,
+                                 bool have_precomp,
+                                 std::vector<size_t> *dedicated) {
+  dedicated->clear();
+  size_t count = std::min(layers.size(), planes.size());
+  if (!have_precomp && count < layers.size())
+    return;
+  for (size_t i = 0; i < count; i++)
+    dedicated->push_back(i);
+}
+
+void PlanCostModel::Serialize(int display, bool have_precomp,
+                              const std::vector<PlanCostLayer> &layers,
+                              const std::vector<PlanCostPlane> &planes,
+                              std::ostringstream *out) {
+  *out << "frame " << display << " " << have_precomp << "\n";
+  for (const PlanCostPlane &plane : planes) {
+    *out << "plane " << plane.primary << " " << plane.can_rotate << " "
+         << plane.can_alpha << " ";
+    if (plane.formats.empty())
+      *out << "-";
+    for (size_t i = 0; i < plane.formats.size(); i++)
+      *out << (i ? "," : "") << plane.formats[i];
+    *out << "\n";
+  }
+  for (const PlanCostLayer &layer : layers) {
+    *out << "layer " << layer.index;
+    for (int i = 0; i < 4; i++)
+      *out << " " << layer.display_frame.bounds[i];
+    for (int i = 0; i < 4; i++)
+      *out << " " << layer.source_crop.bounds[i];
+    *out << " " << layer.format << " " << layer.transform << " "
+         << (unsigned)layer.alpha << " " << layer.opaque << "\n";
+  }
+  *out << "end\n";
+}
+
+bool PlanCostModel::Deserialize(std::istream &in, int *display,
+                                bool *have_precomp,
+                                std::vector<PlanCostLayer> *layers,
+                                std::vector<PlanCostPlane> *planes) {
+  std::string line;
+  layers->clear();
+  planes->clear();
+
+  // Skip anything up to the next frame, e.g. logcat noise
+  bool in_frame = false;
+  while (std::getline(in, line)) {
+    size_t start = line.find("frame ");
+    if (!in_frame) {
+      if (start == std::string::npos)
+        continue;
+      std::istringstream fields(line.substr(start + 6));
+      if (!(fields >> *display >> *have_precomp))
+        return false;
+      in_frame = true;
+      continue;
+    }
+
+    size_t plane_pos = line.find("plane ");
+    size_t layer_pos = line.find("layer ");
+    if (plane_pos != std::string::npos) {
+      std::istringstream fields(line.substr(plane_pos + 6));
+      PlanCostPlane plane;
+      std::string formats;
+      if (!(fields >> plane.primary >> plane.can_rotate >> plane.can_alpha >>
+            formats))
+        return false;
+      if (formats != "-") {
+        std::istringstream format_fields(formats);
+        std::string format;
+        while (std::getline(format_fields, format, ','))
+          plane.formats.push_back(std::stoul(format));
+      }
+      planes->push_back(plane);
+    } else if (layer_pos != std::string::npos) {
+      std::istringstream fields(line.substr(layer_pos + 6));
+      PlanCostLayer layer;
+      unsigned alpha;
+      fields >> layer.index;
+      for (int i = 0; i < 4; i++)
+        fields >> layer.display_frame.bounds[i];
+      for (int i = 0; i < 4; i++)
+        fields >> layer.source_crop.bounds[i];
+      if (!(fields >> layer.format >> layer.transform >> alpha >>
+            layer.opaque))
+        return false;
+      layer.alpha = alpha;
+      layers->push_back(layer);
+    } else if (line.find("end") != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_DRM_PLAN_COST_H_
+#define ANDROID_DRM_PLAN_COST_H_
+
+#include "separate_rects.h"
+
+#include <stdint.h>
+#include <istream>
+#include <sstream>
+#include <vector>
+
+namespace android {
+
+// The cost model behind PlanStageCostBased. It only deals with plain
+// descriptions of layers and planes so that recorded layer stacks can be
+// replayed against it on the host (see tests/planner_replay.cpp).
+
+struct PlanCostLayer {
+  size_t index = 0;  // z-order, higher is closer to the viewer
+  separate_rects::Rect<int> display_frame;
+  separate_rects::Rect<float> source_crop;
+  uint32_t format = 0;     // DRM_FORMAT_*, 0 if unknown
+  uint32_t transform = 0;  // DrmHwcTransform
+  uint8_t alpha = 0xff;
+  bool opaque = false;  // not blended with the layers below
+  bool dedicated_last_frame = false;
+};
+
+struct PlanCostPlane {
+  bool primary = false;
+  bool can_rotate = false;
+  bool can_alpha = false;
+  std::vector<uint32_t> formats;  // empty if unknown
+};
+
+class PlanCostModel {
+ public:
+  // Stacks with more layers than this are not searched exhaustively, the
+  // greedy plan is used instead.
+  static const size_t kMaxSearchLayers = 12;
+
+  // Moving a layer between a dedicated plane and the precomposition forces
+  // the precomposition to be redrawn from scratch, so a plan pays
+  // 1/kSwitchPenaltyDivisor of a layer's precomposition bytes for every
+  // layer it moves compared to the previous frame.
+  static const uint64_t kSwitchPenaltyDivisor = 4;
+
+  // Bytes read to precomposite the layer.
+  static uint64_t PrecompBytes(const PlanCostLayer &layer);
+
+  // Whether plane can scan out layer without help from GL.
+  static bool CanScanout(const PlanCostLayer &layer,
+                         const PlanCostPlane &plane);
+
+  // Whether putting the given layers on dedicated planes (planes[i] for
+  // dedicated[i]) and the rest in the precomposition gives a correct image.
+  static bool IsValid(const std::vector<PlanCostLayer> &layers,
+                      const std::vector<PlanCostPlane> &planes,
+                      bool have_precomp, const std::vector<size_t> &dedicated);
+
+  static uint64_t Cost(const std::vector<PlanCostLayer> &layers,
+                       const std::vector<size_t> &dedicated);
+
+  // Picks the valid plan with the lowest Cost(). layers must be sorted by
+  // index; dedicated receives positions into layers in ascending order.
+  // Returns false if there is no valid plan, which can only happen when
+  // have_precomp is false.
+  static bool Choose(const std::vector<PlanCostLayer> &layers,
+                     const std::vector<PlanCostPlane> &planes,
+                     bool have_precomp, std::vector<size_t> *dedicated);
+
+  // The plan PlanStageGreedy would come up with (which may not be valid).
+  static void ChooseGreedy(const std::vector<PlanCostLayer> &layers,
+                           const std::vector<PlanCostPlane> &planes,
+                           bool have_precomp, std::vector<size_t> *dedicated);
+
+  // Text format used for recording and replaying layer stacks:
+  //   frame <display> <have_precomp>
+  //   plane <primary> <can_rotate> <can_alpha> <format,...|->
+  //   layer <index> <frame l t r b> <crop l t r b> <format> <transform>
+  //         <alpha> <opaque>
+  //   end
+  static void Serialize(int display, bool have_precomp,
+                        const std::vector<PlanCostLayer> &layers,
+                        const std::vector<PlanCostPlane> &planes,
+                        std::ostringstream *out);
+  // Returns false at the end of the input or on a malformed frame.
+  static bool Deserialize(std::istream &in, int *display, bool *have_precomp,
+                          std::vector<PlanCostLayer> *layers,
+                          std::vector<PlanCostPlane> *planes);
+};
+}
+
+#endif  // ANDROID_DRM_PLAN_COST_H_
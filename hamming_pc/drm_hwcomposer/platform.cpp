@@ -19,7 +19,13 @@
 #include "drmresources.h"
 #include "platform.h"
 
+#include <stdlib.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+
 #include <cutils/log.h>
+#include <cutils/properties.h>
 
 namespace android {
 
@@ -164,4 +170,96 @@ int PlanStageGreedy::ProvisionPlanes(
 
   return 0;
 }
+
+PlanStageCostBased::PlanStageCostBased() {
+  char trace_prop[PROPERTY_VALUE_MAX];
+  property_get("hwc.drm.planner_trace", trace_prop, "0");
+  trace_ = atoi(trace_prop);
+}
+
+int PlanStageCostBased::ProvisionPlanes(
+    std::vector<DrmCompositionPlane> *composition,
+    std::map<size_t, DrmHwcLayer *> &layers, DrmCrtc *crtc,
+    std::vector<DrmPlane *> *planes) {
+  std::vector<DrmHwcRect<int>> &last_dedicated =
+      last_dedicated_[crtc->display()];
+
+  std::vector<PlanCostLayer> cost_layers;
+  for (auto &i : layers) {
+    const DrmHwcLayer *layer = i.second;
+    cost_layers.emplace_back();
+    PlanCostLayer &cost_layer = cost_layers.back();
+    cost_layer.index = i.first;
+    cost_layer.display_frame = layer->display_frame;
+    cost_layer.source_crop = layer->source_crop;
+    cost_layer.format = layer->buffer ? layer->buffer->format : 0;
+    cost_layer.transform = layer->transform;
+    cost_layer.alpha = layer->alpha;
+    cost_layer.opaque =
+        layer->blending == DrmHwcBlending::kNone && layer->alpha == 0xff;
+    cost_layer.dedicated_last_frame =
+        std::find(last_dedicated.begin(), last_dedicated.end(),
+                  layer->display_frame) != last_dedicated.end();
+  }
+
+  std::vector<PlanCostPlane> cost_planes;
+  for (DrmPlane *plane : *planes) {
+    cost_planes.emplace_back();
+    PlanCostPlane &cost_plane = cost_planes.back();
+    cost_plane.primary = plane->type() == DRM_PLANE_TYPE_PRIMARY;
+    cost_plane.can_rotate = plane->rotation_property().id() != 0;
+    cost_plane.can_alpha = plane->alpha_property().id() != 0;
+    cost_plane.formats = plane->formats();
+  }
+
+  DrmCompositionPlane *precomp = GetPrecomp(composition);
+
+  if (trace_) {
+    std::ostringstream trace;
+    PlanCostModel::Serialize(crtc->display(), precomp != NULL, cost_layers,
+                             cost_planes, &trace);
+    std::istringstream lines(trace.str());
+    std::string line;
+    while (std::getline(lines, line))
+      ALOGI("planner-trace: %s", line.c_str());
+  }
+
+  std::vector<size_t> dedicated;
+  if (!PlanCostModel::Choose(cost_layers, cost_planes, precomp != NULL,
+                             &dedicated)) {
+    // Some layer can't be scanned out directly, so precomposite after all,
+    // using the topmost plane like Planner::ProvisionPlanes() would have.
+    if (planes->empty()) {
+      ALOGE("Not enough planes to reserve for precomp fb");
+      return 0;
+    }
+    composition->emplace_back(DrmCompositionPlane::Type::kPrecomp,
+                              planes->back(), crtc);
+    planes->pop_back();
+    cost_planes.pop_back();
+    precomp = GetPrecomp(composition);
+    PlanCostModel::Choose(cost_layers, cost_planes, true, &dedicated);
+  }
+
+  last_dedicated.clear();
+  for (size_t pos : dedicated) {
+    const PlanCostLayer &cost_layer = cost_layers[pos];
+    int ret = Emplace(composition, planes, DrmCompositionPlane::Type::kLayer,
+                      crtc, cost_layer.index);
+    if (ret) {
+      ALOGE("Failed to emplace layer %zu", cost_layer.index);
+      continue;
+    }
+    last_dedicated.push_back(cost_layer.display_frame);
+    layers.erase(cost_layer.index);
+  }
+
+  // Put the rest of the layers in the precomp plane
+  if (precomp) {
+    for (auto i = layers.begin(); i != layers.end(); i = layers.erase(i))
+      precomp->source_layers().emplace_back(i->first);
+  }
+
+  return 0;
+}
 }
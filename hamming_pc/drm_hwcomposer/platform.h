@@ -19,6 +19,7 @@
 
 #include "drmdisplaycomposition.h"
 #include "drmhwcomposer.h"
+#include "plancost.h"
 
 #include <hardware/hardware.h>
 #include <hardware/hwcomposer.h>
@@ -161,5 +162,25 @@ class PlanStageGreedy : public Planner::PlanStage {
                       std::map<size_t, DrmHwcLayer *> &layers, DrmCrtc *crtc,
                       std::vector<DrmPlane *> *planes);
 };
+
+// This plan stage picks the set of layers to put on dedicated planes which
+// minimizes the number of bytes precomposited (see PlanCostModel), taking the
+// plane capabilities and the previous frame's plan into account, and sticks
+// the rest in a precomposition plane. Setting hwc.drm.planner_trace to 1 logs
+// every layer stack in the format tests/planner_replay.cpp reads.
+class PlanStageCostBased : public Planner::PlanStage {
+ public:
+  PlanStageCostBased();
+
+  int ProvisionPlanes(std::vector<DrmCompositionPlane> *composition,
+                      std::map<size_t, DrmHwcLayer *> &layers, DrmCrtc *crtc,
+                      std::vector<DrmPlane *> *planes);
+
+ private:
+  bool trace_;
+  // Display frames of the layers which got dedicated planes last frame,
+  // per display.
+  std::map<int, std::vector<DrmHwcRect<int>>> last_dedicated_;
+};
 }
 #endif
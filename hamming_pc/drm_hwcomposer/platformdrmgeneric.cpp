@@ -20,11 +20,14 @@
 #include "platform.h"
 #include "platformdrmgeneric.h"
 
+#include <string.h>
+
 #include <drm/drm_fourcc.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
 #include <cutils/log.h>
+#include <cutils/properties.h>
 #include <gralloc_drm.h>
 #include <gralloc_drm_priv.h>
 #include <gralloc_drm_handle.h>
@@ -111,6 +114,10 @@ int DrmGenericImporter::ImportBuffer(buffer_handle_t handle, hwc_drm_bo_t *bo) {
   bo->gem_handles[0] = gem_handle;
   bo->offsets[0] = 0;
 
+  // gralloc picks the tiling from the format, size and usage
+  bo->usage = gr_handle->usage;
+  bo->layout_known = 1;
+
   ret = drmModeAddFB2(drm_->fd(), bo->width, bo->height, bo->format,
                       bo->gem_handles, bo->pitches, bo->offsets, &bo->fb_id, 0);
   if (ret) {
@@ -146,6 +153,13 @@ int DrmGenericImporter::ReleaseBuffer(hwc_drm_bo_t *bo) {
 #ifdef USE_DRM_GENERIC_IMPORTER
 std::unique_ptr<Planner> Planner::CreateInstance(DrmResources *) {
   std::unique_ptr<Planner> planner(new Planner);
+
+  char planner_prop[PROPERTY_VALUE_MAX];
+  property_get("hwc.drm.planner", planner_prop, "cost");
+  if (!strcmp(planner_prop, "cost"))
+    planner->AddStage<PlanStageCostBased>();
+  // Picks up anything left over, or does all the work if hwc.drm.planner is
+  // set to "greedy"
   planner->AddStage<PlanStageGreedy>();
   return planner;
 }
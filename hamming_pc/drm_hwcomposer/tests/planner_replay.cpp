@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays layer stacks recorded with hwc.drm.planner_trace=1, e.g.
+//
+//   adb logcat -d -s hwc-platform | hwc-planner-replay
+//
+// and compares the greedy planner with the cost based one without needing
+// the hardware. For every plan it reports the bytes that had to be
+// precomposited, how often layers moved between planes and the precomp
+// buffer, and how many plans would have given a wrong image.
+
+#include "plancost.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+
+using android::PlanCostLayer;
+using android::PlanCostModel;
+using android::PlanCostPlane;
+
+namespace {
+
+struct PlannerStats {
+  const char *name;
+  uint64_t frames = 0;
+  uint64_t precomp_bytes = 0;
+  uint64_t layer_switches = 0;
+  uint64_t invalid_plans = 0;
+
+  // Display frames of the layers dedicated in the previous frame, per display
+  std::map<int, std::vector<separate_rects::Rect<int>>> last_dedicated;
+
+  explicit PlannerStats(const char *n) : name(n) {
+  }
+
+  void Record(int display, const std::vector<PlanCostLayer> &layers,
+              const std::vector<PlanCostPlane> &planes, bool have_precomp,
+              const std::vector<size_t> &dedicated) {
+    std::vector<separate_rects::Rect<int>> &last = last_dedicated[display];
+    std::vector<separate_rects::Rect<int>> current;
+
+    frames++;
+    if (!PlanCostModel::IsValid(layers, planes, have_precomp, dedicated))
+      invalid_plans++;
+
+    size_t next = 0;
+    for (size_t i = 0; i < layers.size(); i++) {
+      bool is_dedicated = next < dedicated.size() && dedicated[next] == i;
+      if (is_dedicated) {
+        next++;
+        current.push_back(layers[i].display_frame);
+      } else {
+        precomp_bytes += PlanCostModel::PrecompBytes(layers[i]);
+      }
+      bool was_dedicated = std::find(last.begin(), last.end(),
+                                     layers[i].display_frame) != last.end();
+      if (is_dedicated != was_dedicated)
+        layer_switches++;
+    }
+    last = std::move(current);
+  }
+
+  void Print() const {
+    printf("%-8s frames=%" PRIu64 " precomp_bytes=%" PRIu64
+           " (%.1f KiB/frame) layer_switches=%" PRIu64
+           " invalid_plans=%" PRIu64 "\n",
+           name, frames, precomp_bytes,
+           frames ? precomp_bytes / 1024.0 / frames : 0.0, layer_switches,
+           invalid_plans);
+  }
+};
+
+// The cost model looks at which layers were dedicated last frame, so feed it
+// the same history the hwc would have had.
+void MarkLastDedicated(const PlannerStats &stats, int display,
+                       std::vector<PlanCostLayer> *layers) {
+  auto last = stats.last_dedicated.find(display);
+  for (PlanCostLayer &layer : *layers) {
+    layer.dedicated_last_frame =
+        last != stats.last_dedicated.end() &&
+        std::find(last->second.begin(), last->second.end(),
+                  layer.display_frame) != last->second.end();
+  }
+}
+}
+
+int main(int argc, char *argv[]) {
+  std::ifstream file;
+  if (argc > 2) {
+    fprintf(stderr, "usage: %s [trace file]\n", argv[0]);
+    return 1;
+  }
+  if (argc == 2) {
+    file.open(argv[1]);
+    if (!file) {
+      fprintf(stderr, "failed to open %s\n", argv[1]);
+      return 1;
+    }
+  }
+  std::istream &in = argc == 2 ? file : std::cin;
+
+  PlannerStats greedy("greedy");
+  PlannerStats cost("cost");
+
+  int display;
+  bool have_precomp;
+  std::vector<PlanCostLayer> layers;
+  std::vector<PlanCostPlane> planes;
+  while (PlanCostModel::Deserialize(in, &display, &have_precomp, &layers,
+                                    &planes)) {
+    std::vector<size_t> dedicated;
+
+    PlanCostModel::ChooseGreedy(layers, planes, have_precomp, &dedicated);
+    greedy.Record(display, layers, planes, have_precomp, dedicated);
+
+    // Like PlanStageCostBased, fall back to precompositing if some layer
+    // can't be scanned out.
+    MarkLastDedicated(cost, display, &layers);
+    bool cost_precomp = have_precomp;
+    std::vector<PlanCostPlane> cost_planes = planes;
+    if (!PlanCostModel::Choose(layers, cost_planes, cost_precomp,
+                               &dedicated) &&
+        !cost_planes.empty()) {
+      cost_planes.pop_back();
+      cost_precomp = true;
+      PlanCostModel::Choose(layers, cost_planes, cost_precomp, &dedicated);
+    }
+    cost.Record(display, layers, cost_planes, cost_precomp, dedicated);
+  }
+
+  greedy.Print();
+  cost.Print();
+  return 0;
+}
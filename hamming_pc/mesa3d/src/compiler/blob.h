@@ -252,6 +252,20 @@ blob_overwrite_intptr(struct blob *blob,
                       size_t offset,
                       intptr_t value);
 
+/**
+ * Add a uint32_t to a blob as a variable-length integer.
+ *
+ * The value is stored seven bits per byte, least significant bits first,
+ * with the top bit of each byte set if more bytes follow.  Values below 128
+ * take a single byte.  Unlike blob_write_uint32, no alignment padding is
+ * added, so this is the more compact choice for values that are usually
+ * small.
+ *
+ * \return True unless allocation failed.
+ */
+bool
+blob_write_varint(struct blob *blob, uint32_t value);
+
 /**
  * Add a NULL-terminated string to a blob, (including the NULL terminator).
  *
@@ -330,6 +344,16 @@ blob_read_uint64(struct blob_reader *blob);
 intptr_t
 blob_read_intptr(struct blob_reader *blob);
 
+/**
+ * Read a variable-length integer written by blob_write_varint from the
+ * current location.
+ *
+ * \return The value read, or 0 if the data ends early or the encoding is
+ * longer than any uint32_t needs, in which case blob->overrun is set.
+ */
+uint32_t
+blob_read_varint(struct blob_reader *blob);
+
 /**
  * Read a NULL-terminated string from the current location, (and update the
  * current location to just past this string).
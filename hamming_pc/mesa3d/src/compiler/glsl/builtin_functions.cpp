@@ -83,6 +83,7 @@
 #include <math.h>
 #include "builtin_functions.h"
 #include "util/hash_table.h"
+#include "util/set.h"
 
 #define M_PIf   ((float) M_PI)
 #define M_PI_2f ((float) M_PI_2)
@@ -643,7 +644,8 @@ namespace {
  * function module.
  *
  * It generates IR for every built-in function signature, and organizes them
- * into functions.
+ * into functions.  Only the intrinsics are generated up front; each built-in
+ * function is generated the first time a shader refers to it by name.
  */
 class builtin_builder {
 public:
@@ -656,20 +658,39 @@ public:
                                const char *name, exec_list *actual_parameters);
 
    /**
-    * A shader to hold all the built-in signatures; created by this module.
+    * Look up the built-in function called \p name, generating its IR if
+    * this is the first time it was asked for.
     *
-    * This includes signatures for every built-in, regardless of version or
-    * enabled extensions.  The availability predicate associated with each
-    * signature allows matching_signature() to filter out the irrelevant ones.
+    * Returns NULL if there is no such built-in.
+    */
+   ir_function *get_function(const char *name);
+
+   /**
+    * A shader to hold the built-in signatures; created by this module.
+    *
+    * This includes signatures for every built-in that has been generated so
+    * far, regardless of version or enabled extensions.  The availability
+    * predicate associated with each signature allows matching_signature() to
+    * filter out the irrelevant ones.
     */
    gl_shader *shader;
 
 private:
    void *mem_ctx;
 
+   /** Names of all the built-in functions create_builtins() knows about. */
+   struct set *names;
+
+   /**
+    * The built-in function create_builtins() should generate, or NULL if it
+    * should only record the names of the built-ins in \c names.
+    */
+   const char *wanted;
+
    void create_shader();
    void create_intrinsics();
    void create_builtins();
+   bool want_function(const char *name);
 
    /**
     * IR builder helpers:
@@ -1015,6 +1036,8 @@ builtin_builder::builtin_builder()
    : shader(NULL)
 {
    mem_ctx = NULL;
+   names = NULL;
+   wanted = NULL;
 }
 
 builtin_builder::~builtin_builder()
@@ -1035,7 +1058,7 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
     */
    state->uses_builtin_functions = true;
 
-   ir_function *f = shader->symbols->get_function(name);
+   ir_function *f = get_function(name);
    if (f == NULL)
       return NULL;
 
@@ -1047,6 +1070,28 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
    return sig;
 }
 
+ir_function *
+builtin_builder::get_function(const char *name)
+{
+   ir_function *f = shader->symbols->get_function(name);
+   if (f != NULL)
+      return f;
+
+   /* Intrinsics are always present, so anything else not in the symbol
+    * table is either a built-in that hasn't been generated yet or not a
+    * built-in at all.
+    */
+   struct set_entry *entry = _mesa_set_search(names, name);
+   if (entry == NULL)
+      return NULL;
+
+   wanted = (const char *) entry->key;
+   create_builtins();
+   wanted = NULL;
+
+   return shader->symbols->get_function(name);
+}
+
 void
 builtin_builder::initialize()
 {
@@ -1055,8 +1100,15 @@ builtin_builder::initialize()
       return;
 
    mem_ctx = ralloc_context(NULL);
+   names = _mesa_set_create(mem_ctx, _mesa_key_hash_string,
+                            _mesa_key_string_equal);
    create_shader();
    create_intrinsics();
+
+   /* With nothing wanted, this only collects the names of the built-ins.
+    * Generating the IR for all of them takes a good while and most of it
+    * would never be used, so get_function() does that on demand.
+    */
    create_builtins();
 }
 
@@ -1065,6 +1117,7 @@ builtin_builder::release()
 {
    ralloc_free(mem_ctx);
    mem_ctx = NULL;
+   names = NULL;
 
    ralloc_free(shader);
    shader = NULL;
@@ -1265,13 +1318,37 @@ builtin_builder::create_intrinsics()
 }
 
 /**
- * Create ir_function and ir_function_signature objects for each built-in.
+ * Whether create_builtins() should generate the built-in \p name.
+ *
+ * When nothing is wanted this records \p name as a built-in instead.
+ */
+bool
+builtin_builder::want_function(const char *name)
+{
+   if (wanted == NULL) {
+      _mesa_set_add(names, name);
+      return false;
+   }
+
+   return strcmp(name, wanted) == 0;
+}
+
+/**
+ * Create ir_function and ir_function_signature objects for each built-in
+ * that want_function() asks for.
  *
  * Contains a list of every available built-in.
  */
 void
 builtin_builder::create_builtins()
 {
+   /* Only evaluate the signature generators of the built-ins we want. */
+#define add_function(NAME, ...)                                   \
+   do {                                                           \
+      if (want_function(NAME))                                    \
+         builtin_builder::add_function(NAME, __VA_ARGS__);        \
+   } while (0)
+
 #define F(NAME)                                 \
    add_function(#NAME,                          \
                 _##NAME(glsl_type::float_type), \
@@ -3330,6 +3407,7 @@ builtin_builder::create_builtins()
 #undef FIUD_VEC
 #undef FIUBD_VEC
 #undef FIU2_MIXED
+#undef add_function
 }
 
 void
@@ -3402,6 +3480,10 @@ builtin_builder::add_image_function(const char *name,
       glsl_type::uimage2DMSArray_type
    };
 
+   /* The image intrinsics are always generated. */
+   if ((flags & IMAGE_FUNCTION_EMIT_STUB) && !want_function(name))
+      return;
+
    ir_function *f = new(mem_ctx) ir_function(name);
 
    for (unsigned i = 0; i < ARRAY_SIZE(types); ++i) {
@@ -6309,7 +6391,7 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    ir_function *f;
    bool ret = false;
    mtx_lock(&builtins_lock);
-   f = builtins.shader->symbols->get_function(name);
+   f = builtins.get_function(name);
    if (f != NULL) {
       foreach_in_list(ir_function_signature, sig, &f->signatures) {
          if (sig->is_builtin_available(state)) {
@@ -6323,10 +6405,15 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    return ret;
 }
 
-gl_shader *
-_mesa_glsl_get_builtin_function_shader()
+ir_function *
+_mesa_glsl_get_builtin_function(const char *name)
 {
-   return builtins.shader;
+   ir_function *f;
+   mtx_lock(&builtins_lock);
+   f = builtins.get_function(name);
+   mtx_unlock(&builtins_lock);
+
+   return f;
 }
 
 
@@ -73,8 +73,10 @@
 #include "program.h"
 #include "program/prog_instruction.h"
 #include "program/program.h"
+#include "util/debug.h"
 #include "util/mesa-sha1.h"
 #include "util/set.h"
+#include "util/u_queue.h"
 #include "string_to_uint_map.h"
 #include "linker.h"
 #include "link_varyings.h"
@@ -4693,25 +4695,6 @@ link_varyings_and_uniforms(unsigned first, unsigned last,
    if (!prog->data->LinkStatus)
       return false;
 
-   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
-      if (prog->_LinkedShaders[i] == NULL)
-         continue;
-
-      const struct gl_shader_compiler_options *options =
-         &ctx->Const.ShaderCompilerOptions[i];
-
-      if (options->LowerBufferInterfaceBlocks)
-         lower_ubo_reference(prog->_LinkedShaders[i],
-                             options->ClampBlockIndicesToArrayBounds,
-                             ctx->Const.UseSTD430AsDefaultPacking);
-
-      if (i == MESA_SHADER_COMPUTE)
-         lower_shared_reference(ctx, prog, prog->_LinkedShaders[i]);
-
-      lower_vector_derefs(prog->_LinkedShaders[i]);
-      do_vec_index_to_swizzle(prog->_LinkedShaders[i]->ir);
-   }
-
    return true;
 }
 
@@ -4733,6 +4716,131 @@ linker_optimisation_loop(struct gl_context *ctx, exec_list *ir,
       }
 }
 
+struct link_stage_job {
+   struct gl_context *ctx;
+   struct gl_shader_program *prog;
+   gl_shader_stage stage;
+   struct util_queue_fence fence;
+};
+
+static struct util_queue link_queue;
+static bool link_queue_ready;
+static once_flag link_queue_once = ONCE_FLAG_INIT;
+
+static void
+init_link_queue(void)
+{
+   if (!env_var_as_boolean("MESA_GLSL_PARALLEL_LINK", true))
+      return;
+
+   /* The calling thread works on one of the stages itself, so a program
+    * with all five graphics stages needs four more threads.
+    */
+   link_queue_ready = util_queue_init(&link_queue, "glsl_link",
+                                      MESA_SHADER_STAGES,
+                                      MESA_SHADER_STAGES - 2, 0);
+}
+
+/**
+ * Run \c execute on a \c link_stage_job for every linked stage.
+ *
+ * The callers only do work that doesn't look past the stage's own IR, so
+ * when there is more than one stage they are spread across the link queue.
+ * That gives the same IR as running them one after another.
+ */
+static void
+link_for_each_stage(struct gl_context *ctx, struct gl_shader_program *prog,
+                    util_queue_execute_func execute)
+{
+   struct link_stage_job jobs[MESA_SHADER_STAGES];
+   unsigned num_jobs = 0;
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (prog->_LinkedShaders[i] == NULL)
+         continue;
+
+      jobs[num_jobs].ctx = ctx;
+      jobs[num_jobs].prog = prog;
+      jobs[num_jobs].stage = (gl_shader_stage) i;
+      num_jobs++;
+   }
+
+   if (num_jobs > 1)
+      call_once(&link_queue_once, init_link_queue);
+
+   if (num_jobs <= 1 || !link_queue_ready) {
+      for (unsigned j = 0; j < num_jobs; j++)
+         execute(&jobs[j], 0);
+      return;
+   }
+
+   /* Parts of the IR may still be allocated out of the linker's temporary
+    * context, which all stages share, and ralloc isn't thread safe.  Move
+    * everything under the stage's own IR list so that new IR allocated
+    * next to existing IR stays within the stage.
+    */
+   for (unsigned j = 0; j < num_jobs; j++) {
+      exec_list *ir = prog->_LinkedShaders[jobs[j].stage]->ir;
+      reparent_ir(ir, ir);
+   }
+
+   for (unsigned j = 0; j < num_jobs - 1; j++) {
+      util_queue_fence_init(&jobs[j].fence);
+      util_queue_add_job(&link_queue, &jobs[j], &jobs[j].fence, execute,
+                         NULL);
+   }
+
+   execute(&jobs[num_jobs - 1], 0);
+
+   for (unsigned j = 0; j < num_jobs - 1; j++) {
+      util_queue_fence_wait(&jobs[j].fence);
+      util_queue_fence_destroy(&jobs[j].fence);
+   }
+}
+
+static void
+optimize_stage(void *data, int thread_index)
+{
+   struct link_stage_job *job = (struct link_stage_job *) data;
+   exec_list *ir = job->prog->_LinkedShaders[job->stage]->ir;
+
+   /* Call opts before lowering const arrays to uniforms so we can const
+    * propagate any elements accessed directly.
+    */
+   linker_optimisation_loop(job->ctx, ir, job->stage);
+
+   /* Call opts after lowering const arrays to copy propagate things. */
+   if (lower_const_arrays_to_uniforms(ir, job->stage))
+      linker_optimisation_loop(job->ctx, ir, job->stage);
+
+   propagate_invariance(ir);
+}
+
+static void
+lower_stage_after_varyings(void *data, int thread_index)
+{
+   struct link_stage_job *job = (struct link_stage_job *) data;
+   struct gl_context *ctx = job->ctx;
+   struct gl_linked_shader *sh = job->prog->_LinkedShaders[job->stage];
+   const struct gl_shader_compiler_options *options =
+      &ctx->Const.ShaderCompilerOptions[job->stage];
+
+   if (options->LowerBufferInterfaceBlocks)
+      lower_ubo_reference(sh, options->ClampBlockIndicesToArrayBounds,
+                          ctx->Const.UseSTD430AsDefaultPacking);
+
+   if (job->stage == MESA_SHADER_COMPUTE)
+      lower_shared_reference(ctx, job->prog, sh);
+
+   lower_vector_derefs(sh);
+   do_vec_index_to_swizzle(sh->ir);
+
+   /* Linking varyings can cause some extra, useless swizzles to be generated
+    * due to packing and unpacking.
+    */
+   optimize_swizzles(sh->ir);
+}
+
 void
 link_shaders(struct gl_context *ctx, struct gl_shader_program *prog)
 {
@@ -5048,19 +5156,10 @@ link_shaders(struct gl_context *ctx, struct gl_shader_program *prog)
       if (ctx->Const.LowerTessLevel) {
          lower_tess_level(prog->_LinkedShaders[i]);
       }
-
-      /* Call opts before lowering const arrays to uniforms so we can const
-       * propagate any elements accessed directly.
-       */
-      linker_optimisation_loop(ctx, prog->_LinkedShaders[i]->ir, i);
-
-      /* Call opts after lowering const arrays to copy propagate things. */
-      if (lower_const_arrays_to_uniforms(prog->_LinkedShaders[i]->ir, i))
-         linker_optimisation_loop(ctx, prog->_LinkedShaders[i]->ir, i);
-
-      propagate_invariance(prog->_LinkedShaders[i]->ir);
    }
 
+   link_for_each_stage(ctx, prog, optimize_stage);
+
    /* Validation for special cases where we allow sampler array indexing
     * with loop induction variable. This check emits a warning or error
     * depending if backend can handle dynamic indexing.
@@ -5079,15 +5178,7 @@ link_shaders(struct gl_context *ctx, struct gl_shader_program *prog)
    if(!link_varyings_and_uniforms(first, last, ctx, prog, mem_ctx))
       goto done;
 
-   /* Linking varyings can cause some extra, useless swizzles to be generated
-    * due to packing and unpacking.
-    */
-   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
-      if (prog->_LinkedShaders[i] == NULL)
-         continue;
-
-      optimize_swizzles(prog->_LinkedShaders[i]->ir);
-   }
+   link_for_each_stage(ctx, prog, lower_stage_after_varyings);
 
    /* OpenGL ES < 3.1 requires that a vertex shader and a fragment shader both
     * be present in a linked program. GL_ARB_ES2_compatibility doesn't say
@@ -580,6 +580,18 @@ standalone_compile_shader(const struct standalone_options *_options,
          dv.remove_dead_variables();
       }
 
+      if (options->dump_lir) {
+         for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+            struct gl_linked_shader *shader = whole_program->_LinkedShaders[i];
+
+            if (!shader)
+               continue;
+
+            printf("Linked %s shader:\n", _mesa_shader_stage_to_string(i));
+            _mesa_print_ir(stdout, shader->ir, NULL);
+         }
+      }
+
       if (options->dump_builder) {
          for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
             struct gl_linked_shader *shader = whole_program->_LinkedShaders[i];
@@ -267,6 +267,61 @@ test_overrun(void)
    blob_finish(&blob);
 }
 
+/* Test variable-length integers around the byte boundaries of the encoding
+ * and that truncated or overlong ones are detected.
+ */
+static void
+test_varint(void)
+{
+   static const uint32_t values[] = {
+      0, 1, 0x7f, 0x80, 0x3fff, 0x4000, 0x1fffff, 0x200000,
+      0xfffffff, 0x10000000, 0xffffffff,
+   };
+   static const size_t sizes[] = { 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5 };
+   struct blob blob;
+   struct blob_reader reader;
+   size_t i, last;
+
+   blob_init(&blob);
+
+   /* A varint after an unaligned write must not add any padding. */
+   blob_write_bytes(&blob, "x", 1);
+   last = blob.size;
+
+   for (i = 0; i < ARRAY_SIZE(values); i++) {
+      blob_write_varint(&blob, values[i]);
+      expect_equal(sizes[i], blob.size - last, "size of varint");
+      last = blob.size;
+   }
+
+   blob_reader_init(&reader, blob.data, blob.size);
+   blob_read_bytes(&reader, 1);
+
+   for (i = 0; i < ARRAY_SIZE(values); i++)
+      expect_equal(values[i], blob_read_varint(&reader),
+                   "blob_write/read_varint");
+
+   expect_equal(reader.end - reader.data, reader.current - reader.data,
+                "read_consumes_all_varint_bytes");
+   expect_equal(false, reader.overrun, "varint read does not overrun");
+
+   /* Drop the last byte of the last value. */
+   blob_reader_init(&reader, blob.data, blob.size - 1);
+   blob_read_bytes(&reader, 1);
+   for (i = 0; i < ARRAY_SIZE(values) - 1; i++)
+      blob_read_varint(&reader);
+   expect_equal(0, blob_read_varint(&reader), "read of truncated varint");
+   expect_equal(true, reader.overrun, "overrun flag set by truncated varint");
+
+   blob_finish(&blob);
+
+   /* Six bytes is more than any uint32_t needs. */
+   const uint8_t overlong[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 };
+   blob_reader_init(&reader, overlong, sizeof(overlong));
+   expect_equal(0, blob_read_varint(&reader), "read of overlong varint");
+   expect_equal(true, reader.overrun, "overrun flag set by overlong varint");
+}
+
 /* Test that we can read and write some large objects, (exercising the code in
  * the blob_write functions to realloc blob->data.
  */
@@ -318,6 +373,7 @@ main (void)
    test_write_and_read_functions ();
    test_alignment ();
    test_overrun ();
+   test_varint ();
    test_big_objects ();
 
    return error ? 1 : 0;
@@ -426,6 +426,175 @@ test_put_and_get(void)
    disk_cache_destroy(cache);
 }
 
+static void
+test_packed_put_and_get(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   char string[] = "While this string has thirty-four";
+   uint8_t string_key[20];
+   uint8_t *noise;
+   uint8_t noise_key[20];
+   char *result;
+   size_t size;
+   int count;
+
+   setenv("MESA_GLSL_CACHE_PACKED", "true", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1M", 1);
+   cache = disk_cache_create("test", "make_check_packed", 0);
+   expect_non_null(cache, "disk_cache_create with MESA_GLSL_CACHE_PACKED");
+
+   struct stat sb;
+   expect_equal(stat(CACHE_TEST_TMP "/mesa-glsl-cache-dir/" CACHE_DIR_NAME
+                     "/packed.db", &sb), 0,
+                "disk_cache_create with MESA_GLSL_CACHE_PACKED creates packed.db");
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   disk_cache_compute_key(cache, string, sizeof(string), string_key);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_null(result, "packed disk_cache_get with non-existent item (pointer)");
+   expect_equal(size, 0, "packed disk_cache_get with non-existent item (size)");
+
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_put(cache, string_key, string, sizeof(string), NULL);
+   wait_until_file_written(cache, blob_key);
+   wait_until_file_written(cache, string_key);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "packed disk_cache_get of existing item (pointer)");
+   expect_equal(size, sizeof(blob), "packed disk_cache_get of existing item (size)");
+   free(result);
+
+   result = disk_cache_get(cache, string_key, &size);
+   expect_equal_str(string, result, "2nd packed disk_cache_get of existing item (pointer)");
+   expect_equal(size, sizeof(string), "2nd packed disk_cache_get of existing item (size)");
+   free(result);
+
+   disk_cache_remove(cache, string_key);
+   expect_true(!does_cache_contain(cache, string_key),
+               "packed disk_cache_get of removed item");
+
+   /* Entries survive reopening the cache. */
+   disk_cache_put(cache, string_key, string, sizeof(string), NULL);
+   wait_until_file_written(cache, string_key);
+   disk_cache_destroy(cache);
+
+   /* Set the cache size to 1KB and add an item that doesn't compress and
+    * just fits to force the eviction of both others.
+    */
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1K", 1);
+   cache = disk_cache_create("test", "make_check_packed", 0);
+
+   count = 0;
+   if (does_cache_contain(cache, blob_key))
+      count++;
+
+   if (does_cache_contain(cache, string_key))
+      count++;
+
+   expect_equal(count, 2, "packed entries are kept across disk_cache_create");
+
+   noise = malloc(900);
+   srand(1);
+   for (unsigned i = 0; i < 900; i++)
+      noise[i] = rand();
+
+   disk_cache_compute_key(cache, noise, 900, noise_key);
+   disk_cache_put(cache, noise_key, noise, 900, NULL);
+   wait_until_file_written(cache, noise_key);
+
+   result = disk_cache_get(cache, noise_key, &size);
+   expect_true(result && memcmp(result, noise, 900) == 0,
+               "packed disk_cache_get of item after eviction (pointer)");
+   expect_equal(size, 900, "packed disk_cache_get of item after eviction (size)");
+   free(result);
+   free(noise);
+
+   count = 0;
+   if (does_cache_contain(cache, blob_key))
+      count++;
+
+   if (does_cache_contain(cache, string_key))
+      count++;
+
+   expect_equal(count, 0, "packed eviction with MAX_SIZE=1K");
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_GLSL_CACHE_PACKED");
+   unsetenv("MESA_GLSL_CACHE_MAX_SIZE");
+}
+
+static void
+test_lz4_and_prefetch(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   char string[] = "While this string has thirty-four";
+   uint8_t string_key[20];
+   cache_key keys[2];
+   char *result;
+   size_t size;
+
+   setenv("MESA_GLSL_CACHE_CODEC", "lz4", 1);
+   cache = disk_cache_create("test", "make_check_lz4", 0);
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   disk_cache_compute_key(cache, string, sizeof(string), string_key);
+
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_put(cache, string_key, string, sizeof(string), NULL);
+   wait_until_file_written(cache, blob_key);
+   wait_until_file_written(cache, string_key);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "disk_cache_get with lz4 (pointer)");
+   expect_equal(size, sizeof(blob), "disk_cache_get with lz4 (size)");
+   free(result);
+
+   /* Entries are readable whatever codec new ones get. */
+   disk_cache_destroy(cache);
+   unsetenv("MESA_GLSL_CACHE_CODEC");
+   cache = disk_cache_create("test", "make_check_lz4", 0);
+
+   /* Whether or not the prefetch job ran yet, the gets must see the
+    * items.
+    */
+   memcpy(keys[0], blob_key, sizeof(cache_key));
+   memcpy(keys[1], string_key, sizeof(cache_key));
+   disk_cache_prefetch(cache, keys, 2);
+
+   result = disk_cache_get(cache, string_key, &size);
+   expect_equal_str(string, result, "disk_cache_get after prefetch (pointer)");
+   expect_equal(size, sizeof(string), "disk_cache_get after prefetch (size)");
+   free(result);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "2nd disk_cache_get after prefetch (pointer)");
+   expect_equal(size, sizeof(blob), "2nd disk_cache_get after prefetch (size)");
+   free(result);
+
+   /* A prefetch that is still reading an entry when it gets removed must
+    * not bring it back.
+    */
+   for (unsigned i = 0; i < 20; i++) {
+      disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+      wait_until_file_written(cache, blob_key);
+
+      disk_cache_prefetch(cache, keys, 1);
+      disk_cache_remove(cache, blob_key);
+
+      result = disk_cache_get(cache, blob_key, &size);
+      expect_null(result, "disk_cache_get after prefetch and remove");
+      free(result);
+   }
+
+   disk_cache_destroy(cache);
+}
+
 static void
 test_put_key_and_get_key(void)
 {
@@ -489,6 +658,10 @@ main(void)
 
    test_put_and_get();
 
+   test_packed_put_and_get();
+
+   test_lz4_and_prefetch();
+
    test_put_key_and_get_key();
 
    err = rmrf_local(CACHE_TEST_TMP);
@@ -0,0 +1,70 @@
+#!/bin/sh
+
+if [ -z "$srcdir" -o -z "$abs_builddir" ]; then
+    echo ""
+    echo "Warning: you're invoking the script manually and things may fail."
+    echo "Attempting to determine/set srcdir and abs_builddir variables."
+    echo ""
+
+    # Variable should point to the Makefile.glsl.am
+    srcdir=./../../
+    cd `dirname "$0"`
+    # Variable should point to glsl_compiler
+    abs_builddir=`pwd`/../../
+fi
+
+# Link programs with more than one stage with the stages optimized one after
+# another and in parallel, and check that the linked IR is the same.
+
+compiler=$abs_builddir/glsl_compiler
+total=0
+pass=0
+
+if [ ! -x "$compiler" ]; then
+    echo "Could not find glsl_compiler. Ensure that it is build via make check"
+    exit 1
+fi
+
+tests_relative_dir="glsl/tests/parallel_link"
+
+echo "====== Testing parallel linking ======"
+for test in $srcdir/$tests_relative_dir/*/; do
+    test_output="$abs_builddir/$tests_relative_dir/`basename $test`"
+    mkdir -p $abs_builddir/$tests_relative_dir/
+    echo -n "Testing `basename $test`..."
+    total=$((total+1))
+    if ! MESA_GLSL_PARALLEL_LINK=false $compiler --link --dump-lir \
+            --version 150 $test/shader.* > "$test_output.serial" 2>&1; then
+        echo "FAIL"
+        cat "$test_output.serial"
+        continue
+    fi
+    if ! MESA_GLSL_PARALLEL_LINK=true $compiler --link --dump-lir \
+            --version 150 $test/shader.* > "$test_output.parallel" 2>&1; then
+        echo "FAIL"
+        cat "$test_output.parallel"
+        continue
+    fi
+    if diff "$test_output.serial" "$test_output.parallel" >/dev/null 2>&1; then
+        echo "PASS"
+        pass=$((pass+1))
+    else
+        echo "FAIL"
+        diff "$test_output.serial" "$test_output.parallel"
+    fi
+done
+
+if [ $total -eq 0 ]; then
+    echo "Could not find any tests."
+    exit 1
+fi
+
+echo ""
+echo "$pass/$total tests returned correct results"
+echo ""
+
+if [ $pass = $total ]; then
+    exit 0
+else
+    exit 1
+fi
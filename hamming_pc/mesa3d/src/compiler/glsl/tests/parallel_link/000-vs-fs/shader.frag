@@ -0,0 +1,20 @@
+#version 150
+
+uniform sampler2D tex;
+uniform float threshold;
+
+in vec4 v_color;
+in vec2 v_texcoord;
+
+out vec4 frag_color;
+
+void main()
+{
+   vec4 texel = texture(tex, v_texcoord);
+   float luma = dot(texel.rgb, vec3(0.299, 0.587, 0.114));
+
+   if (luma < threshold)
+      discard;
+
+   frag_color = mix(texel, v_color, 0.25) * 1.0 + vec4(0.0);
+}
@@ -0,0 +1,29 @@
+#version 150
+
+uniform mat4 mvp;
+uniform vec4 weights[4];
+
+in vec4 position;
+in vec4 color;
+
+out vec4 v_color;
+out vec2 v_texcoord;
+out float v_unused;
+
+vec4 blend(vec4 c)
+{
+   vec4 sum = vec4(0.0);
+
+   for (int i = 0; i < 4; i++)
+      sum += c * weights[i];
+
+   return sum;
+}
+
+void main()
+{
+   gl_Position = mvp * position;
+   v_color = blend(color);
+   v_texcoord = position.xy * 0.5 + 0.5;
+   v_unused = position.z;
+}
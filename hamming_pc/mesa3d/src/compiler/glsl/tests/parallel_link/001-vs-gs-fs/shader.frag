@@ -0,0 +1,25 @@
+#version 150
+
+uniform vec3 light_dir;
+uniform vec4 colors[2];
+
+in vec3 gs_normal;
+flat in int gs_layer;
+
+out vec4 frag_color;
+
+float diffuse(vec3 n)
+{
+   return max(dot(normalize(n), -light_dir), 0.0);
+}
+
+void main()
+{
+   vec4 base = colors[gs_layer];
+   float d = 0.0;
+
+   for (int i = 0; i < 2; i++)
+      d += diffuse(gs_normal) * 0.5;
+
+   frag_color = vec4(base.rgb * d, base.a);
+}
@@ -0,0 +1,18 @@
+#version 150
+
+uniform mat4 mvp;
+
+in vec4 position;
+in vec3 normal;
+
+out vec3 vs_normal;
+out float vs_depth;
+
+void main()
+{
+   vec4 pos = mvp * position;
+
+   gl_Position = pos;
+   vs_normal = normalize(normal);
+   vs_depth = pos.z / pos.w;
+}
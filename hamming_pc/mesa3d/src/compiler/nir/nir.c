@@ -27,8 +27,26 @@
 
 #include "nir.h"
 #include "nir_control_flow_private.h"
+#include "util/debug.h"
+#include "c11/threads.h"
 #include <assert.h>
 
+static once_flag use_pool_once_flag = ONCE_FLAG_INIT;
+static bool use_pool;
+
+static void
+init_use_pool(void)
+{
+   use_pool = env_var_as_boolean("NIR_POOL", true);
+}
+
+static void
+shader_destructor(void *ptr)
+{
+   nir_shader *shader = ptr;
+   ralloc_pool_destroy(shader->pool);
+}
+
 nir_shader *
 nir_shader_create(void *mem_ctx,
                   gl_shader_stage stage,
@@ -62,9 +80,38 @@ nir_shader_create(void *mem_ctx,
    shader->num_uniforms = 0;
    shader->num_shared = 0;
 
+   /* Instructions and control flow nodes come and go all the time while
+    * optimizing, so take them from a pool with free lists per size instead
+    * of malloc.  NIR_POOL=false goes back to plain ralloc for comparison.
+    * Shaders get created on compiler threads too.
+    */
+   call_once(&use_pool_once_flag, init_use_pool);
+
+   if (use_pool) {
+      shader->pool = ralloc_pool_create();
+      ralloc_set_destructor(shader, shader_destructor);
+   }
+
    return shader;
 }
 
+/* Allocates a node which belongs to the shader, from its pool if it has one. */
+static void *
+node_alloc(nir_shader *shader, size_t size)
+{
+   if (shader->pool)
+      return ralloc_pool_size(shader->pool, shader, size);
+   return ralloc_size(shader, size);
+}
+
+static void *
+node_zalloc(nir_shader *shader, size_t size)
+{
+   if (shader->pool)
+      return rzalloc_pool_size(shader->pool, shader, size);
+   return rzalloc_size(shader, size);
+}
+
 static nir_register *
 reg_create(void *mem_ctx, struct exec_list *list)
 {
@@ -341,7 +388,7 @@ nir_function_impl_create(nir_function *function)
 nir_block *
 nir_block_create(nir_shader *shader)
 {
-   nir_block *block = rzalloc(shader, nir_block);
+   nir_block *block = node_zalloc(shader, sizeof(nir_block));
 
    cf_init(&block->cf_node, nir_cf_node_block);
 
@@ -377,7 +424,7 @@ src_init(nir_src *src)
 nir_if *
 nir_if_create(nir_shader *shader)
 {
-   nir_if *if_stmt = ralloc(shader, nir_if);
+   nir_if *if_stmt = node_alloc(shader, sizeof(nir_if));
 
    cf_init(&if_stmt->cf_node, nir_cf_node_if);
    src_init(&if_stmt->condition);
@@ -398,7 +445,7 @@ nir_if_create(nir_shader *shader)
 nir_loop *
 nir_loop_create(nir_shader *shader)
 {
-   nir_loop *loop = rzalloc(shader, nir_loop);
+   nir_loop *loop = node_zalloc(shader, sizeof(nir_loop));
 
    cf_init(&loop->cf_node, nir_cf_node_loop);
 
@@ -455,8 +502,8 @@ nir_alu_instr_create(nir_shader *shader, nir_op op)
    unsigned num_srcs = nir_op_infos[op].num_inputs;
    /* TODO: don't use rzalloc */
    nir_alu_instr *instr =
-      rzalloc_size(shader,
-                   sizeof(nir_alu_instr) + num_srcs * sizeof(nir_alu_src));
+      node_zalloc(shader,
+                  sizeof(nir_alu_instr) + num_srcs * sizeof(nir_alu_src));
 
    instr_init(&instr->instr, nir_instr_type_alu);
    instr->op = op;
@@ -470,7 +517,7 @@ nir_alu_instr_create(nir_shader *shader, nir_op op)
 nir_jump_instr *
 nir_jump_instr_create(nir_shader *shader, nir_jump_type type)
 {
-   nir_jump_instr *instr = ralloc(shader, nir_jump_instr);
+   nir_jump_instr *instr = node_alloc(shader, sizeof(nir_jump_instr));
    instr_init(&instr->instr, nir_instr_type_jump);
    instr->type = type;
    return instr;
@@ -480,7 +527,8 @@ nir_load_const_instr *
 nir_load_const_instr_create(nir_shader *shader, unsigned num_components,
                             unsigned bit_size)
 {
-   nir_load_const_instr *instr = rzalloc(shader, nir_load_const_instr);
+   nir_load_const_instr *instr =
+      node_zalloc(shader, sizeof(nir_load_const_instr));
    instr_init(&instr->instr, nir_instr_type_load_const);
 
    nir_ssa_def_init(&instr->instr, &instr->def, num_components, bit_size, NULL);
@@ -494,7 +542,7 @@ nir_intrinsic_instr_create(nir_shader *shader, nir_intrinsic_op op)
    unsigned num_srcs = nir_intrinsic_infos[op].num_srcs;
    /* TODO: don't use rzalloc */
    nir_intrinsic_instr *instr =
-      rzalloc_size(shader,
+      node_zalloc(shader,
                   sizeof(nir_intrinsic_instr) + num_srcs * sizeof(nir_src));
 
    instr_init(&instr->instr, nir_instr_type_intrinsic);
@@ -512,7 +560,7 @@ nir_intrinsic_instr_create(nir_shader *shader, nir_intrinsic_op op)
 nir_call_instr *
 nir_call_instr_create(nir_shader *shader, nir_function *callee)
 {
-   nir_call_instr *instr = ralloc(shader, nir_call_instr);
+   nir_call_instr *instr = node_alloc(shader, sizeof(nir_call_instr));
    instr_init(&instr->instr, nir_instr_type_call);
 
    instr->callee = callee;
@@ -526,7 +574,7 @@ nir_call_instr_create(nir_shader *shader, nir_function *callee)
 nir_tex_instr *
 nir_tex_instr_create(nir_shader *shader, unsigned num_srcs)
 {
-   nir_tex_instr *instr = rzalloc(shader, nir_tex_instr);
+   nir_tex_instr *instr = node_zalloc(shader, sizeof(nir_tex_instr));
    instr_init(&instr->instr, nir_instr_type_tex);
 
    dest_init(&instr->dest);
@@ -586,7 +634,7 @@ nir_tex_instr_remove_src(nir_tex_instr *tex, unsigned src_idx)
 nir_phi_instr *
 nir_phi_instr_create(nir_shader *shader)
 {
-   nir_phi_instr *instr = ralloc(shader, nir_phi_instr);
+   nir_phi_instr *instr = node_alloc(shader, sizeof(nir_phi_instr));
    instr_init(&instr->instr, nir_instr_type_phi);
 
    dest_init(&instr->dest);
@@ -597,7 +645,8 @@ nir_phi_instr_create(nir_shader *shader)
 nir_parallel_copy_instr *
 nir_parallel_copy_instr_create(nir_shader *shader)
 {
-   nir_parallel_copy_instr *instr = ralloc(shader, nir_parallel_copy_instr);
+   nir_parallel_copy_instr *instr =
+      node_alloc(shader, sizeof(nir_parallel_copy_instr));
    instr_init(&instr->instr, nir_instr_type_parallel_copy);
 
    exec_list_make_empty(&instr->entries);
@@ -610,7 +659,7 @@ nir_ssa_undef_instr_create(nir_shader *shader,
                            unsigned num_components,
                            unsigned bit_size)
 {
-   nir_ssa_undef_instr *instr = ralloc(shader, nir_ssa_undef_instr);
+   nir_ssa_undef_instr *instr = node_alloc(shader, sizeof(nir_ssa_undef_instr));
    instr_init(&instr->instr, nir_instr_type_ssa_undef);
 
    nir_ssa_def_init(&instr->instr, &instr->def, num_components, bit_size, NULL);
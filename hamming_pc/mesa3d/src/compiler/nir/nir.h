@@ -1929,6 +1929,13 @@ typedef struct nir_shader {
    /** list of global register in the shader */
    struct exec_list registers;
 
+   /**
+    * Pool the instructions and control flow nodes are allocated from, or
+    * NULL if they are plain ralloc allocations.  Either way they are ralloc
+    * children of the shader.
+    */
+   struct ralloc_pool *pool;
+
    /** next available global register index */
    unsigned reg_alloc;
 
@@ -25,6 +25,7 @@
 
 from __future__ import print_function
 import ast
+from collections import defaultdict
 import itertools
 import struct
 import sys
@@ -495,6 +496,213 @@ class SearchAndReplace(object):
 
       BitSizeValidator(varset).validate(self.search, self.replace)
 
+class IndexMap(object):
+   """An ordered set that also gives each of its objects a stable index.
+
+   Looking up the index of an object is a dictionary lookup rather than a
+   linear search, and iteration follows insertion order.
+   """
+   def __init__(self):
+      self.objects = []
+      self.map = {}
+
+   def __getitem__(self, i):
+      return self.objects[i]
+
+   def __contains__(self, obj):
+      return obj in self.map
+
+   def __len__(self):
+      return len(self.objects)
+
+   def __iter__(self):
+      return iter(self.objects)
+
+   def index(self, obj):
+      return self.map[obj]
+
+   def clear(self):
+      self.objects = []
+      self.map.clear()
+
+   def add(self, obj):
+      if obj not in self.map:
+         self.map[obj] = len(self.objects)
+         self.objects.append(obj)
+      return self.map[obj]
+
+class TreeAutomaton(object):
+   """A bottom-up tree automaton recognizing the search expressions of a pass.
+
+   Instead of trying every transform for an opcode one at a time, the
+   generated pass first labels each ALU instruction with a state, computed
+   from its opcode and the states of its sources with a single table lookup.
+   A state stands for the set of pattern subtrees ("items") which might
+   match the instruction, and the transforms worth trying on an instruction
+   are exactly the ones whose search expression is in its state.
+
+   The automaton only looks at the shape of the expressions: variables match
+   anything, constants and '#' variables match any load_const, and things
+   like bit sizes, conditions and repeated variables are left to
+   nir_replace_instr().  A state can therefore only ever contain too many
+   items, never too few, so the pass makes exactly the same replacements as
+   trying every transform would.
+
+   The tables are built with the reachability-based tabulation of algorithm
+   5.7.38 in Loek Cleophas, "Tree Algorithms: Two Taxonomies and a Toolkit"
+   (2008), where the transitions of each opcode are indexed by "filtered"
+   source states.  Filtering a state for an opcode drops the items which
+   never appear as a source of that opcode, which keeps the number of rows
+   in each table small.
+   """
+
+   class Item(object):
+      """A subtree of some search expression, shared between patterns."""
+      def __init__(self, opcode, children):
+         self.opcode = opcode
+         self.children = children
+         # Indices of the patterns whose search expression this item is.
+         self.patterns = []
+         # Opcodes of the items this item is a source of.
+         self.parent_ops = set()
+
+      def __repr__(self):
+         return '(' + ', '.join([self.opcode] +
+                                [repr(c) for c in self.children]) + ')'
+
+   # State of anything that is not an ALU instruction or load_const, which
+   # only matches variables.  Also the state of every SSA def before the
+   # automaton runs, so it has to be zero.
+   WILDCARD_STATE = 0
+   # State of load_const instructions.
+   CONST_STATE = 1
+
+   def __init__(self, patterns):
+      self.patterns = patterns
+      self._compute_items()
+      self._build_table()
+
+   def _get_item(self, opcode, children, pattern=None):
+      item = self.items.get((opcode, children))
+      if item is None:
+         item = self.Item(opcode, children)
+         self.items[opcode, children] = item
+         # nir_search tries both source orders of commutative opcodes.
+         if len(children) == 2 and \
+            'commutative' in opcodes[opcode].algebraic_properties:
+            self.items[opcode, (children[1], children[0])] = item
+      if pattern is not None:
+         item.patterns.append(pattern)
+      return item
+
+   def _process_subpattern(self, value, pattern=None):
+      if isinstance(value, Constant):
+         return self.const
+      elif isinstance(value, Variable):
+         return self.const if value.is_constant else self.wildcard
+
+      assert isinstance(value, Expression)
+      self.opcodes.add(value.opcode)
+      children = tuple(self._process_subpattern(src) for src in value.sources)
+      for child in children:
+         child.parent_ops.add(value.opcode)
+      return self._get_item(value.opcode, children, pattern)
+
+   def _compute_items(self):
+      # Map from (opcode, source items) to item, with both source orders of
+      # commutative opcodes mapping to the same item.
+      self.items = {}
+      # Every opcode used by some search expression.  The others don't get
+      # a table and always end up in WILDCARD_STATE.
+      self.opcodes = IndexMap()
+
+      self.wildcard = self._get_item('__wildcard', ())
+      self.const = self._get_item('__const', ())
+
+      for i, pattern in enumerate(self.patterns):
+         self._process_subpattern(pattern, i)
+
+   def _build_table(self):
+      # Every reachable state, as a frozenset of items.
+      self.states = IndexMap()
+      # The patterns in each state, in the order they were given.
+      self.state_patterns = []
+      # For each opcode, the filtered state index of every state.
+      self.filter = defaultdict(list)
+      # For each opcode, every filtered state as a frozenset of items.
+      self.rep = defaultdict(IndexMap)
+      # For each opcode, the transitions from tuples of filtered source
+      # states to the resulting state.
+      self.table = defaultdict(dict)
+
+      # States with an index of at least num_processed have not been
+      # filtered yet, and for each opcode the filtered states with an index
+      # of at least num_tabulated[op] have not been used to build its table.
+      num_processed = [0]
+      num_tabulated = defaultdict(int)
+      new_opcodes = IndexMap()
+
+      def process_new_states():
+         while num_processed[0] < len(self.states):
+            state = self.states[num_processed[0]]
+
+            patterns = sorted(p for item in state for p in item.patterns)
+            assert len(patterns) < 2**16
+            self.state_patterns.append(patterns)
+
+            for op in self.opcodes:
+               filtered = frozenset(item for item in state
+                                    if op in item.parent_ops)
+               if filtered not in self.rep[op]:
+                  new_opcodes.add(op)
+               self.filter[op].append(self.rep[op].add(filtered))
+
+            num_processed[0] += 1
+
+      self.states.add(frozenset([self.wildcard]))
+      self.states.add(frozenset([self.wildcard, self.const]))
+      assert self.states.index(frozenset([self.wildcard])) == \
+         self.WILDCARD_STATE
+      assert self.states.index(frozenset([self.wildcard, self.const])) == \
+         self.CONST_STATE
+      process_new_states()
+
+      while len(new_opcodes) > 0:
+         for op in new_opcodes:
+            rep = self.rep[op]
+            table = self.table[op]
+            num_srcs = opcodes[op].num_inputs
+
+            # Only source combinations with at least one filtered state that
+            # is new since the last time around need to be looked at.
+            for srcs in itertools.product(range(len(rep)), repeat=num_srcs):
+               if all(src < num_tabulated[op] for src in srcs):
+                  continue
+
+               state = set(self.items[op, children]
+                           for children in itertools.product(*[rep[src]
+                                                               for src in srcs])
+                           if (op, children) in self.items)
+               # Anything can be matched by a variable.
+               state.add(self.wildcard)
+
+               table[srcs] = self.states.add(frozenset(state))
+
+            num_tabulated[op] = len(rep)
+
+         new_opcodes.clear()
+         process_new_states()
+
+      assert len(self.states) < 2**16
+      assert sum(len(p) for p in self.state_patterns) < 2**16
+
+   def flat_table(self, op):
+      """The transitions of op in the order of itertools.product(), which is
+      the order the generated pass computes its indices in."""
+      num_srcs = opcodes[op].num_inputs
+      return [self.table[op][srcs] for srcs in
+              itertools.product(range(len(self.rep[op])), repeat=num_srcs)]
+
 _algebraic_pass_template = mako.template.Template("""
 #include "nir.h"
 #include "nir_search.h"
@@ -509,21 +717,157 @@ struct transform {
    unsigned condition_offset;
 };
 
+/* The transforms worth trying on an instruction in a given automaton state,
+ * as a range of an array of transform indices.
+ */
+struct state_xforms {
+   uint16_t first;
+   uint16_t count;
+};
+
+/* The automaton transitions for one opcode.  The new state of an
+ * instruction is table[] indexed by the filtered states of its sources,
+ * with the first source being the most significant digit.
+ */
+struct per_op_table {
+   const uint16_t *filter;
+   unsigned num_filtered_states;
+   const uint16_t *table;
+};
+
+#define WILDCARD_STATE ${TreeAutomaton.WILDCARD_STATE}
+#define CONST_STATE ${TreeAutomaton.CONST_STATE}
+
 #endif
 
-% for (opcode, xform_list) in xform_dict.iteritems():
-% for xform in xform_list:
+% for xform in xforms:
    ${xform.search.render()}
    ${xform.replace.render()}
 % endfor
 
+% if automaton:
+static const struct transform ${pass_name}_xforms[] = {
+% for xform in xforms:
+   { &${xform.search.name}, ${xform.replace.c_ptr}, ${xform.condition_index} },
+% endfor
+};
+
+static const uint16_t ${pass_name}_state_xform_list[] = {
+% for i, patterns in enumerate(automaton.state_patterns):
+% if patterns:
+   ${', '.join(str(p) for p in patterns)}, /* state ${i} */
+% endif
+% endfor
+};
+
+<% first = 0 %>\\
+static const struct state_xforms ${pass_name}_state_xforms[] = {
+% for patterns in automaton.state_patterns:
+   { ${first}, ${len(patterns)} },
+<% first += len(patterns) %>\\
+% endfor
+};
+
+% for op in automaton.opcodes:
+static const uint16_t ${pass_name}_${op}_filter[] = {
+   ${', '.join(str(s) for s in automaton.filter[op])}
+};
+
+static const uint16_t ${pass_name}_${op}_table[] = {
+   ${', '.join(str(s) for s in automaton.flat_table(op))}
+};
+
+% endfor
+static const struct per_op_table ${pass_name}_table[nir_num_opcodes] = {
+% for op in automaton.opcodes:
+   [nir_op_${op}] = {
+      ${pass_name}_${op}_filter,
+      ${len(automaton.rep[op])},
+      ${pass_name}_${op}_table,
+   },
+% endfor
+};
+
+static void
+${pass_name}_pre_block(nir_block *block, uint16_t *states)
+{
+   nir_foreach_instr(instr, block) {
+      switch (instr->type) {
+      case nir_instr_type_alu: {
+         nir_alu_instr *alu = nir_instr_as_alu(instr);
+         const struct per_op_table *tbl = &${pass_name}_table[alu->op];
+         if (!alu->dest.dest.is_ssa || tbl->num_filtered_states == 0)
+            break;
+
+         unsigned index = 0;
+         for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+            const nir_src *src = &alu->src[i].src;
+            index *= tbl->num_filtered_states;
+            index += tbl->filter[src->is_ssa ? states[src->ssa->index] :
+                                               WILDCARD_STATE];
+         }
+         states[alu->dest.dest.ssa.index] = tbl->table[index];
+         break;
+      }
+
+      case nir_instr_type_load_const:
+         states[nir_instr_as_load_const(instr)->def.index] = CONST_STATE;
+         break;
+
+      default:
+         break;
+      }
+   }
+}
+% else:
+% for opcode in opcodes:
 static const struct transform ${pass_name}_${opcode}_xforms[] = {
-% for xform in xform_list:
+% for xform in xforms:
+% if xform.search.opcode == opcode:
    { &${xform.search.name}, ${xform.replace.c_ptr}, ${xform.condition_index} },
+% endif
 % endfor
 };
+
 % endfor
+% endif
+
+% if automaton:
+static bool
+${pass_name}_block(nir_block *block, const uint16_t *states,
+                   const bool *condition_flags, void *mem_ctx)
+{
+   bool progress = false;
+
+   /* Instructions added by nir_replace_instr() go right before the one
+    * being replaced, so the safe iterator never visits them and every
+    * instruction we look at has a state.
+    */
+   nir_foreach_instr_reverse_safe(instr, block) {
+      if (instr->type != nir_instr_type_alu)
+         continue;
+
+      nir_alu_instr *alu = nir_instr_as_alu(instr);
+      if (!alu->dest.dest.is_ssa)
+         continue;
 
+      const struct state_xforms *range =
+         &${pass_name}_state_xforms[states[alu->dest.dest.ssa.index]];
+      for (unsigned i = 0; i < range->count; i++) {
+         const struct transform *xform =
+            &${pass_name}_xforms[${pass_name}_state_xform_list[range->first + i]];
+         if (condition_flags[xform->condition_offset] &&
+             nir_replace_instr(alu, xform->search, xform->replace,
+                               mem_ctx)) {
+            progress = true;
+            break;
+         }
+      }
+   }
+
+   return progress;
+}
+% else:
 static bool
 ${pass_name}_block(nir_block *block, const bool *condition_flags,
                    void *mem_ctx)
@@ -539,7 +883,7 @@ ${pass_name}_block(nir_block *block, const bool *condition_flags,
          continue;
 
       switch (alu->op) {
-      % for opcode in xform_dict.keys():
+      % for opcode in opcodes:
       case nir_op_${opcode}:
          for (unsigned i = 0; i < ARRAY_SIZE(${pass_name}_${opcode}_xforms); i++) {
             const struct transform *xform = &${pass_name}_${opcode}_xforms[i];
@@ -559,6 +903,7 @@ ${pass_name}_block(nir_block *block, const bool *condition_flags,
 
    return progress;
 }
+% endif
 
 static bool
 ${pass_name}_impl(nir_function_impl *impl, const bool *condition_flags)
@@ -566,9 +911,26 @@ ${pass_name}_impl(nir_function_impl *impl, const bool *condition_flags)
    void *mem_ctx = ralloc_parent(impl);
    bool progress = false;
 
+% if automaton:
+   /* Zeroing the states leaves everything we don't visit below in
+    * WILDCARD_STATE.
+    */
+   uint16_t *states = calloc(impl->ssa_alloc, sizeof(*states));
+
+   nir_foreach_block(block, impl) {
+      ${pass_name}_pre_block(block, states);
+   }
+
+   nir_foreach_block_reverse(block, impl) {
+      progress |= ${pass_name}_block(block, states, condition_flags, mem_ctx);
+   }
+
+   free(states);
+% else:
    nir_foreach_block_reverse(block, impl) {
       progress |= ${pass_name}_block(block, condition_flags, mem_ctx);
    }
+% endif
 
    if (progress)
       nir_metadata_preserve(impl, nir_metadata_block_index |
@@ -600,8 +962,16 @@ ${pass_name}(nir_shader *shader)
 """)
 
 class AlgebraicPass(object):
-   def __init__(self, pass_name, transforms):
-      self.xform_dict = {}
+   """An algebraic optimization pass made of a list of transforms.
+
+   By default the generated pass finds the transforms to try on each
+   instruction with a TreeAutomaton.  With automaton=False it tries every
+   transform for the opcode of the instruction in turn instead, which is
+   only useful for checking the automaton against.
+   """
+   def __init__(self, pass_name, transforms, automaton=True):
+      self.xforms = []
+      self.opcodes = IndexMap()
       self.pass_name = pass_name
 
       error = False
@@ -618,15 +988,22 @@ class AlgebraicPass(object):
                error = True
                continue
 
-         if xform.search.opcode not in self.xform_dict:
-            self.xform_dict[xform.search.opcode] = []
-
-         self.xform_dict[xform.search.opcode].append(xform)
+         self.xforms.append(xform)
+         self.opcodes.add(xform.search.opcode)
 
       if error:
          sys.exit(1)
 
+      if automaton:
+         self.automaton = TreeAutomaton([xform.search
+                                         for xform in self.xforms])
+      else:
+         self.automaton = None
+
    def render(self):
       return _algebraic_pass_template.render(pass_name=self.pass_name,
-                                             xform_dict=self.xform_dict,
+                                             xforms=self.xforms,
+                                             opcodes=self.opcodes,
+                                             automaton=self.automaton,
+                                             TreeAutomaton=TreeAutomaton,
                                              condition_list=condition_list)
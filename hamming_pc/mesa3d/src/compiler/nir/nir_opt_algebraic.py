@@ -24,6 +24,7 @@
 #    Jason Ekstrand (jason@jlekstrand.net)
 
 import nir_algebraic
+import sys
 
 # Convenience variables
 a = 'a'
@@ -587,8 +588,17 @@ late_optimizations = [
    (('fmax', ('fadd(is_used_once)', '#c', a), ('fadd(is_used_once)', '#c', b)), ('fadd', c, ('fmax', a, b))),
 ]
 
-print nir_algebraic.AlgebraicPass("nir_opt_algebraic", optimizations).render()
-print nir_algebraic.AlgebraicPass("nir_opt_algebraic_before_ffma",
-                                  before_ffma_optimizations).render()
-print nir_algebraic.AlgebraicPass("nir_opt_algebraic_late",
-                                  late_optimizations).render()
+# With --linear, generate the passes without the tree automaton and with a
+# _linear suffix, for tests/algebraic_bench.c to compare against.
+linear = '--linear' in sys.argv[1:]
+suffix = '_linear' if linear else ''
+
+print nir_algebraic.AlgebraicPass("nir_opt_algebraic" + suffix,
+                                  optimizations,
+                                  automaton=not linear).render()
+print nir_algebraic.AlgebraicPass("nir_opt_algebraic_before_ffma" + suffix,
+                                  before_ffma_optimizations,
+                                  automaton=not linear).render()
+print nir_algebraic.AlgebraicPass("nir_opt_algebraic_late" + suffix,
+                                  late_optimizations,
+                                  automaton=not linear).render()
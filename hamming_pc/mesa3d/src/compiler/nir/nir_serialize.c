@@ -26,7 +26,6 @@
 #include "util/u_dynarray.h"
 
 typedef struct {
-   size_t blob_offset;
    nir_ssa_def *src;
    nir_block *block;
 } write_phi_fixup;
@@ -42,8 +41,12 @@ typedef struct {
    /* the next index to assign to a NIR in-memory object */
    uintptr_t next_idx;
 
-   /* Array of write_phi_fixup structs representing phi sources that need to
-    * be resolved in the second pass.
+   /* maps glsl_type pointer to index + 1 */
+   struct hash_table *type_table;
+   uint32_t num_types;
+
+   /* Array of write_phi_fixup structs representing phi sources, which are
+    * written after the rest of the function.
     */
    struct util_dynarray phi_fixups;
 } write_ctx;
@@ -62,6 +65,9 @@ typedef struct {
    /* map from index to deserialized pointer */
    void **idx_table;
 
+   /* Array of the glsl_type pointers seen so far */
+   struct util_dynarray types;
+
    /* List of phi sources. */
    struct list_head phi_srcs;
 
@@ -85,7 +91,7 @@ write_lookup_object(write_ctx *ctx, const void *obj)
 static void
 write_object(write_ctx *ctx, const void *obj)
 {
-   blob_write_intptr(ctx->blob, write_lookup_object(ctx, obj));
+   blob_write_varint(ctx->blob, write_lookup_object(ctx, obj));
 }
 
 static void
@@ -105,14 +111,58 @@ read_lookup_object(read_ctx *ctx, uintptr_t idx)
 static void *
 read_object(read_ctx *ctx)
 {
-   return read_lookup_object(ctx, blob_read_intptr(ctx->blob));
+   return read_lookup_object(ctx, blob_read_varint(ctx->blob));
+}
+
+/* Types are shared by lots of variables and derefs, so each one is only
+ * encoded the first time it shows up and referred to by its index after
+ * that.  Index 0 is NULL and the index one past the last type seen so far
+ * introduces a new type.
+ */
+static void
+write_type(write_ctx *ctx, const struct glsl_type *type)
+{
+   if (type == NULL) {
+      blob_write_varint(ctx->blob, 0);
+      return;
+   }
+
+   struct hash_entry *entry = _mesa_hash_table_search(ctx->type_table, type);
+   if (entry) {
+      blob_write_varint(ctx->blob, (uintptr_t) entry->data);
+      return;
+   }
+
+   uint32_t index = ++ctx->num_types;
+   _mesa_hash_table_insert(ctx->type_table, type, (void *)(uintptr_t) index);
+   blob_write_varint(ctx->blob, index);
+   encode_type_to_blob(ctx->blob, type);
+}
+
+static const struct glsl_type *
+read_type(read_ctx *ctx)
+{
+   uint32_t index = blob_read_varint(ctx->blob);
+   unsigned num_types = ctx->types.size / sizeof(const struct glsl_type *);
+   if (index == 0)
+      return NULL;
+
+   if (index == num_types + 1) {
+      const struct glsl_type *type = decode_type_from_blob(ctx->blob);
+      util_dynarray_append(&ctx->types, const struct glsl_type *, type);
+      return type;
+   }
+
+   assert(index <= num_types);
+   return *util_dynarray_element(&ctx->types, const struct glsl_type *,
+                                 index - 1);
 }
 
 static void
 write_constant(write_ctx *ctx, const nir_constant *c)
 {
    blob_write_bytes(ctx->blob, c->values, sizeof(c->values));
-   blob_write_uint32(ctx->blob, c->num_elements);
+   blob_write_varint(ctx->blob, c->num_elements);
    for (unsigned i = 0; i < c->num_elements; i++)
       write_constant(ctx, c->elements[i]);
 }
@@ -123,7 +173,7 @@ read_constant(read_ctx *ctx, nir_variable *nvar)
    nir_constant *c = ralloc(nvar, nir_constant);
 
    blob_copy_bytes(ctx->blob, (uint8_t *)c->values, sizeof(c->values));
-   c->num_elements = blob_read_uint32(ctx->blob);
+   c->num_elements = blob_read_varint(ctx->blob);
    c->elements = ralloc_array(ctx->nir, nir_constant *, c->num_elements);
    for (unsigned i = 0; i < c->num_elements; i++)
       c->elements[i] = read_constant(ctx, nvar);
@@ -135,19 +185,19 @@ static void
 write_variable(write_ctx *ctx, const nir_variable *var)
 {
    write_add_object(ctx, var);
-   encode_type_to_blob(ctx->blob, var->type);
-   blob_write_uint32(ctx->blob, !!(var->name));
-   blob_write_string(ctx->blob, var->name);
+   write_type(ctx, var->type);
+   write_type(ctx, var->interface_type);
+   uint32_t flags = !!(var->name);
+   flags |= !!(var->constant_initializer) << 1;
+   blob_write_varint(ctx->blob, flags);
+   if (var->name)
+      blob_write_string(ctx->blob, var->name);
    blob_write_bytes(ctx->blob, (uint8_t *) &var->data, sizeof(var->data));
-   blob_write_uint32(ctx->blob, var->num_state_slots);
+   blob_write_varint(ctx->blob, var->num_state_slots);
    blob_write_bytes(ctx->blob, (uint8_t *) var->state_slots,
                     var->num_state_slots * sizeof(nir_state_slot));
-   blob_write_uint32(ctx->blob, !!(var->constant_initializer));
    if (var->constant_initializer)
       write_constant(ctx, var->constant_initializer);
-   blob_write_uint32(ctx->blob, !!(var->interface_type));
-   if (var->interface_type)
-      encode_type_to_blob(ctx->blob, var->interface_type);
 }
 
 static nir_variable *
@@ -156,29 +206,24 @@ read_variable(read_ctx *ctx)
    nir_variable *var = rzalloc(ctx->nir, nir_variable);
    read_add_object(ctx, var);
 
-   var->type = decode_type_from_blob(ctx->blob);
-   bool has_name = blob_read_uint32(ctx->blob);
-   if (has_name) {
+   var->type = read_type(ctx);
+   var->interface_type = read_type(ctx);
+   uint32_t flags = blob_read_varint(ctx->blob);
+   if (flags & 0x1) {
       const char *name = blob_read_string(ctx->blob);
       var->name = ralloc_strdup(var, name);
    } else {
       var->name = NULL;
    }
    blob_copy_bytes(ctx->blob, (uint8_t *) &var->data, sizeof(var->data));
-   var->num_state_slots = blob_read_uint32(ctx->blob);
+   var->num_state_slots = blob_read_varint(ctx->blob);
    var->state_slots = ralloc_array(var, nir_state_slot, var->num_state_slots);
    blob_copy_bytes(ctx->blob, (uint8_t *) var->state_slots,
                    var->num_state_slots * sizeof(nir_state_slot));
-   bool has_const_initializer = blob_read_uint32(ctx->blob);
-   if (has_const_initializer)
+   if (flags & 0x2)
       var->constant_initializer = read_constant(ctx, var);
    else
       var->constant_initializer = NULL;
-   bool has_interface_type = blob_read_uint32(ctx->blob);
-   if (has_interface_type)
-      var->interface_type = decode_type_from_blob(ctx->blob);
-   else
-      var->interface_type = NULL;
 
    return var;
 }
@@ -186,7 +231,7 @@ read_variable(read_ctx *ctx)
 static void
 write_var_list(write_ctx *ctx, const struct exec_list *src)
 {
-   blob_write_uint32(ctx->blob, exec_list_length(src));
+   blob_write_varint(ctx->blob, exec_list_length(src));
    foreach_list_typed(nir_variable, var, node, src) {
       write_variable(ctx, var);
    }
@@ -196,7 +241,7 @@ static void
 read_var_list(read_ctx *ctx, struct exec_list *dst)
 {
    exec_list_make_empty(dst);
-   unsigned num_vars = blob_read_uint32(ctx->blob);
+   unsigned num_vars = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < num_vars; i++) {
       nir_variable *var = read_variable(ctx);
       exec_list_push_tail(dst, &var->node);
@@ -207,14 +252,14 @@ static void
 write_register(write_ctx *ctx, const nir_register *reg)
 {
    write_add_object(ctx, reg);
-   blob_write_uint32(ctx->blob, reg->num_components);
-   blob_write_uint32(ctx->blob, reg->bit_size);
-   blob_write_uint32(ctx->blob, reg->num_array_elems);
-   blob_write_uint32(ctx->blob, reg->index);
-   blob_write_uint32(ctx->blob, !!(reg->name));
+   blob_write_varint(ctx->blob, reg->num_components);
+   blob_write_varint(ctx->blob, reg->bit_size);
+   blob_write_varint(ctx->blob, reg->num_array_elems);
+   blob_write_varint(ctx->blob, reg->index);
+   blob_write_varint(ctx->blob, !!(reg->name) << 2 | reg->is_global << 1 |
+                                reg->is_packed);
    if (reg->name)
       blob_write_string(ctx->blob, reg->name);
-   blob_write_uint32(ctx->blob, reg->is_global << 1 | reg->is_packed);
 }
 
 static nir_register *
@@ -222,20 +267,19 @@ read_register(read_ctx *ctx)
 {
    nir_register *reg = ralloc(ctx->nir, nir_register);
    read_add_object(ctx, reg);
-   reg->num_components = blob_read_uint32(ctx->blob);
-   reg->bit_size = blob_read_uint32(ctx->blob);
-   reg->num_array_elems = blob_read_uint32(ctx->blob);
-   reg->index = blob_read_uint32(ctx->blob);
-   bool has_name = blob_read_uint32(ctx->blob);
-   if (has_name) {
+   reg->num_components = blob_read_varint(ctx->blob);
+   reg->bit_size = blob_read_varint(ctx->blob);
+   reg->num_array_elems = blob_read_varint(ctx->blob);
+   reg->index = blob_read_varint(ctx->blob);
+   unsigned flags = blob_read_varint(ctx->blob);
+   reg->is_global = flags & 0x2;
+   reg->is_packed = flags & 0x1;
+   if (flags & 0x4) {
       const char *name = blob_read_string(ctx->blob);
       reg->name = ralloc_strdup(reg, name);
    } else {
       reg->name = NULL;
    }
-   unsigned flags = blob_read_uint32(ctx->blob);
-   reg->is_global = flags & 0x2;
-   reg->is_packed = flags & 0x1;
 
    list_inithead(&reg->uses);
    list_inithead(&reg->defs);
@@ -247,7 +291,7 @@ read_register(read_ctx *ctx)
 static void
 write_reg_list(write_ctx *ctx, const struct exec_list *src)
 {
-   blob_write_uint32(ctx->blob, exec_list_length(src));
+   blob_write_varint(ctx->blob, exec_list_length(src));
    foreach_list_typed(nir_register, reg, node, src)
       write_register(ctx, reg);
 }
@@ -256,7 +300,7 @@ static void
 read_reg_list(read_ctx *ctx, struct exec_list *dst)
 {
    exec_list_make_empty(dst);
-   unsigned num_regs = blob_read_uint32(ctx->blob);
+   unsigned num_regs = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < num_regs; i++) {
       nir_register *reg = read_register(ctx);
       exec_list_push_tail(dst, &reg->node);
@@ -268,20 +312,20 @@ write_src(write_ctx *ctx, const nir_src *src)
 {
    /* Since sources are very frequent, we try to save some space when storing
     * them. In particular, we store whether the source is a register and
-    * whether the register has an indirect index in the low two bits. We can
-    * assume that the high two bits of the index are zero, since otherwise our
-    * address space would've been exhausted allocating the remap table!
+    * whether the register has an indirect index in the low two bits.  SSA
+    * sources other than phi sources always come after their definition, so
+    * we store how far back the definition is instead of its index, which
+    * keeps the number small enough for a byte or two.
     */
    if (src->is_ssa) {
-      uintptr_t idx = write_lookup_object(ctx, src->ssa) << 2;
-      idx |= 1;
-      blob_write_intptr(ctx->blob, idx);
+      uint32_t dist = ctx->next_idx - write_lookup_object(ctx, src->ssa);
+      blob_write_varint(ctx->blob, dist << 2 | 1);
    } else {
-      uintptr_t idx = write_lookup_object(ctx, src->reg.reg) << 2;
+      uint32_t idx = write_lookup_object(ctx, src->reg.reg) << 2;
       if (src->reg.indirect)
          idx |= 2;
-      blob_write_intptr(ctx->blob, idx);
-      blob_write_uint32(ctx->blob, src->reg.base_offset);
+      blob_write_varint(ctx->blob, idx);
+      blob_write_varint(ctx->blob, src->reg.base_offset);
       if (src->reg.indirect) {
          write_src(ctx, src->reg.indirect);
       }
@@ -291,15 +335,15 @@ write_src(write_ctx *ctx, const nir_src *src)
 static void
 read_src(read_ctx *ctx, nir_src *src, void *mem_ctx)
 {
-   uintptr_t val = blob_read_intptr(ctx->blob);
-   uintptr_t idx = val >> 2;
+   uint32_t val = blob_read_varint(ctx->blob);
+   uint32_t idx = val >> 2;
    src->is_ssa = val & 0x1;
    if (src->is_ssa) {
-      src->ssa = read_lookup_object(ctx, idx);
+      src->ssa = read_lookup_object(ctx, ctx->next_idx - idx);
    } else {
       bool is_indirect = val & 0x2;
       src->reg.reg = read_lookup_object(ctx, idx);
-      src->reg.base_offset = blob_read_uint32(ctx->blob);
+      src->reg.base_offset = blob_read_varint(ctx->blob);
       if (is_indirect) {
          src->reg.indirect = ralloc(mem_ctx, nir_src);
          read_src(ctx, src->reg.indirect, mem_ctx);
@@ -309,25 +353,47 @@ read_src(read_ctx *ctx, nir_src *src, void *mem_ctx)
    }
 }
 
+/* Packs the size of an SSA value into five bits: the number of components
+ * minus one in the low two and log2 of the bit size above them.
+ */
+static uint32_t
+encode_def_size(unsigned num_components, unsigned bit_size)
+{
+   assert(num_components >= 1 && num_components <= 4);
+   assert(util_is_power_of_two(bit_size) && bit_size <= 64);
+   return (num_components - 1) | (ffs(bit_size) - 1) << 2;
+}
+
+static unsigned
+decode_num_components(uint32_t val)
+{
+   return (val & 0x3) + 1;
+}
+
+static unsigned
+decode_bit_size(uint32_t val)
+{
+   return 1 << ((val >> 2) & 0x7);
+}
+
 static void
 write_dest(write_ctx *ctx, const nir_dest *dst)
 {
    uint32_t val = dst->is_ssa;
    if (dst->is_ssa) {
       val |= !!(dst->ssa.name) << 1;
-      val |= dst->ssa.num_components << 2;
-      val |= dst->ssa.bit_size << 5;
+      val |= encode_def_size(dst->ssa.num_components, dst->ssa.bit_size) << 2;
    } else {
       val |= !!(dst->reg.indirect) << 1;
    }
-   blob_write_uint32(ctx->blob, val);
+   blob_write_varint(ctx->blob, val);
    if (dst->is_ssa) {
       write_add_object(ctx, &dst->ssa);
       if (dst->ssa.name)
          blob_write_string(ctx->blob, dst->ssa.name);
    } else {
-      blob_write_intptr(ctx->blob, write_lookup_object(ctx, dst->reg.reg));
-      blob_write_uint32(ctx->blob, dst->reg.base_offset);
+      write_object(ctx, dst->reg.reg);
+      blob_write_varint(ctx->blob, dst->reg.base_offset);
       if (dst->reg.indirect)
          write_src(ctx, dst->reg.indirect);
    }
@@ -336,19 +402,18 @@ write_dest(write_ctx *ctx, const nir_dest *dst)
 static void
 read_dest(read_ctx *ctx, nir_dest *dst, nir_instr *instr)
 {
-   uint32_t val = blob_read_uint32(ctx->blob);
+   uint32_t val = blob_read_varint(ctx->blob);
    bool is_ssa = val & 0x1;
    if (is_ssa) {
       bool has_name = val & 0x2;
-      unsigned num_components = (val >> 2) & 0x7;
-      unsigned bit_size = val >> 5;
       char *name = has_name ? blob_read_string(ctx->blob) : NULL;
-      nir_ssa_dest_init(instr, dst, num_components, bit_size, name);
+      nir_ssa_dest_init(instr, dst, decode_num_components(val >> 2),
+                        decode_bit_size(val >> 2), name);
       read_add_object(ctx, &dst->ssa);
    } else {
       bool is_indirect = val & 0x2;
       dst->reg.reg = read_object(ctx);
-      dst->reg.base_offset = blob_read_uint32(ctx->blob);
+      dst->reg.base_offset = blob_read_varint(ctx->blob);
       if (is_indirect) {
          dst->reg.indirect = ralloc(instr, nir_src);
          read_src(ctx, dst->reg.indirect, instr);
@@ -364,29 +429,29 @@ write_deref_chain(write_ctx *ctx, const nir_deref_var *deref_var)
    uint32_t len = 0;
    for (const nir_deref *d = deref_var->deref.child; d; d = d->child)
       len++;
-   blob_write_uint32(ctx->blob, len);
+   blob_write_varint(ctx->blob, len);
 
    for (const nir_deref *d = deref_var->deref.child; d; d = d->child) {
-      blob_write_uint32(ctx->blob, d->deref_type);
+      blob_write_varint(ctx->blob, d->deref_type);
       switch (d->deref_type) {
       case nir_deref_type_array: {
          const nir_deref_array *deref_array = nir_deref_as_array(d);
-         blob_write_uint32(ctx->blob, deref_array->deref_array_type);
-         blob_write_uint32(ctx->blob, deref_array->base_offset);
+         blob_write_varint(ctx->blob, deref_array->deref_array_type);
+         blob_write_varint(ctx->blob, deref_array->base_offset);
          if (deref_array->deref_array_type == nir_deref_array_type_indirect)
             write_src(ctx, &deref_array->indirect);
          break;
       }
       case nir_deref_type_struct: {
          const nir_deref_struct *deref_struct = nir_deref_as_struct(d);
-         blob_write_uint32(ctx->blob, deref_struct->index);
+         blob_write_varint(ctx->blob, deref_struct->index);
          break;
       }
       case nir_deref_type_var:
          unreachable("Invalid deref type");
       }
 
-      encode_type_to_blob(ctx->blob, d->type);
+      write_type(ctx, d->type);
    }
 }
 
@@ -396,24 +461,24 @@ read_deref_chain(read_ctx *ctx, void *mem_ctx)
    nir_variable *var = read_object(ctx);
    nir_deref_var *deref_var = nir_deref_var_create(mem_ctx, var);
 
-   uint32_t len = blob_read_uint32(ctx->blob);
+   uint32_t len = blob_read_varint(ctx->blob);
 
    nir_deref *tail = &deref_var->deref;
    for (uint32_t i = 0; i < len; i++) {
-      nir_deref_type deref_type = blob_read_uint32(ctx->blob);
+      nir_deref_type deref_type = blob_read_varint(ctx->blob);
       nir_deref *deref = NULL;
       switch (deref_type) {
       case nir_deref_type_array: {
          nir_deref_array *deref_array = nir_deref_array_create(tail);
-         deref_array->deref_array_type = blob_read_uint32(ctx->blob);
-         deref_array->base_offset = blob_read_uint32(ctx->blob);
+         deref_array->deref_array_type = blob_read_varint(ctx->blob);
+         deref_array->base_offset = blob_read_varint(ctx->blob);
          if (deref_array->deref_array_type == nir_deref_array_type_indirect)
             read_src(ctx, &deref_array->indirect, mem_ctx);
          deref = &deref_array->deref;
          break;
       }
       case nir_deref_type_struct: {
-         uint32_t index = blob_read_uint32(ctx->blob);
+         uint32_t index = blob_read_varint(ctx->blob);
          nir_deref_struct *deref_struct = nir_deref_struct_create(tail, index);
          deref = &deref_struct->deref;
          break;
@@ -422,7 +487,7 @@ read_deref_chain(read_ctx *ctx, void *mem_ctx)
          unreachable("Invalid deref type");
       }
 
-      deref->type = decode_type_from_blob(ctx->blob);
+      deref->type = read_type(ctx);
 
       tail->child = deref;
       tail = deref;
@@ -431,47 +496,74 @@ read_deref_chain(read_ctx *ctx, void *mem_ctx)
    return deref_var;
 }
 
+static uint32_t
+alu_src_modifiers(const nir_alu_src *src)
+{
+   uint32_t mods = src->negate;
+   mods |= src->abs << 1;
+   for (unsigned j = 0; j < 4; j++)
+      mods |= src->swizzle[j] << (2 + 2 * j);
+   return mods;
+}
+
+/* No negate or abs and the .xyzw swizzle */
+#define ALU_SRC_NO_MODIFIERS (0 << 2 | 1 << 4 | 2 << 6 | 3 << 8)
+
 static void
 write_alu(write_ctx *ctx, const nir_alu_instr *alu)
 {
-   blob_write_uint32(ctx->blob, alu->op);
+   unsigned num_inputs = nir_op_infos[alu->op].num_inputs;
+
+   /* Most sources have neither modifiers nor a swizzle, so the header has a
+    * bit per source saying whether there are any to write.
+    */
+   uint32_t has_mods = 0;
+   for (unsigned i = 0; i < num_inputs; i++) {
+      if (alu_src_modifiers(&alu->src[i]) != ALU_SRC_NO_MODIFIERS)
+         has_mods |= 1 << i;
+   }
+
+   blob_write_varint(ctx->blob, alu->op);
    uint32_t flags = alu->exact;
    flags |= alu->dest.saturate << 1;
    flags |= alu->dest.write_mask << 2;
-   blob_write_uint32(ctx->blob, flags);
+   flags |= has_mods << 6;
+   blob_write_varint(ctx->blob, flags);
 
    write_dest(ctx, &alu->dest.dest);
 
-   for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+   for (unsigned i = 0; i < num_inputs; i++) {
       write_src(ctx, &alu->src[i].src);
-      flags = alu->src[i].negate;
-      flags |= alu->src[i].abs << 1;
-      for (unsigned j = 0; j < 4; j++)
-         flags |= alu->src[i].swizzle[j] << (2 + 2 * j);
-      blob_write_uint32(ctx->blob, flags);
+      if (has_mods & (1 << i))
+         blob_write_varint(ctx->blob, alu_src_modifiers(&alu->src[i]));
    }
 }
 
 static nir_alu_instr *
 read_alu(read_ctx *ctx)
 {
-   nir_op op = blob_read_uint32(ctx->blob);
+   nir_op op = blob_read_varint(ctx->blob);
    nir_alu_instr *alu = nir_alu_instr_create(ctx->nir, op);
 
-   uint32_t flags = blob_read_uint32(ctx->blob);
+   uint32_t flags = blob_read_varint(ctx->blob);
    alu->exact = flags & 1;
    alu->dest.saturate = flags & 2;
-   alu->dest.write_mask = flags >> 2;
+   alu->dest.write_mask = (flags >> 2) & 0xf;
+   uint32_t has_mods = flags >> 6;
 
    read_dest(ctx, &alu->dest.dest, &alu->instr);
 
    for (unsigned i = 0; i < nir_op_infos[op].num_inputs; i++) {
       read_src(ctx, &alu->src[i].src, &alu->instr);
-      flags = blob_read_uint32(ctx->blob);
-      alu->src[i].negate = flags & 1;
-      alu->src[i].abs = flags & 2;
-      for (unsigned j = 0; j < 4; j++)
-         alu->src[i].swizzle[j] = (flags >> (2 * j + 2)) & 3;
+
+      /* nir_alu_instr_create already gave us the defaults. */
+      if (has_mods & (1 << i)) {
+         uint32_t mods = blob_read_varint(ctx->blob);
+         alu->src[i].negate = mods & 1;
+         alu->src[i].abs = mods & 2;
+         for (unsigned j = 0; j < 4; j++)
+            alu->src[i].swizzle[j] = (mods >> (2 * j + 2)) & 3;
+      }
    }
 
    return alu;
@@ -480,13 +572,13 @@ read_alu(read_ctx *ctx)
 static void
 write_intrinsic(write_ctx *ctx, const nir_intrinsic_instr *intrin)
 {
-   blob_write_uint32(ctx->blob, intrin->intrinsic);
+   blob_write_varint(ctx->blob, intrin->intrinsic);
 
    unsigned num_variables = nir_intrinsic_infos[intrin->intrinsic].num_variables;
    unsigned num_srcs = nir_intrinsic_infos[intrin->intrinsic].num_srcs;
    unsigned num_indices = nir_intrinsic_infos[intrin->intrinsic].num_indices;
 
-   blob_write_uint32(ctx->blob, intrin->num_components);
+   blob_write_varint(ctx->blob, intrin->num_components);
 
    if (nir_intrinsic_infos[intrin->intrinsic].has_dest)
       write_dest(ctx, &intrin->dest);
@@ -498,13 +590,13 @@ write_intrinsic(write_ctx *ctx, const nir_intrinsic_instr *intrin)
       write_src(ctx, &intrin->src[i]);
 
    for (unsigned i = 0; i < num_indices; i++)
-      blob_write_uint32(ctx->blob, intrin->const_index[i]);
+      blob_write_varint(ctx->blob, intrin->const_index[i]);
 }
 
 static nir_intrinsic_instr *
 read_intrinsic(read_ctx *ctx)
 {
-   nir_intrinsic_op op = blob_read_uint32(ctx->blob);
+   nir_intrinsic_op op = blob_read_varint(ctx->blob);
 
    nir_intrinsic_instr *intrin = nir_intrinsic_instr_create(ctx->nir, op);
 
@@ -512,7 +604,7 @@ read_intrinsic(read_ctx *ctx)
    unsigned num_srcs = nir_intrinsic_infos[op].num_srcs;
    unsigned num_indices = nir_intrinsic_infos[op].num_indices;
 
-   intrin->num_components = blob_read_uint32(ctx->blob);
+   intrin->num_components = blob_read_varint(ctx->blob);
 
    if (nir_intrinsic_infos[op].has_dest)
       read_dest(ctx, &intrin->dest, &intrin->instr);
@@ -524,30 +616,40 @@ read_intrinsic(read_ctx *ctx)
       read_src(ctx, &intrin->src[i], &intrin->instr);
 
    for (unsigned i = 0; i < num_indices; i++)
-      intrin->const_index[i] = blob_read_uint32(ctx->blob);
+      intrin->const_index[i] = blob_read_varint(ctx->blob);
 
    return intrin;
 }
 
+/* Only the components the value actually has are stored.  The arrays of
+ * every bit size in nir_const_value start at the same address, so that's
+ * just the first num_components * bit_size / 8 bytes.
+ */
+static unsigned
+load_const_size(const nir_ssa_def *def)
+{
+   return def->num_components * def->bit_size / 8;
+}
+
 static void
 write_load_const(write_ctx *ctx, const nir_load_const_instr *lc)
 {
-   uint32_t val = lc->def.num_components;
-   val |= lc->def.bit_size << 3;
-   blob_write_uint32(ctx->blob, val);
-   blob_write_bytes(ctx->blob, (uint8_t *) &lc->value, sizeof(lc->value));
+   uint32_t val = encode_def_size(lc->def.num_components, lc->def.bit_size);
+   blob_write_varint(ctx->blob, val);
+   blob_write_bytes(ctx->blob, (uint8_t *) &lc->value, load_const_size(&lc->def));
    write_add_object(ctx, &lc->def);
 }
 
 static nir_load_const_instr *
 read_load_const(read_ctx *ctx)
 {
-   uint32_t val = blob_read_uint32(ctx->blob);
+   uint32_t val = blob_read_varint(ctx->blob);
 
    nir_load_const_instr *lc =
-      nir_load_const_instr_create(ctx->nir, val & 0x7, val >> 3);
+      nir_load_const_instr_create(ctx->nir, decode_num_components(val),
+                                  decode_bit_size(val));
 
-   blob_copy_bytes(ctx->blob, (uint8_t *) &lc->value, sizeof(lc->value));
+   blob_copy_bytes(ctx->blob, (uint8_t *) &lc->value, load_const_size(&lc->def));
    read_add_object(ctx, &lc->def);
    return lc;
 }
@@ -555,19 +657,20 @@ read_load_const(read_ctx *ctx)
 static void
 write_ssa_undef(write_ctx *ctx, const nir_ssa_undef_instr *undef)
 {
-   uint32_t val = undef->def.num_components;
-   val |= undef->def.bit_size << 3;
-   blob_write_uint32(ctx->blob, val);
+   uint32_t val = encode_def_size(undef->def.num_components,
+                                  undef->def.bit_size);
+   blob_write_varint(ctx->blob, val);
    write_add_object(ctx, &undef->def);
 }
 
 static nir_ssa_undef_instr *
 read_ssa_undef(read_ctx *ctx)
 {
-   uint32_t val = blob_read_uint32(ctx->blob);
+   uint32_t val = blob_read_varint(ctx->blob);
 
    nir_ssa_undef_instr *undef =
-      nir_ssa_undef_instr_create(ctx->nir, val & 0x7, val >> 3);
+      nir_ssa_undef_instr_create(ctx->nir, decode_num_components(val),
+                                 decode_bit_size(val));
 
    read_add_object(ctx, &undef->def);
    return undef;
@@ -591,11 +694,11 @@ union packed_tex_data {
 static void
 write_tex(write_ctx *ctx, const nir_tex_instr *tex)
 {
-   blob_write_uint32(ctx->blob, tex->num_srcs);
-   blob_write_uint32(ctx->blob, tex->op);
-   blob_write_uint32(ctx->blob, tex->texture_index);
-   blob_write_uint32(ctx->blob, tex->texture_array_size);
-   blob_write_uint32(ctx->blob, tex->sampler_index);
+   blob_write_varint(ctx->blob, tex->num_srcs);
+   blob_write_varint(ctx->blob, tex->op);
+   blob_write_varint(ctx->blob, tex->texture_index);
+   blob_write_varint(ctx->blob, tex->texture_array_size);
+   blob_write_varint(ctx->blob, tex->sampler_index);
 
    STATIC_ASSERT(sizeof(union packed_tex_data) == sizeof(uint32_t));
    union packed_tex_data packed = {
@@ -609,11 +712,11 @@ write_tex(write_ctx *ctx, const nir_tex_instr *tex)
       .u.has_texture_deref = tex->texture != NULL,
       .u.has_sampler_deref = tex->sampler != NULL,
    };
-   blob_write_uint32(ctx->blob, packed.u32);
+   blob_write_varint(ctx->blob, packed.u32);
 
    write_dest(ctx, &tex->dest);
    for (unsigned i = 0; i < tex->num_srcs; i++) {
-      blob_write_uint32(ctx->blob, tex->src[i].src_type);
+      blob_write_varint(ctx->blob, tex->src[i].src_type);
       write_src(ctx, &tex->src[i].src);
    }
 
@@ -626,16 +729,16 @@ write_tex(write_ctx *ctx, const nir_tex_instr *tex)
 static nir_tex_instr *
 read_tex(read_ctx *ctx)
 {
-   unsigned num_srcs = blob_read_uint32(ctx->blob);
+   unsigned num_srcs = blob_read_varint(ctx->blob);
    nir_tex_instr *tex = nir_tex_instr_create(ctx->nir, num_srcs);
 
-   tex->op = blob_read_uint32(ctx->blob);
-   tex->texture_index = blob_read_uint32(ctx->blob);
-   tex->texture_array_size = blob_read_uint32(ctx->blob);
-   tex->sampler_index = blob_read_uint32(ctx->blob);
+   tex->op = blob_read_varint(ctx->blob);
+   tex->texture_index = blob_read_varint(ctx->blob);
+   tex->texture_array_size = blob_read_varint(ctx->blob);
+   tex->sampler_index = blob_read_varint(ctx->blob);
 
    union packed_tex_data packed;
-   packed.u32 = blob_read_uint32(ctx->blob);
+   packed.u32 = blob_read_varint(ctx->blob);
    tex->sampler_dim = packed.u.sampler_dim;
    tex->dest_type = packed.u.dest_type;
    tex->coord_components = packed.u.coord_components;
@@ -646,7 +749,7 @@ read_tex(read_ctx *ctx)
 
    read_dest(ctx, &tex->dest, &tex->instr);
    for (unsigned i = 0; i < tex->num_srcs; i++) {
-      tex->src[i].src_type = blob_read_uint32(ctx->blob);
+      tex->src[i].src_type = blob_read_varint(ctx->blob);
       read_src(ctx, &tex->src[i].src, &tex->instr);
    }
 
@@ -662,21 +765,17 @@ static void
 write_phi(write_ctx *ctx, const nir_phi_instr *phi)
 {
    /* Phi nodes are special, since they may reference SSA definitions and
-    * basic blocks that don't exist yet. We leave two empty uintptr_t's here,
-    * and then store enough information so that a later fixup pass can fill
-    * them in correctly.
+    * basic blocks that don't exist yet. We only write the number of sources
+    * here and write the sources themselves, in the same order, once the
+    * whole function has been written.
     */
    write_dest(ctx, &phi->dest);
 
-   blob_write_uint32(ctx->blob, exec_list_length(&phi->srcs));
+   blob_write_varint(ctx->blob, exec_list_length(&phi->srcs));
 
    nir_foreach_phi_src(src, phi) {
       assert(src->src.is_ssa);
-      size_t blob_offset = blob_reserve_intptr(ctx->blob);
-      MAYBE_UNUSED size_t blob_offset2 = blob_reserve_intptr(ctx->blob);
-      assert(blob_offset + sizeof(uintptr_t) == blob_offset2);
       write_phi_fixup fixup = {
-         .blob_offset = blob_offset,
          .src = src->src.ssa,
          .block = src->pred,
       };
@@ -688,9 +787,8 @@ static void
 write_fixup_phis(write_ctx *ctx)
 {
    util_dynarray_foreach(&ctx->phi_fixups, write_phi_fixup, fixup) {
-      uintptr_t *blob_ptr = (uintptr_t *)(ctx->blob->data + fixup->blob_offset);
-      blob_ptr[0] = write_lookup_object(ctx, fixup->src);
-      blob_ptr[1] = write_lookup_object(ctx, fixup->block);
+      write_object(ctx, fixup->src);
+      write_object(ctx, fixup->block);
    }
 
    util_dynarray_clear(&ctx->phi_fixups);
@@ -703,10 +801,10 @@ read_phi(read_ctx *ctx, nir_block *blk)
 
    read_dest(ctx, &phi->dest, &phi->instr);
 
-   unsigned num_srcs = blob_read_uint32(ctx->blob);
+   unsigned num_srcs = blob_read_varint(ctx->blob);
 
-   /* For similar reasons as before, we just store the index directly into the
-    * pointer, and let a later pass resolve the phi sources.
+   /* For similar reasons as before, we leave the sources empty and let a
+    * later pass read and resolve them.
     *
     * In order to ensure that the copied sources (which are just the indices
     * from the blob for now) don't get inserted into the old shader's use-def
@@ -719,8 +817,8 @@ read_phi(read_ctx *ctx, nir_block *blk)
       nir_phi_src *src = ralloc(phi, nir_phi_src);
 
       src->src.is_ssa = true;
-      src->src.ssa = (nir_ssa_def *) blob_read_intptr(ctx->blob);
-      src->pred = (nir_block *) blob_read_intptr(ctx->blob);
+      src->src.ssa = NULL;
+      src->pred = NULL;
 
       /* Since we're not letting nir_insert_instr handle use/def stuff for us,
        * we have to set the parent_instr manually.  It doesn't really matter
@@ -731,7 +829,7 @@ read_phi(read_ctx *ctx, nir_block *blk)
       /* Stash it in the list of phi sources.  We'll walk this list and fix up
        * sources at the very end of read_function_impl.
        */
-      list_add(&src->src.use_link, &ctx->phi_srcs);
+      list_addtail(&src->src.use_link, &ctx->phi_srcs);
 
       exec_list_push_tail(&phi->srcs, &src->node);
    }
@@ -743,8 +841,8 @@ static void
 read_fixup_phis(read_ctx *ctx)
 {
    list_for_each_entry_safe(nir_phi_src, src, &ctx->phi_srcs, src.use_link) {
-      src->pred = read_lookup_object(ctx, (uintptr_t)src->pred);
-      src->src.ssa = read_lookup_object(ctx, (uintptr_t)src->src.ssa);
+      src->src.ssa = read_object(ctx);
+      src->pred = read_object(ctx);
 
       /* Remove from this list */
       list_del(&src->src.use_link);
@@ -757,13 +855,13 @@ read_fixup_phis(read_ctx *ctx)
 static void
 write_jump(write_ctx *ctx, const nir_jump_instr *jmp)
 {
-   blob_write_uint32(ctx->blob, jmp->type);
+   blob_write_varint(ctx->blob, jmp->type);
 }
 
 static nir_jump_instr *
 read_jump(read_ctx *ctx)
 {
-   nir_jump_type type = blob_read_uint32(ctx->blob);
+   nir_jump_type type = blob_read_varint(ctx->blob);
    nir_jump_instr *jmp = nir_jump_instr_create(ctx->nir, type);
    return jmp;
 }
@@ -771,7 +869,7 @@ read_jump(read_ctx *ctx)
 static void
 write_call(write_ctx *ctx, const nir_call_instr *call)
 {
-   blob_write_intptr(ctx->blob, write_lookup_object(ctx, call->callee));
+   write_object(ctx, call->callee);
 
    for (unsigned i = 0; i < call->num_params; i++)
       write_deref_chain(ctx, call->params[i]);
@@ -796,7 +894,7 @@ read_call(read_ctx *ctx)
 static void
 write_instr(write_ctx *ctx, const nir_instr *instr)
 {
-   blob_write_uint32(ctx->blob, instr->type);
+   blob_write_varint(ctx->blob, instr->type);
    switch (instr->type) {
    case nir_instr_type_alu:
       write_alu(ctx, nir_instr_as_alu(instr));
@@ -832,7 +930,7 @@ write_instr(write_ctx *ctx, const nir_instr *instr)
 static void
 read_instr(read_ctx *ctx, nir_block *block)
 {
-   nir_instr_type type = blob_read_uint32(ctx->blob);
+   nir_instr_type type = blob_read_varint(ctx->blob);
    nir_instr *instr;
    switch (type) {
    case nir_instr_type_alu:
@@ -877,7 +975,7 @@ static void
 write_block(write_ctx *ctx, const nir_block *block)
 {
    write_add_object(ctx, block);
-   blob_write_uint32(ctx->blob, exec_list_length(&block->instr_list));
+   blob_write_varint(ctx->blob, exec_list_length(&block->instr_list));
    nir_foreach_instr(instr, block)
       write_instr(ctx, instr);
 }
@@ -893,7 +991,7 @@ read_block(read_ctx *ctx, struct exec_list *cf_list)
       exec_node_data(nir_block, exec_list_get_tail(cf_list), cf_node.node);
 
    read_add_object(ctx, block);
-   unsigned num_instrs = blob_read_uint32(ctx->blob);
+   unsigned num_instrs = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < num_instrs; i++) {
       read_instr(ctx, block);
    }
@@ -946,7 +1044,7 @@ read_loop(read_ctx *ctx, struct exec_list *cf_list)
 static void
 write_cf_node(write_ctx *ctx, nir_cf_node *cf)
 {
-   blob_write_uint32(ctx->blob, cf->type);
+   blob_write_varint(ctx->blob, cf->type);
 
    switch (cf->type) {
    case nir_cf_node_block:
@@ -966,7 +1064,7 @@ write_cf_node(write_ctx *ctx, nir_cf_node *cf)
 static void
 read_cf_node(read_ctx *ctx, struct exec_list *list)
 {
-   nir_cf_node_type type = blob_read_uint32(ctx->blob);
+   nir_cf_node_type type = blob_read_varint(ctx->blob);
 
    switch (type) {
    case nir_cf_node_block:
@@ -986,7 +1084,7 @@ read_cf_node(read_ctx *ctx, struct exec_list *list)
 static void
 write_cf_list(write_ctx *ctx, const struct exec_list *cf_list)
 {
-   blob_write_uint32(ctx->blob, exec_list_length(cf_list));
+   blob_write_varint(ctx->blob, exec_list_length(cf_list));
    foreach_list_typed(nir_cf_node, cf, node, cf_list) {
       write_cf_node(ctx, cf);
    }
@@ -995,27 +1093,38 @@ write_cf_list(write_ctx *ctx, const struct exec_list *cf_list)
 static void
 read_cf_list(read_ctx *ctx, struct exec_list *cf_list)
 {
-   uint32_t num_cf_nodes = blob_read_uint32(ctx->blob);
+   uint32_t num_cf_nodes = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < num_cf_nodes; i++)
       read_cf_node(ctx, cf_list);
 }
 
+/* A rough upper bound on the memory an average instruction takes, used to
+ * have the pool set aside room for all of them at once when reading.
+ */
+#define INSTR_SIZE_ESTIMATE \
+   (sizeof(nir_alu_instr) + 2 * sizeof(nir_alu_src) + 64)
+
 static void
 write_function_impl(write_ctx *ctx, const nir_function_impl *fi)
 {
    write_var_list(ctx, &fi->locals);
    write_reg_list(ctx, &fi->registers);
-   blob_write_uint32(ctx->blob, fi->reg_alloc);
+   blob_write_varint(ctx->blob, fi->reg_alloc);
 
-   blob_write_uint32(ctx->blob, fi->num_params);
+   blob_write_varint(ctx->blob, fi->num_params);
    for (unsigned i = 0; i < fi->num_params; i++) {
       write_variable(ctx, fi->params[i]);
    }
 
-   blob_write_uint32(ctx->blob, !!(fi->return_var));
+   blob_write_varint(ctx->blob, !!(fi->return_var));
    if (fi->return_var)
       write_variable(ctx, fi->return_var);
 
+   uint32_t num_instrs = 0;
+   nir_foreach_block(block, (nir_function_impl *) fi)
+      num_instrs += exec_list_length(&block->instr_list);
+   blob_write_varint(ctx->blob, num_instrs);
+
    write_cf_list(ctx, &fi->body);
    write_fixup_phis(ctx);
 }
@@ -1028,19 +1137,31 @@ read_function_impl(read_ctx *ctx, nir_function *fxn)
 
    read_var_list(ctx, &fi->locals);
    read_reg_list(ctx, &fi->registers);
-   fi->reg_alloc = blob_read_uint32(ctx->blob);
+   fi->reg_alloc = blob_read_varint(ctx->blob);
 
-   fi->num_params = blob_read_uint32(ctx->blob);
+   fi->num_params = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < fi->num_params; i++) {
       fi->params[i] = read_variable(ctx);
    }
 
-   bool has_return = blob_read_uint32(ctx->blob);
+   bool has_return = blob_read_varint(ctx->blob);
    if (has_return)
       fi->return_var = read_variable(ctx);
    else
       fi->return_var = NULL;
 
+   /* Get the memory for all the instructions in one go.  Every instruction
+    * takes at least a byte of the blob, so a count beyond what is left of
+    * it comes from a corrupt blob and doesn't get to size anything.
+    */
+   uint32_t num_instrs = blob_read_varint(ctx->blob);
+   size_t remaining = ctx->blob->end - ctx->blob->current;
+   if (ctx->nir->pool && !ctx->blob->overrun && num_instrs <= remaining &&
+       num_instrs <= SIZE_MAX / INSTR_SIZE_ESTIMATE) {
+      ralloc_pool_reserve(ctx->nir->pool,
+                          (size_t) num_instrs * INSTR_SIZE_ESTIMATE);
+   }
+
    read_cf_list(ctx, &fi->body);
    read_fixup_phis(ctx);
 
@@ -1052,19 +1173,19 @@ read_function_impl(read_ctx *ctx, nir_function *fxn)
 static void
 write_function(write_ctx *ctx, const nir_function *fxn)
 {
-   blob_write_uint32(ctx->blob, !!(fxn->name));
+   blob_write_varint(ctx->blob, !!(fxn->name));
    if (fxn->name)
       blob_write_string(ctx->blob, fxn->name);
 
    write_add_object(ctx, fxn);
 
-   blob_write_uint32(ctx->blob, fxn->num_params);
+   blob_write_varint(ctx->blob, fxn->num_params);
    for (unsigned i = 0; i < fxn->num_params; i++) {
-      blob_write_uint32(ctx->blob, fxn->params[i].param_type);
-      encode_type_to_blob(ctx->blob, fxn->params[i].type);
+      blob_write_varint(ctx->blob, fxn->params[i].param_type);
+      write_type(ctx, fxn->params[i].type);
    }
 
-   encode_type_to_blob(ctx->blob, fxn->return_type);
+   write_type(ctx, fxn->return_type);
 
    /* At first glance, it looks like we should write the function_impl here.
     * However, call instructions need to be able to reference at least the
@@ -1076,20 +1197,20 @@ write_function(write_ctx *ctx, const nir_function *fxn)
 static void
 read_function(read_ctx *ctx)
 {
-   bool has_name = blob_read_uint32(ctx->blob);
+   bool has_name = blob_read_varint(ctx->blob);
    char *name = has_name ? blob_read_string(ctx->blob) : NULL;
 
    nir_function *fxn = nir_function_create(ctx->nir, name);
 
    read_add_object(ctx, fxn);
 
-   fxn->num_params = blob_read_uint32(ctx->blob);
+   fxn->num_params = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < fxn->num_params; i++) {
-      fxn->params[i].param_type = blob_read_uint32(ctx->blob);
-      fxn->params[i].type = decode_type_from_blob(ctx->blob);
+      fxn->params[i].param_type = blob_read_varint(ctx->blob);
+      fxn->params[i].type = read_type(ctx);
    }
 
-   fxn->return_type = decode_type_from_blob(ctx->blob);
+   fxn->return_type = read_type(ctx);
 }
 
 void
@@ -1098,12 +1219,15 @@ nir_serialize(struct blob *blob, const nir_shader *nir)
    write_ctx ctx;
    ctx.remap_table = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
                                              _mesa_key_pointer_equal);
+   ctx.type_table = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                            _mesa_key_pointer_equal);
+   ctx.num_types = 0;
    ctx.next_idx = 0;
    ctx.blob = blob;
    ctx.nir = nir;
    util_dynarray_init(&ctx.phi_fixups, NULL);
 
-   size_t idx_size_offset = blob_reserve_intptr(blob);
+   size_t idx_size_offset = blob_reserve_uint32(blob);
 
    struct shader_info info = nir->info;
    uint32_t strings = 0;
@@ -1111,7 +1235,7 @@ nir_serialize(struct blob *blob, const nir_shader *nir)
       strings |= 0x1;
    if (info.label)
       strings |= 0x2;
-   blob_write_uint32(blob, strings);
+   blob_write_varint(blob, strings);
    if (info.name)
       blob_write_string(blob, info.name);
    if (info.label)
@@ -1127,13 +1251,13 @@ nir_serialize(struct blob *blob, const nir_shader *nir)
    write_var_list(&ctx, &nir->system_values);
 
    write_reg_list(&ctx, &nir->registers);
-   blob_write_uint32(blob, nir->reg_alloc);
-   blob_write_uint32(blob, nir->num_inputs);
-   blob_write_uint32(blob, nir->num_uniforms);
-   blob_write_uint32(blob, nir->num_outputs);
-   blob_write_uint32(blob, nir->num_shared);
+   blob_write_varint(blob, nir->reg_alloc);
+   blob_write_varint(blob, nir->num_inputs);
+   blob_write_varint(blob, nir->num_uniforms);
+   blob_write_varint(blob, nir->num_outputs);
+   blob_write_varint(blob, nir->num_shared);
 
-   blob_write_uint32(blob, exec_list_length(&nir->functions));
+   blob_write_varint(blob, exec_list_length(&nir->functions));
    nir_foreach_function(fxn, nir) {
       write_function(&ctx, fxn);
    }
@@ -1142,9 +1266,10 @@ nir_serialize(struct blob *blob, const nir_shader *nir)
       write_function_impl(&ctx, fxn->impl);
    }
 
-   *(uintptr_t *)(blob->data + idx_size_offset) = ctx.next_idx;
+   blob_overwrite_uint32(blob, idx_size_offset, ctx.next_idx);
 
    _mesa_hash_table_destroy(ctx.remap_table, NULL);
+   _mesa_hash_table_destroy(ctx.type_table, NULL);
    util_dynarray_fini(&ctx.phi_fixups);
 }
 
@@ -1156,11 +1281,12 @@ nir_deserialize(void *mem_ctx,
    read_ctx ctx;
    ctx.blob = blob;
    list_inithead(&ctx.phi_srcs);
-   ctx.idx_table_len = blob_read_intptr(blob);
+   util_dynarray_init(&ctx.types, NULL);
+   ctx.idx_table_len = blob_read_uint32(blob);
    ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
    ctx.next_idx = 0;
 
-   uint32_t strings = blob_read_uint32(blob);
+   uint32_t strings = blob_read_varint(blob);
    char *name = (strings & 0x1) ? blob_read_string(blob) : NULL;
    char *label = (strings & 0x2) ? blob_read_string(blob) : NULL;
 
@@ -1182,13 +1308,13 @@ nir_deserialize(void *mem_ctx,
    read_var_list(&ctx, &ctx.nir->system_values);
 
    read_reg_list(&ctx, &ctx.nir->registers);
-   ctx.nir->reg_alloc = blob_read_uint32(blob);
-   ctx.nir->num_inputs = blob_read_uint32(blob);
-   ctx.nir->num_uniforms = blob_read_uint32(blob);
-   ctx.nir->num_outputs = blob_read_uint32(blob);
-   ctx.nir->num_shared = blob_read_uint32(blob);
+   ctx.nir->reg_alloc = blob_read_varint(blob);
+   ctx.nir->num_inputs = blob_read_varint(blob);
+   ctx.nir->num_uniforms = blob_read_varint(blob);
+   ctx.nir->num_outputs = blob_read_varint(blob);
+   ctx.nir->num_shared = blob_read_varint(blob);
 
-   unsigned num_functions = blob_read_uint32(blob);
+   unsigned num_functions = blob_read_varint(blob);
    for (unsigned i = 0; i < num_functions; i++)
       read_function(&ctx);
 
@@ -1196,6 +1322,7 @@ nir_deserialize(void *mem_ctx,
       fxn->impl = read_function_impl(&ctx, fxn);
 
    free(ctx.idx_table);
+   util_dynarray_fini(&ctx.types);
 
    return ctx.nir;
 }
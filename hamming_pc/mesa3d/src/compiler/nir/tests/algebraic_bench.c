@@ -0,0 +1,252 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Runs the algebraic passes over a corpus of shaders twice, once as
+ * generated with the tree automaton and once with the linear matcher it
+ * replaced (nir_opt_algebraic.py --linear), checks that both give the same
+ * shaders and reports how long each took.
+ *
+ * The random shaders of the corpus (see bench_common.h) are scalar
+ * expressions.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench_common.h"
+#include "nir_builder.h"
+#include "util/os_time.h"
+
+bool nir_opt_algebraic_linear(nir_shader *shader);
+bool nir_opt_algebraic_before_ffma_linear(nir_shader *shader);
+bool nir_opt_algebraic_late_linear(nir_shader *shader);
+
+struct timing {
+   int64_t linear;
+   int64_t automaton;
+};
+
+static int64_t
+time_pass(bool (*pass)(nir_shader *), nir_shader *nir, bool *progress)
+{
+   int64_t start = os_time_get_nano();
+   *progress |= pass(nir);
+   return os_time_get_nano() - start;
+}
+
+static void
+optimize(nir_shader *nir, bool linear, struct timing *timing)
+{
+   int64_t *ns = linear ? &timing->linear : &timing->automaton;
+   bool progress;
+
+   /* Cap the number of iterations in case some random shader makes the
+    * transforms go around in circles.  Both matchers hit the cap on the
+    * same shaders if they really are equivalent.
+    */
+   for (unsigned i = 0; i < 32; i++) {
+      progress = false;
+      *ns += time_pass(linear ? nir_opt_algebraic_linear :
+                                nir_opt_algebraic, nir, &progress);
+      progress |= nir_copy_prop(nir);
+      progress |= nir_opt_dce(nir);
+      progress |= nir_opt_cse(nir);
+      progress |= nir_opt_constant_folding(nir);
+      if (!progress)
+         break;
+   }
+
+   *ns += time_pass(linear ? nir_opt_algebraic_before_ffma_linear :
+                             nir_opt_algebraic_before_ffma, nir, &progress);
+   *ns += time_pass(linear ? nir_opt_algebraic_late_linear :
+                             nir_opt_algebraic_late, nir, &progress);
+   nir_copy_prop(nir);
+   nir_opt_dce(nir);
+}
+
+struct algebraic_bench {
+   nir_op ops[nir_num_opcodes];
+   unsigned num_ops;
+   struct timing timing;
+};
+
+/* Returns false if the two matchers disagree on the shader. */
+static bool
+run_shader(nir_shader *nir, const char *name, void *data)
+{
+   struct timing *timing = &((struct algebraic_bench *) data)->timing;
+   nir_shader *linear = nir_shader_clone(NULL, nir);
+
+   optimize(nir, false, timing);
+   optimize(linear, true, timing);
+
+   size_t size, linear_size;
+   char *str = bench_print_shader(nir, &size);
+   char *linear_str = bench_print_shader(linear, &linear_size);
+   bool same = size == linear_size && memcmp(str, linear_str, size) == 0;
+
+   if (!same) {
+      fprintf(stderr, "%s: the matchers disagree\n", name);
+      fprintf(stderr, "automaton:\n%s\nlinear:\n%s\n", str, linear_str);
+   }
+
+   free(str);
+   free(linear_str);
+   ralloc_free(linear);
+   return same;
+}
+
+static bool
+is_32bit_type(nir_alu_type type)
+{
+   unsigned size = nir_alu_type_get_type_size(type);
+   return size == 0 || size == 32;
+}
+
+/* Opcodes that work on scalar 32-bit values, which is all the random
+ * shaders are made of.
+ */
+static unsigned
+get_scalar_ops(nir_op *ops)
+{
+   unsigned num_ops = 0;
+
+   for (unsigned op = 0; op < nir_num_opcodes; op++) {
+      const nir_op_info *info = &nir_op_infos[op];
+      bool ok = info->num_inputs > 0 && info->output_size == 0 &&
+                is_32bit_type(info->output_type);
+
+      for (unsigned i = 0; i < info->num_inputs; i++) {
+         if (info->input_sizes[i] != 0 || !is_32bit_type(info->input_types[i]))
+            ok = false;
+      }
+
+      /* Constant folding these divides by zero sooner or later. */
+      if (op == nir_op_idiv || op == nir_op_udiv || op == nir_op_imod ||
+          op == nir_op_irem || op == nir_op_umod)
+         ok = false;
+
+      if (ok)
+         ops[num_ops++] = op;
+   }
+
+   return num_ops;
+}
+
+static nir_ssa_def *
+random_const(nir_builder *b)
+{
+   static const uint32_t ints[] = {
+      0, 1, 2, 3, 8, 16, 24, 31, 0xff, 0xffff, 0x80000000, 0xffffffff,
+   };
+   static const float floats[] = {
+      0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 2.0f, 3.0f, 4.0f,
+   };
+
+   if (bench_rand() % 2)
+      return nir_imm_int(b, ints[bench_rand() % ARRAY_SIZE(ints)]);
+   else
+      return nir_imm_float(b, floats[bench_rand() % ARRAY_SIZE(floats)]);
+}
+
+static nir_shader *
+random_shader(void *data)
+{
+   const struct algebraic_bench *bench = data;
+   nir_builder b;
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_FRAGMENT,
+                                  &bench_options);
+
+   nir_ssa_def *values[64];
+   unsigned num_values = 0;
+
+   for (unsigned i = 0; i < 4; i++) {
+      nir_intrinsic_instr *load =
+         nir_intrinsic_instr_create(b.shader, nir_intrinsic_load_input);
+      load->num_components = 1;
+      load->src[0] = nir_src_for_ssa(nir_imm_int(&b, 0));
+      nir_intrinsic_set_base(load, i);
+      nir_ssa_dest_init(&load->instr, &load->dest, 1, 32, NULL);
+      nir_builder_instr_insert(&b, &load->instr);
+      values[num_values++] = &load->dest.ssa;
+   }
+
+   unsigned num_alus = 8 + bench_rand() % 48;
+   for (unsigned i = 0; i < num_alus; i++) {
+      nir_op op = bench->ops[bench_rand() % bench->num_ops];
+      nir_ssa_def *srcs[4] = { NULL };
+
+      for (unsigned s = 0; s < nir_op_infos[op].num_inputs; s++) {
+         /* Mostly use recent values so that we get deep expressions for
+          * the patterns to match, and sprinkle in some constants.
+          */
+         uint32_t r = bench_rand() % 8;
+         if (r == 0)
+            srcs[s] = random_const(&b);
+         else if (r < 6)
+            srcs[s] = values[num_values - 1 - bench_rand() % MIN2(num_values, 4)];
+         else
+            srcs[s] = values[bench_rand() % num_values];
+      }
+
+      nir_ssa_def *def = nir_build_alu(&b, op, srcs[0], srcs[1], srcs[2],
+                                       srcs[3]);
+      if (num_values < ARRAY_SIZE(values))
+         values[num_values++] = def;
+      else
+         values[4 + bench_rand() % (num_values - 4)] = def;
+   }
+
+   for (unsigned i = 0; i < 4; i++) {
+      nir_intrinsic_instr *store =
+         nir_intrinsic_instr_create(b.shader, nir_intrinsic_store_output);
+      store->num_components = 1;
+      store->src[0] = nir_src_for_ssa(values[num_values - 1 - i]);
+      store->src[1] = nir_src_for_ssa(nir_imm_int(&b, 0));
+      nir_intrinsic_set_base(store, i);
+      nir_intrinsic_set_write_mask(store, 0x1);
+      nir_builder_instr_insert(&b, &store->instr);
+   }
+
+   return b.shader;
+}
+
+int
+main(int argc, char **argv)
+{
+   struct algebraic_bench bench = { .timing = { 0, 0 } };
+   unsigned num_shaders, num_failed;
+
+   bench.num_ops = get_scalar_ops(bench.ops);
+   num_failed = bench_run_corpus(argc, argv, random_shader, run_shader,
+                                 &bench, &num_shaders);
+
+   printf("%u shaders, %u failed\n", num_shaders, num_failed);
+   printf("linear:    %8.3f ms\n", bench.timing.linear / 1000000.0);
+   printf("automaton: %8.3f ms\n", bench.timing.automaton / 1000000.0);
+
+   return num_failed ? 1 : 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bench_common.h"
+#include "spirv/nir_spirv.h"
+
+const nir_shader_compiler_options bench_options = {
+   .lower_fdiv = true,
+   .lower_flrp32 = true,
+   .lower_flrp64 = true,
+   .lower_fpow = true,
+   .lower_fsat = true,
+   .lower_fmod32 = true,
+   .lower_fmod64 = true,
+   .lower_bitfield_extract = true,
+   .lower_bitfield_insert = true,
+   .lower_uadd_carry = true,
+   .lower_usub_borrow = true,
+   .lower_sub = true,
+   .lower_scmp = true,
+   .fuse_ffma = true,
+};
+
+static uint32_t rand_state = 0x12345678;
+
+uint32_t
+bench_rand(void)
+{
+   rand_state ^= rand_state << 13;
+   rand_state ^= rand_state >> 17;
+   rand_state ^= rand_state << 5;
+   return rand_state;
+}
+
+char *
+bench_print_shader(nir_shader *nir, size_t *size)
+{
+   nir_foreach_function(func, nir) {
+      if (func->impl) {
+         nir_index_ssa_defs(func->impl);
+         nir_index_blocks(func->impl);
+      }
+   }
+
+   char *str = NULL;
+   FILE *fp = open_memstream(&str, size);
+   nir_print_shader(nir, fp);
+   fclose(fp);
+
+   return str;
+}
+
+nir_shader *
+bench_load_spirv(const char *filename)
+{
+   int fd = open(filename, O_RDONLY);
+   if (fd < 0) {
+      fprintf(stderr, "Failed to open %s\n", filename);
+      return NULL;
+   }
+
+   off_t len = lseek(fd, 0, SEEK_END);
+   if (len % 4 != 0) {
+      fprintf(stderr, "%s: not a SPIR-V shader\n", filename);
+      close(fd);
+      return NULL;
+   }
+
+   const void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (map == MAP_FAILED) {
+      fprintf(stderr, "Failed to mmap %s: %s\n", filename, strerror(errno));
+      return NULL;
+   }
+
+   struct spirv_to_nir_options spirv_options = { 0 };
+   nir_function *entry_point =
+      spirv_to_nir(map, len / 4, NULL, 0, MESA_SHADER_FRAGMENT, "main",
+                   &spirv_options, &bench_options);
+   munmap((void *) map, len);
+   if (entry_point == NULL)
+      return NULL;
+
+   /* Get rid of the function calls and variables like a driver would. */
+   nir_shader *nir = entry_point->shader;
+   nir_lower_returns(nir);
+   nir_inline_functions(nir);
+   foreach_list_typed_safe(nir_function, func, node, &nir->functions) {
+      if (func != entry_point)
+         exec_node_remove(&func->node);
+   }
+   nir_lower_vars_to_ssa(nir);
+   nir_copy_prop(nir);
+   nir_opt_dce(nir);
+
+   return nir;
+}
+
+unsigned
+bench_run_corpus(int argc, char **argv,
+                 nir_shader *(*random_shader)(void *data),
+                 bool (*run_shader)(nir_shader *nir, const char *name,
+                                    void *data),
+                 void *data, unsigned *num_shaders)
+{
+   unsigned num_random = 2000;
+   unsigned num_failed = 0;
+   int first_file = 1;
+
+   if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+      num_random = strtoul(argv[2], NULL, 0);
+      first_file = 3;
+   }
+
+   *num_shaders = 0;
+
+   if (first_file < argc) {
+      for (int i = first_file; i < argc; i++) {
+         nir_shader *nir = bench_load_spirv(argv[i]);
+         if (nir == NULL) {
+            num_failed++;
+            continue;
+         }
+
+         if (!run_shader(nir, argv[i], data))
+            num_failed++;
+         (*num_shaders)++;
+         ralloc_free(nir);
+      }
+   } else {
+      for (unsigned i = 0; i < num_random; i++) {
+         nir_shader *nir = random_shader(data);
+         char name[32];
+         snprintf(name, sizeof(name), "random shader %u", i);
+
+         if (!run_shader(nir, name, data))
+            num_failed++;
+         (*num_shaders)++;
+         ralloc_free(nir);
+      }
+   }
+
+   return num_failed;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * What the NIR benchmarks in this directory have in common: they run over
+ * a corpus that is either the SPIR-V files given on the command line or,
+ * without any, a set of random shaders that is the same on every run.
+ *
+ *    <bench> [-n <random shaders>] [shader.spv...]
+ */
+
+#ifndef NIR_BENCH_COMMON_H
+#define NIR_BENCH_COMMON_H
+
+#include "nir.h"
+
+/* Roughly what a scalar backend asks for. */
+extern const nir_shader_compiler_options bench_options;
+
+/** Next number of a xorshift generator, so the corpus is reproducible. */
+uint32_t bench_rand(void);
+
+/**
+ * Prints \p nir to a malloc'ed string, after giving it SSA and block
+ * numbering that only depends on the shader so that prints of equal shaders
+ * compare equal.
+ */
+char *bench_print_shader(nir_shader *nir, size_t *size);
+
+/** Loads a SPIR-V fragment shader, inlined and in SSA form. */
+nir_shader *bench_load_spirv(const char *filename);
+
+/**
+ * Runs \p run_shader on every shader of the corpus given by the command
+ * line, making random shaders with \p random_shader when there are no
+ * files.  Both get \p data.  Returns the number of shaders that failed to
+ * load or run and sets \p num_shaders to how many there were.
+ */
+unsigned bench_run_corpus(int argc, char **argv,
+                          nir_shader *(*random_shader)(void *data),
+                          bool (*run_shader)(nir_shader *nir,
+                                             const char *name, void *data),
+                          void *data, unsigned *num_shaders);
+
+#endif /* NIR_BENCH_COMMON_H */
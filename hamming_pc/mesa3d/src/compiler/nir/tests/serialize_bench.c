@@ -0,0 +1,285 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Round-trips a corpus of shaders through nir_serialize and nir_deserialize,
+ * checks that the shaders come back the same and that serializing them
+ * again gives the same blob, and reports the blob sizes and how long it
+ * took each way.
+ *
+ * The random shaders of the corpus (see bench_common.h) have control flow,
+ * phis, textures and vectors, roughly like what the GLSL front-end hands to
+ * drivers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench_common.h"
+#include "nir_builder.h"
+#include "nir_serialize.h"
+#include "util/os_time.h"
+
+struct stats {
+   size_t bytes;
+   int64_t serialize;
+   int64_t deserialize;
+};
+
+static bool
+run_shader(nir_shader *nir, const char *name, void *data)
+{
+   struct stats *stats = data;
+   struct blob blob, blob2;
+   struct blob_reader reader;
+   bool ok = true;
+
+   blob_init(&blob);
+   int64_t start = os_time_get_nano();
+   nir_serialize(&blob, nir);
+   stats->serialize += os_time_get_nano() - start;
+   stats->bytes += blob.size;
+
+   blob_reader_init(&reader, blob.data, blob.size);
+   start = os_time_get_nano();
+   nir_shader *copy = nir_deserialize(NULL, &bench_options, &reader);
+   stats->deserialize += os_time_get_nano() - start;
+
+   if (reader.overrun || reader.current != reader.end) {
+      fprintf(stderr, "%s: deserialize read %s than was written\n", name,
+              reader.overrun ? "more" : "less");
+      ok = false;
+   }
+
+   nir_validate_shader(copy);
+
+   blob_init(&blob2);
+   nir_serialize(&blob2, copy);
+   if (blob2.size != blob.size || memcmp(blob.data, blob2.data, blob.size)) {
+      fprintf(stderr, "%s: serializing the copy gives a different blob\n",
+              name);
+      ok = false;
+   }
+
+   size_t a_size, b_size;
+   char *a = bench_print_shader(nir, &a_size);
+   char *b = bench_print_shader(copy, &b_size);
+   if (a_size != b_size || memcmp(a, b, a_size) != 0) {
+      fprintf(stderr, "%s: shaders differ\n--- original\n%s\n--- copy\n%s\n",
+              name, a, b);
+      ok = false;
+   }
+
+   free(a);
+   free(b);
+   blob_finish(&blob2);
+   blob_finish(&blob);
+   ralloc_free(copy);
+
+   return ok;
+}
+
+#define NUM_VARS 4
+
+struct random_shader {
+   nir_builder b;
+   nir_variable *vars[NUM_VARS];
+   nir_ssa_def *values[16];
+   unsigned num_values;
+};
+
+static nir_ssa_def *
+random_value(struct random_shader *s)
+{
+   nir_builder *b = &s->b;
+
+   switch (bench_rand() % 8) {
+   case 0:
+      return nir_imm_vec4(b, 1.0f, 0.5f, -2.0f, (float) (bench_rand() % 16));
+   case 1:
+   case 2:
+      return nir_load_var(b, s->vars[bench_rand() % NUM_VARS]);
+   default:
+      return s->values[bench_rand() % s->num_values];
+   }
+}
+
+static void
+add_value(struct random_shader *s, nir_ssa_def *def)
+{
+   if (s->num_values < ARRAY_SIZE(s->values))
+      s->values[s->num_values++] = def;
+   else
+      s->values[bench_rand() % s->num_values] = def;
+}
+
+static nir_ssa_def *
+random_alu(struct random_shader *s)
+{
+   static const nir_op ops[] = {
+      nir_op_fadd, nir_op_fmul, nir_op_fmax, nir_op_fmin, nir_op_ffma,
+      nir_op_fneg, nir_op_fabs, nir_op_ffloor, nir_op_fsqrt, nir_op_flrp,
+      nir_op_fdot4, nir_op_fcsel,
+   };
+   nir_builder *b = &s->b;
+   nir_op op = ops[bench_rand() % ARRAY_SIZE(ops)];
+   nir_ssa_def *srcs[3] = { NULL };
+
+   for (unsigned i = 0; i < nir_op_infos[op].num_inputs; i++) {
+      srcs[i] = random_value(s);
+
+      /* Sprinkle in swizzles the way vec4 front-ends produce them. */
+      if (bench_rand() % 4 == 0) {
+         unsigned swiz[4] = { bench_rand() % 4, bench_rand() % 4,
+                              bench_rand() % 4, bench_rand() % 4 };
+         srcs[i] = nir_swizzle(b, srcs[i], swiz, 4, false);
+      }
+   }
+
+   nir_ssa_def *def = nir_build_alu(b, op, srcs[0], srcs[1], srcs[2], NULL);
+   if (def->num_components == 1)
+      def = nir_vec4(b, def, def, def, nir_imm_float(b, 1.0f));
+
+   return def;
+}
+
+static nir_ssa_def *
+random_tex(struct random_shader *s)
+{
+   nir_builder *b = &s->b;
+   nir_tex_instr *tex = nir_tex_instr_create(b->shader, 1);
+
+   tex->op = nir_texop_tex;
+   tex->sampler_dim = GLSL_SAMPLER_DIM_2D;
+   tex->dest_type = nir_type_float;
+   tex->coord_components = 2;
+   tex->texture_index = bench_rand() % 4;
+   tex->sampler_index = tex->texture_index;
+   tex->src[0].src_type = nir_tex_src_coord;
+   tex->src[0].src = nir_src_for_ssa(nir_channels(b, random_value(s), 0x3));
+   nir_ssa_dest_init(&tex->instr, &tex->dest, 4, 32, NULL);
+   nir_builder_instr_insert(b, &tex->instr);
+
+   return &tex->dest.ssa;
+}
+
+static void
+random_block(struct random_shader *s, unsigned depth)
+{
+   nir_builder *b = &s->b;
+   unsigned num_statements = 2 + bench_rand() % 8;
+
+   /* Values defined in here don't dominate what comes after the block. */
+   nir_ssa_def *values[ARRAY_SIZE(s->values)];
+   unsigned num_values = s->num_values;
+   memcpy(values, s->values, sizeof(values));
+
+   for (unsigned i = 0; i < num_statements; i++) {
+      unsigned r = bench_rand() % 16;
+
+      if (r < 2 && depth < 3) {
+         nir_ssa_def *cond = nir_flt(b, nir_channel(b, random_value(s), 0),
+                                     nir_imm_float(b, 0.5f));
+         nir_if *nif = nir_push_if(b, cond);
+         random_block(s, depth + 1);
+         nir_push_else(b, nif);
+         random_block(s, depth + 1);
+         nir_pop_if(b, nif);
+      } else if (r < 3 && depth < 3) {
+         nir_loop *loop = nir_push_loop(b);
+         nir_ssa_def *cond = nir_fge(b, nir_channel(b, random_value(s), 1),
+                                     nir_imm_float(b, 4.0f));
+         nir_if *nif = nir_push_if(b, cond);
+         nir_jump(b, nir_jump_break);
+         nir_pop_if(b, nif);
+         random_block(s, depth + 1);
+         nir_pop_loop(b, loop);
+      } else if (r < 5) {
+         nir_store_var(b, s->vars[bench_rand() % NUM_VARS], random_value(s),
+                       0xf);
+      } else if (r < 6) {
+         add_value(s, random_tex(s));
+      } else {
+         add_value(s, random_alu(s));
+      }
+   }
+
+   if (depth > 0) {
+      memcpy(s->values, values, sizeof(values));
+      s->num_values = num_values;
+   }
+}
+
+static nir_shader *
+random_shader(void *data)
+{
+   struct random_shader s;
+   nir_builder *b = &s.b;
+
+   nir_builder_init_simple_shader(b, NULL, MESA_SHADER_FRAGMENT,
+                                  &bench_options);
+   s.num_values = 0;
+
+   nir_variable *in = nir_variable_create(b->shader, nir_var_shader_in,
+                                          glsl_vec4_type(), "in");
+   in->data.location = VARYING_SLOT_VAR0;
+   nir_variable *out = nir_variable_create(b->shader, nir_var_shader_out,
+                                           glsl_vec4_type(), "out");
+   out->data.location = FRAG_RESULT_DATA0;
+
+   for (unsigned i = 0; i < NUM_VARS; i++) {
+      s.vars[i] = nir_local_variable_create(b->impl, glsl_vec4_type(),
+                                            "tmp");
+      nir_store_var(b, s.vars[i], nir_load_var(b, in), 0xf);
+   }
+   add_value(&s, nir_load_var(b, in));
+
+   random_block(&s, 0);
+
+   nir_store_var(b, out, random_value(&s), 0xf);
+
+   /* Go to SSA and clean up like a driver would before caching. */
+   nir_lower_vars_to_ssa(b->shader);
+   nir_copy_prop(b->shader);
+   nir_opt_dce(b->shader);
+
+   return b->shader;
+}
+
+int
+main(int argc, char **argv)
+{
+   struct stats stats = { 0, 0, 0 };
+   unsigned num_shaders, num_failed;
+
+   num_failed = bench_run_corpus(argc, argv, random_shader, run_shader,
+                                 &stats, &num_shaders);
+
+   printf("%u shaders, %u failed\n", num_shaders, num_failed);
+   printf("size:        %10zu bytes\n", stats.bytes);
+   printf("serialize:   %10.3f ms\n", stats.serialize / 1000000.0);
+   printf("deserialize: %10.3f ms\n", stats.deserialize / 1000000.0);
+
+   return num_failed ? 1 : 0;
+}
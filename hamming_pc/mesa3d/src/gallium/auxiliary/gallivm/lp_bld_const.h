@@ -141,6 +141,12 @@ lp_build_const_int_pointer(struct gallivm_state *gallivm, const void *ptr)
    LLVMTypeRef int_type;
    LLVMValueRef v;
 
+   /* The address is only valid in this process, so the resulting code
+    * must not end up in a shader cache.
+    */
+   if (gallivm->cache)
+      gallivm->cache->dont_cache = TRUE;
+
    /* int type large enough to hold a pointer */
    int_type = LLVMIntTypeInContext(gallivm->context, 8 * sizeof(void *));
    v = LLVMConstInt(int_type, (uintptr_t) ptr, 0);
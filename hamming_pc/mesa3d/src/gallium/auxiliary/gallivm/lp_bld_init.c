@@ -176,6 +176,12 @@ gallivm_free_ir(struct gallivm_state *gallivm)
       LLVMDisposeModule(gallivm->module);
    }
 
+   /* The object cache must outlive the engine which references it. */
+   if (gallivm->cache) {
+      lp_free_objcache(gallivm->cache->jit_obj_cache);
+      gallivm->cache->jit_obj_cache = NULL;
+   }
+
    FREE(gallivm->module_name);
 
    if (!use_mcjit) {
@@ -198,6 +204,7 @@ gallivm_free_ir(struct gallivm_state *gallivm)
    gallivm->passmgr = NULL;
    gallivm->context = NULL;
    gallivm->builder = NULL;
+   gallivm->cache = NULL;
 }
 
 
@@ -237,6 +244,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
                                                     gallivm->memorymgr,
                                                     (unsigned) optlevel,
                                                     use_mcjit,
+                                                    gallivm->cache,
                                                     &error);
       if (ret) {
          _debug_printf("%s\n", error);
@@ -285,7 +293,7 @@ fail:
  */
 static boolean
 init_gallivm_state(struct gallivm_state *gallivm, const char *name,
-                   LLVMContextRef context)
+                   LLVMContextRef context, struct lp_cached_code *cache)
 {
    assert(!gallivm->context);
    assert(!gallivm->module);
@@ -294,6 +302,7 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
       return FALSE;
 
    gallivm->context = context;
+   gallivm->cache = cache;
 
    if (!gallivm->context)
       goto fail;
@@ -493,15 +502,19 @@ lp_build_init(void)
 
 /**
  * Create a new gallivm_state object.
+ * \param cache  optional cached machine code for the module, see
+ *               struct lp_cached_code.  Must stay valid until
+ *               gallivm_free_ir() or gallivm_destroy() is called.
  */
 struct gallivm_state *
-gallivm_create(const char *name, LLVMContextRef context)
+gallivm_create(const char *name, LLVMContextRef context,
+               struct lp_cached_code *cache)
 {
    struct gallivm_state *gallivm;
 
    gallivm = CALLOC_STRUCT(gallivm_state);
    if (gallivm) {
-      if (!init_gallivm_state(gallivm, name, context)) {
+      if (!init_gallivm_state(gallivm, name, context, cache)) {
          FREE(gallivm);
          gallivm = NULL;
       }
@@ -565,37 +578,40 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       gallivm->builder = NULL;
    }
 
-   if (gallivm_debug & GALLIVM_DEBUG_PERF)
-      time_begin = os_time_get();
-
-   /* Run optimization passes */
-   LLVMInitializeFunctionPassManager(gallivm->passmgr);
-   func = LLVMGetFirstFunction(gallivm->module);
-   while (func) {
-      if (0) {
-         debug_printf("optimizing func %s...\n", LLVMGetValueName(func));
-      }
+   /* Cached machine code makes optimizing the IR pointless. */
+   if (!gallivm->cache || !gallivm->cache->data_size) {
+      if (gallivm_debug & GALLIVM_DEBUG_PERF)
+         time_begin = os_time_get();
+
+      /* Run optimization passes */
+      LLVMInitializeFunctionPassManager(gallivm->passmgr);
+      func = LLVMGetFirstFunction(gallivm->module);
+      while (func) {
+         if (0) {
+            debug_printf("optimizing func %s...\n", LLVMGetValueName(func));
+         }
 
-   /* Disable frame pointer omission on debug/profile builds */
-   /* XXX: And workaround http://llvm.org/PR21435 */
+      /* Disable frame pointer omission on debug/profile builds */
+      /* XXX: And workaround http://llvm.org/PR21435 */
 #if HAVE_LLVM >= 0x0307 && \
     (defined(DEBUG) || defined(PROFILE) || \
      defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64))
-      LLVMAddTargetDependentFunctionAttr(func, "no-frame-pointer-elim", "true");
-      LLVMAddTargetDependentFunctionAttr(func, "no-frame-pointer-elim-non-leaf", "true");
+         LLVMAddTargetDependentFunctionAttr(func, "no-frame-pointer-elim", "true");
+         LLVMAddTargetDependentFunctionAttr(func, "no-frame-pointer-elim-non-leaf", "true");
 #endif
 
-      LLVMRunFunctionPassManager(gallivm->passmgr, func);
-      func = LLVMGetNextFunction(func);
-   }
-   LLVMFinalizeFunctionPassManager(gallivm->passmgr);
-
-   if (gallivm_debug & GALLIVM_DEBUG_PERF) {
-      int64_t time_end = os_time_get();
-      int time_msec = (int)(time_end - time_begin) / 1000;
-      assert(gallivm->module_name);
-      debug_printf("optimizing module %s took %d msec\n",
-                   gallivm->module_name, time_msec);
+         LLVMRunFunctionPassManager(gallivm->passmgr, func);
+         func = LLVMGetNextFunction(func);
+      }
+      LLVMFinalizeFunctionPassManager(gallivm->passmgr);
+
+      if (gallivm_debug & GALLIVM_DEBUG_PERF) {
+         int64_t time_end = os_time_get();
+         int time_msec = (int)(time_end - time_begin) / 1000;
+         assert(gallivm->module_name);
+         debug_printf("optimizing module %s took %d msec\n",
+                      gallivm->module_name, time_msec);
+      }
    }
 
    /* Dump byte code to a file */
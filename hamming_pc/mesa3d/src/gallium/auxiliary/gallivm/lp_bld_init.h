@@ -39,6 +39,24 @@
 extern "C" {
 #endif
 
+/**
+ * Machine code for a module, as stored in a shader cache.
+ *
+ * If data_size is non-zero when the module is compiled, the object code
+ * in data is used instead of running the optimizer and code generator.
+ * Otherwise the freshly generated object code is returned in data (to be
+ * freed by the caller with free()), unless dont_cache got set because the
+ * generated code refers to process-specific addresses.
+ */
+struct lp_cached_code
+{
+   void *data;
+   size_t data_size;
+   boolean dont_cache;
+   void *jit_obj_cache;
+};
+
+
 struct gallivm_state
 {
    char *module_name;
@@ -50,6 +68,7 @@ struct gallivm_state
    LLVMBuilderRef builder;
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
+   struct lp_cached_code *cache;
    unsigned compiled;
 };
 
@@ -59,7 +78,8 @@ lp_build_init(void);
 
 
 struct gallivm_state *
-gallivm_create(const char *name, LLVMContextRef context);
+gallivm_create(const char *name, LLVMContextRef context,
+               struct lp_cached_code *cache);
 
 void
 gallivm_destroy(struct gallivm_state *gallivm);
@@ -65,6 +65,8 @@
 #include <llvm/ExecutionEngine/JITMemoryManager.h>
 #else
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/MemoryBuffer.h>
 #endif
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Host.h>
@@ -95,9 +97,14 @@
 #include "util/u_debug.h"
 #include "util/u_cpu_detect.h"
 
+#include "lp_bld_init.h"
 #include "lp_bld_misc.h"
 #include "lp_bld_debug.h"
 
+#ifndef MESA_LLVM_VERSION_PATCH
+#define MESA_LLVM_VERSION_PATCH 0
+#endif
+
 namespace {
 
 class LLVMEnsureMultithreaded {
@@ -473,88 +480,54 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
 };
 
 
+#if HAVE_LLVM >= 0x0306
 /**
- * Same as LLVMCreateJITCompilerForModule, but:
- * - allows using MCJIT and enabling AVX feature where available.
- * - set target options
+ * MCJIT object cache backed by a struct lp_cached_code.
  *
- * See also:
- * - llvm/lib/ExecutionEngine/ExecutionEngineBindings.cpp
- * - llvm/tools/lli/lli.cpp
- * - http://markmail.org/message/ttkuhvgj4cxxy2on#query:+page:1+mid:aju2dggerju3ivd3+state:results
+ * When the lp_cached_code already holds object code, MCJIT loads it
+ * instead of running the code generator.  Otherwise the object code MCJIT
+ * produces is copied into the lp_cached_code so the caller can store it.
  */
-extern "C"
-LLVMBool
-lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
-                                        lp_generated_code **OutCode,
-                                        LLVMModuleRef M,
-                                        LLVMMCJITMemoryManagerRef CMM,
-                                        unsigned OptLevel,
-                                        int useMCJIT,
-                                        char **OutError)
-{
-   using namespace llvm;
+class LPObjectCache : public llvm::ObjectCache {
+   struct lp_cached_code *cache_out;
 
-   std::string Error;
-#if HAVE_LLVM >= 0x0306
-   EngineBuilder builder(std::unique_ptr<Module>(unwrap(M)));
-#else
-   EngineBuilder builder(unwrap(M));
-#endif
+   public:
+      LPObjectCache(struct lp_cached_code *cache) {
+         cache_out = cache;
+      }
 
-   /**
-    * LLVM 3.1+ haven't more "extern unsigned llvm::StackAlignmentOverride" and
-    * friends for configuring code generation options, like stack alignment.
-    */
-   TargetOptions options;
-#if defined(PIPE_ARCH_X86)
-   options.StackAlignmentOverride = 4;
-#if HAVE_LLVM < 0x0304
-   options.RealignStack = true;
-#endif
-#endif
+      virtual void notifyObjectCompiled(const llvm::Module *M,
+                                        llvm::MemoryBufferRef Obj) {
+         if (cache_out->data_size || cache_out->dont_cache)
+            return;
 
-#if defined(DEBUG) && HAVE_LLVM < 0x0307
-   options.JITEmitDebugInfo = true;
-#endif
+         cache_out->data = malloc(Obj.getBufferSize());
+         if (!cache_out->data)
+            return;
+         memcpy(cache_out->data, Obj.getBufferStart(), Obj.getBufferSize());
+         cache_out->data_size = Obj.getBufferSize();
+      }
 
-   /* XXX: Workaround http://llvm.org/PR21435 */
-#if defined(DEBUG) || defined(PROFILE) || \
-    (HAVE_LLVM >= 0x0303 && (defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64)))
-#if HAVE_LLVM < 0x0304
-   options.NoFramePointerElimNonLeaf = true;
-#endif
-#if HAVE_LLVM < 0x0307
-   options.NoFramePointerElim = true;
-#endif
-#endif
+      virtual std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *M) {
+         if (!cache_out->data_size)
+            return NULL;
 
-   builder.setEngineKind(EngineKind::JIT)
-          .setErrorStr(&Error)
-          .setTargetOptions(options)
-          .setOptLevel((CodeGenOpt::Level)OptLevel);
-
-   if (useMCJIT) {
-#if HAVE_LLVM < 0x0306
-       builder.setUseMCJIT(true);
-#endif
-#ifdef _WIN32
-       /*
-        * MCJIT works on Windows, but currently only through ELF object format.
-        *
-        * XXX: We could use `LLVM_HOST_TRIPLE "-elf"` but LLVM_HOST_TRIPLE has
-        * different strings for MinGW/MSVC, so better play it safe and be
-        * explicit.
-        */
-#  ifdef _WIN64
-       LLVMSetTarget(M, "x86_64-pc-win32-elf");
-#  else
-       LLVMSetTarget(M, "i686-pc-win32-elf");
-#  endif
+         return llvm::MemoryBuffer::getMemBuffer(
+            llvm::StringRef((const char *) cache_out->data,
+                            cache_out->data_size),
+            "", false);
+      }
+};
 #endif
-   }
 
-   llvm::SmallVector<std::string, 16> MAttrs;
+
+/**
+ * The -mattr options to give the JIT.
+ */
+static void
+lp_get_mattrs(llvm::SmallVector<std::string, 16> &MAttrs)
+{
+   using namespace llvm;
 
 #if defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64)
 #if HAVE_LLVM >= 0x0400
@@ -674,20 +647,18 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
 #endif
 #endif
 #endif
+}
 
-   builder.setMAttrs(MAttrs);
-
-   if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM | GALLIVM_DEBUG_DUMP_BC)) {
-      int n = MAttrs.size();
-      if (n > 0) {
-         debug_printf("llc -mattr option(s): ");
-         for (int i = 0; i < n; i++)
-            debug_printf("%s%s", MAttrs[i].c_str(), (i < n - 1) ? "," : "");
-         debug_printf("\n");
-      }
-   }
 
 #if HAVE_LLVM >= 0x0305
+/**
+ * The -mcpu option to give the JIT.
+ */
+static llvm::StringRef
+lp_get_mcpu(void)
+{
+   using namespace llvm;
+
    StringRef MCPU = llvm::sys::getHostCPUName();
    /*
     * The cpu bits are no longer set automatically, so need to set mcpu manually.
@@ -714,6 +685,140 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    if (MCPU == "generic")
       MCPU = "pwr8";
 #endif
+   return MCPU;
+}
+#endif
+
+
+/**
+ * Describe what the JIT generates code for: the LLVM version and the
+ * exact -mcpu and -mattr options lp_build_create_jit_compiler_for_module()
+ * uses, so that machine code cached on disk is only reused on a host it
+ * runs on.  The result must be freed with free().
+ */
+extern "C"
+char *
+lp_build_get_jit_target(void)
+{
+   llvm::SmallVector<std::string, 16> MAttrs;
+   std::string target;
+
+   target = "llvm " + std::to_string(HAVE_LLVM >> 8) + "." +
+            std::to_string(HAVE_LLVM & 0xff) + "." +
+            std::to_string(MESA_LLVM_VERSION_PATCH);
+
+#if HAVE_LLVM >= 0x0305
+   target += " mcpu " + lp_get_mcpu().str();
+#endif
+
+   lp_get_mattrs(MAttrs);
+   target += " mattr ";
+   for (unsigned i = 0; i < MAttrs.size(); i++)
+      target += (i ? "," : "") + MAttrs[i];
+
+   return strdup(target.c_str());
+}
+
+
+/**
+ * Same as LLVMCreateJITCompilerForModule, but:
+ * - allows using MCJIT and enabling AVX feature where available.
+ * - set target options
+ *
+ * See also:
+ * - llvm/lib/ExecutionEngine/ExecutionEngineBindings.cpp
+ * - llvm/tools/lli/lli.cpp
+ * - http://markmail.org/message/ttkuhvgj4cxxy2on#query:+page:1+mid:aju2dggerju3ivd3+state:results
+ */
+extern "C"
+LLVMBool
+lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
+                                        lp_generated_code **OutCode,
+                                        LLVMModuleRef M,
+                                        LLVMMCJITMemoryManagerRef CMM,
+                                        unsigned OptLevel,
+                                        int useMCJIT,
+                                        struct lp_cached_code *cache_out,
+                                        char **OutError)
+{
+   using namespace llvm;
+
+   std::string Error;
+#if HAVE_LLVM >= 0x0306
+   EngineBuilder builder(std::unique_ptr<Module>(unwrap(M)));
+#else
+   EngineBuilder builder(unwrap(M));
+#endif
+
+   /**
+    * LLVM 3.1+ haven't more "extern unsigned llvm::StackAlignmentOverride" and
+    * friends for configuring code generation options, like stack alignment.
+    */
+   TargetOptions options;
+#if defined(PIPE_ARCH_X86)
+   options.StackAlignmentOverride = 4;
+#if HAVE_LLVM < 0x0304
+   options.RealignStack = true;
+#endif
+#endif
+
+#if defined(DEBUG) && HAVE_LLVM < 0x0307
+   options.JITEmitDebugInfo = true;
+#endif
+
+   /* XXX: Workaround http://llvm.org/PR21435 */
+#if defined(DEBUG) || defined(PROFILE) || \
+    (HAVE_LLVM >= 0x0303 && (defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64)))
+#if HAVE_LLVM < 0x0304
+   options.NoFramePointerElimNonLeaf = true;
+#endif
+#if HAVE_LLVM < 0x0307
+   options.NoFramePointerElim = true;
+#endif
+#endif
+
+   builder.setEngineKind(EngineKind::JIT)
+          .setErrorStr(&Error)
+          .setTargetOptions(options)
+          .setOptLevel((CodeGenOpt::Level)OptLevel);
+
+   if (useMCJIT) {
+#if HAVE_LLVM < 0x0306
+       builder.setUseMCJIT(true);
+#endif
+#ifdef _WIN32
+       /*
+        * MCJIT works on Windows, but currently only through ELF object format.
+        *
+        * XXX: We could use `LLVM_HOST_TRIPLE "-elf"` but LLVM_HOST_TRIPLE has
+        * different strings for MinGW/MSVC, so better play it safe and be
+        * explicit.
+        */
+#  ifdef _WIN64
+       LLVMSetTarget(M, "x86_64-pc-win32-elf");
+#  else
+       LLVMSetTarget(M, "i686-pc-win32-elf");
+#  endif
+#endif
+   }
+
+   llvm::SmallVector<std::string, 16> MAttrs;
+   lp_get_mattrs(MAttrs);
+
+   builder.setMAttrs(MAttrs);
+
+   if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM | GALLIVM_DEBUG_DUMP_BC)) {
+      int n = MAttrs.size();
+      if (n > 0) {
+         debug_printf("llc -mattr option(s): ");
+         for (int i = 0; i < n; i++)
+            debug_printf("%s%s", MAttrs[i].c_str(), (i < n - 1) ? "," : "");
+         debug_printf("\n");
+      }
+   }
+
+#if HAVE_LLVM >= 0x0305
+   StringRef MCPU = lp_get_mcpu();
    builder.setMCPU(MCPU);
    if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM | GALLIVM_DEBUG_DUMP_BC)) {
       debug_printf("llc -mcpu option: %s\n", MCPU.str().c_str());
@@ -754,6 +859,13 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    JIT->RegisterJITEventListener(JEL);
 #endif
    if (JIT) {
+#if HAVE_LLVM >= 0x0306
+      if (useMCJIT && cache_out) {
+         LPObjectCache *objcache = new LPObjectCache(cache_out);
+         JIT->setObjectCache(objcache);
+         cache_out->jit_obj_cache = (void *) objcache;
+      }
+#endif
       *OutJIT = wrap(JIT);
       return 0;
    }
@@ -772,6 +884,16 @@ lp_free_generated_code(struct lp_generated_code *code)
    ShaderMemoryManager::freeGeneratedCode(code);
 }
 
+extern "C"
+void
+lp_free_objcache(void *objcache_ptr)
+{
+#if HAVE_LLVM >= 0x0306
+   LPObjectCache *objcache = (LPObjectCache *) objcache_ptr;
+   delete objcache;
+#endif
+}
+
 extern "C"
 LLVMMCJITMemoryManagerRef
 lp_get_default_memory_manager()
@@ -42,6 +42,11 @@ struct translate *translate_create( const struct translate_key *key )
    translate = translate_sse2_create( key );
    if (translate)
       return translate;
+
+   /* AVX2 only takes the half float and integer keys SSE rejects. */
+   translate = translate_avx2_create( key );
+   if (translate)
+      return translate;
 #else
    (void)translate;
 #endif
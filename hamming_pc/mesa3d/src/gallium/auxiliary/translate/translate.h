@@ -161,6 +161,8 @@ static inline void translate_key_sanitize( struct translate_key *a )
  */
 struct translate *translate_sse2_create( const struct translate_key *key );
 
+struct translate *translate_avx2_create( const struct translate_key *key );
+
 struct translate *translate_generic_create( const struct translate_key *key );
 
 boolean translate_generic_is_output_format_supported(enum pipe_format format);
@@ -0,0 +1,771 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * Vertex fetch/emit with AVX2.
+ *
+ * Vertices are converted eight at a time, one per 32-bit lane of a ymm
+ * register: the attribute of each vertex is loaded, the batch is transposed
+ * so that every register holds one channel of all eight vertices, the
+ * channels are converted to float (or kept as integers) with a handful of
+ * vector operations, and the result is transposed back and stored.
+ *
+ * The SSE code is faster for the keys it handles, so this backend only
+ * takes the keys it rejects that would otherwise go to the generic path:
+ * those with a 16-bit float input or a pure integer output.  The other
+ * elements of such keys may be plain array formats with 8, 16 or 32-bit
+ * channels converted to 32-bit float outputs, straight copies and instance
+ * ids.  translate_avx2_create() returns NULL for anything else.
+ */
+
+#include "pipe/p_config.h"
+#include "pipe/p_compiler.h"
+#include "util/u_memory.h"
+#include "util/u_math.h"
+#include "util/u_format.h"
+#include "util/u_cpu_detect.h"
+
+#include "translate.h"
+
+
+#if (defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64)) && \
+    (defined(__clang__) || (defined(PIPE_CC_GCC) && PIPE_CC_GCC_VERSION >= 409))
+
+#include <immintrin.h>
+
+/* The rest of the driver isn't built with -mavx2, so only the functions
+ * below get to use it.  They are only reached when util_cpu_caps says so.
+ */
+#define AVX2_FUNC __attribute__((target("avx2,f16c")))
+
+/** Number of vertices converted per iteration */
+#define AVX2_BATCH 8
+
+
+enum avx2_element_kind {
+   AVX2_ELEMENT_COPY,         /**< input format == output format */
+   AVX2_ELEMENT_CONVERT,      /**< fetch, convert and emit 32-bit channels */
+   AVX2_ELEMENT_INSTANCE_ID,  /**< instance id as a 32-bit integer */
+   AVX2_ELEMENT_INSTANCE_ID_FLOAT, /**< instance id as a float */
+};
+
+/** How the fetched 32-bit channels turn into the output channels */
+enum avx2_convert {
+   AVX2_CONVERT_NONE,         /**< 32-bit float or pure integer */
+   AVX2_CONVERT_HALF,         /**< 16-bit float to float */
+   AVX2_CONVERT_UNSIGNED,     /**< unsigned to float, then scaled */
+   AVX2_CONVERT_SIGNED,       /**< signed to float, then scaled */
+};
+
+
+struct translate_avx2_element
+{
+   enum avx2_element_kind kind;
+
+   unsigned buffer;
+   unsigned slot;             /**< index into vertex_buffer[], if not instanced */
+   unsigned input_offset;
+   unsigned instance_divisor;
+   unsigned output_offset;
+
+   /** Bytes to read from each vertex */
+   unsigned input_size;
+
+   /** Input channels and their size in bits: 8, 16 or 32 */
+   unsigned nr_channels;
+   unsigned channel_size;
+   boolean is_signed;
+
+   enum avx2_convert convert;
+   float scale;
+
+   /** Output channel sources: PIPE_SWIZZLE_X..W, _0 or _1 */
+   unsigned char swizzle[4];
+   boolean pure_integer;
+
+   /** Output channels, all 32 bits wide */
+   unsigned nr_outputs;
+};
+
+struct translate_avx2_buffer
+{
+   const uint8_t *base_ptr;
+   unsigned stride;
+   unsigned max_index;
+};
+
+struct translate_avx2
+{
+   struct translate translate;
+
+   struct translate_avx2_element element[TRANSLATE_MAX_ATTRIBS];
+   unsigned nr_elements;
+
+   struct translate_avx2_buffer buffer[TRANSLATE_MAX_ATTRIBS];
+
+   /** Buffers read per vertex, whose vertex addresses every batch computes
+    * once for all their elements.
+    */
+   unsigned vertex_buffer[TRANSLATE_MAX_ATTRIBS];
+   unsigned nr_vertex_buffers;
+
+   /** Per-run vertex address of the instanced elements */
+   const uint8_t *instance_ptr[TRANSLATE_MAX_ATTRIBS];
+};
+
+
+static struct translate_avx2 *
+translate_avx2(struct translate *translate)
+{
+   return (struct translate_avx2 *)translate;
+}
+
+
+/**
+ * Read \p size bytes into the low end of an xmm register, and not a byte
+ * more: the last vertex may sit at the very end of a buffer.
+ */
+static inline __m128i AVX2_FUNC
+avx2_load(const uint8_t *src, unsigned size)
+{
+   uint16_t w;
+   uint32_t d;
+   uint64_t q;
+
+   switch (size) {
+   case 1:
+      return _mm_cvtsi32_si128(src[0]);
+   case 2:
+      memcpy(&w, src, 2);
+      return _mm_cvtsi32_si128(w);
+   case 3:
+      memcpy(&w, src, 2);
+      return _mm_cvtsi32_si128(w | (uint32_t)src[2] << 16);
+   case 4:
+      memcpy(&d, src, 4);
+      return _mm_cvtsi32_si128(d);
+   case 6:
+      memcpy(&d, src, 4);
+      memcpy(&w, src + 4, 2);
+      q = d | (uint64_t)w << 32;
+      return _mm_loadl_epi64((const __m128i *)&q);
+   case 8:
+      return _mm_loadl_epi64((const __m128i *)src);
+   case 12:
+      memcpy(&d, src + 8, 4);
+      return _mm_insert_epi32(_mm_loadl_epi64((const __m128i *)src), d, 2);
+   default:
+      assert(size == 16);
+      return _mm_loadu_si128((const __m128i *)src);
+   }
+}
+
+/**
+ * Write the low \p size bytes of an xmm register, for the sizes
+ * avx2_load() handles.
+ */
+static inline void AVX2_FUNC
+avx2_store(uint8_t *dst, __m128i v, unsigned size)
+{
+   uint16_t w;
+   uint32_t d;
+
+   switch (size) {
+   case 1:
+      dst[0] = _mm_cvtsi128_si32(v);
+      break;
+   case 2:
+      w = _mm_cvtsi128_si32(v);
+      memcpy(dst, &w, 2);
+      break;
+   case 3:
+      d = _mm_cvtsi128_si32(v);
+      memcpy(dst, &d, 2);
+      dst[2] = d >> 16;
+      break;
+   case 4:
+      d = _mm_cvtsi128_si32(v);
+      memcpy(dst, &d, 4);
+      break;
+   case 6:
+      d = _mm_cvtsi128_si32(v);
+      w = _mm_extract_epi16(v, 2);
+      memcpy(dst, &d, 4);
+      memcpy(dst + 4, &w, 2);
+      break;
+   case 8:
+      _mm_storel_epi64((__m128i *)dst, v);
+      break;
+   case 12:
+      _mm_storel_epi64((__m128i *)dst, v);
+      d = _mm_extract_epi32(v, 2);
+      memcpy(dst + 8, &d, 4);
+      break;
+   default:
+      assert(size == 16);
+      _mm_storeu_si128((__m128i *)dst, v);
+      break;
+   }
+}
+
+/**
+ * Transpose eight vectors of four dwords held as (v[i] | v[i + 4]) pairs
+ * into four vectors of eight dwords, or back.
+ */
+static inline void AVX2_FUNC
+avx2_transpose(__m256i r[4])
+{
+   __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+   __m256i t1 = _mm256_unpacklo_epi32(r[2], r[3]);
+   __m256i t2 = _mm256_unpackhi_epi32(r[0], r[1]);
+   __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+
+   r[0] = _mm256_unpacklo_epi64(t0, t1);
+   r[1] = _mm256_unpackhi_epi64(t0, t1);
+   r[2] = _mm256_unpacklo_epi64(t2, t3);
+   r[3] = _mm256_unpackhi_epi64(t2, t3);
+}
+
+/**
+ * Extract a \p bits wide channel starting at bit \p shift of each dword.
+ */
+static inline __m256i AVX2_FUNC
+avx2_extract(__m256i v, unsigned shift, unsigned bits, boolean is_signed)
+{
+   if (is_signed) {
+      v = _mm256_sll_epi32(v, _mm_cvtsi32_si128(32 - bits - shift));
+      return _mm256_sra_epi32(v, _mm_cvtsi32_si128(32 - bits));
+   }
+   else {
+      v = _mm256_srl_epi32(v, _mm_cvtsi32_si128(shift));
+      return _mm256_and_si256(v, _mm256_set1_epi32((1u << bits) - 1));
+   }
+}
+
+static inline __m256 AVX2_FUNC
+avx2_half_to_float(__m256i v)
+{
+   /* Pack the zero-extended halves into the low 128 bits. */
+   v = _mm256_packus_epi32(v, v);
+   v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+   return _mm256_cvtph_ps(_mm256_castsi256_si128(v));
+}
+
+
+/* Expand \p stmt once per size avx2_load() handles, so that the size is a
+ * constant within the loops of \p stmt.
+ */
+#define AVX2_FOR_EACH_SIZE(size, stmt, fallback)  \
+   switch (size) {                                \
+   case 1: { const unsigned SIZE = 1; stmt; break; }    \
+   case 2: { const unsigned SIZE = 2; stmt; break; }    \
+   case 3: { const unsigned SIZE = 3; stmt; break; }    \
+   case 4: { const unsigned SIZE = 4; stmt; break; }    \
+   case 6: { const unsigned SIZE = 6; stmt; break; }    \
+   case 8: { const unsigned SIZE = 8; stmt; break; }    \
+   case 12: { const unsigned SIZE = 12; stmt; break; }  \
+   case 16: { const unsigned SIZE = 16; stmt; break; }  \
+   default: fallback; break;                      \
+   }
+
+
+/**
+ * Fetch, convert and emit one element of \p n vertices.  All eight \p vtx
+ * addresses must be valid, only the first \p n vertices are written.
+ */
+static inline void AVX2_FUNC
+avx2_convert_element(const struct translate_avx2_element *e,
+                     const uint8_t *const *vtx,
+                     unsigned n,
+                     unsigned output_stride,
+                     uint8_t *dst)
+{
+   const unsigned offset = e->input_offset;
+   __m256i r[4], chan[4];
+   unsigned i;
+
+   AVX2_FOR_EACH_SIZE(e->input_size,
+      for (i = 0; i < 4; i++) {
+         r[i] = _mm256_inserti128_si256(
+                   _mm256_castsi128_si256(avx2_load(vtx[i] + offset, SIZE)),
+                   avx2_load(vtx[i + 4] + offset, SIZE), 1);
+      },
+      unreachable("unexpected input size"))
+
+   avx2_transpose(r);
+
+   for (i = 0; i < e->nr_channels; i++) {
+      __m256i c;
+
+      switch (e->channel_size) {
+      case 8:
+         c = avx2_extract(r[0], i * 8, 8, e->is_signed);
+         break;
+      case 16:
+         c = avx2_extract(r[i / 2], (i % 2) * 16, 16, e->is_signed);
+         break;
+      default:
+         c = r[i];
+         break;
+      }
+
+      switch (e->convert) {
+      case AVX2_CONVERT_HALF:
+         c = _mm256_castps_si256(avx2_half_to_float(c));
+         break;
+      case AVX2_CONVERT_UNSIGNED:
+      case AVX2_CONVERT_SIGNED:
+         c = _mm256_castps_si256(_mm256_mul_ps(_mm256_cvtepi32_ps(c),
+                                               _mm256_set1_ps(e->scale)));
+         break;
+      default:
+         break;
+      }
+
+      chan[i] = c;
+   }
+
+   for (i = 0; i < 4; i++) {
+      unsigned swz = e->swizzle[i];
+
+      if (i >= e->nr_outputs)
+         r[i] = _mm256_setzero_si256();
+      else if (swz <= PIPE_SWIZZLE_W)
+         r[i] = chan[swz];
+      else if (swz == PIPE_SWIZZLE_1)
+         r[i] = e->pure_integer ? _mm256_set1_epi32(1) :
+                                  _mm256_castps_si256(_mm256_set1_ps(1.0f));
+      else
+         r[i] = _mm256_setzero_si256();
+   }
+
+   avx2_transpose(r);
+
+   AVX2_FOR_EACH_SIZE(e->nr_outputs * 4,
+      for (i = 0; i < n; i++) {
+         __m128i v = i < 4 ? _mm256_castsi256_si128(r[i]) :
+                             _mm256_extracti128_si256(r[i - 4], 1);
+
+         avx2_store(dst + i * output_stride, v, SIZE);
+      },
+      unreachable("unexpected output size"))
+}
+
+
+/**
+ * Convert \p n vertices.  \p idx holds AVX2_BATCH indices, those past \p n
+ * only need to be in bounds.
+ */
+static void AVX2_FUNC
+avx2_run_batch(struct translate_avx2 *p,
+               const unsigned *idx,
+               unsigned n,
+               unsigned instance_id,
+               uint8_t *vert)
+{
+   const unsigned output_stride = p->translate.key.output_stride;
+   const uint8_t *vtx[TRANSLATE_MAX_ATTRIBS][AVX2_BATCH];
+   const uint8_t *instance_vtx[AVX2_BATCH];
+   unsigned attr, i;
+
+   for (attr = 0; attr < p->nr_vertex_buffers; attr++) {
+      const struct translate_avx2_buffer *buf =
+         &p->buffer[p->vertex_buffer[attr]];
+
+      /* clamp to avoid going out of bounds */
+      for (i = 0; i < AVX2_BATCH; i++) {
+         vtx[attr][i] = buf->base_ptr +
+                        (ptrdiff_t)buf->stride * MIN2(idx[i], buf->max_index);
+      }
+   }
+
+   for (attr = 0; attr < p->nr_elements; attr++) {
+      const struct translate_avx2_element *e = &p->element[attr];
+      uint8_t *dst = vert + e->output_offset;
+      const uint8_t *const *src;
+
+      if (e->kind == AVX2_ELEMENT_INSTANCE_ID ||
+          e->kind == AVX2_ELEMENT_INSTANCE_ID_FLOAT) {
+         uint32_t value = instance_id;
+
+         if (e->kind == AVX2_ELEMENT_INSTANCE_ID_FLOAT) {
+            float f = (float)instance_id;
+            memcpy(&value, &f, 4);
+         }
+
+         for (i = 0; i < n; i++)
+            memcpy(dst + i * output_stride, &value, 4);
+         continue;
+      }
+
+      if (e->instance_divisor) {
+         for (i = 0; i < AVX2_BATCH; i++)
+            instance_vtx[i] = p->instance_ptr[attr];
+         src = instance_vtx;
+      }
+      else {
+         src = vtx[e->slot];
+      }
+
+      if (e->kind == AVX2_ELEMENT_COPY) {
+         for (i = 0; i < n; i++)
+            memcpy(dst + i * output_stride, src[i] + e->input_offset,
+                   e->input_size);
+      }
+      else {
+         avx2_convert_element(e, src, n, output_stride, dst);
+      }
+   }
+}
+
+
+static void
+avx2_begin(struct translate_avx2 *p,
+           unsigned start_instance,
+           unsigned instance_id)
+{
+   unsigned attr;
+
+   for (attr = 0; attr < p->nr_elements; attr++) {
+      const struct translate_avx2_element *e = &p->element[attr];
+
+      if (e->kind != AVX2_ELEMENT_INSTANCE_ID &&
+          e->kind != AVX2_ELEMENT_INSTANCE_ID_FLOAT &&
+          e->instance_divisor) {
+         const struct translate_avx2_buffer *buf = &p->buffer[e->buffer];
+         unsigned index = start_instance + instance_id / e->instance_divisor;
+
+         /* XXX we need to clamp the index here too, but to a
+          * per-array max value, not the draw->pt.max_index value
+          * that's being given to us via translate->set_buffer().
+          */
+         p->instance_ptr[attr] = buf->base_ptr +
+                                 (ptrdiff_t)buf->stride * index;
+      }
+   }
+}
+
+
+#define AVX2_RUN_ELTS(NAME, TYPE)                                      \
+static void PIPE_CDECL                                                 \
+NAME(struct translate *translate,                                      \
+     const TYPE *elts,                                                 \
+     unsigned count,                                                   \
+     unsigned start_instance,                                          \
+     unsigned instance_id,                                             \
+     void *output_buffer)                                              \
+{                                                                      \
+   struct translate_avx2 *p = translate_avx2(translate);               \
+   const unsigned output_stride = translate->key.output_stride;        \
+   uint8_t *vert = output_buffer;                                      \
+   unsigned idx[AVX2_BATCH];                                           \
+                                                                       \
+   avx2_begin(p, start_instance, instance_id);                         \
+                                                                       \
+   while (count) {                                                     \
+      unsigned n = MIN2(count, AVX2_BATCH);                            \
+      unsigned i;                                                      \
+                                                                       \
+      for (i = 0; i < n; i++)                                          \
+         idx[i] = elts[i];                                             \
+      for (; i < AVX2_BATCH; i++)                                      \
+         idx[i] = idx[0];                                              \
+                                                                       \
+      avx2_run_batch(p, idx, n, instance_id, vert);                    \
+                                                                       \
+      elts += n;                                                       \
+      count -= n;                                                      \
+      vert += n * output_stride;                                       \
+   }                                                                   \
+}
+
+AVX2_RUN_ELTS(avx2_run_elts, unsigned)
+AVX2_RUN_ELTS(avx2_run_elts16, uint16_t)
+AVX2_RUN_ELTS(avx2_run_elts8, uint8_t)
+
+static void PIPE_CDECL
+avx2_run(struct translate *translate,
+         unsigned start,
+         unsigned count,
+         unsigned start_instance,
+         unsigned instance_id,
+         void *output_buffer)
+{
+   struct translate_avx2 *p = translate_avx2(translate);
+   const unsigned output_stride = translate->key.output_stride;
+   uint8_t *vert = output_buffer;
+   unsigned idx[AVX2_BATCH];
+
+   avx2_begin(p, start_instance, instance_id);
+
+   while (count) {
+      unsigned n = MIN2(count, AVX2_BATCH);
+      unsigned i;
+
+      for (i = 0; i < n; i++)
+         idx[i] = start + i;
+      for (; i < AVX2_BATCH; i++)
+         idx[i] = start;
+
+      avx2_run_batch(p, idx, n, instance_id, vert);
+
+      start += n;
+      count -= n;
+      vert += n * output_stride;
+   }
+}
+
+
+static void
+avx2_set_buffer(struct translate *translate,
+                unsigned buf,
+                const void *ptr,
+                unsigned stride,
+                unsigned max_index)
+{
+   struct translate_avx2 *p = translate_avx2(translate);
+
+   if (buf < ARRAY_SIZE(p->buffer)) {
+      p->buffer[buf].base_ptr = ptr;
+      p->buffer[buf].stride = stride;
+      p->buffer[buf].max_index = max_index;
+   }
+}
+
+
+static void
+avx2_release(struct translate *translate)
+{
+   FREE(translate);
+}
+
+
+/**
+ * Whether \p desc is a 32-bit per channel output format whose channels
+ * are stored in RGBA order.
+ */
+static boolean
+is_rgba32_format(const struct util_format_description *desc)
+{
+   unsigned i;
+
+   if (desc->layout != UTIL_FORMAT_LAYOUT_PLAIN || !desc->is_array ||
+       desc->channel[0].size != 32)
+      return FALSE;
+
+   for (i = 0; i < desc->nr_channels; i++) {
+      if (desc->swizzle[i] != PIPE_SWIZZLE_X + i)
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Set up \p e to fetch \p in and emit \p out, returning FALSE if that's
+ * beyond this backend.
+ */
+static boolean
+avx2_init_convert(struct translate_avx2_element *e,
+                  const struct util_format_description *in,
+                  const struct util_format_description *out)
+{
+   const struct util_format_channel_description *chan = &in->channel[0];
+   unsigned i;
+
+   if (in->layout != UTIL_FORMAT_LAYOUT_PLAIN || !in->is_array ||
+       in->colorspace != UTIL_FORMAT_COLORSPACE_RGB ||
+       in->nr_channels > 4 ||
+       (chan->size != 8 && chan->size != 16 && chan->size != 32))
+      return FALSE;
+
+   if (!is_rgba32_format(out))
+      return FALSE;
+
+   e->nr_channels = in->nr_channels;
+   e->channel_size = chan->size;
+   e->input_size = in->block.bits / 8;
+   e->is_signed = chan->type == UTIL_FORMAT_TYPE_SIGNED;
+   e->pure_integer = chan->pure_integer;
+   e->nr_outputs = out->nr_channels;
+   e->scale = 1.0f;
+
+   switch (chan->type) {
+   case UTIL_FORMAT_TYPE_FLOAT:
+      if (out->channel[0].type != UTIL_FORMAT_TYPE_FLOAT)
+         return FALSE;
+      if (chan->size == 16) {
+         if (!util_cpu_caps.has_f16c)
+            return FALSE;
+         e->convert = AVX2_CONVERT_HALF;
+      }
+      else if (chan->size == 32) {
+         e->convert = AVX2_CONVERT_NONE;
+      }
+      else {
+         return FALSE;
+      }
+      break;
+
+   case UTIL_FORMAT_TYPE_UNSIGNED:
+   case UTIL_FORMAT_TYPE_SIGNED:
+      if (chan->pure_integer) {
+         /* Integers keep their sign and can't lose precision. */
+         if (!out->channel[0].pure_integer ||
+             out->channel[0].type != chan->type)
+            return FALSE;
+         e->convert = AVX2_CONVERT_NONE;
+         break;
+      }
+
+      if (out->channel[0].type != UTIL_FORMAT_TYPE_FLOAT)
+         return FALSE;
+
+      /* Unsigned 32-bit values don't fit in the signed conversion. */
+      if (chan->type == UTIL_FORMAT_TYPE_SIGNED)
+         e->convert = AVX2_CONVERT_SIGNED;
+      else if (chan->size == 32)
+         return FALSE;
+      else
+         e->convert = AVX2_CONVERT_UNSIGNED;
+
+      if (chan->normalized) {
+         unsigned bits = e->is_signed ? chan->size - 1 : chan->size;
+         e->scale = (float)(1.0 / (double)((1ull << bits) - 1));
+      }
+      break;
+
+   default:
+      return FALSE;
+   }
+
+   for (i = 0; i < 4; i++)
+      e->swizzle[i] = in->swizzle[i];
+
+   return TRUE;
+}
+
+
+struct translate *
+translate_avx2_create(const struct translate_key *key)
+{
+   struct translate_avx2 *p;
+   unsigned nr_fallbacks = 0;
+   unsigned i;
+
+   if (!util_cpu_caps.has_avx2)
+      return NULL;
+
+   p = CALLOC_STRUCT(translate_avx2);
+   if (!p)
+      return NULL;
+
+   assert(key->nr_elements <= TRANSLATE_MAX_ATTRIBS);
+
+   p->translate.key = *key;
+   p->translate.release = avx2_release;
+   p->translate.set_buffer = avx2_set_buffer;
+   p->translate.run_elts = avx2_run_elts;
+   p->translate.run_elts16 = avx2_run_elts16;
+   p->translate.run_elts8 = avx2_run_elts8;
+   p->translate.run = avx2_run;
+
+   for (i = 0; i < key->nr_elements; i++) {
+      const struct translate_element *elem = &key->element[i];
+      struct translate_avx2_element *e = &p->element[i];
+      const struct util_format_description *in_desc, *out_desc;
+
+      e->output_offset = elem->output_offset;
+
+      if (elem->type == TRANSLATE_ELEMENT_INSTANCE_ID) {
+         if (elem->output_format == PIPE_FORMAT_R32_USCALED ||
+             elem->output_format == PIPE_FORMAT_R32_SSCALED)
+            e->kind = AVX2_ELEMENT_INSTANCE_ID;
+         else if (elem->output_format == PIPE_FORMAT_R32_FLOAT)
+            e->kind = AVX2_ELEMENT_INSTANCE_ID_FLOAT;
+         else
+            goto fail;
+         continue;
+      }
+
+      in_desc = util_format_description(elem->input_format);
+      out_desc = util_format_description(elem->output_format);
+      if (!in_desc || !out_desc)
+         goto fail;
+
+      e->buffer = elem->input_buffer;
+      e->input_offset = elem->input_offset;
+      e->instance_divisor = elem->instance_divisor;
+
+      if (!e->instance_divisor) {
+         for (e->slot = 0; e->slot < p->nr_vertex_buffers; e->slot++) {
+            if (p->vertex_buffer[e->slot] == e->buffer)
+               break;
+         }
+         if (e->slot == p->nr_vertex_buffers)
+            p->vertex_buffer[p->nr_vertex_buffers++] = e->buffer;
+      }
+
+      if (elem->input_format == elem->output_format &&
+          in_desc->block.width == 1 &&
+          in_desc->block.height == 1 &&
+          !(in_desc->block.bits & 7)) {
+         e->kind = AVX2_ELEMENT_COPY;
+         e->input_size = in_desc->block.bits / 8;
+      }
+      else if (avx2_init_convert(e, in_desc, out_desc)) {
+         e->kind = AVX2_ELEMENT_CONVERT;
+         if (e->convert == AVX2_CONVERT_HALF || e->pure_integer)
+            nr_fallbacks++;
+      }
+      else {
+         goto fail;
+      }
+   }
+
+   /* Keys without half floats or integers are the SSE code's, which
+    * is faster at them.
+    */
+   if (!nr_fallbacks)
+      goto fail;
+
+   p->nr_elements = key->nr_elements;
+
+   return &p->translate;
+
+ fail:
+   FREE(p);
+   return NULL;
+}
+
+
+#else
+
+struct translate *
+translate_avx2_create(const struct translate_key *key)
+{
+   return NULL;
+}
+
+#endif
@@ -45,6 +45,7 @@
 #include "lp_state.h"
 #include "lp_surface.h"
 #include "lp_query.h"
+#include "lp_screen.h"
 #include "lp_setup.h"
 
 /* This is only safe if there's just one concurrent context */
@@ -59,6 +60,14 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
 
    lp_print_counters();
 
+   if (!LIST_IS_EMPTY(&llvmpipe->screen_link)) {
+      struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+
+      mtx_lock(&screen->buffer_mutex);
+      LIST_DEL(&llvmpipe->screen_link);
+      mtx_unlock(&screen->buffer_mutex);
+   }
+
    if (llvmpipe->blitter) {
       util_blitter_destroy(llvmpipe->blitter);
    }
@@ -149,6 +158,7 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
 
    make_empty_list(&llvmpipe->setup_variants_list);
 
+   list_inithead(&llvmpipe->screen_link);
 
    llvmpipe->pipe.screen = screen;
    llvmpipe->pipe.priv = priv;
@@ -233,6 +243,16 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
     */
    llvmpipe->dirty |= LP_NEW_SCISSOR;
 
+   /* Make buffer storage replaced from now on wait for our draws */
+   {
+      struct llvmpipe_screen *lp_screen = llvmpipe_screen(screen);
+
+      mtx_lock(&lp_screen->buffer_mutex);
+      llvmpipe->buffer_timestamp = lp_screen->buffer_timestamp;
+      list_addtail(&llvmpipe->screen_link, &lp_screen->contexts);
+      mtx_unlock(&lp_screen->buffer_mutex);
+   }
+
    return &llvmpipe->pipe;
 
  fail:
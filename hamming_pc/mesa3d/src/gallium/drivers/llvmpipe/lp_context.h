@@ -34,6 +34,7 @@
 #include "pipe/p_context.h"
 
 #include "draw/draw_vertex.h"
+#include "util/list.h"
 #include "util/u_blitter.h"
 
 #include "lp_tex_sample.h"
@@ -136,6 +137,14 @@ struct llvmpipe_context {
    struct blitter_context *blitter;
 
    unsigned tex_timestamp;
+
+   /** Screen buffer_timestamp the bound buffer state was last updated for */
+   unsigned buffer_timestamp;
+
+   /** Screen buffer_timestamp when the draw in progress started, if any */
+   unsigned draw_timestamp;
+   boolean drawing;
+   struct list_head screen_link;
    boolean no_rast;
 
    /** List of all fragment shader variants */
@@ -39,6 +39,7 @@
 #include "lp_context.h"
 #include "lp_state.h"
 #include "lp_query.h"
+#include "lp_texture.h"
 
 #include "draw/draw_context.h"
 
@@ -66,6 +67,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
       return;
    }
 
+   llvmpipe_begin_buffer_access(lp);
+
    if (lp->dirty)
       llvmpipe_update_derived( lp );
 
@@ -153,6 +156,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
     * internally when this condition is seen?)
     */
    draw_flush(draw);
+
+   llvmpipe_end_buffer_access(lp);
 }
 
 
@@ -62,6 +62,10 @@ struct lp_counters
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   unsigned nr_scenes;
+   unsigned nr_scene_waits;    /**< setup had to wait for the rasterizer */
+   int64_t scene_wait_time;    /**< total, in microseconds */
 };
 
 
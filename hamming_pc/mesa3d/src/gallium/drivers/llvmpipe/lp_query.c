@@ -53,14 +53,20 @@ llvmpipe_create_query(struct pipe_context *pipe,
                       unsigned type,
                       unsigned index)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq;
 
    assert(type < PIPE_QUERY_TYPES);
 
-   pq = CALLOC_STRUCT( llvmpipe_query );
+   /* The per-thread counters live right after the query object. */
+   pq = CALLOC(1, sizeof *pq + 2 * num_threads * sizeof(uint64_t));
 
    if (pq) {
       pq->type = type;
+      pq->num_threads = num_threads;
+      pq->start = (uint64_t *) (pq + 1);
+      pq->end = pq->start + num_threads;
    }
 
    return (struct pipe_query *) pq;
@@ -104,6 +110,10 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
    if (pq->fence) {
       /* only have a fence if there was a scene */
       if (!lp_fence_signalled(pq->fence)) {
+         /* The threaded context only calls this from the application
+          * thread for queries it has already flushed, whose fences have
+          * been issued, so this never flushes from the wrong thread.
+          */
          if (!lp_fence_issued(pq->fence))
             llvmpipe_flush(pipe, NULL, __FUNCTION__);
 
@@ -201,8 +211,8 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
    }
 
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+   memset(pq->start, 0, pq->num_threads * sizeof(pq->start[0]));
+   memset(pq->end, 0, pq->num_threads * sizeof(pq->end[0]));
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
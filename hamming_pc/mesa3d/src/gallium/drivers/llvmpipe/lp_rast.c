@@ -33,6 +33,7 @@
 #include "util/u_pack_color.h"
 #include "util/u_string.h"
 #include "util/u_thread.h"
+#include "util/u_atomic.h"
 
 #include "util/os_time.h"
 
@@ -65,21 +66,44 @@ static void
 lp_rast_begin( struct lp_rasterizer *rast,
                struct lp_scene *scene )
 {
+   unsigned num_queues = MAX2(1, rast->num_threads);
+   unsigned num_bins = lp_scene_get_num_bins( scene );
+   unsigned i;
+
    rast->curr_scene = scene;
 
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
    lp_scene_begin_rasterization( scene );
-   lp_scene_bin_iter_begin( scene );
+
+   /* Hand each thread a contiguous run of bins, so that neighbouring
+    * tiles tend to be rasterized by the same thread.
+    */
+   for (i = 0; i < num_queues; i++) {
+      rast->bin_queues[i].next = i * num_bins / num_queues;
+      rast->bin_queues[i].end = (i + 1) * num_bins / num_queues;
+   }
 }
 
 
+/**
+ * Called once all threads are done with the current scene.
+ * Unmaps the framebuffer and signals the scene's fence; after that the
+ * setup module is free to reset and reuse the scene.
+ */
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
-   lp_scene_end_rasterization( rast->curr_scene );
+   struct lp_scene *scene = rast->curr_scene;
+   struct lp_fence *fence = scene->fence;
+
+   lp_scene_end_rasterization( scene );
 
    rast->curr_scene = NULL;
+
+   if (fence) {
+      lp_fence_signal(fence);
+   }
 }
 
 
@@ -644,6 +668,40 @@ rasterize_bin(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Return the next bin for this thread to rasterize, or NULL when all
+ * bins of the scene have been handed out.  Bins come from the thread's
+ * own queue first; once that is exhausted, the remaining bins of the
+ * other threads' queues are stolen.
+ * Called per thread.
+ */
+static struct cmd_bin *
+get_next_bin(struct lp_rasterizer_task *task, int *x, int *y)
+{
+   struct lp_rasterizer *rast = task->rast;
+   struct lp_scene *scene = task->scene;
+   unsigned num_queues = MAX2(1, rast->num_threads);
+   unsigned i;
+
+   for (i = 0; i < num_queues; i++) {
+      struct lp_bin_queue *queue =
+         &rast->bin_queues[(task->thread_index + i) % num_queues];
+
+      if (p_atomic_read(&queue->next) < queue->end) {
+         int index = p_atomic_inc_return(&queue->next) - 1;
+
+         if (index < queue->end) {
+            *x = index % scene->tiles_x;
+            *y = index / scene->tiles_x;
+            return lp_scene_get_bin(scene, *x, *y);
+         }
+      }
+   }
+
+   return NULL;
+}
+
+
 /* An empty bin is one that just loads the contents of the tile and
  * stores them again unchanged.  This typically happens when bins have
  * been flushed for some reason in the middle of a frame, or when
@@ -686,7 +744,7 @@ rasterize_scene(struct lp_rasterizer_task *task,
          int i, j;
 
          assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
+         while ((bin = get_next_bin(task, &i, &j))) {
             if (!is_empty_bin( bin ))
                rasterize_bin(task, bin, i, j);
          }
@@ -708,10 +766,6 @@ rasterize_scene(struct lp_rasterizer_task *task,
    }
 #endif
 
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
-
    task->scene = NULL;
 }
 
@@ -741,8 +795,6 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
       lp_rast_end( rast );
 
       util_fpstate_set(fpstate);
-
-      rast->curr_scene = NULL;
    }
    else {
       /* threaded rendering! */
@@ -760,29 +812,12 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
-void
-lp_rast_finish( struct lp_rasterizer *rast )
-{
-   if (rast->num_threads == 0) {
-      /* nothing to do */
-   }
-   else {
-      int i;
-
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
-   }
-}
-
-
 /**
  * This is the thread's main entrypoint.
  * It's a simple loop:
  *   1. wait for work
  *   2. do work
- *   3. signal that we're done
+ *   3. thread[0] signals the scene's fence
  */
 static int
 thread_function(void *init_data)
@@ -835,17 +870,16 @@ thread_function(void *init_data)
       /* wait for all threads to finish with this scene */
       util_barrier_wait( &rast->barrier );
 
-      /* XXX: shouldn't be necessary:
+      /* thread[0]:
+       *  - unmap the framebuffer surfaces
+       *  - signal the scene's fence
        */
       if (task->thread_index == 0) {
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
 #ifdef _WIN32
@@ -896,6 +930,14 @@ lp_rast_create( unsigned num_threads )
       goto no_full_scenes;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof rast->tasks[0]);
+   rast->threads = CALLOC(MAX2(1, num_threads), sizeof rast->threads[0]);
+   rast->bin_queues = align_malloc(MAX2(1, num_threads) *
+                                   sizeof rast->bin_queues[0], 64);
+   if (!rast->tasks || !rast->threads || !rast->bin_queues) {
+      goto no_tasks;
+   }
+
    for (i = 0; i < MAX2(1, num_threads); i++) {
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
@@ -923,11 +965,17 @@ lp_rast_create( unsigned num_threads )
    return rast;
 
 no_thread_data_cache:
-   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+   for (i = 0; i < MAX2(1, num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
          align_free(rast->tasks[i].thread_data.cache);
       }
    }
+no_tasks:
+   FREE(rast->tasks);
+   FREE(rast->threads);
+   if (rast->bin_queues) {
+      align_free(rast->bin_queues);
+   }
 
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
@@ -979,6 +1027,9 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->tasks);
+   FREE(rast->threads);
+   align_free(rast->bin_queues);
    FREE(rast);
 }
 
@@ -107,6 +107,22 @@ struct lp_rasterizer_task
 };
 
 
+/**
+ * A thread's share of the bins of the scene being rasterized: bin
+ * indices [next, end) in row-major order.  The owning thread takes bins
+ * from its own queue first and then steals from the other threads'
+ * queues, so both the owner and thieves advance 'next' atomically.
+ * Padded to a cache line so that queues of different threads don't
+ * share one.
+ */
+struct lp_bin_queue
+{
+   int next;
+   int end;
+   char pad[64 - 2 * sizeof(int)];
+};
+
+
 /**
  * This is the state required while rasterizing tiles.
  * Note that this contains per-thread information too.
@@ -124,10 +140,13 @@ struct lp_rasterizer
    struct lp_scene *curr_scene;
 
    /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   struct lp_rasterizer_task *tasks;
+
+   /** A bin queue for each rasterization thread */
+   struct lp_bin_queue *bin_queues;
 
    unsigned num_threads;
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
 
    /** For synchronizing the rasterization threads */
    util_barrier barrier;
@@ -62,8 +62,6 @@ lp_scene_create( struct pipe_context *pipe )
    scene->data.head =
       CALLOC_STRUCT(data_block);
 
-   (void) mtx_init(&scene->mutex, mtx_plain);
-
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
    {
@@ -90,9 +88,9 @@ void
 lp_scene_destroy(struct lp_scene *scene)
 {
    lp_fence_reference(&scene->fence, NULL);
-   mtx_destroy(&scene->mutex);
    assert(scene->data.head->next == NULL);
    FREE(scene->data.head);
+   FREE(scene->tile);
    FREE(scene);
 }
 
@@ -104,14 +102,11 @@ lp_scene_destroy(struct lp_scene *scene)
 boolean
 lp_scene_is_empty(struct lp_scene *scene )
 {
-   unsigned x, y;
+   unsigned i;
 
-   for (y = 0; y < TILES_Y; y++) {
-      for (x = 0; x < TILES_X; x++) {
-         const struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
-         if (bin->head) {
-            return FALSE;
-         }
+   for (i = 0; i < scene->num_alloced_tiles; i++) {
+      if (scene->tile[i].head) {
+         return FALSE;
       }
    }
    return TRUE;
@@ -204,12 +199,13 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
 
 /**
- * Free all the temporary data in a scene.
+ * Unmap the framebuffer surfaces.  Called by the rasterizer once all
+ * threads are done with the scene.
  */
 void
 lp_scene_end_rasterization(struct lp_scene *scene )
 {
-   int i, j;
+   int i;
 
    /* Unmap color buffers */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
@@ -232,16 +228,26 @@ lp_scene_end_rasterization(struct lp_scene *scene )
                               zsbuf->u.tex.first_layer);
       scene->zsbuf.map = NULL;
    }
+}
+
 
-   /* Reset all command lists:
+/**
+ * Free all the temporary data in a scene.
+ *
+ * Called from the setup module once the scene's fence has been signalled
+ * (or if the scene was never queued for rasterization), so that the
+ * resource references are dropped in the context's thread rather than
+ * in a rasterizer thread.
+ */
+void
+lp_scene_reset(struct lp_scene *scene)
+{
+   /* Reset all command lists.  Only the first tiles_x * tiles_y bins of
+    * the grid can have been used by this scene.
     */
-   for (i = 0; i < scene->tiles_x; i++) {
-      for (j = 0; j < scene->tiles_y; j++) {
-         struct cmd_bin *bin = lp_scene_get_bin(scene, i, j);
-         bin->head = NULL;
-         bin->tail = NULL;
-         bin->last_state = NULL;
-      }
+   if (scene->tile) {
+      memset(scene->tile, 0,
+             scene->tiles_x * scene->tiles_y * sizeof scene->tile[0]);
    }
 
    /* If there are any bins which weren't cleared by the loop above,
@@ -449,79 +455,60 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
-{
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
-   }
-   return TRUE;
-}
-
-
-void
-lp_scene_bin_iter_begin( struct lp_scene *scene )
-{
-   scene->curr_x = scene->curr_y = -1;
-}
-
-
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
- * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * Make sure the bin grid has room for at least num_tiles bins.
+ * The grid only ever grows; since every bin is empty between scenes
+ * the old contents don't need to be preserved.
  */
-struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
+static boolean
+lp_scene_alloc_bins(struct lp_scene *scene, unsigned num_tiles)
 {
-   struct cmd_bin *bin = NULL;
+   struct cmd_bin *tile;
 
-   mtx_lock(&scene->mutex);
+   if (num_tiles <= scene->num_alloced_tiles)
+      return TRUE;
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
-   }
-
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   tile = CALLOC(num_tiles, sizeof *tile);
+   if (!tile)
+      return FALSE;
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+   FREE(scene->tile);
+   scene->tile = tile;
+   scene->num_alloced_tiles = num_tiles;
+   return TRUE;
 }
 
 
-void lp_scene_begin_binning( struct lp_scene *scene,
-                             struct pipe_framebuffer_state *fb, boolean discard )
+/**
+ * Returns FALSE if the bins for the framebuffer could not be allocated,
+ * in which case the scene has no active tiles.
+ */
+boolean lp_scene_begin_binning( struct lp_scene *scene,
+                                struct pipe_framebuffer_state *fb, boolean discard )
 {
    int i;
    unsigned max_layer = ~0;
+   unsigned tiles_x, tiles_y;
 
    assert(lp_scene_is_empty(scene));
 
    scene->discard = discard;
    util_copy_framebuffer_state(&scene->fb, fb);
 
-   scene->tiles_x = align(fb->width, TILE_SIZE) / TILE_SIZE;
-   scene->tiles_y = align(fb->height, TILE_SIZE) / TILE_SIZE;
-   assert(scene->tiles_x <= TILES_X);
-   assert(scene->tiles_y <= TILES_Y);
+   tiles_x = align(fb->width, TILE_SIZE) / TILE_SIZE;
+   tiles_y = align(fb->height, TILE_SIZE) / TILE_SIZE;
+   assert(tiles_x <= TILES_X);
+   assert(tiles_y <= TILES_Y);
+
+   if (!lp_scene_alloc_bins(scene, tiles_x * tiles_y)) {
+      scene->tiles_x = 0;
+      scene->tiles_y = 0;
+      scene->alloc_failed = TRUE;
+      return FALSE;
+   }
+
+   scene->tiles_x = tiles_x;
+   scene->tiles_y = tiles_y;
 
    /*
     * Determine how many layers the fb has (used for clamping layer value).
@@ -546,6 +533,8 @@ void lp_scene_begin_binning( struct lp_scene *scene,
       max_layer = MIN2(max_layer, zsbuf->u.tex.last_layer - zsbuf->u.tex.first_layer);
    }
    scene->fb_max_layer = max_layer;
+
+   return TRUE;
 }
 
 
@@ -173,10 +173,15 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   mtx_t mutex;
+   /**
+    * The bins, tiles_x * tiles_y of them in row-major order.  The grid
+    * is sized for the current framebuffer rather than for the maximum
+    * surface size, and only grows when a larger framebuffer is bound.
+    * All bins are empty between scenes, so the stride may change freely.
+    */
+   struct cmd_bin *tile;
+   unsigned num_alloced_tiles;
 
-   struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
 };
 
@@ -285,7 +290,9 @@ lp_scene_putback_data( struct lp_scene *scene, unsigned size)
 static inline struct cmd_bin *
 lp_scene_get_bin(struct lp_scene *scene, unsigned x, unsigned y)
 {
-   return &scene->tile[x][y];
+   assert(x < scene->tiles_x);
+   assert(y < scene->tiles_y);
+   return &scene->tile[y * scene->tiles_x + x];
 }
 
 
@@ -378,17 +385,9 @@ lp_scene_get_num_bins( const struct lp_scene *scene )
 }
 
 
-void
-lp_scene_bin_iter_begin( struct lp_scene *scene );
-
-struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
-
-
-
 /* Begin/end binning of a scene
  */
-void
+boolean
 lp_scene_begin_binning( struct lp_scene *scene,
                         struct pipe_framebuffer_state *fb,
                         boolean discard );
@@ -405,6 +404,9 @@ lp_scene_begin_rasterization(struct lp_scene *scene);
 void
 lp_scene_end_rasterization(struct lp_scene *scene );
 
+void
+lp_scene_reset(struct lp_scene *scene);
+
 
 
 
@@ -38,7 +38,10 @@
 
 
 
-#define MAX_SCENE_QUEUE 4
+/* Shared by all contexts of a screen, each of which may have up to
+ * MAX_SCENES scenes in flight.  Enqueueing blocks when the queue is full.
+ */
+#define MAX_SCENE_QUEUE 8
 
 struct scene_packet {
    struct util_packet header;
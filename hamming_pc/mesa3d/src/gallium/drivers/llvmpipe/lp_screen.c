@@ -32,10 +32,16 @@
 #include "util/u_format.h"
 #include "util/u_string.h"
 #include "util/u_format_s3tc.h"
+#include "util/u_atomic.h"
+#include "util/disk_cache.h"
+#include "util/mesa-sha1.h"
 #include "pipe/p_defines.h"
 #include "pipe/p_screen.h"
 #include "draw/draw_context.h"
 #include "gallivm/lp_bld_type.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_misc.h"
 
 #include "os/os_misc.h"
 #include "util/os_time.h"
@@ -67,6 +73,7 @@ static const struct debug_named_value lp_debug_flags[] = {
    { "fence", DEBUG_FENCE, NULL },
    { "mem", DEBUG_MEM, NULL },
    { "fs", DEBUG_FS, NULL },
+   { "cache_stats", DEBUG_CACHE_STATS, NULL },
    DEBUG_NAMED_VALUE_END
 };
 #endif
@@ -558,6 +565,21 @@ llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
    struct sw_winsys *winsys = screen->winsys;
    struct llvmpipe_resource *texture = llvmpipe_resource(resource);
+   struct lp_fence *fence = NULL;
+
+   /* Scenes are rasterized asynchronously, so the state tracker's flush
+    * may return before rendering to the front buffer is done.  We don't
+    * know which context rendered to it, so wait for everything queued
+    * so far; the scene queue is processed in order.
+    */
+   mtx_lock(&screen->rast_mutex);
+   lp_fence_reference(&fence, screen->last_fence);
+   mtx_unlock(&screen->rast_mutex);
+
+   if (fence) {
+      lp_fence_wait(fence);
+      lp_fence_reference(&fence, NULL);
+   }
 
    assert(texture->dt);
    if (texture->dt)
@@ -573,6 +595,16 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   lp_fence_reference(&screen->last_fence, NULL);
+
+   if (screen->disk_shader_cache) {
+      if (LP_DEBUG & DEBUG_CACHE_STATS)
+         debug_printf("llvmpipe: disk shader cache hits = %u, misses = %u\n",
+                      screen->num_disk_shader_cache_hits,
+                      screen->num_disk_shader_cache_misses);
+      disk_cache_destroy(screen->disk_shader_cache);
+   }
+
    lp_jit_screen_cleanup(screen);
 
    if(winsys->destroy)
@@ -580,6 +612,11 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
 
    mtx_destroy(&screen->rast_mutex);
 
+   llvmpipe_release_retired_storage(screen);
+   mtx_destroy(&screen->buffer_mutex);
+
+   slab_destroy_parent(&screen->pool_transfers);
+
    FREE(screen);
 }
 
@@ -619,12 +656,152 @@ llvmpipe_fence_finish(struct pipe_screen *screen,
    return TRUE;
 }
 
+/**
+ * Create a context, running it on a driver thread behind the threaded
+ * context when the state tracker prefers that.
+ *
+ * There is no create_fence callback, so every flush synchronizes with the
+ * driver thread: the fences belong to scenes, which only exist once the
+ * driver thread gets to the flush, so they can't be created ahead of time.
+ */
+static struct pipe_context *
+llvmpipe_screen_create_context(struct pipe_screen *_screen, void *priv,
+                               unsigned flags)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
+   struct pipe_context *pipe;
+
+   pipe = llvmpipe_create_context(_screen, priv, flags);
+   if (!pipe)
+      return NULL;
+
+   if (!(flags & PIPE_CONTEXT_PREFER_THREADED) ||
+       (flags & PIPE_CONTEXT_COMPUTE_ONLY))
+      return pipe;
+
+   return threaded_context_create(pipe, &screen->pool_transfers,
+                                  llvmpipe_replace_buffer_storage,
+                                  NULL, NULL);
+}
+
 static uint64_t
 llvmpipe_get_timestamp(struct pipe_screen *_screen)
 {
    return os_time_get_nano();
 }
 
+/**
+ * Flags which affect the machine code generated for a shader variant
+ * beyond what's in the variant keys and the JIT target: the vector width
+ * and the debug/perf options that change code generation.
+ */
+static uint64_t
+lp_disk_cache_flags(void)
+{
+   uint64_t flags = 0;
+
+   flags |= (uint64_t)(gallivm_debug & (GALLIVM_DEBUG_NO_OPT |
+                                        GALLIVM_DEBUG_NO_BRILINEAR |
+                                        GALLIVM_DEBUG_NO_RHO_APPROX |
+                                        GALLIVM_DEBUG_NO_QUAD_LOD)) << 40;
+   flags |= (uint64_t)(lp_native_vector_width & 0xffff) << 16;
+   flags |= (uint64_t)(LP_PERF & 0xff) << 32;
+
+   return flags;
+}
+
+
+static void
+lp_disk_cache_create(struct llvmpipe_screen *screen)
+{
+   uint32_t mesa_timestamp, llvm_timestamp;
+   unsigned char target_sha1[20];
+   char target_sha1_str[41];
+   char *target, *timestamp_str;
+
+   /* Dumping IR or assembly should show every variant being compiled. */
+   if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM |
+                        GALLIVM_DEBUG_DUMP_BC))
+      return;
+
+   if (!disk_cache_get_function_timestamp(lp_disk_cache_create,
+                                          &mesa_timestamp) ||
+       !disk_cache_get_function_timestamp(LLVMLinkInMCJIT,
+                                          &llvm_timestamp))
+      return;
+
+   /* The exact CPU and features the code is generated for, so that hosts
+    * sharing a cache directory don't run each other's instructions.
+    */
+   target = lp_build_get_jit_target();
+   if (!target)
+      return;
+   _mesa_sha1_compute(target, strlen(target), target_sha1);
+   _mesa_sha1_format(target_sha1_str, target_sha1);
+   free(target);
+
+   if (asprintf(&timestamp_str, "%u_%u_%s",
+                mesa_timestamp, llvm_timestamp, target_sha1_str) == -1)
+      return;
+
+   screen->disk_shader_cache = disk_cache_create("llvmpipe", timestamp_str,
+                                                 lp_disk_cache_flags());
+   free(timestamp_str);
+}
+
+
+/**
+ * Look up the machine code for a shader variant.
+ * On a hit, cache->data holds the object code and must be freed with
+ * free() by the caller.
+ */
+void
+lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                          struct lp_cached_code *cache,
+                          const unsigned char ir_sha1_cache_key[20])
+{
+   cache_key sha1;
+   size_t binary_size;
+   void *buffer;
+
+   if (!screen->disk_shader_cache)
+      return;
+
+   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key,
+                          20, sha1);
+
+   buffer = disk_cache_get(screen->disk_shader_cache, sha1, &binary_size);
+   if (!buffer) {
+      p_atomic_inc(&screen->num_disk_shader_cache_misses);
+      return;
+   }
+
+   cache->data = buffer;
+   cache->data_size = binary_size;
+   p_atomic_inc(&screen->num_disk_shader_cache_hits);
+}
+
+
+/**
+ * Store freshly generated machine code for a shader variant.
+ */
+void
+lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
+                            struct lp_cached_code *cache,
+                            const unsigned char ir_sha1_cache_key[20])
+{
+   cache_key sha1;
+
+   if (!screen->disk_shader_cache || !cache->data_size || cache->dont_cache)
+      return;
+
+   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key,
+                          20, sha1);
+   disk_cache_put(screen->disk_shader_cache, sha1, cache->data,
+                  cache->data_size, NULL);
+}
+
+
 /**
  * Create a new pipe_screen object
  * Note: we're not presently subclassing pipe_screen (no llvmpipe_screen).
@@ -663,7 +840,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.get_paramf = llvmpipe_get_paramf;
    screen->base.is_format_supported = llvmpipe_is_format_supported;
 
-   screen->base.context_create = llvmpipe_create_context;
+   screen->base.context_create = llvmpipe_screen_create_context;
    screen->base.flush_frontbuffer = llvmpipe_flush_frontbuffer;
    screen->base.fence_reference = llvmpipe_fence_reference;
    screen->base.fence_finish = llvmpipe_fence_finish;
@@ -687,5 +864,14 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    }
    (void) mtx_init(&screen->rast_mutex, mtx_plain);
 
+   (void) mtx_init(&screen->buffer_mutex, mtx_plain);
+   list_inithead(&screen->contexts);
+   list_inithead(&screen->retired_storage);
+
+   slab_create_parent(&screen->pool_transfers,
+                      sizeof(struct llvmpipe_transfer), 16);
+
+   lp_disk_cache_create(screen);
+
    return &screen->base;
 }
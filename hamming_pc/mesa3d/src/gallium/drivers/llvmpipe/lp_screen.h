@@ -37,10 +37,15 @@
 #include "pipe/p_screen.h"
 #include "pipe/p_defines.h"
 #include "os/os_thread.h"
+#include "util/list.h"
+#include "util/slab.h"
 #include "gallivm/lp_bld.h"
 
 
 struct sw_winsys;
+struct disk_cache;
+struct lp_cached_code;
+struct lp_fence;
 
 
 struct llvmpipe_screen
@@ -55,8 +60,31 @@ struct llvmpipe_screen
     */
    unsigned timestamp;
 
+   /* Increments whenever the storage of a buffer is replaced.  Contexts
+    * track this to rebind state that holds on to the old data pointer.
+    */
+   unsigned buffer_timestamp;
+
+   /** Guards buffer_timestamp, contexts and retired_storage */
+   mtx_t buffer_mutex;
+   struct list_head contexts;
+
+   /** Replaced buffer storage that draws of other contexts may still read */
+   struct list_head retired_storage;
+
    struct lp_rasterizer *rast;
    mtx_t rast_mutex;
+
+   /** Transfers the threaded context allocates for staging uploads */
+   struct slab_parent_pool pool_transfers;
+
+   /** Fence of the last scene queued by any context, under rast_mutex */
+   struct lp_fence *last_fence;
+
+   /** Cache of JIT-compiled shader variants, may be NULL */
+   struct disk_cache *disk_shader_cache;
+   unsigned num_disk_shader_cache_hits;
+   unsigned num_disk_shader_cache_misses;
 };
 
 
@@ -70,4 +98,15 @@ llvmpipe_screen( struct pipe_screen *pipe )
 
 
 
+void
+lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                          struct lp_cached_code *cache,
+                          const unsigned char ir_sha1_cache_key[20]);
+
+void
+lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
+                            struct lp_cached_code *cache,
+                            const unsigned char ir_sha1_cache_key[20]);
+
+
 #endif /* LP_SCREEN_H */
@@ -48,6 +48,7 @@
 #include "lp_texture.h"
 #include "lp_debug.h"
 #include "lp_fence.h"
+#include "lp_perf.h"
 #include "lp_query.h"
 #include "lp_rast.h"
 #include "lp_setup_context.h"
@@ -64,7 +65,7 @@ static boolean set_scene_state( struct lp_setup_context *, enum setup_state,
 static boolean try_update_scene_state( struct lp_setup_context *setup );
 
 
-static void
+static boolean
 lp_setup_get_empty_scene(struct lp_setup_context *setup)
 {
    assert(setup->scene == NULL);
@@ -74,16 +75,32 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
 
    setup->scene = setup->scenes[setup->scene_idx];
 
-   if (setup->scene->fence) {
+   /* The scene may still be queued or being rasterized.  If so we've
+    * got ahead of the rasterizer by MAX_SCENES scenes and have to wait.
+    */
+   if (setup->scene->fence &&
+       !lp_fence_signalled(setup->scene->fence)) {
+      int64_t start = 0;
+
       if (LP_DEBUG & DEBUG_SETUP)
          debug_printf("%s: wait for scene %d\n",
                       __FUNCTION__, setup->scene->fence->id);
 
+      if (LP_DEBUG & DEBUG_COUNTERS)
+         start = os_time_get();
+
       lp_fence_wait(setup->scene->fence);
+
+      LP_COUNT(nr_scene_waits);
+      if (LP_DEBUG & DEBUG_COUNTERS)
+         LP_COUNT_ADD(scene_wait_time, os_time_get() - start);
    }
 
-   lp_scene_begin_binning(setup->scene, &setup->fb, setup->rasterizer_discard);
+   /* Drop whatever the scene still holds from its previous use */
+   lp_scene_reset(setup->scene);
 
+   return lp_scene_begin_binning(setup->scene, &setup->fb,
+                                 setup->rasterizer_discard);
 }
 
 
@@ -167,21 +184,18 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
 
    mtx_lock(&screen->rast_mutex);
 
-   /* FIXME: We enqueue the scene then wait on the rasterizer to finish.
-    * This means we never actually run any vertex stuff in parallel to
-    * rasterization (not in the same context at least) which is what the
-    * multiple scenes per setup is about - when we get a new empty scene
-    * any old one is already empty again because we waited here for
-    * raster tasks to be finished. Ideally, we shouldn't need to wait here
-    * and rely on fences elsewhere when waiting is necessary.
-    * Certainly, lp_scene_end_rasterization() would need to be deferred too
-    * and there's probably other bits why this doesn't actually work.
+   /* Don't wait for the rasterizer here: binning of the next scene
+    * overlaps with rasterization of this one.  The scene is reset when
+    * lp_setup_get_empty_scene() comes round to it again, after waiting
+    * on its fence; anything else that needs the results waits on
+    * setup->last_fence (or screen->last_fence) instead.
     */
+   lp_fence_reference(&screen->last_fence, scene->fence);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    mtx_unlock(&screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
+   LP_COUNT(nr_scenes);
+
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -199,9 +213,10 @@ begin_binning( struct lp_setup_context *setup )
    assert(scene);
    assert(scene->fence == NULL);
 
-   /* Always create a fence:
+   /* Always create a fence.  It is signalled once, by the rasterizer,
+    * after all threads are done with the scene:
     */
-   scene->fence = lp_fence_create(MAX2(1, setup->num_threads));
+   scene->fence = lp_fence_create(1);
    if (!scene->fence)
       return FALSE;
 
@@ -311,8 +326,10 @@ set_scene_state( struct lp_setup_context *setup,
 
    /* wait for a free/empty scene
     */
-   if (old_state == SETUP_FLUSHED) 
-      lp_setup_get_empty_scene(setup);
+   if (old_state == SETUP_FLUSHED) {
+      if (!lp_setup_get_empty_scene(setup))
+         goto fail;
+   }
 
    switch (new_state) {
    case SETUP_CLEARED:
@@ -342,7 +359,7 @@ set_scene_state( struct lp_setup_context *setup,
 
 fail:
    if (setup->scene) {
-      lp_scene_end_rasterization(setup->scene);
+      lp_scene_reset(setup->scene);
       setup->scene = NULL;
    }
 
@@ -961,6 +978,23 @@ lp_setup_set_fragment_sampler_state(struct lp_setup_context *setup,
 }
 
 
+static boolean
+fb_references_resource(const struct pipe_framebuffer_state *fb,
+                       const struct pipe_resource *texture)
+{
+   unsigned i;
+
+   for (i = 0; i < fb->nr_cbufs; i++) {
+      if (fb->cbufs[i] && fb->cbufs[i]->texture == texture)
+         return TRUE;
+   }
+   if (fb->zsbuf && fb->zsbuf->texture == texture)
+      return TRUE;
+
+   return FALSE;
+}
+
+
 /**
  * Is the given texture referenced by any scene?
  * Note: we have to check all scenes including any scenes currently
@@ -972,23 +1006,30 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
 {
    unsigned i;
 
+   unsigned referenced = LP_UNREFERENCED;
+
    /* check the render targets */
-   for (i = 0; i < setup->fb.nr_cbufs; i++) {
-      if (setup->fb.cbufs[i] && setup->fb.cbufs[i]->texture == texture)
-         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
-   }
-   if (setup->fb.zsbuf && setup->fb.zsbuf->texture == texture) {
+   if (fb_references_resource(&setup->fb, texture))
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
-   }
 
-   /* check textures referenced by the scene */
+   /* check the scenes which are being binned or are still in flight;
+    * scenes whose fence has been signalled only hold on to their
+    * references until they are reused.
+    */
    for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
-         return LP_REFERENCED_FOR_READ;
-      }
+      struct lp_scene *scene = setup->scenes[i];
+
+      if (scene->fence && lp_fence_signalled(scene->fence))
+         continue;
+
+      if (fb_references_resource(&scene->fb, texture))
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+
+      if (lp_scene_is_resource_referenced(scene, texture))
+         referenced = LP_REFERENCED_FOR_READ;
    }
 
-   return LP_UNREFERENCED;
+   return referenced;
 }
 
 
@@ -1156,13 +1197,21 @@ try_update_scene_state( struct lp_setup_context *setup )
          setup->fs.stored = stored;
          
          /* The scene now references the textures in the rasterization
-          * state record.  Note that now.
+          * state record.  Note that now.  A buffer whose storage was
+          * replaced is read through the buffer that owns it, which may
+          * be replaced again before the scene is rasterized.
           */
          for (i = 0; i < ARRAY_SIZE(setup->fs.current_tex); i++) {
             if (setup->fs.current_tex[i]) {
+               struct pipe_resource *storage =
+                  llvmpipe_resource(setup->fs.current_tex[i])->storage;
+
                if (!lp_scene_add_resource_reference(scene,
                                                     setup->fs.current_tex[i],
-                                                    new_scene)) {
+                                                    new_scene) ||
+                   (storage &&
+                    !lp_scene_add_resource_reference(scene, storage,
+                                                     new_scene))) {
                   assert(!new_scene);
                   return FALSE;
                }
@@ -1283,13 +1332,14 @@ lp_setup_destroy( struct lp_setup_context *setup )
       pipe_resource_reference(&setup->constants[i].current.buffer, NULL);
    }
 
-   /* free the scenes in the 'empty' queue */
+   /* wait for any scenes still in flight, then free them all */
    for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
       struct lp_scene *scene = setup->scenes[i];
 
-      if (scene->fence)
+      if (scene->fence && scene->fence->issued)
          lp_fence_wait(scene->fence);
 
+      lp_scene_reset(scene);
       lp_scene_destroy(scene);
    }
 
@@ -54,9 +54,12 @@
 struct lp_setup_variant;
 
 
-/** Max number of scenes */
-/* XXX: make multiple scenes per context work, see lp_setup_rasterize_scene */
-#define MAX_SCENES 1
+/**
+ * Max number of scenes per context.  While the rasterizer works on one
+ * scene the setup module bins the next ones; it only has to wait once
+ * it gets MAX_SCENES scenes ahead.
+ */
+#define MAX_SCENES 4
 
 
 
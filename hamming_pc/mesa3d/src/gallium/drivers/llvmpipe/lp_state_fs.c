@@ -68,6 +68,7 @@
 #include "util/simple_list.h"
 #include "util/u_dual_blend.h"
 #include "util/os_time.h"
+#include "util/mesa-sha1.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
 #include "tgsi/tgsi_dump.h"
@@ -102,6 +103,7 @@
 #include "lp_flush.h"
 #include "lp_state_fs.h"
 #include "lp_rast.h"
+#include "lp_screen.h"
 
 
 /** Fragment shader number (for debugging) */
@@ -2486,8 +2488,11 @@ generate_fragment(struct llvmpipe_context *lp,
 
    blend_vec_type = lp_build_vec_type(gallivm, blend_type);
 
-   util_snprintf(func_name, sizeof(func_name), "fs%u_variant%u_%s",
-                 shader->no, variant->no, partial_mask ? "partial" : "whole");
+   /* The name must not depend on the shader/variant numbers, as the
+    * machine code may come from the shader cache of another process.
+    */
+   util_snprintf(func_name, sizeof(func_name), "fs_variant_%s",
+                 partial_mask ? "partial" : "whole");
 
    arg_types[0] = variant->jit_context_ptr_type;       /* context */
    arg_types[1] = int32_type;                          /* x */
@@ -2797,10 +2802,14 @@ generate_variant(struct llvmpipe_context *lp,
                  struct lp_fragment_shader *shader,
                  const struct lp_fragment_shader_variant_key *key)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc = NULL;
    boolean fullcolormask;
    char module_name[64];
+   struct lp_cached_code cached = { 0 };
+   unsigned char ir_sha1_cache_key[20];
+   boolean needs_caching = FALSE;
 
    variant = CALLOC_STRUCT(lp_fragment_shader_variant);
    if (!variant)
@@ -2809,8 +2818,23 @@ generate_variant(struct llvmpipe_context *lp,
    util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
                  shader->no, shader->variants_created);
 
-   variant->gallivm = gallivm_create(module_name, lp->context);
+   if (screen->disk_shader_cache) {
+      struct mesa_sha1 ctx;
+
+      _mesa_sha1_init(&ctx);
+      _mesa_sha1_update(&ctx, shader->base.tokens,
+                        tgsi_num_tokens(shader->base.tokens) *
+                        sizeof(struct tgsi_token));
+      _mesa_sha1_update(&ctx, key, shader->variant_key_size);
+      _mesa_sha1_final(&ctx, ir_sha1_cache_key);
+
+      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+      needs_caching = !cached.data_size;
+   }
+
+   variant->gallivm = gallivm_create(module_name, lp->context, &cached);
    if (!variant->gallivm) {
+      free(cached.data);
       FREE(variant);
       return NULL;
    }
@@ -2888,7 +2912,12 @@ generate_variant(struct llvmpipe_context *lp,
       variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
    }
 
+   if (needs_caching) {
+      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
+   }
+
    gallivm_free_ir(variant->gallivm);
+   free(cached.data);
 
    return variant;
 }
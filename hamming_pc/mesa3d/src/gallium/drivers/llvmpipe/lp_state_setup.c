@@ -30,6 +30,7 @@
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "util/os_time.h"
+#include "util/mesa-sha1.h"
 #include "gallivm/lp_bld_arit.h"
 #include "gallivm/lp_bld_bitarit.h"
 #include "gallivm/lp_bld_const.h"
@@ -710,13 +711,18 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    struct lp_setup_variant *variant = NULL;
    struct gallivm_state *gallivm;
    struct lp_setup_args args;
-   char func_name[64];
+   char module_name[64];
+   const char *func_name = "setup_variant";
    LLVMTypeRef vec4f_type;
    LLVMTypeRef func_type;
    LLVMTypeRef arg_types[7];
    LLVMBasicBlockRef block;
    LLVMBuilderRef builder;
    int64_t t0 = 0, t1;
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_cached_code cached = { 0 };
+   unsigned char ir_sha1_cache_key[20];
+   boolean needs_caching = FALSE;
 
    if (0)
       goto fail;
@@ -727,10 +733,17 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    variant->no = setup_no++;
 
-   util_snprintf(func_name, sizeof(func_name), "setup_variant_%u",
+   util_snprintf(module_name, sizeof(module_name), "setup_variant_%u",
                  variant->no);
 
-   variant->gallivm = gallivm = gallivm_create(func_name, lp->context);
+   if (screen->disk_shader_cache) {
+      _mesa_sha1_compute(key, key->size, ir_sha1_cache_key);
+      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+      needs_caching = !cached.data_size;
+   }
+
+   variant->gallivm = gallivm = gallivm_create(module_name, lp->context,
+                                               &cached);
    if (!variant->gallivm) {
       goto fail;
    }
@@ -805,7 +818,12 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    if (!variant->jit_function)
       goto fail;
 
+   if (needs_caching) {
+      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
+   }
+
    gallivm_free_ir(variant->gallivm);
+   free(cached.data);
 
    /*
     * Update timing information:
@@ -825,6 +843,7 @@ fail:
       }
       FREE(variant);
    }
+   free(cached.data);
 
    return NULL;
 }
@@ -42,6 +42,8 @@
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "util/u_transfer.h"
+#include "util/u_atomic.h"
+#include "draw/draw_context.h"
 
 #include "lp_context.h"
 #include "lp_flush.h"
@@ -69,7 +71,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
                         struct llvmpipe_resource *lpr,
                         boolean allocate)
 {
-   struct pipe_resource *pt = &lpr->base;
+   struct pipe_resource *pt = &lpr->base.b;
    unsigned level;
    unsigned width = pt->width0;
    unsigned height = pt->height0;
@@ -106,7 +108,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
          align_x = align_y = 1;
       else {
          align_x = LP_RASTER_BLOCK_SIZE;
-         if (llvmpipe_resource_is_1d(&lpr->base))
+         if (llvmpipe_resource_is_1d(&lpr->base.b))
             align_y = 1;
          else
             align_y = LP_RASTER_BLOCK_SIZE;
@@ -132,16 +134,16 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
       lpr->img_stride[level] = lpr->row_stride[level] * nblocksy;
 
       /* Number of 3D image slices, cube faces or texture array layers */
-      if (lpr->base.target == PIPE_TEXTURE_CUBE) {
+      if (lpr->base.b.target == PIPE_TEXTURE_CUBE) {
          assert(layers == 6);
       }
 
-      if (lpr->base.target == PIPE_TEXTURE_3D)
+      if (lpr->base.b.target == PIPE_TEXTURE_3D)
          num_slices = depth;
-      else if (lpr->base.target == PIPE_TEXTURE_1D_ARRAY ||
-               lpr->base.target == PIPE_TEXTURE_2D_ARRAY ||
-               lpr->base.target == PIPE_TEXTURE_CUBE ||
-               lpr->base.target == PIPE_TEXTURE_CUBE_ARRAY)
+      else if (lpr->base.b.target == PIPE_TEXTURE_1D_ARRAY ||
+               lpr->base.b.target == PIPE_TEXTURE_2D_ARRAY ||
+               lpr->base.b.target == PIPE_TEXTURE_CUBE ||
+               lpr->base.b.target == PIPE_TEXTURE_CUBE_ARRAY)
          num_slices = layers;
       else
          num_slices = 1;
@@ -193,7 +195,7 @@ llvmpipe_can_create_resource(struct pipe_screen *screen,
 {
    struct llvmpipe_resource lpr;
    memset(&lpr, 0, sizeof(lpr));
-   lpr.base = *res;
+   lpr.base.b = *res;
    return llvmpipe_texture_layout(llvmpipe_screen(screen), &lpr, false);
 }
 
@@ -208,12 +210,12 @@ llvmpipe_displaytarget_layout(struct llvmpipe_screen *screen,
    /* Round up the surface size to a multiple of the tile size to
     * avoid tile clipping.
     */
-   const unsigned width = MAX2(1, align(lpr->base.width0, TILE_SIZE));
-   const unsigned height = MAX2(1, align(lpr->base.height0, TILE_SIZE));
+   const unsigned width = MAX2(1, align(lpr->base.b.width0, TILE_SIZE));
+   const unsigned height = MAX2(1, align(lpr->base.b.height0, TILE_SIZE));
 
    lpr->dt = winsys->displaytarget_create(winsys,
-                                          lpr->base.bind,
-                                          lpr->base.format,
+                                          lpr->base.b.bind,
+                                          lpr->base.b.format,
                                           width, height,
                                           64,
                                           map_front_private,
@@ -246,14 +248,14 @@ llvmpipe_resource_create_front(struct pipe_screen *_screen,
    if (!lpr)
       return NULL;
 
-   lpr->base = *templat;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = &screen->base;
+   lpr->base.b = *templat;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = &screen->base;
 
-   /* assert(lpr->base.bind); */
+   /* assert(lpr->base.b.bind); */
 
-   if (llvmpipe_resource_is_texture(&lpr->base)) {
-      if (lpr->base.bind & (PIPE_BIND_DISPLAY_TARGET |
+   if (llvmpipe_resource_is_texture(&lpr->base.b)) {
+      if (lpr->base.b.bind & (PIPE_BIND_DISPLAY_TARGET |
                             PIPE_BIND_SCANOUT |
                             PIPE_BIND_SHARED)) {
          /* displayable surface */
@@ -292,12 +294,13 @@ llvmpipe_resource_create_front(struct pipe_screen *_screen,
    }
 
    lpr->id = id_counter++;
+   threaded_resource_init(&lpr->base.b);
 
 #ifdef DEBUG
    insert_at_tail(&resource_list, lpr);
 #endif
 
-   return &lpr->base;
+   return &lpr->base.b;
 
  fail:
    FREE(lpr);
@@ -332,11 +335,17 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
          lpr->tex_data = NULL;
       }
    }
+   else if (lpr->storage) {
+      pipe_resource_reference(&lpr->storage, NULL);
+      align_free(lpr->own_data);
+   }
    else if (!lpr->userBuffer) {
       assert(lpr->data);
       align_free(lpr->data);
    }
 
+   threaded_resource_deinit(pt);
+
 #ifdef DEBUG
    if (lpr->next)
       remove_from_list(lpr);
@@ -450,17 +459,17 @@ llvmpipe_resource_from_handle(struct pipe_screen *screen,
       goto no_lpr;
    }
 
-   lpr->base = *template;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = screen;
+   lpr->base.b = *template;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = screen;
 
    /*
     * Looks like unaligned displaytargets work just fine,
     * at least sampler/render ones.
     */
 #if 0
-   assert(lpr->base.width0 == width);
-   assert(lpr->base.height0 == height);
+   assert(lpr->base.b.width0 == width);
+   assert(lpr->base.b.height0 == height);
 #endif
 
    lpr->dt = winsys->displaytarget_from_handle(winsys,
@@ -472,12 +481,14 @@ llvmpipe_resource_from_handle(struct pipe_screen *screen,
    }
 
    lpr->id = id_counter++;
+   threaded_resource_init(&lpr->base.b);
+   lpr->base.is_shared = true;
 
 #ifdef DEBUG
    insert_at_tail(&resource_list, lpr);
 #endif
 
-   return &lpr->base;
+   return &lpr->base.b;
 
 no_dt:
    FREE(lpr);
@@ -504,6 +515,38 @@ llvmpipe_resource_get_handle(struct pipe_screen *screen,
 }
 
 
+/**
+ * Flag the fragment constants as dirty if \p resource is one of them and
+ * is about to be written.
+ */
+static void
+check_constant_buffer_write(struct llvmpipe_context *llvmpipe,
+                            struct pipe_resource *resource)
+{
+   unsigned i;
+
+   if (!(resource->bind & PIPE_BIND_CONSTANT_BUFFER))
+      return;
+
+   for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_FRAGMENT]); ++i) {
+      if (resource == llvmpipe->constants[PIPE_SHADER_FRAGMENT][i].buffer) {
+         /* constants may have changed */
+         llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
+         break;
+      }
+   }
+}
+
+
+/**
+ * Map a resource for the state tracker.
+ *
+ * Under the threaded context, buffer maps come with
+ * TC_TRANSFER_MAP_NO_INFER_UNSYNCHRONIZED and TC_TRANSFER_MAP_NO_INVALIDATE.
+ * llvmpipe never infers unsynchronized maps or invalidates buffers on its
+ * own, so neither changes anything here.  TC_TRANSFER_MAP_THREADED_UNSYNC
+ * maps run on the application thread and only touch the resource.
+ */
 static void *
 llvmpipe_transfer_map( struct pipe_context *pipe,
                        struct pipe_resource *resource,
@@ -546,23 +589,18 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
       }
    }
 
-   /* Check if we're mapping a current constant buffer */
+   /* Check if we're mapping a current constant buffer.  Unsynchronized maps
+    * from the threaded context come from the application thread, which must
+    * not touch the context, so those are checked at unmap time instead.
+    */
    if ((usage & PIPE_TRANSFER_WRITE) &&
-       (resource->bind & PIPE_BIND_CONSTANT_BUFFER)) {
-      unsigned i;
-      for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_FRAGMENT]); ++i) {
-         if (resource == llvmpipe->constants[PIPE_SHADER_FRAGMENT][i].buffer) {
-            /* constants may have changed */
-            llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
-            break;
-         }
-      }
-   }
+       !(usage & TC_TRANSFER_MAP_THREADED_UNSYNC))
+      check_constant_buffer_write(llvmpipe, resource);
 
    lpt = CALLOC_STRUCT(llvmpipe_transfer);
    if (!lpt)
       return NULL;
-   pt = &lpt->base;
+   pt = &lpt->base.b;
    pipe_resource_reference(&pt->resource, resource);
    pt->box = *box;
    pt->level = level;
@@ -594,7 +632,7 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
       printf("transfer map tex %u  mode %s\n", lpr->id, mode);
    }
 
-   format = lpr->base.format;
+   format = lpr->base.b.format;
 
    map = llvmpipe_resource_map(resource,
                                level,
@@ -608,7 +646,7 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
    if (usage & PIPE_TRANSFER_WRITE) {
       /* Do something to notify sharing contexts of a texture change.
        */
-      screen->timestamp++;
+      p_atomic_inc(&screen->timestamp);
    }
 
    map +=
@@ -625,6 +663,10 @@ llvmpipe_transfer_unmap(struct pipe_context *pipe,
 {
    assert(transfer->resource);
 
+   if ((transfer->usage & PIPE_TRANSFER_WRITE) &&
+       (transfer->usage & TC_TRANSFER_MAP_THREADED_UNSYNC))
+      check_constant_buffer_write(llvmpipe_context(pipe), transfer->resource);
+
    llvmpipe_resource_unmap(transfer->resource,
                            transfer->level,
                            transfer->box.z);
@@ -638,6 +680,198 @@ llvmpipe_transfer_unmap(struct pipe_context *pipe,
    FREE(transfer);
 }
 
+/**
+ * Buffer storage replaced while draws of other contexts may still read it
+ * through their draw module.
+ */
+struct llvmpipe_retired_storage
+{
+   struct list_head link;
+   struct pipe_resource *storage;
+
+   /** Screen buffer_timestamp right after the replacement */
+   unsigned timestamp;
+};
+
+
+/**
+ * Release the retired storage that no draw in progress can read anymore.
+ * Called with buffer_mutex held.
+ */
+static void
+release_retired_storage_locked(struct llvmpipe_screen *screen)
+{
+   struct llvmpipe_retired_storage *retired, *next;
+   struct llvmpipe_context *ctx;
+   unsigned oldest = screen->buffer_timestamp;
+
+   LIST_FOR_EACH_ENTRY(ctx, &screen->contexts, screen_link) {
+      if (ctx->drawing && (int)(ctx->draw_timestamp - oldest) < 0)
+         oldest = ctx->draw_timestamp;
+   }
+
+   LIST_FOR_EACH_ENTRY_SAFE(retired, next, &screen->retired_storage, link) {
+      if ((int)(oldest - retired->timestamp) < 0)
+         continue;
+
+      pipe_resource_reference(&retired->storage, NULL);
+      LIST_DEL(&retired->link);
+      FREE(retired);
+   }
+}
+
+
+/**
+ * Make \p dst use the storage of \p src.
+ *
+ * The threaded context invalidates a buffer by allocating \p src and
+ * handing its storage to \p dst.  \p src stays the buffer that the
+ * application thread maps unsynchronized, so both keep pointing at the same
+ * memory and \p dst holds a reference to \p src to keep it alive.
+ *
+ * Every context sharing \p dst may have its old data pointer bound, so
+ * this bumps the screen's buffer timestamp and each context rebinds before
+ * its next draw.  Scenes binned before that reference the storage they
+ * read.  Draws already running on other contexts may still read the old
+ * memory through their draw module though, so the buffer's own allocation
+ * is kept until it is destroyed and intermediate storage is retired until
+ * those draws are done.
+ */
+void
+llvmpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct llvmpipe_resource *lp_dst = llvmpipe_resource(dst);
+   struct llvmpipe_resource *lp_src = llvmpipe_resource(src);
+   struct llvmpipe_retired_storage *retired = NULL;
+
+   assert(dst->target == PIPE_BUFFER && src->target == PIPE_BUFFER);
+   assert(!lp_dst->userBuffer && !lp_src->storage);
+
+   /* Out of memory, the old storage is released right away then */
+   if (lp_dst->storage)
+      retired = CALLOC_STRUCT(llvmpipe_retired_storage);
+
+   mtx_lock(&screen->buffer_mutex);
+
+   /* The first storage is our own and stays around until the resource is
+    * destroyed, since it may still be mapped.  Intermediate storage is
+    * retired until no draw that began before this can read it anymore.
+    */
+   if (!lp_dst->storage)
+      lp_dst->own_data = lp_dst->data;
+   else if (retired) {
+      retired->storage = lp_dst->storage;
+      lp_dst->storage = NULL;
+   }
+
+   pipe_resource_reference(&lp_dst->storage, src);
+   lp_dst->data = lp_src->data;
+
+   screen->buffer_timestamp++;
+
+   if (retired) {
+      retired->timestamp = screen->buffer_timestamp;
+      list_addtail(&retired->link, &screen->retired_storage);
+      release_retired_storage_locked(screen);
+   }
+
+   mtx_unlock(&screen->buffer_mutex);
+}
+
+
+/**
+ * Rebind the buffer state that holds on to a data pointer, after the
+ * storage of some buffer was replaced.
+ */
+static void
+llvmpipe_rebind_buffers(struct llvmpipe_context *llvmpipe)
+{
+   unsigned sh, i;
+
+   llvmpipe->buffer_timestamp = llvmpipe->draw_timestamp;
+
+   for (sh = 0; sh < PIPE_SHADER_TYPES; sh++) {
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[sh]); i++) {
+         const struct pipe_constant_buffer *cb = &llvmpipe->constants[sh][i];
+
+         if (!cb->buffer)
+            continue;
+
+         if (sh == PIPE_SHADER_VERTEX || sh == PIPE_SHADER_GEOMETRY) {
+            draw_set_mapped_constant_buffer(llvmpipe->draw, sh, i,
+                                            (ubyte *)
+                                            llvmpipe_resource_data(cb->buffer) +
+                                            cb->buffer_offset,
+                                            cb->buffer_size);
+         }
+         else {
+            llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
+         }
+      }
+   }
+
+   for (i = 0; i < llvmpipe->num_sampler_views[PIPE_SHADER_FRAGMENT]; i++) {
+      struct pipe_sampler_view *view =
+         llvmpipe->sampler_views[PIPE_SHADER_FRAGMENT][i];
+
+      if (view && view->texture->target == PIPE_BUFFER)
+         llvmpipe->dirty |= LP_NEW_SAMPLER_VIEW;
+   }
+}
+
+
+/**
+ * Called before drawing.  Keeps storage replaced from now on alive until
+ * the matching llvmpipe_end_buffer_access, and rebinds buffers whose
+ * storage was replaced since the last draw.
+ */
+void
+llvmpipe_begin_buffer_access(struct llvmpipe_context *llvmpipe)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(llvmpipe->pipe.screen);
+
+   mtx_lock(&screen->buffer_mutex);
+   llvmpipe->draw_timestamp = screen->buffer_timestamp;
+   llvmpipe->drawing = TRUE;
+   mtx_unlock(&screen->buffer_mutex);
+
+   if (llvmpipe->buffer_timestamp != llvmpipe->draw_timestamp)
+      llvmpipe_rebind_buffers(llvmpipe);
+}
+
+
+void
+llvmpipe_end_buffer_access(struct llvmpipe_context *llvmpipe)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(llvmpipe->pipe.screen);
+
+   mtx_lock(&screen->buffer_mutex);
+   llvmpipe->drawing = FALSE;
+   if (!LIST_IS_EMPTY(&screen->retired_storage))
+      release_retired_storage_locked(screen);
+   mtx_unlock(&screen->buffer_mutex);
+}
+
+
+/**
+ * Release all retired storage, when no context is left to read it.
+ */
+void
+llvmpipe_release_retired_storage(struct llvmpipe_screen *screen)
+{
+   struct llvmpipe_retired_storage *retired, *next;
+
+   LIST_FOR_EACH_ENTRY_SAFE(retired, next, &screen->retired_storage, link) {
+      pipe_resource_reference(&retired->storage, NULL);
+      LIST_DEL(&retired->link);
+      FREE(retired);
+   }
+}
+
+
 unsigned int
 llvmpipe_is_resource_referenced( struct pipe_context *pipe,
                                  struct pipe_resource *presource,
@@ -698,20 +932,24 @@ llvmpipe_user_buffer_create(struct pipe_screen *screen,
    if (!buffer)
       return NULL;
 
-   pipe_reference_init(&buffer->base.reference, 1);
-   buffer->base.screen = screen;
-   buffer->base.format = PIPE_FORMAT_R8_UNORM; /* ?? */
-   buffer->base.bind = bind_flags;
-   buffer->base.usage = PIPE_USAGE_IMMUTABLE;
-   buffer->base.flags = 0;
-   buffer->base.width0 = bytes;
-   buffer->base.height0 = 1;
-   buffer->base.depth0 = 1;
-   buffer->base.array_size = 1;
+   pipe_reference_init(&buffer->base.b.reference, 1);
+   buffer->base.b.screen = screen;
+   buffer->base.b.format = PIPE_FORMAT_R8_UNORM; /* ?? */
+   buffer->base.b.bind = bind_flags;
+   buffer->base.b.usage = PIPE_USAGE_IMMUTABLE;
+   buffer->base.b.flags = 0;
+   buffer->base.b.width0 = bytes;
+   buffer->base.b.height0 = 1;
+   buffer->base.b.depth0 = 1;
+   buffer->base.b.array_size = 1;
    buffer->userBuffer = TRUE;
    buffer->data = ptr;
 
-   return &buffer->base;
+   threaded_resource_init(&buffer->base.b);
+   buffer->base.is_user_ptr = true;
+   util_range_add(&buffer->base.valid_buffer_range, 0, bytes);
+
+   return &buffer->base.b;
 }
 
 
@@ -736,7 +974,7 @@ llvmpipe_get_texture_image_address(struct llvmpipe_resource *lpr,
 {
    unsigned offset;
 
-   assert(llvmpipe_resource_is_texture(&lpr->base));
+   assert(llvmpipe_resource_is_texture(&lpr->base.b));
 
    offset = lpr->mip_offsets[level];
 
@@ -776,11 +1014,11 @@ llvmpipe_print_resources(void)
 
    debug_printf("LLVMPIPE: current resources:\n");
    foreach(lpr, &resource_list) {
-      unsigned size = llvmpipe_resource_size(&lpr->base);
+      unsigned size = llvmpipe_resource_size(&lpr->base.b);
       debug_printf("resource %u at %p, size %ux%ux%u: %u bytes, refcount %u\n",
                    lpr->id, (void *) lpr,
-                   lpr->base.width0, lpr->base.height0, lpr->base.depth0,
-                   size, lpr->base.reference.count);
+                   lpr->base.b.width0, lpr->base.b.height0, lpr->base.b.depth0,
+                   size, lpr->base.b.reference.count);
       total += size;
       n++;
    }
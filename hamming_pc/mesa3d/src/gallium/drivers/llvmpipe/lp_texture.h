@@ -31,6 +31,7 @@
 
 #include "pipe/p_state.h"
 #include "util/u_debug.h"
+#include "util/u_threaded_context.h"
 #include "lp_limits.h"
 
 
@@ -45,6 +46,7 @@ enum lp_texture_usage
 struct pipe_context;
 struct pipe_screen;
 struct llvmpipe_context;
+struct llvmpipe_screen;
 
 struct sw_displaytarget;
 
@@ -58,7 +60,7 @@ struct sw_displaytarget;
  */
 struct llvmpipe_resource
 {
-   struct pipe_resource base;
+   struct threaded_resource base;
 
    /** Row stride in bytes */
    unsigned row_stride[LP_MAX_TEXTURE_LEVELS];
@@ -85,6 +87,20 @@ struct llvmpipe_resource
     */
    void *data;
 
+   /**
+    * The buffer that owns \c data, if it isn't this one.  That's the case
+    * once the threaded context has invalidated the buffer and handed it the
+    * storage of a new one.
+    */
+   struct pipe_resource *storage;
+
+   /**
+    * The buffer's own allocation once \c storage is set.  Scenes of other
+    * contexts only reference this buffer, so the memory they may still read
+    * lives as long as the buffer does.
+    */
+   void *own_data;
+
    boolean userBuffer;  /** Is this a user-space buffer? */
    unsigned timestamp;
 
@@ -99,7 +115,7 @@ struct llvmpipe_resource
 
 struct llvmpipe_transfer
 {
-   struct pipe_transfer base;
+   struct threaded_transfer base;
 
    unsigned long offset;
 };
@@ -236,4 +252,18 @@ llvmpipe_is_resource_referenced( struct pipe_context *pipe,
 unsigned
 llvmpipe_get_format_alignment(enum pipe_format format);
 
+void
+llvmpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src);
+
+void
+llvmpipe_begin_buffer_access(struct llvmpipe_context *llvmpipe);
+
+void
+llvmpipe_end_buffer_access(struct llvmpipe_context *llvmpipe);
+
+void
+llvmpipe_release_retired_storage(struct llvmpipe_screen *screen);
+
 #endif /* LP_TEXTURE_H */
@@ -37,7 +37,7 @@ get_dimensions(const struct pipe_shader_buffer *bview,
     * Bounds check the buffer size from the view
     * and the buffer size from the underlying buffer.
     */
-   if (*width > spr->base.width0)
+   if (*width > spr->base.b.width0)
       return false;
    return true;
 }
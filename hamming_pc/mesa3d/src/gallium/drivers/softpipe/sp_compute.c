@@ -20,6 +20,7 @@
  * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
  * USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
+#include "util/u_atomic.h"
 #include "util/u_inlines.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
@@ -178,6 +179,8 @@ softpipe_launch_grid(struct pipe_context *context,
    uint32_t grid_size[3] = {0};
    void *local_mem = NULL;
 
+   softpipe_begin_buffer_access(softpipe);
+
    softpipe_update_compute_samplers(softpipe);
    bwidth = cs->info.properties[TGSI_PROPERTY_CS_FIXED_BLOCK_WIDTH];
    bheight = cs->info.properties[TGSI_PROPERTY_CS_FIXED_BLOCK_HEIGHT];
@@ -193,6 +196,7 @@ softpipe_launch_grid(struct pipe_context *context,
    machines = CALLOC(sizeof(struct tgsi_exec_machine *), num_threads_in_group);
    if (!machines) {
       FREE(local_mem);
+      softpipe_end_buffer_access(softpipe);
       return;
    }
 
@@ -234,4 +238,6 @@ softpipe_launch_grid(struct pipe_context *context,
 
    FREE(local_mem);
    FREE(machines);
+
+   softpipe_end_buffer_access(softpipe);
 }
@@ -60,6 +60,14 @@ softpipe_destroy( struct pipe_context *pipe )
    struct softpipe_context *softpipe = softpipe_context( pipe );
    uint i, sh;
 
+   if (!LIST_IS_EMPTY(&softpipe->screen_link)) {
+      struct softpipe_screen *sp_screen = softpipe_screen(pipe->screen);
+
+      mtx_lock(&sp_screen->buffer_mutex);
+      LIST_DEL(&softpipe->screen_link);
+      mtx_unlock(&sp_screen->buffer_mutex);
+   }
+
 #if DO_PSTIPPLE_IN_HELPER_MODULE
    if (softpipe->pstipple.sampler)
       pipe->delete_sampler_state(pipe, softpipe->pstipple.sampler);
@@ -202,6 +210,8 @@ softpipe_create_context(struct pipe_screen *screen,
 
    util_init_math();
 
+   list_inithead(&softpipe->screen_link);
+
    for (i = 0; i < PIPE_SHADER_TYPES; i++) {
       softpipe->tgsi.sampler[i] = sp_create_tgsi_sampler();
    }
@@ -356,6 +366,12 @@ softpipe_create_context(struct pipe_screen *screen,
    softpipe->pstipple.sampler = util_pstipple_create_sampler(&softpipe->pipe);
 #endif
 
+   /* Make buffer storage replaced from now on wait for our draws */
+   mtx_lock(&sp_screen->buffer_mutex);
+   softpipe->buffer_timestamp = sp_screen->buffer_timestamp;
+   list_addtail(&softpipe->screen_link, &sp_screen->contexts);
+   mtx_unlock(&sp_screen->buffer_mutex);
+
    return &softpipe->pipe;
 
  fail:
@@ -32,6 +32,7 @@
 #define SP_CONTEXT_H
 
 #include "pipe/p_context.h"
+#include "util/list.h"
 #include "util/u_blitter.h"
 
 #include "draw/draw_vertex.h"
@@ -118,6 +119,7 @@ struct softpipe_context {
    /** Mapped constant buffers */
    const void *mapped_constants[PIPE_SHADER_TYPES][PIPE_MAX_CONSTANT_BUFFERS];
    unsigned const_buffer_size[PIPE_SHADER_TYPES][PIPE_MAX_CONSTANT_BUFFERS];
+   unsigned const_buffer_offset[PIPE_SHADER_TYPES][PIPE_MAX_CONSTANT_BUFFERS];
 
    /** Vertex format */
    struct sp_setup_info setup_info;
@@ -196,6 +198,14 @@ struct softpipe_context {
 
    unsigned tex_timestamp;
 
+   /** Screen buffer_timestamp the bound buffer state was last updated for */
+   unsigned buffer_timestamp;
+
+   /** Screen buffer_timestamp when the draw in progress started, if any */
+   unsigned draw_timestamp;
+   boolean drawing;
+   struct list_head screen_link;
+
    /*
     * Texture caches for vertex, fragment, geometry stages.
     * Don't use PIPE_SHADER_TYPES here to avoid allocating unused memory
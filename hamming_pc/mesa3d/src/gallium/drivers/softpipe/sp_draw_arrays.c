@@ -76,6 +76,8 @@ softpipe_draw_vbo(struct pipe_context *pipe,
 
    sp->reduced_api_prim = u_reduced_prim(info->mode);
 
+   softpipe_begin_buffer_access(sp);
+
    if (sp->dirty) {
       softpipe_update_derived(sp, sp->reduced_api_prim);
    }
@@ -165,6 +167,8 @@ softpipe_draw_vbo(struct pipe_context *pipe,
     */
    draw_flush(draw);
 
+   softpipe_end_buffer_access(sp);
+
    /* Note: leave drawing surfaces mapped */
    sp->dirty_render_cache = TRUE;
 }
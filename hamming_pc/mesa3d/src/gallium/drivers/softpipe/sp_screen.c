@@ -38,6 +38,7 @@
 
 #include "state_tracker/sw_winsys.h"
 #include "tgsi/tgsi_exec.h"
+#include "util/u_threaded_context.h"
 
 #include "sp_texture.h"
 #include "sp_screen.h"
@@ -481,10 +482,40 @@ softpipe_destroy_screen( struct pipe_screen *screen )
    if(winsys->destroy)
       winsys->destroy(winsys);
 
+   softpipe_release_retired_storage(sp_screen);
+   mtx_destroy(&sp_screen->buffer_mutex);
+
+   slab_destroy_parent(&sp_screen->pool_transfers);
+
    FREE(screen);
 }
 
 
+/**
+ * Create a context, running it on a driver thread behind the threaded
+ * context when the state tracker prefers that.
+ */
+static struct pipe_context *
+softpipe_screen_create_context(struct pipe_screen *_screen, void *priv,
+                               unsigned flags)
+{
+   struct softpipe_screen *screen = softpipe_screen(_screen);
+   struct pipe_context *pipe;
+
+   pipe = softpipe_create_context(_screen, priv, flags);
+   if (!pipe)
+      return NULL;
+
+   if (!(flags & PIPE_CONTEXT_PREFER_THREADED) ||
+       (flags & PIPE_CONTEXT_COMPUTE_ONLY))
+      return pipe;
+
+   return threaded_context_create(pipe, &screen->pool_transfers,
+                                  softpipe_replace_buffer_storage,
+                                  NULL, NULL);
+}
+
+
 /* This is often overriden by the co-state tracker.
  */
 static void
@@ -586,7 +617,7 @@ softpipe_create_screen(struct sw_winsys *winsys)
    screen->base.get_paramf = softpipe_get_paramf;
    screen->base.get_timestamp = softpipe_get_timestamp;
    screen->base.is_format_supported = softpipe_is_format_supported;
-   screen->base.context_create = softpipe_create_context;
+   screen->base.context_create = softpipe_screen_create_context;
    screen->base.flush_frontbuffer = softpipe_flush_frontbuffer;
    screen->base.get_compute_param = softpipe_get_compute_param;
    screen->use_llvm = debug_get_option_use_llvm();
@@ -594,5 +625,12 @@ softpipe_create_screen(struct sw_winsys *winsys)
    softpipe_init_screen_texture_funcs(&screen->base);
    softpipe_init_screen_fence_funcs(&screen->base);
 
+   slab_create_parent(&screen->pool_transfers,
+                      sizeof(struct softpipe_transfer), 16);
+
+   (void) mtx_init(&screen->buffer_mutex, mtx_plain);
+   list_inithead(&screen->contexts);
+   list_inithead(&screen->retired_storage);
+
    return &screen->base;
 }
@@ -33,6 +33,9 @@
 
 #include "pipe/p_screen.h"
 #include "pipe/p_defines.h"
+#include "os/os_thread.h"
+#include "util/list.h"
+#include "util/slab.h"
 
 
 struct sw_winsys;
@@ -46,7 +49,23 @@ struct softpipe_screen {
     * this.
     */
    unsigned timestamp;
+
+   /* Increments whenever the storage of a buffer is replaced.  Contexts
+    * track this to rebind state that holds on to the old data pointer.
+    */
+   unsigned buffer_timestamp;
+
+   /** Guards buffer_timestamp, contexts and retired_storage */
+   mtx_t buffer_mutex;
+   struct list_head contexts;
+
+   /** Replaced buffer storage that draws of other contexts may still read */
+   struct list_head retired_storage;
+
    boolean use_llvm;
+
+   /** Transfers the threaded context allocates for staging uploads */
+   struct slab_parent_pool pool_transfers;
 };
 
 static inline struct softpipe_screen *
@@ -370,6 +370,7 @@ softpipe_set_constant_buffer(struct pipe_context *pipe,
 
    softpipe->mapped_constants[shader][index] = data;
    softpipe->const_buffer_size[shader][index] = size;
+   softpipe->const_buffer_offset[shader][index] = cb ? cb->buffer_offset : 0;
 
    softpipe->dirty |= SP_NEW_CONSTANTS;
 
@@ -37,12 +37,16 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_transfer.h"
+#include "util/u_atomic.h"
 #include "util/u_surface.h"
+#include "draw/draw_context.h"
 
 #include "sp_context.h"
 #include "sp_flush.h"
 #include "sp_texture.h"
 #include "sp_screen.h"
+#include "sp_state.h"
+#include "sp_tex_tile_cache.h"
 
 #include "state_tracker/sw_winsys.h"
 
@@ -56,7 +60,7 @@ softpipe_resource_layout(struct pipe_screen *screen,
                          struct softpipe_resource *spr,
                          boolean allocate)
 {
-   struct pipe_resource *pt = &spr->base;
+   struct pipe_resource *pt = &spr->base.b;
    unsigned level;
    unsigned width = pt->width0;
    unsigned height = pt->height0;
@@ -118,7 +122,7 @@ softpipe_can_create_resource(struct pipe_screen *screen,
 {
    struct softpipe_resource spr;
    memset(&spr, 0, sizeof(spr));
-   spr.base = *res;
+   spr.base.b = *res;
    return softpipe_resource_layout(screen, &spr, FALSE);
 }
 
@@ -136,10 +140,10 @@ softpipe_displaytarget_layout(struct pipe_screen *screen,
    /* Round up the surface size to a multiple of the tile size?
     */
    spr->dt = winsys->displaytarget_create(winsys,
-                                          spr->base.bind,
-                                          spr->base.format,
-                                          spr->base.width0, 
-                                          spr->base.height0,
+                                          spr->base.b.bind,
+                                          spr->base.b.format,
+                                          spr->base.b.width0, 
+                                          spr->base.b.height0,
                                           64,
                                           map_front_private,
                                           &spr->stride[0] );
@@ -162,15 +166,15 @@ softpipe_resource_create_front(struct pipe_screen *screen,
 
    assert(templat->format != PIPE_FORMAT_NONE);
 
-   spr->base = *templat;
-   pipe_reference_init(&spr->base.reference, 1);
-   spr->base.screen = screen;
+   spr->base.b = *templat;
+   pipe_reference_init(&spr->base.b.reference, 1);
+   spr->base.b.screen = screen;
 
    spr->pot = (util_is_power_of_two(templat->width0) &&
                util_is_power_of_two(templat->height0) &&
                util_is_power_of_two(templat->depth0));
 
-   if (spr->base.bind & (PIPE_BIND_DISPLAY_TARGET |
+   if (spr->base.b.bind & (PIPE_BIND_DISPLAY_TARGET |
 			 PIPE_BIND_SCANOUT |
 			 PIPE_BIND_SHARED)) {
       if (!softpipe_displaytarget_layout(screen, spr, map_front_private))
@@ -180,8 +184,10 @@ softpipe_resource_create_front(struct pipe_screen *screen,
       if (!softpipe_resource_layout(screen, spr, TRUE))
          goto fail;
    }
-    
-   return &spr->base;
+
+   threaded_resource_init(&spr->base.b);
+
+   return &spr->base.b;
 
  fail:
    FREE(spr);
@@ -207,11 +213,17 @@ softpipe_resource_destroy(struct pipe_screen *pscreen,
       struct sw_winsys *winsys = screen->winsys;
       winsys->displaytarget_destroy(winsys, spr->dt);
    }
+   else if (spr->storage) {
+      /* buffer whose storage was replaced */
+      pipe_resource_reference(&spr->storage, NULL);
+   }
    else if (!spr->userBuffer) {
       /* regular texture */
       align_free(spr->data);
    }
 
+   threaded_resource_deinit(pt);
+
    FREE(spr);
 }
 
@@ -227,9 +239,9 @@ softpipe_resource_from_handle(struct pipe_screen *screen,
    if (!spr)
       return NULL;
 
-   spr->base = *templat;
-   pipe_reference_init(&spr->base.reference, 1);
-   spr->base.screen = screen;
+   spr->base.b = *templat;
+   pipe_reference_init(&spr->base.b.reference, 1);
+   spr->base.b.screen = screen;
 
    spr->pot = (util_is_power_of_two(templat->width0) &&
                util_is_power_of_two(templat->height0) &&
@@ -242,7 +254,10 @@ softpipe_resource_from_handle(struct pipe_screen *screen,
    if (!spr->dt)
       goto fail;
 
-   return &spr->base;
+   threaded_resource_init(&spr->base.b);
+   spr->base.is_shared = true;
+
+   return &spr->base.b;
 
  fail:
    FREE(spr);
@@ -415,7 +430,7 @@ softpipe_transfer_map(struct pipe_context *pipe,
    if (!spt)
       return NULL;
 
-   pt = &spt->base;
+   pt = &spt->base.b;
 
    pipe_resource_reference(&pt->resource, resource);
    pt->level = level;
@@ -427,7 +442,7 @@ softpipe_transfer_map(struct pipe_context *pipe,
    spt->offset = softpipe_get_tex_image_offset(spr, level, box->z);
 
    spt->offset +=
-         box->y / util_format_get_blockheight(format) * spt->base.stride +
+         box->y / util_format_get_blockheight(format) * spt->base.b.stride +
          box->x / util_format_get_blockwidth(format) * util_format_get_blocksize(format);
 
    /* resources backed by display target treated specially:
@@ -469,8 +484,11 @@ softpipe_transfer_unmap(struct pipe_context *pipe,
    }
 
    if (transfer->usage & PIPE_TRANSFER_WRITE) {
-      /* Mark the texture as dirty to expire the tile caches. */
-      spr->timestamp++;
+      /* Mark the texture as dirty to expire the tile caches.  The
+       * threaded context queues every unmap, but other contexts may read
+       * the timestamp concurrently.
+       */
+      p_atomic_inc(&spr->timestamp);
    }
 
    pipe_resource_reference(&transfer->resource, NULL);
@@ -492,20 +510,225 @@ softpipe_user_buffer_create(struct pipe_screen *screen,
    if (!spr)
       return NULL;
 
-   pipe_reference_init(&spr->base.reference, 1);
-   spr->base.screen = screen;
-   spr->base.format = PIPE_FORMAT_R8_UNORM; /* ?? */
-   spr->base.bind = bind_flags;
-   spr->base.usage = PIPE_USAGE_IMMUTABLE;
-   spr->base.flags = 0;
-   spr->base.width0 = bytes;
-   spr->base.height0 = 1;
-   spr->base.depth0 = 1;
-   spr->base.array_size = 1;
+   pipe_reference_init(&spr->base.b.reference, 1);
+   spr->base.b.screen = screen;
+   spr->base.b.format = PIPE_FORMAT_R8_UNORM; /* ?? */
+   spr->base.b.bind = bind_flags;
+   spr->base.b.usage = PIPE_USAGE_IMMUTABLE;
+   spr->base.b.flags = 0;
+   spr->base.b.width0 = bytes;
+   spr->base.b.height0 = 1;
+   spr->base.b.depth0 = 1;
+   spr->base.b.array_size = 1;
    spr->userBuffer = TRUE;
    spr->data = ptr;
 
-   return &spr->base;
+   threaded_resource_init(&spr->base.b);
+   spr->base.is_user_ptr = true;
+   util_range_add(&spr->base.valid_buffer_range, 0, bytes);
+
+   return &spr->base.b;
+}
+
+
+/**
+ * Buffer storage replaced while draws of other contexts may still read it.
+ * Either a reference to the storage resource, or the buffer's own data.
+ */
+struct softpipe_retired_storage
+{
+   struct list_head link;
+   struct pipe_resource *storage;
+   void *data;
+
+   /** Screen buffer_timestamp right after the replacement */
+   unsigned timestamp;
+};
+
+
+static void
+free_retired_storage(struct softpipe_retired_storage *retired)
+{
+   if (retired->storage)
+      pipe_resource_reference(&retired->storage, NULL);
+   else
+      align_free(retired->data);
+
+   LIST_DEL(&retired->link);
+   FREE(retired);
+}
+
+
+/**
+ * Release the retired storage that no draw in progress can read anymore.
+ * Called with buffer_mutex held.
+ */
+static void
+release_retired_storage_locked(struct softpipe_screen *screen)
+{
+   struct softpipe_retired_storage *retired, *next;
+   struct softpipe_context *ctx;
+   unsigned oldest = screen->buffer_timestamp;
+
+   LIST_FOR_EACH_ENTRY(ctx, &screen->contexts, screen_link) {
+      if (ctx->drawing && (int)(ctx->draw_timestamp - oldest) < 0)
+         oldest = ctx->draw_timestamp;
+   }
+
+   LIST_FOR_EACH_ENTRY_SAFE(retired, next, &screen->retired_storage, link) {
+      if ((int)(oldest - retired->timestamp) >= 0)
+         free_retired_storage(retired);
+   }
+}
+
+
+/**
+ * Make \p dst use the storage of \p src.
+ *
+ * The threaded context invalidates a buffer by allocating \p src and
+ * handing its storage to \p dst, while the application thread keeps
+ * mapping \p src.  \p dst holds a reference to \p src to keep the memory
+ * alive.  Every context sharing \p dst may have the old data pointer
+ * bound, so this bumps the screen's buffer timestamp and each context
+ * rebinds before it next draws.  With the threaded context, other contexts
+ * may be in the middle of a draw reading the old storage on their driver
+ * threads though, so it is retired until the draws that began before the
+ * replacement are done.
+ */
+void
+softpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src)
+{
+   struct softpipe_context *softpipe = softpipe_context(pipe);
+   struct softpipe_screen *screen = softpipe_screen(pipe->screen);
+   struct softpipe_resource *sp_dst = softpipe_resource(dst);
+   struct softpipe_resource *sp_src = softpipe_resource(src);
+   struct softpipe_retired_storage *retired;
+
+   assert(dst->target == PIPE_BUFFER && src->target == PIPE_BUFFER);
+   assert(!sp_dst->userBuffer && !sp_src->storage);
+
+   draw_flush(softpipe->draw);
+
+   /* Out of memory, the old storage is released right away then */
+   retired = CALLOC_STRUCT(softpipe_retired_storage);
+
+   mtx_lock(&screen->buffer_mutex);
+
+   if (retired) {
+      retired->storage = sp_dst->storage;
+      retired->data = sp_dst->data;
+   }
+   else if (sp_dst->storage)
+      pipe_resource_reference(&sp_dst->storage, NULL);
+   else
+      align_free(sp_dst->data);
+
+   sp_dst->storage = NULL;
+   pipe_resource_reference(&sp_dst->storage, src);
+   sp_dst->data = sp_src->data;
+
+   screen->buffer_timestamp++;
+
+   if (retired) {
+      retired->timestamp = screen->buffer_timestamp;
+      list_addtail(&retired->link, &screen->retired_storage);
+      release_retired_storage_locked(screen);
+   }
+
+   mtx_unlock(&screen->buffer_mutex);
+}
+
+
+/**
+ * Rebind the buffer state that holds on to a data pointer, after the
+ * storage of some buffer was replaced.
+ */
+static void
+softpipe_rebind_buffers(struct softpipe_context *softpipe)
+{
+   unsigned sh, i;
+
+   softpipe->buffer_timestamp = softpipe->draw_timestamp;
+
+   for (sh = 0; sh < PIPE_SHADER_TYPES; sh++) {
+      for (i = 0; i < PIPE_MAX_CONSTANT_BUFFERS; i++) {
+         struct pipe_resource *constants = softpipe->constants[sh][i];
+         const ubyte *data;
+
+         if (!constants)
+            continue;
+
+         data = (const ubyte *) softpipe_resource_data(constants) +
+                softpipe->const_buffer_offset[sh][i];
+
+         if (sh == PIPE_SHADER_VERTEX || sh == PIPE_SHADER_GEOMETRY) {
+            draw_set_mapped_constant_buffer(softpipe->draw, sh, i, data,
+                                            softpipe->const_buffer_size[sh][i]);
+         }
+
+         softpipe->mapped_constants[sh][i] = data;
+         softpipe->dirty |= SP_NEW_CONSTANTS;
+      }
+
+      for (i = 0; i < PIPE_MAX_SHADER_SAMPLER_VIEWS; i++) {
+         struct pipe_sampler_view *view = softpipe->sampler_views[sh][i];
+
+         if (view && view->texture->target == PIPE_BUFFER) {
+            sp_tex_tile_cache_set_sampler_view(softpipe->tex_cache[sh][i],
+                                               NULL);
+            sp_tex_tile_cache_set_sampler_view(softpipe->tex_cache[sh][i],
+                                               view);
+         }
+      }
+   }
+}
+
+
+/**
+ * Called before drawing.  Keeps storage replaced from now on alive until
+ * the matching softpipe_end_buffer_access, and rebinds buffers whose
+ * storage was replaced since the last draw.
+ */
+void
+softpipe_begin_buffer_access(struct softpipe_context *softpipe)
+{
+   struct softpipe_screen *screen = softpipe_screen(softpipe->pipe.screen);
+
+   mtx_lock(&screen->buffer_mutex);
+   softpipe->draw_timestamp = screen->buffer_timestamp;
+   softpipe->drawing = TRUE;
+   mtx_unlock(&screen->buffer_mutex);
+
+   if (softpipe->buffer_timestamp != softpipe->draw_timestamp)
+      softpipe_rebind_buffers(softpipe);
+}
+
+
+void
+softpipe_end_buffer_access(struct softpipe_context *softpipe)
+{
+   struct softpipe_screen *screen = softpipe_screen(softpipe->pipe.screen);
+
+   mtx_lock(&screen->buffer_mutex);
+   softpipe->drawing = FALSE;
+   if (!LIST_IS_EMPTY(&screen->retired_storage))
+      release_retired_storage_locked(screen);
+   mtx_unlock(&screen->buffer_mutex);
+}
+
+
+/**
+ * Release all retired storage, when no context is left to read it.
+ */
+void
+softpipe_release_retired_storage(struct softpipe_screen *screen)
+{
+   struct softpipe_retired_storage *retired, *next;
+
+   LIST_FOR_EACH_ENTRY_SAFE(retired, next, &screen->retired_storage, link)
+      free_retired_storage(retired);
 }
 
 
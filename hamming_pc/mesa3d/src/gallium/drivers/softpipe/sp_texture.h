@@ -30,12 +30,14 @@
 
 
 #include "pipe/p_state.h"
+#include "util/u_threaded_context.h"
 #include "sp_limits.h"
 
 
 struct pipe_context;
 struct pipe_screen;
 struct softpipe_context;
+struct softpipe_screen;
 
 
 /**
@@ -43,7 +45,7 @@ struct softpipe_context;
  */
 struct softpipe_resource
 {
-   struct pipe_resource base;
+   struct threaded_resource base;
 
    unsigned long level_offset[SP_MAX_TEXTURE_2D_LEVELS];
    unsigned stride[SP_MAX_TEXTURE_2D_LEVELS];
@@ -60,6 +62,12 @@ struct softpipe_resource
     */
    void *data;
 
+   /**
+    * The buffer that owns data, after the threaded context replaced the
+    * storage of this one.
+    */
+   struct pipe_resource *storage;
+
    /* True if texture images are power-of-two in all dimensions:
     */
    boolean pot;
@@ -74,7 +82,7 @@ struct softpipe_resource
  */
 struct softpipe_transfer
 {
-   struct pipe_transfer base;
+   struct threaded_transfer base;
 
    unsigned long offset;
 };
@@ -119,4 +127,19 @@ softpipe_init_texture_funcs(struct pipe_context *pipe);
 unsigned
 softpipe_get_tex_image_offset(const struct softpipe_resource *spr,
                               unsigned level, unsigned layer);
+
+extern void
+softpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src);
+
+extern void
+softpipe_begin_buffer_access(struct softpipe_context *softpipe);
+
+extern void
+softpipe_end_buffer_access(struct softpipe_context *softpipe);
+
+extern void
+softpipe_release_retired_storage(struct softpipe_screen *screen);
+
 #endif /* SP_TEXTURE */
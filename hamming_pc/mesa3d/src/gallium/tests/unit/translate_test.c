@@ -24,6 +24,7 @@
  **************************************************************************/
 
 #include <stdio.h>
+#include <math.h>
 #include "translate/translate.h"
 #include "util/u_memory.h"
 #include "util/u_format.h"
@@ -46,6 +47,87 @@ static double rand_double()
    return v;
 }
 
+/* Run the generic path for \p key and check that the first element of
+ * \p output matches it.  \p half feeds the second element, if any.
+ */
+static boolean matches_generic(const struct translate_key *key,
+                               const void *input, unsigned input_stride,
+                               const uint16_t *half,
+                               const unsigned char *output,
+                               unsigned char *reference,
+                               const unsigned *elts, unsigned count,
+                               float error)
+{
+   const struct util_format_description* desc =
+      util_format_description(key->element[0].output_format);
+   struct translate *generic = translate_generic_create(key);
+   unsigned i, j;
+
+   if (!generic)
+      return TRUE;
+
+   generic->set_buffer(generic, 0, input, input_stride, count - 1);
+   if (key->nr_elements > 1)
+      generic->set_buffer(generic, 1, half, 8, count - 1);
+   generic->run_elts(generic, elts, count, 0, 0, reference);
+   generic->release(generic);
+
+   for (i = 0; i < count; ++i)
+   {
+      float a[4];
+      float b[4];
+      desc->fetch_rgba_float(a, output + i * key->output_stride, 0, 0);
+      desc->fetch_rgba_float(b, reference + i * key->output_stride, 0, 0);
+
+      for (j = 0; j < 4; ++j)
+      {
+         /* relative, large integers don't convert exactly to float */
+         float d = a[j] - b[j];
+         float tolerance = error * MAX2(1.0f, fabsf(b[j]));
+         if (d > tolerance || d < -tolerance)
+            return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+/* translate_avx2 only takes keys with a half float or integer element, so
+ * pair the element of \p key with a half float one to test its other
+ * conversions too.  Returns -1 if translate_avx2 doesn't take the pair.
+ */
+static int avx2_matches_generic(struct translate_key key,
+                                const void *input, unsigned input_stride,
+                                const uint16_t *half,
+                                unsigned char *output,
+                                unsigned char *reference,
+                                const unsigned *elts, unsigned count,
+                                float error)
+{
+   unsigned size = util_format_get_stride(key.element[0].output_format, 1);
+   struct translate *avx2;
+
+   key.nr_elements = 2;
+   key.element[1] = key.element[0];
+   key.element[1].input_buffer = 1;
+   key.element[1].input_format = PIPE_FORMAT_R16G16B16A16_FLOAT;
+   key.element[1].output_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   key.element[1].output_offset = size;
+   key.output_stride = size + 16;
+
+   avx2 = translate_avx2_create(&key);
+   if (!avx2)
+      return -1;
+
+   avx2->set_buffer(avx2, 0, input, input_stride, count - 1);
+   avx2->set_buffer(avx2, 1, half, 8, count - 1);
+   avx2->run_elts(avx2, elts, count, 0, 0, output);
+   avx2->release(avx2);
+
+   return matches_generic(&key, input, input_stride, half, output, reference,
+                          elts, count, error);
+}
+
 int main(int argc, char** argv)
 {
    struct translate *(*create_fn)(const struct translate_key *key) = 0;
@@ -55,12 +137,14 @@ int main(int argc, char** argv)
    unsigned input_format;
    unsigned buffer_size = 4096;
    unsigned char* buffer[5];
+   unsigned char* reference_buffer;
    unsigned char* byte_buffer;
    float* float_buffer;
    double* double_buffer;
    uint16_t *half_buffer;
    unsigned * elts;
-   unsigned count = 4;
+   /* enough for a full batch and a partial one in translate_avx2 */
+   unsigned count = 10;
    unsigned i, j, k;
    unsigned passed = 0;
    unsigned total = 0;
@@ -127,16 +211,26 @@ int main(int argc, char** argv)
       }
       create_fn = translate_sse2_create;
    }
+   else if (!strcmp(argv[1], "avx2"))
+   {
+      if(!util_cpu_caps.has_avx2)
+      {
+         printf("Error: CPU doesn't support AVX2\n");
+         return 2;
+      }
+      create_fn = translate_avx2_create;
+   }
 
    if (!create_fn)
    {
-      printf("Usage: ./translate_test [default|generic|x86|nosse|sse|sse2|sse3|sse4.1]\n");
+      printf("Usage: ./translate_test [default|generic|x86|nosse|sse|sse2|sse3|sse4.1|avx2]\n");
       return 2;
    }
 
    for (i = 1; i < ARRAY_SIZE(buffer); ++i)
       buffer[i] = align_malloc(buffer_size, 4096);
 
+   reference_buffer = align_malloc(buffer_size, 4096);
    byte_buffer = align_malloc(buffer_size, 4096);
    float_buffer = align_malloc(buffer_size, 4096);
    double_buffer = align_malloc(buffer_size, 4096);
@@ -227,9 +321,37 @@ int main(int argc, char** argv)
                      && input_format_size * output_format_desc->nr_channels > output_format_size * input_format_desc->nr_channels))
             continue;
 
+         if(input_is_float && input_format_desc->channel[0].size == 32)
+            buffer[0] = (unsigned char*)float_buffer;
+         else if(input_is_float && input_format_desc->channel[0].size == 64)
+            buffer[0] = (unsigned char*)double_buffer;
+         else if(input_is_float && input_format_desc->channel[0].size == 16)
+            buffer[0] = (unsigned char*)half_buffer;
+         else if(input_is_float)
+            abort();
+         else
+            buffer[0] = byte_buffer;
+
          key.element[0].input_format = input_format;
          key.element[0].output_format = output_format;
          key.output_stride = output_format_size;
+
+         if (create_fn == translate_avx2_create)
+         {
+            int ret = avx2_matches_generic(key, buffer[0], input_format_size,
+                                           half_buffer, buffer[1],
+                                           reference_buffer, elts, count,
+                                           error);
+            if (ret < 0)
+               continue;
+
+            printf("%s: %s -> %s\n", ret ? "PASS" : "FAIL",
+                   input_format_desc->name, output_format_desc->name);
+            passed += ret;
+            ++total;
+            continue;
+         }
+
          translate[0] = create_fn(&key);
          if (!translate[0])
             continue;
@@ -249,17 +371,6 @@ int main(int argc, char** argv)
          for(i = 1; i < 5; ++i)
             memset(buffer[i], 0xcd - (0x22 * i), 4096);
 
-         if(input_is_float && input_format_desc->channel[0].size == 32)
-            buffer[0] = (unsigned char*)float_buffer;
-         else if(input_is_float && input_format_desc->channel[0].size == 64)
-            buffer[0] = (unsigned char*)double_buffer;
-         else if(input_is_float && input_format_desc->channel[0].size == 16)
-            buffer[0] = (unsigned char*)half_buffer;
-         else if(input_is_float)
-            abort();
-         else
-            buffer[0] = byte_buffer;
-
          translate[0]->set_buffer(translate[0], 0, buffer[0], input_format_size, count - 1);
          translate[0]->run_elts(translate[0], elts, count, 0, 0, buffer[1]);
          translate[1]->set_buffer(translate[1], 0, buffer[1], output_format_size, count - 1);
@@ -276,7 +387,7 @@ int main(int argc, char** argv)
             input_format_desc->fetch_rgba_float(a, buffer[2] + i * input_format_size, 0, 0);
             input_format_desc->fetch_rgba_float(b, buffer[4] + i * input_format_size, 0, 0);
 
-            for (j = 0; j < count; ++j)
+            for (j = 0; j < 4; ++j)
             {
                float d = a[j] - b[j];
                if (d > error || d < -error)
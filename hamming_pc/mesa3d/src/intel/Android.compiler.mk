@@ -56,6 +56,10 @@ $(intermediates)/compiler/brw_nir_trig_workarounds.c: $(brw_nir_trig_workarounds
 	@mkdir -p $(dir $@)
 	$(hide) $(MESA_PYTHON2) $< -p $(MESA_TOP)/src/compiler/nir > $@
 
+$(intermediates)/compiler/brw_reg_set_layouts.c: $(LOCAL_PATH)/compiler/brw_reg_set_layouts.py
+	@mkdir -p $(dir $@)
+	$(hide) $(MESA_PYTHON2) $< > $@
+
 LOCAL_STATIC_LIBRARIES = libmesa_genxml
 
 LOCAL_GENERATED_SOURCES += $(addprefix $(intermediates)/, \
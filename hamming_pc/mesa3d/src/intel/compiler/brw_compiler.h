@@ -53,7 +53,7 @@ struct brw_compiler {
        * Mapping for register-allocated objects in *regs to the first
        * GRF for that object.
        */
-      uint8_t *ra_reg_to_grf;
+      const uint8_t *ra_reg_to_grf;
    } vec4_reg_set;
 
    struct {
@@ -79,7 +79,7 @@ struct brw_compiler {
        * Mapping for register-allocated objects in *regs to the first
        * GRF for that object.
        */
-      uint8_t *ra_reg_to_grf;
+      const uint8_t *ra_reg_to_grf;
 
       /**
        * ra class for the aligned pairs we use for PLN, which doesn't
@@ -28,6 +28,7 @@
  * from the LIR.
  */
 
+#include <unistd.h>
 #include "main/macros.h"
 #include "brw_eu.h"
 #include "brw_fs.h"
@@ -39,6 +40,8 @@
 #include "compiler/glsl_types.h"
 #include "compiler/nir/nir_builder.h"
 #include "program/prog_parameter.h"
+#include "util/debug.h"
+#include "util/u_queue.h"
 
 using namespace brw;
 
@@ -6390,8 +6393,14 @@ gen9_ps_header_only_workaround(struct brw_wm_prog_data *wm_prog_data)
    wm_prog_data->num_varying_inputs = 1;
 }
 
+/**
+ * Emits the IR of a fragment shader and decides where its uniforms go.
+ *
+ * This is everything import_uniforms() needs from the first compile, so the
+ * compiles of the other dispatch widths can start once it is done.
+ */
 bool
-fs_visitor::run_fs(bool allow_spilling, bool do_rep_send)
+fs_visitor::emit_fs(bool do_rep_send)
 {
    struct brw_wm_prog_data *wm_prog_data = brw_wm_prog_data(this->prog_data);
    brw_wm_prog_key *wm_key = (brw_wm_prog_key *) this->key;
@@ -6450,25 +6459,48 @@ fs_visitor::run_fs(bool allow_spilling, bool do_rep_send)
 
       calculate_cfg();
 
-      optimize();
+      /* optimize() starts by doing this anyway. */
+      assign_constant_locations();
+   }
 
-      assign_curb_setup();
+   return !failed;
+}
 
-      if (devinfo->gen >= 9)
-         gen9_ps_header_only_workaround(wm_prog_data);
+/**
+ * Optimizes, schedules and allocates registers for the IR from emit_fs().
+ * The repclear shader is complete after emit_fs() and doesn't need this.
+ */
+bool
+fs_visitor::finish_fs(bool allow_spilling)
+{
+   struct brw_wm_prog_data *wm_prog_data = brw_wm_prog_data(this->prog_data);
 
-      assign_urb_setup();
+   assert(stage == MESA_SHADER_FRAGMENT);
 
-      fixup_3src_null_dest();
-      allocate_registers(8, allow_spilling);
+   optimize();
 
-      if (failed)
-         return false;
-   }
+   assign_curb_setup();
+
+   if (devinfo->gen >= 9)
+      gen9_ps_header_only_workaround(wm_prog_data);
+
+   assign_urb_setup();
+
+   fixup_3src_null_dest();
+   allocate_registers(8, allow_spilling);
 
    return !failed;
 }
 
+bool
+fs_visitor::run_fs(bool allow_spilling, bool do_rep_send)
+{
+   if (!emit_fs(do_rep_send))
+      return false;
+
+   return do_rep_send || finish_fs(allow_spilling);
+}
+
 bool
 fs_visitor::run_cs(unsigned min_dispatch_width)
 {
@@ -6732,6 +6764,51 @@ brw_register_blocks(int reg_count)
    return ALIGN(reg_count, 16) / 16 - 1;
 }
 
+/**
+ * The SIMD16 compile of a fragment shader, which runs on fs_compile_queue
+ * while the calling thread finishes the SIMD8 compile.
+ */
+struct fs_simd16_job {
+   fs_visitor *v;
+   bool allow_spilling;
+   bool use_rep_send;
+   bool done;
+   bool compiled;
+   struct util_queue_fence fence;
+};
+
+static struct util_queue fs_compile_queue;
+static bool fs_compile_queue_ready;
+static once_flag fs_compile_queue_once = ONCE_FLAG_INIT;
+
+static void
+init_fs_compile_queue(void)
+{
+   /* With a single CPU, handing the SIMD16 compile to another thread only
+    * costs a couple of context switches.
+    */
+   if (!env_var_as_boolean("INTEL_PARALLEL_COMPILE",
+                           sysconf(_SC_NPROCESSORS_ONLN) > 1))
+      return;
+
+   /* A compile puts at most one job on the queue and takes it back if no
+    * thread has started it by the time the SIMD8 compile is done, so a few
+    * threads shared by every compiler are plenty.
+    */
+   fs_compile_queue_ready =
+      util_queue_init(&fs_compile_queue, "brw_fs", 16, 4,
+                      UTIL_QUEUE_INIT_RESIZE_IF_FULL);
+}
+
+static void
+compile_fs_simd16(void *data, int thread_index)
+{
+   struct fs_simd16_job *job = (struct fs_simd16_job *) data;
+
+   job->compiled = job->v->run_fs(job->allow_spilling, job->use_rep_send);
+   job->done = true;
+}
+
 const unsigned *
 brw_compile_fs(const struct brw_compiler *compiler, void *log_data,
                void *mem_ctx,
@@ -6795,10 +6872,63 @@ brw_compile_fs(const struct brw_compiler *compiler, void *log_data,
    fs_visitor v8(compiler, log_data, mem_ctx, key,
                  &prog_data->base, prog, shader, 8,
                  shader_time_index8);
-   if (!v8.run_fs(allow_spilling, false /* do_rep_send */)) {
+   if (!v8.emit_fs(false /* do_rep_send */)) {
+      if (error_str)
+         *error_str = ralloc_strdup(mem_ctx, v8.fail_msg);
+
+      return NULL;
+   }
+
+   /* Everything the SIMD16 compile needs from the SIMD8 one is known once
+    * the SIMD8 IR is emitted, so the SIMD16 compile can run on another
+    * thread while this one optimizes and allocates registers for SIMD8.
+    * ralloc isn't thread safe, so it gets a memory context of its own.  It
+    * also gets a copy of prog_data: everything it would write there is the
+    * same as what the SIMD8 compile writes, but the SIMD8 compile may be
+    * reading those fields at the same time.
+    */
+   struct fs_simd16_job simd16 = {};
+   struct brw_wm_prog_data simd16_prog_data;
+   bool simd16_queued = false;
+
+   if (v8.max_dispatch_width >= 16 &&
+       likely(!(INTEL_DEBUG & DEBUG_NO16) || use_rep_send)) {
+      simd16_prog_data = *prog_data;
+      simd16.v = new fs_visitor(compiler, log_data, ralloc_context(mem_ctx),
+                                key, &simd16_prog_data.base, prog, shader, 16,
+                                shader_time_index16);
+      simd16.v->import_uniforms(&v8);
+      simd16.allow_spilling = allow_spilling;
+      simd16.use_rep_send = use_rep_send;
+
+      /* Keep the debug output of the two compiles apart. */
+      if (likely(!(INTEL_DEBUG & DEBUG_WM))) {
+         call_once(&fs_compile_queue_once, init_fs_compile_queue);
+
+         if (fs_compile_queue_ready) {
+            util_queue_fence_init(&simd16.fence);
+            util_queue_add_job(&fs_compile_queue, &simd16, &simd16.fence,
+                               compile_fs_simd16, NULL);
+            simd16_queued = true;
+         }
+      }
+   }
+
+   const bool simd8_compiled = v8.finish_fs(allow_spilling);
+
+   if (simd16_queued) {
+      /* Takes the job back if no thread has started it yet, or waits for it
+       * otherwise.
+       */
+      util_queue_drop_job(&fs_compile_queue, &simd16.fence);
+      util_queue_fence_destroy(&simd16.fence);
+   }
+
+   if (!simd8_compiled) {
       if (error_str)
          *error_str = ralloc_strdup(mem_ctx, v8.fail_msg);
 
+      delete simd16.v;
       return NULL;
    } else if (likely(!(INTEL_DEBUG & DEBUG_NO8))) {
       simd8_cfg = v8.cfg;
@@ -6806,21 +6936,19 @@ brw_compile_fs(const struct brw_compiler *compiler, void *log_data,
       simd8_grf_used = v8.grf_used;
    }
 
-   if (v8.max_dispatch_width >= 16 &&
-       likely(!(INTEL_DEBUG & DEBUG_NO16) || use_rep_send)) {
+   if (simd16.v) {
       /* Try a SIMD16 compile */
-      fs_visitor v16(compiler, log_data, mem_ctx, key,
-                     &prog_data->base, prog, shader, 16,
-                     shader_time_index16);
-      v16.import_uniforms(&v8);
-      if (!v16.run_fs(allow_spilling, use_rep_send)) {
+      if (!simd16.done)
+         compile_fs_simd16(&simd16, 0);
+
+      if (!simd16.compiled) {
          compiler->shader_perf_log(log_data,
                                    "SIMD16 shader failed to compile: %s",
-                                   v16.fail_msg);
+                                   simd16.v->fail_msg);
       } else {
-         simd16_cfg = v16.cfg;
-         simd16_grf_start = v16.payload.num_regs;
-         simd16_grf_used = v16.grf_used;
+         simd16_cfg = simd16.v->cfg;
+         simd16_grf_start = simd16.v->payload.num_regs;
+         simd16_grf_used = simd16.v->grf_used;
       }
    }
 
@@ -6890,6 +7018,8 @@ brw_compile_fs(const struct brw_compiler *compiler, void *log_data,
       prog_data->reg_blocks_0 = brw_register_blocks(simd16_grf_used);
    }
 
+   delete simd16.v;
+
    return g.get_assembly(&prog_data->base.program_size);
 }
 
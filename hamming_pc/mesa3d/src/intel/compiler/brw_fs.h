@@ -95,6 +95,8 @@ public:
    void DEP_RESOLVE_MOV(const brw::fs_builder &bld, int grf);
 
    bool run_fs(bool allow_spilling, bool do_rep_send);
+   bool emit_fs(bool do_rep_send);
+   bool finish_fs(bool allow_spilling);
    bool run_vs();
    bool run_tcs_single_patch();
    bool run_tes();
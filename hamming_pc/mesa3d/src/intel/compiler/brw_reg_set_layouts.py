@@ -0,0 +1,280 @@
+#
+# Copyright (C) 2017 Intel Corporation
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice (including the next
+# paragraph) shall be included in all copies or substantial portions of the
+# Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+
+# Generates the layouts of the register sets used by the FS and vec4
+# register allocators on each hardware generation, so that creating a
+# compiler only has to load them rather than work out the classes, register
+# conflicts and q values every time.  See brw_reg_sets.h.
+
+from __future__ import print_function
+
+import textwrap
+
+BRW_MAX_GRF = 128
+GEN7_MRF_HACK_START = 112
+MAX_VGRF_SIZE = 16
+
+# (name, gen, has_pln) for each kind of device that needs its own layouts.
+DEVICES = [
+    ('i965', 4, False),
+    ('g4x', 4, True),
+    ('ilk', 5, True),
+    ('snb', 6, True),
+    ('ivb', 7, True),
+    ('bdw', 8, True),
+    ('skl', 9, True),
+    ('cnl', 10, True),
+]
+
+
+class Layout(object):
+    """The register set for a given number of GRFs and alignment rules.
+
+    Every class is a block of contiguous GRFs of a size from 1 to
+    MAX_VGRF_SIZE, and holds a register starting at each GRF the block fits
+    at.  With pairs, as gen4-5 SIMD16 needs, every register is made of
+    aligned pairs of GRFs instead.  With aligned_pairs, as PLN needs on
+    gen4.5-6 SIMD8, there is one more class made of the registers of the
+    2-GRF class that start at an even GRF.
+    """
+
+    def __init__(self, base_reg_count, pairs, aligned_pairs, round_robin):
+        self.base_reg_count = base_reg_count
+        self.pairs = pairs
+        self.aligned_pairs = aligned_pairs
+        self.round_robin = round_robin
+        self.users = []
+
+        sizes = list(range(1, MAX_VGRF_SIZE + 1))
+
+        self.ranges = []
+        self.ra_reg_to_grf = []
+        self.classes = []
+        self.q_values = []
+        self.class_to_ra_reg_range = [0] * (MAX_VGRF_SIZE + 1)
+
+        for size in sizes:
+            if pairs:
+                # From the G45 PRM:
+                #
+                # In order to reduce the hardware complexity, the following
+                # rules and restrictions apply to the compressed instruction:
+                # ...
+                # * Operand Alignment Rule: With the exceptions listed below, a
+                #   source/destination operand in general should be aligned to
+                #   even 256-bit physical register with a region size equal to
+                #   two 256-bit physical register
+                #
+                # The q values work out as below, except that we are dealing
+                # with pairs of registers instead of single registers.
+                # Registers of odd sizes simply get rounded up.
+                reg_count = (base_reg_count - (size - 1)) // 2
+                units = (size + 1) // 2
+                self.q_values.append([(size + 1) // 2 + (other + 1) // 2 - 1
+                                      for other in sizes])
+            else:
+                # q(B,C) (indexed by C, B is this register class) in
+                # Runeson/Nystrom paper.  This is "how many registers of B
+                # could the worst choice register from C conflict with".
+                #
+                # View the register from C as fixed starting at GRF n
+                # somwhere in the middle, and the register from B as sliding
+                # back and forth.  Then the first register to conflict from B
+                # is the one starting at n - class_size[B] + 1 and the last
+                # register to conflict will start at n + class_size[B] - 1.
+                # Therefore, the number of conflicts from B is
+                # class_size[B] + class_size[C] - 1.
+                #
+                #   +-+-+-+-+-+-+     +-+-+-+-+-+-+
+                # B | | | | | |n| --> | | | | | | |
+                #   +-+-+-+-+-+-+     +-+-+-+-+-+-+
+                #             +-+-+-+-+-+
+                # C           |n| | | | |
+                #             +-+-+-+-+-+
+                reg_count = base_reg_count - (size - 1)
+                units = size
+                self.q_values.append([size + other - 1 for other in sizes])
+
+            self.classes.append((len(self.ranges), reg_count, 1))
+            for j in range(reg_count):
+                self.ranges.append((j, units))
+                self.ra_reg_to_grf.append(j * 2 if pairs else j)
+
+            self.class_to_ra_reg_range[size] = len(self.ranges)
+
+        if aligned_pairs:
+            assert not pairs
+            first, reg_count, _ = self.classes[1]
+            self.classes.append((first, (reg_count + 1) // 2, 2))
+
+            # These are a little counter-intuitive because the pair registers
+            # are required to be aligned while the register they are
+            # potentially interferring with are not.  In the case where the
+            # size is even, the worst-case is that the register is
+            # odd-aligned.  In the odd-size case, it doesn't matter.
+            for i, size in enumerate(sizes):
+                self.q_values[i].append(size + 1)
+            self.q_values.append([size // 2 + 1 for size in sizes] + [1])
+
+        self.extra_conflicts = self.find_extra_conflicts()
+
+    def find_extra_conflicts(self):
+        """Finds the conflicts beyond those between overlapping registers.
+
+        The register sets used to be built by adding the conflicts between
+        every register and the base registers it covers, and then making the
+        conflicts of the first base_reg_count registers transitive.  With
+        pairs, only the first half of those are base registers, and the
+        others also make some registers that don't overlap each other
+        conflict.  Work out exactly what that did so that the registers get
+        allocated as before.
+        """
+        n = len(self.ranges)
+
+        conflicts = [1 << r for r in range(n)]
+        for r, (start, count) in enumerate(self.ranges):
+            for base in range(start, start + count):
+                conflicts[base] |= 1 << r
+                conflicts[r] |= 1 << base
+
+        for r in range(self.base_reg_count):
+            mask = conflicts[r]
+            while mask:
+                bit = mask & -mask
+                mask ^= bit
+                conflicts[bit.bit_length() - 1] |= conflicts[r]
+
+        # The registers starting before and ending after each base register.
+        units = max(start + count for start, count in self.ranges)
+        starts_before = [0] * (units + 1)
+        ends_after = [0] * (units + 1)
+        for r, (start, count) in enumerate(self.ranges):
+            for u in range(start + 1, units + 1):
+                starts_before[u] |= 1 << r
+            for u in range(start + count):
+                ends_after[u] |= 1 << r
+
+        extra = []
+        for a, (start, count) in enumerate(self.ranges):
+            overlapping = starts_before[start + count] & ends_after[start]
+            assert conflicts[a] & overlapping == overlapping
+            mask = (conflicts[a] & ~overlapping) >> (a + 1)
+            while mask:
+                bit = mask & -mask
+                mask ^= bit
+                extra.append((a, a + bit.bit_length()))
+        return extra
+
+
+def fs_layout_key(gen, has_pln, dispatch_width):
+    # For IVB+, SIMD16 and SIMD32 use the same register set as SIMD8.
+    if dispatch_width > 8 and gen >= 7:
+        dispatch_width = 8
+    return (BRW_MAX_GRF, gen <= 5 and dispatch_width >= 16,
+            has_pln and dispatch_width == 8 and gen <= 6, gen >= 6)
+
+
+def vec4_layout_key(gen):
+    return (GEN7_MRF_HACK_START if gen >= 7 else BRW_MAX_GRF, False, False,
+            gen >= 6)
+
+
+def c_bool(value):
+    return 'true' if value else 'false'
+
+
+def print_array(ctype, name, values, per_line, dims=''):
+    print('static const {} {}[]{} = {{'.format(ctype, name, dims))
+    for i in range(0, len(values), per_line):
+        print('   ' + ' '.join(values[i:i + per_line]))
+    print('};')
+    print()
+
+
+def main():
+    layouts = []
+    by_key = {}
+
+    def add_user(key, user):
+        if key not in by_key:
+            by_key[key] = Layout(*key)
+            layouts.append(by_key[key])
+        by_key[key].users.append(user)
+
+    for name, gen, has_pln in DEVICES:
+        for width in (8, 16, 32):
+            add_user(fs_layout_key(gen, has_pln, width),
+                     '{} FS SIMD{}'.format(name, width))
+        add_user(vec4_layout_key(gen), '{} vec4'.format(name))
+
+    print('/* This file is generated by brw_reg_set_layouts.py. */')
+    print()
+    print('#include "brw_reg_sets.h"')
+    print()
+
+    for i, layout in enumerate(layouts):
+        comment = textwrap.wrap('Used by {}.'.format(', '.join(layout.users)),
+                                width=74)
+        print('/* ' + '\n * '.join(comment) + ' */')
+        print()
+        print_array('struct ra_reg_range', 'layout{}_ranges'.format(i),
+                    ['{{ {}, {} }},'.format(*r) for r in layout.ranges], 6)
+        print_array('uint8_t', 'layout{}_ra_reg_to_grf'.format(i),
+                    ['{},'.format(g) for g in layout.ra_reg_to_grf], 12)
+        print_array('struct brw_reg_class_layout', 'layout{}_classes'.format(i),
+                    ['{{ {}, {}, {} }},'.format(*c) for c in layout.classes],
+                    4)
+        print_array('unsigned', 'layout{}_q_values'.format(i),
+                    ['{},'.format(q) for row in layout.q_values for q in row],
+                    len(layout.q_values))
+        if layout.extra_conflicts:
+            print_array('uint16_t', 'layout{}_extra_conflicts'.format(i),
+                        ['{{ {}, {} }},'.format(*c)
+                         for c in layout.extra_conflicts], 6, dims='[2]')
+
+    print('const struct brw_reg_set_layout brw_reg_set_layouts[] = {')
+    for i, layout in enumerate(layouts):
+        print('   {')
+        print('      .base_reg_count = {},'.format(layout.base_reg_count))
+        print('      .pairs = {},'.format(c_bool(layout.pairs)))
+        print('      .aligned_pairs = {},'.format(c_bool(layout.aligned_pairs)))
+        print('      .round_robin = {},'.format(c_bool(layout.round_robin)))
+        print('      .ra_reg_count = {},'.format(len(layout.ranges)))
+        print('      .class_count = {},'.format(len(layout.classes)))
+        print('      .classes = layout{}_classes,'.format(i))
+        print('      .q_values = layout{}_q_values,'.format(i))
+        print('      .ranges = layout{}_ranges,'.format(i))
+        print('      .ra_reg_to_grf = layout{}_ra_reg_to_grf,'.format(i))
+        if layout.extra_conflicts:
+            print('      .extra_conflicts = layout{}_extra_conflicts,'.format(i))
+            print('      .extra_conflict_count = {},'.format(
+                len(layout.extra_conflicts)))
+        print('      .class_to_ra_reg_range = {{ {} }},'.format(
+            ', '.join(str(r) for r in layout.class_to_ra_reg_range)))
+        print('   },')
+    print('};')
+    print()
+    print('const unsigned brw_reg_set_layout_count = {};'.format(len(layouts)))
+
+
+if __name__ == '__main__':
+    main()
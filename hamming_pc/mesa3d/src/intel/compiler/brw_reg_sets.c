@@ -0,0 +1,88 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+
+#include "brw_reg_sets.h"
+#include "util/macros.h"
+
+/**
+ * Returns the generated layout for the given parameters, or NULL if
+ * brw_reg_set_layouts.py doesn't generate one.
+ */
+const struct brw_reg_set_layout *
+brw_find_reg_set_layout(unsigned base_reg_count, bool pairs,
+                        bool aligned_pairs, bool round_robin)
+{
+   for (unsigned i = 0; i < brw_reg_set_layout_count; i++) {
+      const struct brw_reg_set_layout *layout = &brw_reg_set_layouts[i];
+
+      if (layout->base_reg_count == base_reg_count &&
+          layout->pairs == pairs &&
+          layout->aligned_pairs == aligned_pairs &&
+          layout->round_robin == round_robin)
+         return layout;
+   }
+
+   return NULL;
+}
+
+/**
+ * Creates the register set described by a layout, with its classes
+ * numbered in the same order as the layout's.
+ */
+struct ra_regs *
+brw_create_reg_set(void *mem_ctx, const struct brw_reg_set_layout *layout)
+{
+   struct ra_regs *regs = ra_alloc_reg_set(mem_ctx, layout->ra_reg_count,
+                                           false);
+   unsigned *q_values[17];
+
+   assert(layout->class_count <= ARRAY_SIZE(q_values));
+
+   if (layout->round_robin)
+      ra_set_allocate_round_robin(regs);
+
+   for (unsigned c = 0; c < layout->class_count; c++) {
+      const struct brw_reg_class_layout *class = &layout->classes[c];
+      MAYBE_UNUSED unsigned ra_class = ra_alloc_reg_class(regs);
+
+      assert(ra_class == c);
+      for (unsigned i = 0; i < class->reg_count; i++) {
+         ra_class_add_reg(regs, c,
+                          class->first_reg + i * class->reg_stride);
+      }
+
+      /* ra_set_finalize() only reads the q values. */
+      q_values[c] = (unsigned *)&layout->q_values[c * layout->class_count];
+   }
+
+   ra_add_range_conflicts(regs, layout->ranges);
+   for (unsigned i = 0; i < layout->extra_conflict_count; i++) {
+      ra_add_reg_conflict(regs, layout->extra_conflicts[i][0],
+                          layout->extra_conflicts[i][1]);
+   }
+   ra_set_finalize(regs, q_values);
+
+   return regs;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef BRW_REG_SETS_H
+#define BRW_REG_SETS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/register_allocate.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The registers of a class, \c reg_count registers from \c first_reg on,
+ * \c reg_stride apart.
+ */
+struct brw_reg_class_layout {
+   uint16_t first_reg;
+   uint16_t reg_count;
+   uint16_t reg_stride;
+};
+
+/**
+ * Everything the FS and vec4 register allocators need to know about a
+ * register set, generated at build time by brw_reg_set_layouts.py for each
+ * hardware generation.
+ *
+ * Class i is made of blocks of i + 1 contiguous GRFs, and the class after
+ * the MAX_VGRF_SIZE block classes, if any, is the aligned pairs class for
+ * PLN.
+ */
+struct brw_reg_set_layout {
+   /** @{
+    * The parameters the layout was generated for.
+    */
+   unsigned base_reg_count;
+   bool pairs;
+   bool aligned_pairs;
+   bool round_robin;
+   /** @} */
+
+   unsigned ra_reg_count;
+   unsigned class_count;
+   const struct brw_reg_class_layout *classes;
+
+   /** The q values, class_count by class_count. */
+   const unsigned *q_values;
+
+   /** The GRFs (or pairs of GRFs) each register is made of. */
+   const struct ra_reg_range *ranges;
+
+   const uint8_t *ra_reg_to_grf;
+   int class_to_ra_reg_range[17];
+
+   /**
+    * Pairs of registers that conflict even though their GRFs don't overlap,
+    * which the register sets used to be built with on gen4-5 SIMD16.
+    */
+   const uint16_t (*extra_conflicts)[2];
+   unsigned extra_conflict_count;
+};
+
+extern const struct brw_reg_set_layout brw_reg_set_layouts[];
+extern const unsigned brw_reg_set_layout_count;
+
+const struct brw_reg_set_layout *
+brw_find_reg_set_layout(unsigned base_reg_count, bool pairs,
+                        bool aligned_pairs, bool round_robin);
+
+struct ra_regs *
+brw_create_reg_set(void *mem_ctx, const struct brw_reg_set_layout *layout);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* BRW_REG_SETS_H */
@@ -23,6 +23,7 @@
 
 #include "util/register_allocate.h"
 #include "brw_vec4.h"
+#include "brw_reg_sets.h"
 #include "brw_cfg.h"
 
 using namespace brw;
@@ -96,73 +97,21 @@ brw_vec4_alloc_reg_set(struct brw_compiler *compiler)
 
    /* After running split_virtual_grfs(), almost all VGRFs will be of size 1.
     * SEND-from-GRF sources cannot be split, so we also need classes for each
-    * potential message length.
+    * potential message length.  The register set is worked out at build time
+    * by brw_reg_set_layouts.py.
     */
-   const int class_count = MAX_VGRF_SIZE;
-   int class_sizes[MAX_VGRF_SIZE];
+   const struct brw_reg_set_layout *layout =
+      brw_find_reg_set_layout(base_reg_count, false, false,
+                              compiler->devinfo->gen >= 6);
+   assert(layout && layout->class_count == MAX_VGRF_SIZE);
 
-   for (int i = 0; i < class_count; i++)
-      class_sizes[i] = i + 1;
-
-   /* Compute the total number of registers across all classes. */
-   int ra_reg_count = 0;
-   for (int i = 0; i < class_count; i++) {
-      ra_reg_count += base_reg_count - (class_sizes[i] - 1);
-   }
-
-   ralloc_free(compiler->vec4_reg_set.ra_reg_to_grf);
-   compiler->vec4_reg_set.ra_reg_to_grf = ralloc_array(compiler, uint8_t, ra_reg_count);
+   compiler->vec4_reg_set.ra_reg_to_grf = layout->ra_reg_to_grf;
    ralloc_free(compiler->vec4_reg_set.regs);
-   compiler->vec4_reg_set.regs = ra_alloc_reg_set(compiler, ra_reg_count, false);
-   if (compiler->devinfo->gen >= 6)
-      ra_set_allocate_round_robin(compiler->vec4_reg_set.regs);
+   compiler->vec4_reg_set.regs = brw_create_reg_set(compiler, layout);
    ralloc_free(compiler->vec4_reg_set.classes);
-   compiler->vec4_reg_set.classes = ralloc_array(compiler, int, class_count);
-
-   /* Now, add the registers to their classes, and add the conflicts
-    * between them and the base GRF registers (and also each other).
-    */
-   int reg = 0;
-   unsigned *q_values[MAX_VGRF_SIZE];
-   for (int i = 0; i < class_count; i++) {
-      int class_reg_count = base_reg_count - (class_sizes[i] - 1);
-      compiler->vec4_reg_set.classes[i] = ra_alloc_reg_class(compiler->vec4_reg_set.regs);
-
-      q_values[i] = new unsigned[MAX_VGRF_SIZE];
-
-      for (int j = 0; j < class_reg_count; j++) {
-	 ra_class_add_reg(compiler->vec4_reg_set.regs, compiler->vec4_reg_set.classes[i], reg);
-
-	 compiler->vec4_reg_set.ra_reg_to_grf[reg] = j;
-
-	 for (int base_reg = j;
-	      base_reg < j + class_sizes[i];
-	      base_reg++) {
-	    ra_add_reg_conflict(compiler->vec4_reg_set.regs, base_reg, reg);
-	 }
-
-	 reg++;
-      }
-
-      for (int j = 0; j < class_count; j++) {
-         /* Calculate the q values manually because the algorithm used by
-          * ra_set_finalize() to do it has higher complexity affecting the
-          * start-up time of some applications.  q(i, j) is just the maximum
-          * number of registers from class i a register from class j can
-          * conflict with.
-          */
-         q_values[i][j] = class_sizes[i] + class_sizes[j] - 1;
-      }
-   }
-   assert(reg == ra_reg_count);
-
-   for (int reg = 0; reg < base_reg_count; reg++)
-      ra_make_reg_conflicts_transitive(compiler->vec4_reg_set.regs, reg);
-
-   ra_set_finalize(compiler->vec4_reg_set.regs, q_values);
-
+   compiler->vec4_reg_set.classes = ralloc_array(compiler, int, MAX_VGRF_SIZE);
    for (int i = 0; i < MAX_VGRF_SIZE; i++)
-      delete[] q_values[i];
+      compiler->vec4_reg_set.classes[i] = i;
 }
 
 void
@@ -0,0 +1,264 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "brw_shader.h"
+#include "brw_reg_sets.h"
+#include "common/gen_device_info.h"
+#include "util/ralloc.h"
+
+/* Checks that the register sets loaded from the tables generated by
+ * brw_reg_set_layouts.py are the same as the ones the compiler used to build
+ * by adding the conflicts between every register and the base GRFs and
+ * making them transitive.
+ */
+
+static const struct device {
+   const char *name;
+   int gen;
+   bool has_pln;
+} devices[] = {
+   { "i965", 4, false },
+   { "g4x", 4, true },
+   { "ilk", 5, true },
+   { "snb", 6, true },
+   { "ivb", 7, true },
+   { "bdw", 8, true },
+   { "skl", 9, true },
+   { "cnl", 10, true },
+};
+
+struct legacy_reg_set {
+   struct ra_regs *regs;
+   int classes[MAX_VGRF_SIZE];
+   int class_to_ra_reg_range[17];
+   uint8_t *ra_reg_to_grf;
+   int aligned_pairs_class;
+};
+
+static void
+legacy_alloc_reg_set(void *mem_ctx, int base_reg_count, bool pairs,
+                     bool aligned_pairs, bool round_robin,
+                     struct legacy_reg_set *set)
+{
+   const int class_count = MAX_VGRF_SIZE;
+
+   memset(set->class_to_ra_reg_range, 0, sizeof(set->class_to_ra_reg_range));
+
+   int ra_reg_count = 0;
+   for (int i = 0; i < class_count; i++) {
+      if (pairs)
+         ra_reg_count += (base_reg_count - i) / 2;
+      else
+         ra_reg_count += base_reg_count - i;
+      set->class_to_ra_reg_range[i + 1] = ra_reg_count;
+   }
+
+   set->ra_reg_to_grf = ralloc_array(mem_ctx, uint8_t, ra_reg_count);
+   set->regs = ra_alloc_reg_set(mem_ctx, ra_reg_count, false);
+   if (round_robin)
+      ra_set_allocate_round_robin(set->regs);
+   set->aligned_pairs_class = -1;
+
+   unsigned **q_values = ralloc_array(mem_ctx, unsigned *, class_count + 1);
+   for (int i = 0; i < class_count + 1; i++)
+      q_values[i] = ralloc_array(q_values, unsigned, class_count + 1);
+
+   int reg = 0;
+   int pairs_base_reg = 0;
+   int pairs_reg_count = 0;
+   for (int i = 0; i < class_count; i++) {
+      const int size = i + 1;
+      const int class_reg_count =
+         pairs ? (base_reg_count - i) / 2 : base_reg_count - i;
+      const int units = pairs ? (size + 1) / 2 : size;
+
+      for (int j = 0; j < class_count; j++) {
+         if (pairs)
+            q_values[i][j] = (size + 1) / 2 + (j + 2) / 2 - 1;
+         else
+            q_values[i][j] = size + (j + 1) - 1;
+      }
+
+      set->classes[i] = ra_alloc_reg_class(set->regs);
+
+      if (size == 2) {
+         pairs_base_reg = reg;
+         pairs_reg_count = class_reg_count;
+      }
+
+      for (int j = 0; j < class_reg_count; j++) {
+         ra_class_add_reg(set->regs, set->classes[i], reg);
+         set->ra_reg_to_grf[reg] = pairs ? j * 2 : j;
+
+         for (int base_reg = j; base_reg < j + units; base_reg++)
+            ra_add_reg_conflict(set->regs, base_reg, reg);
+
+         reg++;
+      }
+   }
+   ASSERT_EQ(ra_reg_count, reg);
+
+   for (int reg = 0; reg < base_reg_count; reg++)
+      ra_make_reg_conflicts_transitive(set->regs, reg);
+
+   if (aligned_pairs) {
+      set->aligned_pairs_class = ra_alloc_reg_class(set->regs);
+
+      for (int i = 0; i < pairs_reg_count; i++) {
+         if ((set->ra_reg_to_grf[pairs_base_reg + i] & 1) == 0)
+            ra_class_add_reg(set->regs, set->aligned_pairs_class,
+                             pairs_base_reg + i);
+      }
+
+      for (int i = 0; i < class_count; i++) {
+         q_values[class_count][i] = (i + 1) / 2 + 1;
+         q_values[i][class_count] = (i + 1) + 1;
+      }
+      q_values[class_count][class_count] = 1;
+   }
+
+   ra_set_finalize(set->regs, q_values);
+}
+
+/* Dumps an empty interference graph, which is enough to get at the
+ * registers, their conflicts, the classes and their q values.
+ */
+static std::string
+dump_reg_set(struct ra_regs *regs)
+{
+   struct ra_graph *g = ra_alloc_interference_graph(regs, 0);
+   char *buf = NULL;
+   size_t size = 0;
+   FILE *f = open_memstream(&buf, &size);
+
+   ra_dump_graph(g, f);
+   fclose(f);
+
+   std::string dump(buf, size);
+   free(buf);
+   ralloc_free(g);
+   return dump;
+}
+
+class reg_sets_test : public ::testing::TestWithParam<device> {
+   virtual void SetUp();
+   virtual void TearDown();
+
+public:
+   void *mem_ctx;
+   struct gen_device_info devinfo;
+   struct brw_compiler *compiler;
+};
+
+void
+reg_sets_test::SetUp()
+{
+   mem_ctx = ralloc_context(NULL);
+
+   memset(&devinfo, 0, sizeof(devinfo));
+   devinfo.gen = GetParam().gen;
+   devinfo.has_pln = GetParam().has_pln;
+
+   compiler = rzalloc(mem_ctx, struct brw_compiler);
+   compiler->devinfo = &devinfo;
+}
+
+void
+reg_sets_test::TearDown()
+{
+   ralloc_free(mem_ctx);
+   mem_ctx = NULL;
+}
+
+static std::string
+get_name(::testing::TestParamInfo<device> info)
+{
+   return info.param.name;
+}
+
+INSTANTIATE_TEST_CASE_P(reg_sets, reg_sets_test,
+                        ::testing::ValuesIn(devices), get_name);
+
+TEST_P(reg_sets_test, fs)
+{
+   brw_fs_alloc_reg_sets(compiler);
+
+   for (int index = 0; index < 3; index++) {
+      const int dispatch_width = 8 << index;
+      const int gen = devinfo.gen;
+      struct legacy_reg_set legacy;
+
+      /* For IVB+, SIMD16 and SIMD32 share the SIMD8 register set. */
+      if (dispatch_width > 8 && gen >= 7) {
+         EXPECT_EQ(compiler->fs_reg_sets[0].regs,
+                   compiler->fs_reg_sets[index].regs);
+         continue;
+      }
+
+      legacy_alloc_reg_set(mem_ctx, BRW_MAX_GRF,
+                           gen <= 5 && dispatch_width >= 16,
+                           devinfo.has_pln && dispatch_width == 8 && gen <= 6,
+                           gen >= 6, &legacy);
+
+      const int ra_reg_count = legacy.class_to_ra_reg_range[MAX_VGRF_SIZE];
+
+      EXPECT_EQ(dump_reg_set(legacy.regs),
+                dump_reg_set(compiler->fs_reg_sets[index].regs))
+         << "SIMD" << dispatch_width;
+      for (int i = 0; i < MAX_VGRF_SIZE; i++)
+         EXPECT_EQ(legacy.classes[i], compiler->fs_reg_sets[index].classes[i]);
+      for (int i = 0; i < 17; i++)
+         EXPECT_EQ(legacy.class_to_ra_reg_range[i],
+                   compiler->fs_reg_sets[index].class_to_ra_reg_range[i]);
+      for (int i = 0; i < ra_reg_count; i++)
+         EXPECT_EQ(legacy.ra_reg_to_grf[i],
+                   compiler->fs_reg_sets[index].ra_reg_to_grf[i]);
+      EXPECT_EQ(legacy.aligned_pairs_class,
+                compiler->fs_reg_sets[index].aligned_pairs_class);
+   }
+}
+
+TEST_P(reg_sets_test, vec4)
+{
+   const int base_reg_count =
+      devinfo.gen >= 7 ? GEN7_MRF_HACK_START : BRW_MAX_GRF;
+   struct legacy_reg_set legacy;
+
+   brw_vec4_alloc_reg_set(compiler);
+
+   legacy_alloc_reg_set(mem_ctx, base_reg_count, false, false,
+                        devinfo.gen >= 6, &legacy);
+
+   const int ra_reg_count = legacy.class_to_ra_reg_range[MAX_VGRF_SIZE];
+
+   EXPECT_EQ(dump_reg_set(legacy.regs),
+             dump_reg_set(compiler->vec4_reg_set.regs));
+   for (int i = 0; i < MAX_VGRF_SIZE; i++)
+      EXPECT_EQ(legacy.classes[i], compiler->vec4_reg_set.classes[i]);
+   for (int i = 0; i < ra_reg_count; i++)
+      EXPECT_EQ(legacy.ra_reg_to_grf[i], compiler->vec4_reg_set.ra_reg_to_grf[i]);
+}
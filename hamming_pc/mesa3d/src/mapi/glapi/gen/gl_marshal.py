@@ -96,7 +96,7 @@ class PrintCode(gl_XML.gl_print_base):
         out('{')
         with indent():
             out('GET_CURRENT_CONTEXT(ctx);')
-            out('_mesa_glthread_finish(ctx);')
+            out('_mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_CALL);')
             out('debug_print_sync("{0}");'.format(func.name))
             self.print_sync_call(func)
         out('}')
@@ -106,8 +106,23 @@ class PrintCode(gl_XML.gl_print_base):
     def print_async_dispatch(self, func):
         out('cmd = _mesa_glthread_allocate_command(ctx, '
             'DISPATCH_CMD_{0}, cmd_size);'.format(func.name))
+        self.print_async_fill(func)
+
+    def print_async_dispatch_with_copy(self, func, copied_param):
+        out('cmd = _mesa_glthread_allocate_command_with_data(ctx, '
+            'DISPATCH_CMD_{0}, cmd_size, {1}, {1}_size, &{1}_copy);'.format(
+                func.name, copied_param))
+        out('if (cmd) {')
+        with indent():
+            self.print_async_fill(func, copied_param)
+            out('return;')
+        out('}')
+
+    def print_async_fill(self, func, copied_param = None):
         for p in func.fixed_params:
-            if p.count:
+            if p.name == copied_param:
+                out('cmd->{0} = {0}_copy;'.format(p.name))
+            elif p.count:
                 out('memcpy(cmd->{0}, {0}, {1});'.format(
                         p.name, p.size_string()))
             else:
@@ -215,12 +230,20 @@ class PrintCode(gl_XML.gl_print_base):
             if p.is_variable_length():
                 out('if (unlikely({0} < 0)) {{'.format(p.size_string()))
                 with indent():
+                    out('_mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_ERROR);')
                     out('goto fallback_to_sync;')
                 out('}')
                 return True
         return False
 
 
+    def has_user_indices(self, func):
+        # Draw calls that may read a user index array of count indices.
+        params = dict((p.name, p) for p in func.parameters)
+        return (func.marshal == 'draw' and 'indices' in params and
+                'type' in params and 'count' in params and
+                not params['count'].is_pointer())
+
     def print_async_marshal(self, func):
         need_fallback_sync = False
         out('static void GLAPIENTRY')
@@ -243,10 +266,27 @@ class PrintCode(gl_XML.gl_print_base):
 
             need_fallback_sync = self.validate_count_or_fallback(func)
 
-            if func.marshal_fail:
+            if func.marshal_fail and self.has_user_indices(func):
+                # Copy user index arrays instead of giving up on threading.
+                out('if ({0}) {{'.format(func.marshal_fail))
+                with indent():
+                    out('const void *indices_copy;')
+                    out('size_t indices_size;')
+                    out('if (_mesa_glthread_get_index_array_size(count, type, '
+                        '&indices_size)) {')
+                    with indent():
+                        self.print_async_dispatch_with_copy(func, 'indices')
+                    out('}')
+                    out('_mesa_glthread_finish_for(ctx, '
+                        'GLTHREAD_SYNC_LARGE_CMD);')
+                    self.print_sync_dispatch(func)
+                    out('return;')
+                out('}')
+            elif func.marshal_fail:
                 out('if ({0}) {{'.format(func.marshal_fail))
                 with indent():
-                    out('_mesa_glthread_finish(ctx);')
+                    out('_mesa_glthread_finish_for(ctx, '
+                        'GLTHREAD_SYNC_UNSUPPORTED);')
                     out('_mesa_glthread_restore_dispatch(ctx);')
                     self.print_sync_dispatch(func)
                     out('return;')
@@ -262,7 +302,7 @@ class PrintCode(gl_XML.gl_print_base):
         if need_fallback_sync:
             out('fallback_to_sync:')
         with indent():
-            out('_mesa_glthread_finish(ctx);')
+            out('_mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_LARGE_CMD);')
             self.print_sync_dispatch(func)
 
         out('}')
@@ -36,10 +36,40 @@
 #include "main/glthread.h"
 #include "main/marshal.h"
 #include "main/marshal_generated.h"
+#include "util/debug.h"
 #include "util/u_atomic.h"
 #include "util/u_thread.h"
 
 
+static const char *sync_reason_names[GLTHREAD_NUM_SYNC_REASONS] = {
+   [GLTHREAD_SYNC_CALL] = "sync call",
+   [GLTHREAD_SYNC_LARGE_CMD] = "large command",
+   [GLTHREAD_SYNC_UNSUPPORTED] = "unsupported",
+   [GLTHREAD_SYNC_STAGING_FULL] = "staging full",
+   [GLTHREAD_SYNC_ERROR] = "error",
+   [GLTHREAD_SYNC_OTHER] = "other",
+};
+
+static void
+glthread_free_staging(struct glthread_batch *batch)
+{
+   struct glthread_state *glthread = batch->ctx->GLThread;
+   struct glthread_staging_block *block = batch->staging;
+
+   while (block) {
+      struct glthread_staging_block *next = block->next;
+      free(block);
+      block = next;
+   }
+
+   if (batch->staging_size) {
+      p_atomic_add(&glthread->staging_in_flight,
+                   -(int64_t)batch->staging_size);
+   }
+   batch->staging = NULL;
+   batch->staging_size = 0;
+}
+
 static void
 glthread_unmarshal_batch(void *job, int thread_index)
 {
@@ -54,6 +84,7 @@ glthread_unmarshal_batch(void *job, int thread_index)
 
    assert(pos == batch->used);
    batch->used = 0;
+   glthread_free_staging(batch);
 }
 
 static void
@@ -92,6 +123,8 @@ _mesa_glthread_init(struct gl_context *ctx)
    }
 
    glthread->stats.queue = &glthread->queue;
+   glthread->print_stats = env_var_as_boolean("MESA_GLTHREAD_STATS", false);
+   glthread->unpack.Alignment = 4;
    ctx->CurrentClientDispatch = ctx->MarshalExec;
    ctx->GLThread = glthread;
 
@@ -115,6 +148,14 @@ _mesa_glthread_destroy(struct gl_context *ctx)
    _mesa_glthread_finish(ctx);
    util_queue_destroy(&glthread->queue);
 
+   if (glthread->print_stats) {
+      fprintf(stderr, "glthread: %u syncs\n", glthread->stats.num_syncs);
+      for (unsigned i = 0; i < GLTHREAD_NUM_SYNC_REASONS; i++) {
+         fprintf(stderr, "glthread:   %-14s %u\n", sync_reason_names[i],
+                 glthread->num_syncs[i]);
+      }
+   }
+
    for (unsigned i = 0; i < MARSHAL_MAX_BATCHES; i++)
       util_queue_fence_destroy(&glthread->batches[i].fence);
 
@@ -177,6 +218,16 @@ _mesa_glthread_flush_batch(struct gl_context *ctx)
  */
 void
 _mesa_glthread_finish(struct gl_context *ctx)
+{
+   _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_OTHER);
+}
+
+/**
+ * Like _mesa_glthread_finish(), but records why we had to synchronize.
+ */
+void
+_mesa_glthread_finish_for(struct gl_context *ctx,
+                          enum glthread_sync_reason reason)
 {
    struct glthread_state *glthread = ctx->GLThread;
    if (!glthread)
@@ -215,6 +266,105 @@ _mesa_glthread_finish(struct gl_context *ctx)
       synced = true;
    }
 
-   if (synced)
+   if (synced) {
       p_atomic_inc(&glthread->stats.num_syncs);
+      glthread->num_syncs[reason]++;
+   }
+}
+
+static void *
+glthread_alloc_staging(struct glthread_batch *batch, size_t size)
+{
+   struct glthread_staging_block *block = batch->staging;
+   const size_t aligned_size = ALIGN(size, 8);
+
+   if (!block || block->used + aligned_size > block->size) {
+      size_t block_size = MAX2(aligned_size, MARSHAL_STAGING_BLOCK_SIZE);
+
+      block = malloc(sizeof(*block) + block_size);
+      if (!block)
+         return NULL;
+
+      block->size = block_size;
+      block->used = 0;
+
+      /* Keep the block with the most room at the head. */
+      if (batch->staging && block_size == aligned_size) {
+         block->next = batch->staging->next;
+         batch->staging->next = block;
+      } else {
+         block->next = batch->staging;
+         batch->staging = block;
+      }
+      batch->staging_size += block_size;
+   }
+
+   void *ptr = &block->data[block->used];
+   block->used += aligned_size;
+   return ptr;
+}
+
+/**
+ * Allocates a command together with a copy of client data that the command
+ * will use when it's executed, so that the call doesn't need to synchronize
+ * to consume the data right away.
+ *
+ * Small data is copied right after the command.  Anything that doesn't fit
+ * in a batch goes to staging memory that is freed after the batch has been
+ * executed.  *data_copy receives the address of the copy, or data itself if
+ * data_size is 0.  Returns NULL if the data is too large for staging, in
+ * which case the caller has to synchronize instead.
+ */
+void *
+_mesa_glthread_allocate_command_with_data(struct gl_context *ctx,
+                                          uint16_t cmd_id,
+                                          size_t cmd_size,
+                                          const void *data,
+                                          size_t data_size,
+                                          const void **data_copy)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+   struct glthread_batch *next;
+
+   if (data_size <= MARSHAL_MAX_CMD_SIZE - cmd_size) {
+      uint8_t *cmd = _mesa_glthread_allocate_command(ctx, cmd_id,
+                                                     cmd_size + data_size);
+      if (data_size) {
+         memcpy(cmd + cmd_size, data, data_size);
+         *data_copy = cmd + cmd_size;
+      } else {
+         *data_copy = data;
+      }
+      return cmd;
+   }
+
+   if (data_size > MARSHAL_MAX_STAGING_SIZE)
+      return NULL;
+
+   if (p_atomic_read(&glthread->staging_in_flight) + data_size >
+       MARSHAL_MAX_STAGING_SIZE) {
+      _mesa_glthread_flush_batch(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_STAGING_FULL);
+   }
+
+   /* Make sure that the command and its staging memory end up in the same
+    * batch.
+    */
+   next = &glthread->batches[glthread->next];
+   if (next->used + cmd_size > MARSHAL_MAX_CMD_SIZE) {
+      _mesa_glthread_flush_batch(ctx);
+      next = &glthread->batches[glthread->next];
+   }
+
+   size_t old_staging_size = next->staging_size;
+   void *copy = glthread_alloc_staging(next, data_size);
+   if (!copy)
+      return NULL;
+
+   memcpy(copy, data, data_size);
+   p_atomic_add(&glthread->staging_in_flight,
+                next->staging_size - old_staging_size);
+   *data_copy = copy;
+
+   return _mesa_glthread_allocate_command(ctx, cmd_id, cmd_size);
 }
@@ -45,12 +45,51 @@
  */
 #define MARSHAL_MAX_BATCHES 8
 
+/* The maximum amount of staging memory that queued batches may hold.
+ *
+ * Client data that doesn't fit in a batch (large glBufferSubData and
+ * glTexSubImage payloads, user index arrays) is copied to staging memory
+ * owned by the batch, so that the call doesn't have to synchronize.
+ * Reaching this limit waits for the worker thread to catch up.
+ */
+#define MARSHAL_MAX_STAGING_SIZE (64 * 1024 * 1024)
+
+/* The size of the staging blocks allocated for small copies. */
+#define MARSHAL_STAGING_BLOCK_SIZE (64 * 1024)
+
 #include <inttypes.h>
 #include <stdbool.h>
 #include "util/u_queue.h"
 
 enum marshal_dispatch_cmd_id;
 
+/** Why the main thread had to wait for the worker thread. */
+enum glthread_sync_reason
+{
+   /** The call returns data or reads client memory of unknown size. */
+   GLTHREAD_SYNC_CALL,
+   /** The call's data didn't fit in a batch or in staging memory. */
+   GLTHREAD_SYNC_LARGE_CMD,
+   /** State we can't track, like user vertex arrays; this disables us. */
+   GLTHREAD_SYNC_UNSUPPORTED,
+   /** Staging memory was full. */
+   GLTHREAD_SYNC_STAGING_FULL,
+   /** The call has invalid parameters and must set the GL error now. */
+   GLTHREAD_SYNC_ERROR,
+   /** Window system and driver interfaces. */
+   GLTHREAD_SYNC_OTHER,
+   GLTHREAD_NUM_SYNC_REASONS
+};
+
+/** A chunk of staging memory owned by a batch. */
+struct glthread_staging_block
+{
+   struct glthread_staging_block *next;
+   size_t size;
+   size_t used;
+   uint8_t data[];
+};
+
 /** A single batch of commands queued up for execution. */
 struct glthread_batch
 {
@@ -63,6 +102,12 @@ struct glthread_batch
    /** Amount of data used by batch commands, in bytes. */
    size_t used;
 
+   /** Staging memory used by the commands, freed after execution. */
+   struct glthread_staging_block *staging;
+
+   /** Total size of the staging blocks, in bytes. */
+   size_t staging_size;
+
    /** Data contained in the command buffer. */
    uint8_t buffer[MARSHAL_MAX_CMD_SIZE];
 };
@@ -84,6 +129,18 @@ struct glthread_state
    /** Index of the batch being filled and about to be submitted. */
    unsigned next;
 
+   /** Staging memory held by batches that haven't been executed yet. */
+   size_t staging_in_flight;
+
+   /** How often we synchronized, per enum glthread_sync_reason. */
+   unsigned num_syncs[GLTHREAD_NUM_SYNC_REASONS];
+
+   /** Print the synchronization counts when the context is destroyed. */
+   bool print_stats;
+
+   /** Pixel unpack state as seen by the main thread, for sizing images. */
+   struct gl_pixelstore_attrib unpack;
+
    /**
     * Tracks on the main thread side whether the current vertex array binding
     * is in a VBO.
@@ -95,6 +152,16 @@ struct glthread_state
     * buffer) binding is in a VBO.
     */
    bool element_array_is_vbo;
+
+   /**
+    * Tracks on the main thread side which pixel unpack buffer is bound, in
+    * which case image pointers are offsets into it.  Binding a name that
+    * isn't a buffer fails on core and ES contexts and keeps the old binding,
+    * so this is only trusted while pixel_unpack_known is set; otherwise the
+    * real binding is looked up after synchronizing.
+    */
+   GLuint pixel_unpack_buffer;
+   bool pixel_unpack_known;
 };
 
 void _mesa_glthread_init(struct gl_context *ctx);
@@ -103,5 +170,13 @@ void _mesa_glthread_destroy(struct gl_context *ctx);
 void _mesa_glthread_restore_dispatch(struct gl_context *ctx);
 void _mesa_glthread_flush_batch(struct gl_context *ctx);
 void _mesa_glthread_finish(struct gl_context *ctx);
+void _mesa_glthread_finish_for(struct gl_context *ctx,
+                               enum glthread_sync_reason reason);
+void *_mesa_glthread_allocate_command_with_data(struct gl_context *ctx,
+                                                uint16_t cmd_id,
+                                                size_t cmd_size,
+                                                const void *data,
+                                                size_t data_size,
+                                                const void **data_copy);
 
 #endif /* _GLTHREAD_H*/
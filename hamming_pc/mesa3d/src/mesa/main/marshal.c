@@ -30,6 +30,8 @@
 #include "main/enums.h"
 #include "main/macros.h"
 #include "marshal.h"
+#include "main/glformats.h"
+#include "main/image.h"
 #include "dispatch.h"
 #include "marshal_generated.h"
 
@@ -88,7 +90,7 @@ _mesa_marshal_Enable(GLenum cap)
    debug_print_marshal("Enable");
 
    if (cap == GL_DEBUG_OUTPUT_SYNCHRONOUS_ARB) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_UNSUPPORTED);
       _mesa_glthread_restore_dispatch(ctx);
    } else {
       cmd = _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_Enable,
@@ -98,7 +100,7 @@ _mesa_marshal_Enable(GLenum cap)
       return;
    }
 
-   _mesa_glthread_finish(ctx);
+   _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_UNSUPPORTED);
    debug_print_sync_fallback("Enable");
    CALL_Enable(ctx->CurrentServerDispatch, (cap));
 }
@@ -187,7 +189,7 @@ _mesa_marshal_ShaderSource(GLuint shader, GLsizei count,
       }
       _mesa_post_marshal_hook(ctx);
    } else {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_LARGE_CMD);
       CALL_ShaderSource(ctx->CurrentServerDispatch,
                         (shader, count, string, length_tmp));
    }
@@ -243,6 +245,11 @@ track_vbo_binding(struct gl_context *ctx, GLenum target, GLuint buffer)
        */
       glthread->element_array_is_vbo = (buffer != 0);
       break;
+   case GL_PIXEL_UNPACK_BUFFER:
+      /* Unbinding always works, binding a bad name doesn't. */
+      glthread->pixel_unpack_buffer = buffer;
+      glthread->pixel_unpack_known = (buffer == 0);
+      break;
    }
 }
 
@@ -283,11 +290,80 @@ _mesa_marshal_BindBuffer(GLenum target, GLuint buffer)
       cmd->buffer = buffer;
       _mesa_post_marshal_hook(ctx);
    } else {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_LARGE_CMD);
       CALL_BindBuffer(ctx->CurrentServerDispatch, (target, buffer));
    }
 }
 
+/* DeleteBuffers: marshalled asynchronously */
+struct marshal_cmd_DeleteBuffers
+{
+   struct marshal_cmd_base cmd_base;
+   GLsizei n;
+   /* Followed by GLuint buffer[n] */
+};
+
+void
+_mesa_unmarshal_DeleteBuffers(struct gl_context *ctx,
+                              const struct marshal_cmd_DeleteBuffers *cmd)
+{
+   const GLuint *buffer = (const GLuint *) (cmd + 1);
+
+   CALL_DeleteBuffers(ctx->CurrentServerDispatch, (cmd->n, buffer));
+}
+
+/**
+ * Deleting the bound pixel unpack buffer unbinds it, which we need to know
+ * about for sizing images.
+ */
+static void
+track_vbo_deletion(struct gl_context *ctx, GLsizei n, const GLuint *buffer)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+
+   if (!glthread->pixel_unpack_known || !glthread->pixel_unpack_buffer ||
+       !buffer)
+      return;
+
+   for (GLsizei i = 0; i < n; i++) {
+      if (buffer[i] == glthread->pixel_unpack_buffer) {
+         glthread->pixel_unpack_buffer = 0;
+         break;
+      }
+   }
+}
+
+void GLAPIENTRY
+_mesa_marshal_DeleteBuffers(GLsizei n, const GLuint *buffer)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct marshal_cmd_DeleteBuffers *cmd;
+   debug_print_marshal("DeleteBuffers");
+
+   if (unlikely(n < 0)) {
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_ERROR);
+      CALL_DeleteBuffers(ctx->CurrentServerDispatch, (n, buffer));
+      return;
+   }
+
+   track_vbo_deletion(ctx, n, buffer);
+
+   const size_t data_size = n * sizeof(GLuint);
+   const size_t cmd_size = sizeof(*cmd) + data_size;
+   STATIC_ASSERT(sizeof(struct marshal_cmd_DeleteBuffers) % sizeof(GLuint) == 0);
+
+   if (cmd_size <= MARSHAL_MAX_CMD_SIZE) {
+      cmd = _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_DeleteBuffers,
+                                            cmd_size);
+      cmd->n = n;
+      memcpy(cmd + 1, buffer, data_size);
+      _mesa_post_marshal_hook(ctx);
+   } else {
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_LARGE_CMD);
+      CALL_DeleteBuffers(ctx->CurrentServerDispatch, (n, buffer));
+   }
+}
+
 /* BufferData: marshalled asynchronously */
 struct marshal_cmd_BufferData
 {
@@ -295,8 +371,8 @@ struct marshal_cmd_BufferData
    GLenum target;
    GLsizeiptr size;
    GLenum usage;
-   bool data_null; /* If set, no data follows for "data" */
-   /* Next size bytes are GLubyte data[size] */
+   /* Copy of the data, either following the command or in staging memory */
+   const GLvoid *data;
 };
 
 void
@@ -306,12 +382,7 @@ _mesa_unmarshal_BufferData(struct gl_context *ctx,
    const GLenum target = cmd->target;
    const GLsizeiptr size = cmd->size;
    const GLenum usage = cmd->usage;
-   const void *data;
-
-   if (cmd->data_null)
-      data = NULL;
-   else
-      data = (const void *) (cmd + 1);
+   const void *data = cmd->data;
 
    CALL_BufferData(ctx->CurrentServerDispatch, (target, size, data, usage));
 }
@@ -321,33 +392,32 @@ _mesa_marshal_BufferData(GLenum target, GLsizeiptr size, const GLvoid * data,
                          GLenum usage)
 {
    GET_CURRENT_CONTEXT(ctx);
-   size_t cmd_size =
-      sizeof(struct marshal_cmd_BufferData) + (data ? size : 0);
+   struct marshal_cmd_BufferData *cmd = NULL;
+   const void *data_copy;
    debug_print_marshal("BufferData");
 
    if (unlikely(size < 0)) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_ERROR);
       _mesa_error(ctx, GL_INVALID_VALUE, "BufferData(size < 0)");
       return;
    }
 
-   if (target != GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD &&
-       cmd_size <= MARSHAL_MAX_CMD_SIZE) {
-      struct marshal_cmd_BufferData *cmd =
-         _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_BufferData,
-                                         cmd_size);
+   if (target != GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD) {
+      cmd = _mesa_glthread_allocate_command_with_data(ctx,
+                                                      DISPATCH_CMD_BufferData,
+                                                      sizeof(*cmd), data,
+                                                      data ? size : 0,
+                                                      &data_copy);
+   }
 
+   if (cmd) {
       cmd->target = target;
       cmd->size = size;
       cmd->usage = usage;
-      cmd->data_null = !data;
-      if (data) {
-         char *variable_data = (char *) (cmd + 1);
-         memcpy(variable_data, data, size);
-      }
+      cmd->data = data_copy;
       _mesa_post_marshal_hook(ctx);
    } else {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_LARGE_CMD);
       CALL_BufferData(ctx->CurrentServerDispatch,
                       (target, size, data, usage));
    }
@@ -360,7 +430,8 @@ struct marshal_cmd_BufferSubData
    GLenum target;
    GLintptr offset;
    GLsizeiptr size;
-   /* Next size bytes are GLubyte data[size] */
+   /* Copy of the data, either following the command or in staging memory */
+   const GLvoid *data;
 };
 
 void
@@ -370,7 +441,7 @@ _mesa_unmarshal_BufferSubData(struct gl_context *ctx,
    const GLenum target = cmd->target;
    const GLintptr offset = cmd->offset;
    const GLsizeiptr size = cmd->size;
-   const void *data = (const void *) (cmd + 1);
+   const void *data = cmd->data;
 
    CALL_BufferSubData(ctx->CurrentServerDispatch,
                       (target, offset, size, data));
@@ -381,28 +452,31 @@ _mesa_marshal_BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size,
                             const GLvoid * data)
 {
    GET_CURRENT_CONTEXT(ctx);
-   size_t cmd_size = sizeof(struct marshal_cmd_BufferSubData) + size;
+   struct marshal_cmd_BufferSubData *cmd = NULL;
+   const void *data_copy;
 
    debug_print_marshal("BufferSubData");
    if (unlikely(size < 0)) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_ERROR);
       _mesa_error(ctx, GL_INVALID_VALUE, "BufferSubData(size < 0)");
       return;
    }
 
-   if (target != GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD &&
-       cmd_size <= MARSHAL_MAX_CMD_SIZE) {
-      struct marshal_cmd_BufferSubData *cmd =
-         _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_BufferSubData,
-                                         cmd_size);
+   if (target != GL_EXTERNAL_VIRTUAL_MEMORY_BUFFER_AMD) {
+      cmd = _mesa_glthread_allocate_command_with_data(ctx,
+                                                      DISPATCH_CMD_BufferSubData,
+                                                      sizeof(*cmd), data, size,
+                                                      &data_copy);
+   }
+
+   if (cmd) {
       cmd->target = target;
       cmd->offset = offset;
       cmd->size = size;
-      char *variable_data = (char *) (cmd + 1);
-      memcpy(variable_data, data, size);
+      cmd->data = data_copy;
       _mesa_post_marshal_hook(ctx);
    } else {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_LARGE_CMD);
       CALL_BufferSubData(ctx->CurrentServerDispatch,
                          (target, offset, size, data));
    }
@@ -415,8 +489,8 @@ struct marshal_cmd_NamedBufferData
    GLuint name;
    GLsizei size;
    GLenum usage;
-   bool data_null; /* If set, no data follows for "data" */
-   /* Next size bytes are GLubyte data[size] */
+   /* Copy of the data, either following the command or in staging memory */
+   const GLvoid *data;
 };
 
 void
@@ -426,12 +500,7 @@ _mesa_unmarshal_NamedBufferData(struct gl_context *ctx,
    const GLuint name = cmd->name;
    const GLsizei size = cmd->size;
    const GLenum usage = cmd->usage;
-   const void *data;
-
-   if (cmd->data_null)
-      data = NULL;
-   else
-      data = (const void *) (cmd + 1);
+   const void *data = cmd->data;
 
    CALL_NamedBufferData(ctx->CurrentServerDispatch,
                         (name, size, data, usage));
@@ -442,30 +511,33 @@ _mesa_marshal_NamedBufferData(GLuint buffer, GLsizeiptr size,
                               const GLvoid * data, GLenum usage)
 {
    GET_CURRENT_CONTEXT(ctx);
-   size_t cmd_size = sizeof(struct marshal_cmd_NamedBufferData) + (data ? size : 0);
+   struct marshal_cmd_NamedBufferData *cmd = NULL;
+   const void *data_copy;
 
    debug_print_marshal("NamedBufferData");
    if (unlikely(size < 0)) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_ERROR);
       _mesa_error(ctx, GL_INVALID_VALUE, "NamedBufferData(size < 0)");
       return;
    }
 
-   if (buffer > 0 && cmd_size <= MARSHAL_MAX_CMD_SIZE) {
-      struct marshal_cmd_NamedBufferData *cmd =
-         _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_NamedBufferData,
-                                         cmd_size);
+   if (buffer > 0) {
+      cmd = _mesa_glthread_allocate_command_with_data(ctx,
+                                                      DISPATCH_CMD_NamedBufferData,
+                                                      sizeof(*cmd), data,
+                                                      data ? size : 0,
+                                                      &data_copy);
+   }
+
+   if (cmd) {
       cmd->name = buffer;
       cmd->size = size;
       cmd->usage = usage;
-      cmd->data_null = !data;
-      if (data) {
-         char *variable_data = (char *) (cmd + 1);
-         memcpy(variable_data, data, size);
-      }
+      cmd->data = data_copy;
       _mesa_post_marshal_hook(ctx);
    } else {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, buffer ? GLTHREAD_SYNC_LARGE_CMD :
+                                              GLTHREAD_SYNC_ERROR);
       CALL_NamedBufferData(ctx->CurrentServerDispatch,
                            (buffer, size, data, usage));
    }
@@ -478,7 +550,8 @@ struct marshal_cmd_NamedBufferSubData
    GLuint name;
    GLintptr offset;
    GLsizei size;
-   /* Next size bytes are GLubyte data[size] */
+   /* Copy of the data, either following the command or in staging memory */
+   const GLvoid *data;
 };
 
 void
@@ -488,7 +561,7 @@ _mesa_unmarshal_NamedBufferSubData(struct gl_context *ctx,
    const GLuint name = cmd->name;
    const GLintptr offset = cmd->offset;
    const GLsizei size = cmd->size;
-   const void *data = (const void *) (cmd + 1);
+   const void *data = cmd->data;
 
    CALL_NamedBufferSubData(ctx->CurrentServerDispatch,
                            (name, offset, size, data));
@@ -499,27 +572,32 @@ _mesa_marshal_NamedBufferSubData(GLuint buffer, GLintptr offset,
                                  GLsizeiptr size, const GLvoid * data)
 {
    GET_CURRENT_CONTEXT(ctx);
-   size_t cmd_size = sizeof(struct marshal_cmd_NamedBufferSubData) + size;
+   struct marshal_cmd_NamedBufferSubData *cmd = NULL;
+   const void *data_copy;
 
    debug_print_marshal("NamedBufferSubData");
    if (unlikely(size < 0)) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_ERROR);
       _mesa_error(ctx, GL_INVALID_VALUE, "NamedBufferSubData(size < 0)");
       return;
    }
 
-   if (buffer > 0 && cmd_size <= MARSHAL_MAX_CMD_SIZE) {
-      struct marshal_cmd_NamedBufferSubData *cmd =
-         _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_NamedBufferSubData,
-                                         cmd_size);
+   if (buffer > 0) {
+      cmd = _mesa_glthread_allocate_command_with_data(ctx,
+                                                      DISPATCH_CMD_NamedBufferSubData,
+                                                      sizeof(*cmd), data, size,
+                                                      &data_copy);
+   }
+
+   if (cmd) {
       cmd->name = buffer;
       cmd->offset = offset;
       cmd->size = size;
-      char *variable_data = (char *) (cmd + 1);
-      memcpy(variable_data, data, size);
+      cmd->data = data_copy;
       _mesa_post_marshal_hook(ctx);
    } else {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, buffer ? GLTHREAD_SYNC_LARGE_CMD :
+                                              GLTHREAD_SYNC_ERROR);
       CALL_NamedBufferSubData(ctx->CurrentServerDispatch,
                               (buffer, offset, size, data));
    }
@@ -635,7 +713,7 @@ _mesa_marshal_ClearBufferfv(GLenum buffer, GLint drawbuffer,
    debug_print_marshal("ClearBufferfv");
 
    if (!(buffer == GL_DEPTH || buffer == GL_COLOR)) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_ERROR);
 
       /* Page 498 of the PDF, section '17.4.3.1 Clearing Individual Buffers'
        * of the OpenGL 4.5 spec states:
@@ -651,7 +729,7 @@ _mesa_marshal_ClearBufferfv(GLenum buffer, GLint drawbuffer,
    if (!clear_buffer_add_command(ctx, DISPATCH_CMD_ClearBufferfv, buffer,
                                  drawbuffer, (GLuint *)value, size)) {
       debug_print_sync("ClearBufferfv");
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_LARGE_CMD);
       CALL_ClearBufferfv(ctx->CurrentServerDispatch,
                          (buffer, drawbuffer, value));
    }
@@ -665,7 +743,7 @@ _mesa_marshal_ClearBufferiv(GLenum buffer, GLint drawbuffer,
    debug_print_marshal("ClearBufferiv");
 
    if (!(buffer == GL_STENCIL || buffer == GL_COLOR)) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_ERROR);
 
       /* Page 498 of the PDF, section '17.4.3.1 Clearing Individual Buffers'
        * of the OpenGL 4.5 spec states:
@@ -681,7 +759,7 @@ _mesa_marshal_ClearBufferiv(GLenum buffer, GLint drawbuffer,
    if (!clear_buffer_add_command(ctx, DISPATCH_CMD_ClearBufferiv, buffer,
                                  drawbuffer, (GLuint *)value, size)) {
       debug_print_sync("ClearBufferiv");
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_LARGE_CMD);
       CALL_ClearBufferiv(ctx->CurrentServerDispatch,
                          (buffer, drawbuffer, value));
    }
@@ -695,7 +773,7 @@ _mesa_marshal_ClearBufferuiv(GLenum buffer, GLint drawbuffer,
    debug_print_marshal("ClearBufferuiv");
 
    if (buffer != GL_COLOR) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_ERROR);
 
       /* Page 498 of the PDF, section '17.4.3.1 Clearing Individual Buffers'
        * of the OpenGL 4.5 spec states:
@@ -710,7 +788,7 @@ _mesa_marshal_ClearBufferuiv(GLenum buffer, GLint drawbuffer,
    if (!clear_buffer_add_command(ctx, DISPATCH_CMD_ClearBufferuiv, buffer,
                                  drawbuffer, (GLuint *)value, 4)) {
       debug_print_sync("ClearBufferuiv");
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_LARGE_CMD);
       CALL_ClearBufferuiv(ctx->CurrentServerDispatch,
                          (buffer, drawbuffer, value));
    }
@@ -724,7 +802,7 @@ _mesa_marshal_ClearBufferfi(GLenum buffer, GLint drawbuffer,
    debug_print_marshal("ClearBufferfi");
 
    if (buffer != GL_DEPTH_STENCIL) {
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_ERROR);
 
       /* Page 498 of the PDF, section '17.4.3.1 Clearing Individual Buffers'
        * of the OpenGL 4.5 spec states:
@@ -742,8 +820,379 @@ _mesa_marshal_ClearBufferfi(GLenum buffer, GLint drawbuffer,
    if (!clear_buffer_add_command(ctx, DISPATCH_CMD_ClearBufferfi, buffer,
                                  drawbuffer, (GLuint *)value, 2)) {
       debug_print_sync("ClearBufferfi");
-      _mesa_glthread_finish(ctx);
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_LARGE_CMD);
       CALL_ClearBufferfi(ctx->CurrentServerDispatch,
                          (buffer, drawbuffer, depth, stencil));
    }
 }
+
+
+/* PixelStorei: marshalled asynchronously */
+struct marshal_cmd_PixelStorei
+{
+   struct marshal_cmd_base cmd_base;
+   GLenum pname;
+   GLint param;
+};
+
+/**
+ * Mirrors the unpack state updates of _mesa_PixelStorei() on the main
+ * thread, so that we know how much client memory glTexSubImage*D() reads.
+ * The validation must match, otherwise we would copy too little.
+ */
+static void
+track_pixel_store(struct gl_context *ctx, GLenum pname, GLint param)
+{
+   struct gl_pixelstore_attrib *unpack = &ctx->GLThread->unpack;
+   const bool no_error = _mesa_is_no_error_enabled(ctx);
+   const bool es3_or_desktop = _mesa_is_desktop_gl(ctx) ||
+                               _mesa_is_gles3(ctx);
+
+   switch (pname) {
+   case GL_UNPACK_ROW_LENGTH:
+   case GL_UNPACK_SKIP_PIXELS:
+   case GL_UNPACK_SKIP_ROWS:
+      if (!no_error && (ctx->API == API_OPENGLES || param < 0))
+         return;
+      break;
+   case GL_UNPACK_IMAGE_HEIGHT:
+   case GL_UNPACK_SKIP_IMAGES:
+      if (!no_error && (!es3_or_desktop || param < 0))
+         return;
+      break;
+   case GL_UNPACK_ALIGNMENT:
+      if (!no_error && param != 1 && param != 2 && param != 4 && param != 8)
+         return;
+      break;
+   default:
+      return;
+   }
+
+   switch (pname) {
+   case GL_UNPACK_ROW_LENGTH:
+      unpack->RowLength = param;
+      break;
+   case GL_UNPACK_SKIP_PIXELS:
+      unpack->SkipPixels = param;
+      break;
+   case GL_UNPACK_SKIP_ROWS:
+      unpack->SkipRows = param;
+      break;
+   case GL_UNPACK_IMAGE_HEIGHT:
+      unpack->ImageHeight = param;
+      break;
+   case GL_UNPACK_SKIP_IMAGES:
+      unpack->SkipImages = param;
+      break;
+   case GL_UNPACK_ALIGNMENT:
+      unpack->Alignment = param;
+      break;
+   }
+}
+
+void
+_mesa_unmarshal_PixelStorei(struct gl_context *ctx,
+                            const struct marshal_cmd_PixelStorei *cmd)
+{
+   CALL_PixelStorei(ctx->CurrentServerDispatch, (cmd->pname, cmd->param));
+}
+
+void GLAPIENTRY
+_mesa_marshal_PixelStorei(GLenum pname, GLint param)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct marshal_cmd_PixelStorei *cmd;
+   debug_print_marshal("PixelStorei");
+
+   track_pixel_store(ctx, pname, param);
+
+   cmd = _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_PixelStorei,
+                                         sizeof(*cmd));
+   cmd->pname = pname;
+   cmd->param = param;
+   _mesa_post_marshal_hook(ctx);
+}
+
+/* PixelStoref: marshalled asynchronously */
+struct marshal_cmd_PixelStoref
+{
+   struct marshal_cmd_base cmd_base;
+   GLenum pname;
+   GLfloat param;
+};
+
+void
+_mesa_unmarshal_PixelStoref(struct gl_context *ctx,
+                            const struct marshal_cmd_PixelStoref *cmd)
+{
+   CALL_PixelStoref(ctx->CurrentServerDispatch, (cmd->pname, cmd->param));
+}
+
+void GLAPIENTRY
+_mesa_marshal_PixelStoref(GLenum pname, GLfloat param)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct marshal_cmd_PixelStoref *cmd;
+   debug_print_marshal("PixelStoref");
+
+   track_pixel_store(ctx, pname, IROUND(param));
+
+   cmd = _mesa_glthread_allocate_command(ctx, DISPATCH_CMD_PixelStoref,
+                                         sizeof(*cmd));
+   cmd->pname = pname;
+   cmd->param = param;
+   _mesa_post_marshal_hook(ctx);
+}
+
+/**
+ * Returns how many bytes of client memory glTexSubImage*D() reads from
+ * pixels, or false if we can't tell without synchronizing.
+ *
+ * Compatibility contexts can change the unpack state behind our back with
+ * glPopClientAttrib(), so we only know it on core and ES contexts.
+ */
+static bool
+get_tex_sub_image_size(struct gl_context *ctx, GLuint dims, GLsizei width,
+                       GLsizei height, GLsizei depth, GLenum format,
+                       GLenum type, size_t *size)
+{
+   struct glthread_state *glthread = ctx->GLThread;
+
+   if (ctx->API == API_OPENGL_COMPAT || type == GL_BITMAP)
+      return false;
+
+   /* We may have tracked a bind that failed; ask the context instead.  This
+    * only happens once after binding a new unpack buffer.
+    */
+   if (!glthread->pixel_unpack_known) {
+      _mesa_glthread_finish_for(ctx, GLTHREAD_SYNC_CALL);
+      glthread->pixel_unpack_buffer = ctx->Unpack.BufferObj->Name;
+      glthread->pixel_unpack_known = true;
+   }
+
+   /* Nothing is read from unpack buffers or for empty and invalid images. */
+   if (glthread->pixel_unpack_buffer || width <= 0 || height <= 0 ||
+       depth <= 0) {
+      *size = 0;
+      return true;
+   }
+
+   const GLint bytes_per_pixel = _mesa_bytes_per_pixel(format, type);
+   if (bytes_per_pixel <= 0)
+      return false;
+
+   /* The end of the last pixel of the last row of the last image. */
+   const GLubyte *last_row =
+      _mesa_image_address(dims, &glthread->unpack, NULL, width, height,
+                          format, type, depth - 1, height - 1, 0);
+   uint64_t end = (uintptr_t)last_row + (uint64_t)width * bytes_per_pixel;
+
+   /* Anything larger than staging memory just has to be synchronous. */
+   *size = MIN2(end, (uint64_t)MARSHAL_MAX_STAGING_SIZE + 1);
+   return true;
+}
+
+/* TexSubImage1D: marshalled asynchronously */
+struct marshal_cmd_TexSubImage1D
+{
+   struct marshal_cmd_base cmd_base;
+   GLenum target;
+   GLint level;
+   GLint xoffset;
+   GLsizei width;
+   GLenum format;
+   GLenum type;
+   /* Copy of the client image, or an offset into the unpack buffer */
+   const GLvoid *pixels;
+};
+
+void
+_mesa_unmarshal_TexSubImage1D(struct gl_context *ctx,
+                              const struct marshal_cmd_TexSubImage1D *cmd)
+{
+   CALL_TexSubImage1D(ctx->CurrentServerDispatch,
+                      (cmd->target, cmd->level, cmd->xoffset, cmd->width,
+                       cmd->format, cmd->type, cmd->pixels));
+}
+
+void GLAPIENTRY
+_mesa_marshal_TexSubImage1D(GLenum target, GLint level, GLint xoffset,
+                            GLsizei width, GLenum format, GLenum type,
+                            const GLvoid *pixels)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct marshal_cmd_TexSubImage1D *cmd = NULL;
+   const void *pixels_copy;
+   size_t size;
+   debug_print_marshal("TexSubImage1D");
+
+   const bool known_size =
+      get_tex_sub_image_size(ctx, 1, width, 1, 1, format, type, &size);
+   if (known_size) {
+      cmd = _mesa_glthread_allocate_command_with_data(ctx,
+                                                      DISPATCH_CMD_TexSubImage1D,
+                                                      sizeof(*cmd), pixels,
+                                                      pixels ? size : 0,
+                                                      &pixels_copy);
+   }
+
+   if (cmd) {
+      cmd->target = target;
+      cmd->level = level;
+      cmd->xoffset = xoffset;
+      cmd->width = width;
+      cmd->format = format;
+      cmd->type = type;
+      cmd->pixels = pixels_copy;
+      _mesa_post_marshal_hook(ctx);
+   } else {
+      _mesa_glthread_finish_for(ctx, known_size ? GLTHREAD_SYNC_LARGE_CMD :
+                                                  GLTHREAD_SYNC_CALL);
+      debug_print_sync_fallback("TexSubImage1D");
+      CALL_TexSubImage1D(ctx->CurrentServerDispatch,
+                         (target, level, xoffset, width, format, type,
+                          pixels));
+   }
+}
+
+/* TexSubImage2D: marshalled asynchronously */
+struct marshal_cmd_TexSubImage2D
+{
+   struct marshal_cmd_base cmd_base;
+   GLenum target;
+   GLint level;
+   GLint xoffset;
+   GLint yoffset;
+   GLsizei width;
+   GLsizei height;
+   GLenum format;
+   GLenum type;
+   /* Copy of the client image, or an offset into the unpack buffer */
+   const GLvoid *pixels;
+};
+
+void
+_mesa_unmarshal_TexSubImage2D(struct gl_context *ctx,
+                              const struct marshal_cmd_TexSubImage2D *cmd)
+{
+   CALL_TexSubImage2D(ctx->CurrentServerDispatch,
+                      (cmd->target, cmd->level, cmd->xoffset, cmd->yoffset,
+                       cmd->width, cmd->height, cmd->format, cmd->type,
+                       cmd->pixels));
+}
+
+void GLAPIENTRY
+_mesa_marshal_TexSubImage2D(GLenum target, GLint level, GLint xoffset,
+                            GLint yoffset, GLsizei width, GLsizei height,
+                            GLenum format, GLenum type, const GLvoid *pixels)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct marshal_cmd_TexSubImage2D *cmd = NULL;
+   const void *pixels_copy;
+   size_t size;
+   debug_print_marshal("TexSubImage2D");
+
+   const bool known_size =
+      get_tex_sub_image_size(ctx, 2, width, height, 1, format, type, &size);
+   if (known_size) {
+      cmd = _mesa_glthread_allocate_command_with_data(ctx,
+                                                      DISPATCH_CMD_TexSubImage2D,
+                                                      sizeof(*cmd), pixels,
+                                                      pixels ? size : 0,
+                                                      &pixels_copy);
+   }
+
+   if (cmd) {
+      cmd->target = target;
+      cmd->level = level;
+      cmd->xoffset = xoffset;
+      cmd->yoffset = yoffset;
+      cmd->width = width;
+      cmd->height = height;
+      cmd->format = format;
+      cmd->type = type;
+      cmd->pixels = pixels_copy;
+      _mesa_post_marshal_hook(ctx);
+   } else {
+      _mesa_glthread_finish_for(ctx, known_size ? GLTHREAD_SYNC_LARGE_CMD :
+                                                  GLTHREAD_SYNC_CALL);
+      debug_print_sync_fallback("TexSubImage2D");
+      CALL_TexSubImage2D(ctx->CurrentServerDispatch,
+                         (target, level, xoffset, yoffset, width, height,
+                          format, type, pixels));
+   }
+}
+
+/* TexSubImage3D: marshalled asynchronously */
+struct marshal_cmd_TexSubImage3D
+{
+   struct marshal_cmd_base cmd_base;
+   GLenum target;
+   GLint level;
+   GLint xoffset;
+   GLint yoffset;
+   GLint zoffset;
+   GLsizei width;
+   GLsizei height;
+   GLsizei depth;
+   GLenum format;
+   GLenum type;
+   /* Copy of the client image, or an offset into the unpack buffer */
+   const GLvoid *pixels;
+};
+
+void
+_mesa_unmarshal_TexSubImage3D(struct gl_context *ctx,
+                              const struct marshal_cmd_TexSubImage3D *cmd)
+{
+   CALL_TexSubImage3D(ctx->CurrentServerDispatch,
+                      (cmd->target, cmd->level, cmd->xoffset, cmd->yoffset,
+                       cmd->zoffset, cmd->width, cmd->height, cmd->depth,
+                       cmd->format, cmd->type, cmd->pixels));
+}
+
+void GLAPIENTRY
+_mesa_marshal_TexSubImage3D(GLenum target, GLint level, GLint xoffset,
+                            GLint yoffset, GLint zoffset, GLsizei width,
+                            GLsizei height, GLsizei depth, GLenum format,
+                            GLenum type, const GLvoid *pixels)
+{
+   GET_CURRENT_CONTEXT(ctx);
+   struct marshal_cmd_TexSubImage3D *cmd = NULL;
+   const void *pixels_copy;
+   size_t size;
+   debug_print_marshal("TexSubImage3D");
+
+   const bool known_size =
+      get_tex_sub_image_size(ctx, 3, width, height, depth, format, type,
+                             &size);
+   if (known_size) {
+      cmd = _mesa_glthread_allocate_command_with_data(ctx,
+                                                      DISPATCH_CMD_TexSubImage3D,
+                                                      sizeof(*cmd), pixels,
+                                                      pixels ? size : 0,
+                                                      &pixels_copy);
+   }
+
+   if (cmd) {
+      cmd->target = target;
+      cmd->level = level;
+      cmd->xoffset = xoffset;
+      cmd->yoffset = yoffset;
+      cmd->zoffset = zoffset;
+      cmd->width = width;
+      cmd->height = height;
+      cmd->depth = depth;
+      cmd->format = format;
+      cmd->type = type;
+      cmd->pixels = pixels_copy;
+      _mesa_post_marshal_hook(ctx);
+   } else {
+      _mesa_glthread_finish_for(ctx, known_size ? GLTHREAD_SYNC_LARGE_CMD :
+                                                  GLTHREAD_SYNC_CALL);
+      debug_print_sync_fallback("TexSubImage3D");
+      CALL_TexSubImage3D(ctx->CurrentServerDispatch,
+                         (target, level, xoffset, yoffset, zoffset, width,
+                          height, depth, format, type, pixels));
+   }
+}
@@ -94,6 +94,36 @@ _mesa_glthread_is_non_vbo_draw_elements(const struct gl_context *ctx)
    return ctx->API != API_OPENGL_CORE && !glthread->element_array_is_vbo;
 }
 
+/**
+ * Returns the size of a user index array for glDrawElements() and friends,
+ * or false if the draw call will just raise an error.
+ */
+static inline bool
+_mesa_glthread_get_index_array_size(GLsizei count, GLenum type, size_t *size)
+{
+   unsigned index_size;
+
+   switch (type) {
+   case GL_UNSIGNED_BYTE:
+      index_size = 1;
+      break;
+   case GL_UNSIGNED_SHORT:
+      index_size = 2;
+      break;
+   case GL_UNSIGNED_INT:
+      index_size = 4;
+      break;
+   default:
+      return false;
+   }
+
+   if (count < 0)
+      return false;
+
+   *size = (size_t)count * index_size;
+   return true;
+}
+
 #define DEBUG_MARSHAL_PRINT_CALLS 0
 
 /**
@@ -178,11 +208,17 @@ struct marshal_cmd_Enable;
 struct marshal_cmd_ShaderSource;
 struct marshal_cmd_Flush;
 struct marshal_cmd_BindBuffer;
+struct marshal_cmd_DeleteBuffers;
 struct marshal_cmd_BufferData;
 struct marshal_cmd_BufferSubData;
 struct marshal_cmd_NamedBufferData;
 struct marshal_cmd_NamedBufferSubData;
 struct marshal_cmd_ClearBuffer;
+struct marshal_cmd_PixelStorei;
+struct marshal_cmd_PixelStoref;
+struct marshal_cmd_TexSubImage1D;
+struct marshal_cmd_TexSubImage2D;
+struct marshal_cmd_TexSubImage3D;
 #define marshal_cmd_ClearBufferfv   marshal_cmd_ClearBuffer
 #define marshal_cmd_ClearBufferiv   marshal_cmd_ClearBuffer
 #define marshal_cmd_ClearBufferuiv  marshal_cmd_ClearBuffer
@@ -217,6 +253,13 @@ void
 _mesa_unmarshal_BindBuffer(struct gl_context *ctx,
                            const struct marshal_cmd_BindBuffer *cmd);
 
+void GLAPIENTRY
+_mesa_marshal_DeleteBuffers(GLsizei n, const GLuint *buffer);
+
+void
+_mesa_unmarshal_DeleteBuffers(struct gl_context *ctx,
+                              const struct marshal_cmd_DeleteBuffers *cmd);
+
 void
 _mesa_unmarshal_BufferData(struct gl_context *ctx,
                            const struct marshal_cmd_BufferData *cmd);
@@ -281,4 +324,46 @@ void GLAPIENTRY
 _mesa_marshal_ClearBufferfi(GLenum buffer, GLint drawbuffer,
                             const GLfloat depth, const GLint stencil);
 
+void
+_mesa_unmarshal_PixelStorei(struct gl_context *ctx,
+                            const struct marshal_cmd_PixelStorei *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_PixelStorei(GLenum pname, GLint param);
+
+void
+_mesa_unmarshal_PixelStoref(struct gl_context *ctx,
+                            const struct marshal_cmd_PixelStoref *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_PixelStoref(GLenum pname, GLfloat param);
+
+void
+_mesa_unmarshal_TexSubImage1D(struct gl_context *ctx,
+                              const struct marshal_cmd_TexSubImage1D *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_TexSubImage1D(GLenum target, GLint level, GLint xoffset,
+                            GLsizei width, GLenum format, GLenum type,
+                            const GLvoid *pixels);
+
+void
+_mesa_unmarshal_TexSubImage2D(struct gl_context *ctx,
+                              const struct marshal_cmd_TexSubImage2D *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_TexSubImage2D(GLenum target, GLint level, GLint xoffset,
+                            GLint yoffset, GLsizei width, GLsizei height,
+                            GLenum format, GLenum type, const GLvoid *pixels);
+
+void
+_mesa_unmarshal_TexSubImage3D(struct gl_context *ctx,
+                              const struct marshal_cmd_TexSubImage3D *cmd);
+
+void GLAPIENTRY
+_mesa_marshal_TexSubImage3D(GLenum target, GLint level, GLint xoffset,
+                            GLint yoffset, GLint zoffset, GLsizei width,
+                            GLsizei height, GLsizei depth, GLenum format,
+                            GLenum type, const GLvoid *pixels);
+
 #endif /* MARSHAL_H */
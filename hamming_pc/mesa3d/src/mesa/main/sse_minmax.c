@@ -92,3 +92,172 @@ _mesa_uint_array_min_max(const unsigned *ui_indices, unsigned *min_index,
    *min_index = min_ui;
    *max_index = max_ui;
 }
+
+
+/* Lanes holding the restart index are replaced by the neutral element of
+ * each reduction, i.e. 0 for max and all ones for min.
+ */
+#define MASK_RESTART(v, eq, max_v, min_v) \
+   do {                                    \
+      max_v = _mm_andnot_si128(eq, v);     \
+      min_v = _mm_or_si128(v, eq);         \
+   } while (0)
+
+void
+_mesa_uint_array_min_max_restart(const unsigned *ui_indices,
+                                 unsigned restart_index, unsigned *min_index,
+                                 unsigned *max_index, const unsigned count)
+{
+   unsigned max_ui = 0;
+   unsigned min_ui = ~0U;
+   unsigned i = 0;
+
+   if (count >= 8) {
+      const __m128i restart4 = _mm_set1_epi32(restart_index);
+      __m128i max_ui4 = _mm_setzero_si128();
+      __m128i min_ui4 = _mm_set1_epi32(~0U);
+
+      for (; i + 4 <= count; i += 4) {
+         __m128i v = _mm_loadu_si128((const __m128i *)&ui_indices[i]);
+         __m128i eq = _mm_cmpeq_epi32(v, restart4);
+         __m128i max_v, min_v;
+
+         MASK_RESTART(v, eq, max_v, min_v);
+         max_ui4 = _mm_max_epu32(max_v, max_ui4);
+         min_ui4 = _mm_min_epu32(min_v, min_ui4);
+      }
+
+      /* Reduce the four lanes. */
+      max_ui4 = _mm_max_epu32(max_ui4, _mm_srli_si128(max_ui4, 8));
+      max_ui4 = _mm_max_epu32(max_ui4, _mm_srli_si128(max_ui4, 4));
+      min_ui4 = _mm_min_epu32(min_ui4, _mm_srli_si128(min_ui4, 8));
+      min_ui4 = _mm_min_epu32(min_ui4, _mm_srli_si128(min_ui4, 4));
+      max_ui = _mm_cvtsi128_si32(max_ui4);
+      min_ui = _mm_cvtsi128_si32(min_ui4);
+   }
+
+   for (; i < count; i++) {
+      if (ui_indices[i] == restart_index)
+         continue;
+      if (ui_indices[i] > max_ui)
+         max_ui = ui_indices[i];
+      if (ui_indices[i] < min_ui)
+         min_ui = ui_indices[i];
+   }
+
+   *min_index = min_ui;
+   *max_index = max_ui;
+}
+
+void
+_mesa_ushort_array_min_max(const uint16_t *us_indices, bool restart,
+                           unsigned restart_index, unsigned *min_index,
+                           unsigned *max_index, const unsigned count)
+{
+   unsigned max_us = 0;
+   unsigned min_us = ~0U;
+   unsigned i = 0;
+
+   /* A restart index that doesn't fit can't match anything. */
+   if (restart_index > UINT16_MAX)
+      restart = false;
+
+   if (count >= 16) {
+      const __m128i restart8 = _mm_set1_epi16(restart_index);
+      __m128i max_us8 = _mm_setzero_si128();
+      __m128i min_us8 = _mm_set1_epi16(-1);
+
+      for (; i + 8 <= count; i += 8) {
+         __m128i v = _mm_loadu_si128((const __m128i *)&us_indices[i]);
+         __m128i max_v = v, min_v = v;
+
+         if (restart) {
+            __m128i eq = _mm_cmpeq_epi16(v, restart8);
+            MASK_RESTART(v, eq, max_v, min_v);
+         }
+         max_us8 = _mm_max_epu16(max_v, max_us8);
+         min_us8 = _mm_min_epu16(min_v, min_us8);
+      }
+
+      /* _mm_minpos_epu16 finds the minimum of eight 16-bit lanes, and the
+       * maximum is the complement of the minimum of the complements.
+       */
+      min_us = _mm_cvtsi128_si32(_mm_minpos_epu16(min_us8)) & 0xffff;
+      max_us = ~_mm_cvtsi128_si32(_mm_minpos_epu16(
+                  _mm_xor_si128(max_us8, _mm_set1_epi16(-1)))) & 0xffff;
+   }
+
+   for (; i < count; i++) {
+      if (restart && us_indices[i] == restart_index)
+         continue;
+      if (us_indices[i] > max_us)
+         max_us = us_indices[i];
+      if (us_indices[i] < min_us)
+         min_us = us_indices[i];
+   }
+
+   /* Only restart indices were found, or none at all. */
+   if (min_us > max_us) {
+      min_us = ~0U;
+      max_us = 0;
+   }
+
+   *min_index = min_us;
+   *max_index = max_us;
+}
+
+void
+_mesa_ubyte_array_min_max(const uint8_t *ub_indices, bool restart,
+                          unsigned restart_index, unsigned *min_index,
+                          unsigned *max_index, const unsigned count)
+{
+   unsigned max_ub = 0;
+   unsigned min_ub = ~0U;
+   unsigned i = 0;
+
+   if (restart_index > UINT8_MAX)
+      restart = false;
+
+   if (count >= 32) {
+      const __m128i restart16 = _mm_set1_epi8(restart_index);
+      __m128i max_ub16 = _mm_setzero_si128();
+      __m128i min_ub16 = _mm_set1_epi8(-1);
+
+      for (; i + 16 <= count; i += 16) {
+         __m128i v = _mm_loadu_si128((const __m128i *)&ub_indices[i]);
+         __m128i max_v = v, min_v = v;
+
+         if (restart) {
+            __m128i eq = _mm_cmpeq_epi8(v, restart16);
+            MASK_RESTART(v, eq, max_v, min_v);
+         }
+         max_ub16 = _mm_max_epu8(max_v, max_ub16);
+         min_ub16 = _mm_min_epu8(min_v, min_ub16);
+      }
+
+      /* Widen to 16 bits and let _mm_minpos_epu16 do the rest. */
+      __m128i min_lo = _mm_min_epu8(min_ub16, _mm_srli_si128(min_ub16, 8));
+      __m128i max_lo = _mm_max_epu8(max_ub16, _mm_srli_si128(max_ub16, 8));
+      min_ub = _mm_cvtsi128_si32(_mm_minpos_epu16(_mm_cvtepu8_epi16(min_lo)))
+               & 0xff;
+      max_ub = ~_mm_cvtsi128_si32(_mm_minpos_epu16(_mm_cvtepu8_epi16(
+                  _mm_xor_si128(max_lo, _mm_set1_epi8(-1))))) & 0xff;
+   }
+
+   for (; i < count; i++) {
+      if (restart && ub_indices[i] == restart_index)
+         continue;
+      if (ub_indices[i] > max_ub)
+         max_ub = ub_indices[i];
+      if (ub_indices[i] < min_ub)
+         min_ub = ub_indices[i];
+   }
+
+   if (min_ub > max_ub) {
+      min_ub = ~0U;
+      max_ub = 0;
+   }
+
+   *min_index = min_ub;
+   *max_index = max_ub;
+}
@@ -28,8 +28,30 @@
 #ifndef SSE_MINMAX_H
 #define SSE_MINMAX_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+/* If restart is set, indices equal to restart_index are skipped.  If no
+ * index is left, min_index is ~0 and max_index is 0.
+ */
+
 void
 _mesa_uint_array_min_max(const unsigned *ui_indices, unsigned *min_index,
                          unsigned *max_index, const unsigned count);
 
+void
+_mesa_uint_array_min_max_restart(const unsigned *ui_indices,
+                                 unsigned restart_index, unsigned *min_index,
+                                 unsigned *max_index, const unsigned count);
+
+void
+_mesa_ushort_array_min_max(const uint16_t *us_indices, bool restart,
+                           unsigned restart_index, unsigned *min_index,
+                           unsigned *max_index, const unsigned count);
+
+void
+_mesa_ubyte_array_min_max(const uint8_t *ub_indices, bool restart,
+                          unsigned restart_index, unsigned *min_index,
+                          unsigned *max_index, const unsigned count);
+
 #endif /* SSE_MINMAX_H */
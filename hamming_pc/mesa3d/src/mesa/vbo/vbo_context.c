@@ -246,6 +246,8 @@ void _vbo_DestroyContext( struct gl_context *ctx )
       vbo_exec_destroy(ctx);
       if (ctx->API == API_OPENGL_COMPAT)
          vbo_save_destroy(ctx);
+      if (util_queue_is_initialized(&vbo->minmax_queue))
+         util_queue_destroy(&vbo->minmax_queue);
       free(vbo);
       ctx->vbo_context = NULL;
    }
@@ -58,6 +58,7 @@
 
 #include "main/api_arrayelt.h"
 #include "main/macros.h"
+#include "util/u_queue.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -83,9 +84,22 @@ struct vbo_context {
     * indirect parameter.
     */
    vbo_indirect_draw_func draw_indirect_prims;
+
+   /* Helper threads for scanning huge index arrays for their min/max index,
+    * created on first use.
+    */
+   struct util_queue minmax_queue;
 };
 
 
+/* Index arrays with at least this many indices are scanned for their
+ * min/max index by VBO_MINMAX_THREADS helper threads and the calling
+ * thread, each taking an equal part.
+ */
+#define VBO_MINMAX_THREADED_COUNT (4 * 1024 * 1024)
+#define VBO_MINMAX_THREADS 3
+
+
 static inline struct vbo_context *vbo_context(struct gl_context *ctx) 
 {
    return ctx->vbo_context;
@@ -33,6 +33,8 @@
 #include "main/sse_minmax.h"
 #include "x86/common_x86_asm.h"
 #include "util/hash_table.h"
+#include "util/u_queue.h"
+#include "vbo_context.h"
 
 
 struct minmax_cache_key {
@@ -227,64 +229,56 @@ out:
 }
 
 
-/**
- * Compute min and max elements by scanning the index buffer for
- * glDraw[Range]Elements() calls.
- * If primitive restart is enabled, we need to ignore restart
- * indexes when computing min/max.
- */
 static void
-vbo_get_minmax_index(struct gl_context *ctx,
-                     const struct _mesa_prim *prim,
-                     const struct _mesa_index_buffer *ib,
-                     GLuint *min_index, GLuint *max_index,
-                     const GLuint count)
+vbo_scan_minmax(const void *indices, unsigned index_size, bool restart,
+                unsigned restart_index, unsigned count,
+                unsigned *min_index, unsigned *max_index)
 {
-   const GLboolean restart = ctx->Array._PrimitiveRestart;
-   const GLuint restartIndex =
-      _mesa_primitive_restart_index(ctx, ib->index_size);
-   const char *indices;
-   GLuint i;
-   GLintptr offset = 0;
-
-   indices = (char *) ib->ptr + prim->start * ib->index_size;
-   if (_mesa_is_bufferobj(ib->obj)) {
-      GLsizeiptr size = MIN2(count * ib->index_size, ib->obj->Size);
+   unsigned i;
 
-      if (vbo_get_minmax_cached(ib->obj, ib->index_size, (GLintptr) indices,
-                                count, min_index, max_index))
+#if defined(USE_SSE41)
+   if (cpu_has_sse4_1) {
+      switch (index_size) {
+      case 4:
+         if (restart) {
+            _mesa_uint_array_min_max_restart(indices, restart_index,
+                                             min_index, max_index, count);
+         } else {
+            _mesa_uint_array_min_max(indices, min_index, max_index, count);
+         }
          return;
-
-      offset = (GLintptr) indices;
-      indices = ctx->Driver.MapBufferRange(ctx, offset, size,
-                                           GL_MAP_READ_BIT, ib->obj,
-                                           MAP_INTERNAL);
+      case 2:
+         _mesa_ushort_array_min_max(indices, restart, restart_index,
+                                    min_index, max_index, count);
+         return;
+      case 1:
+         _mesa_ubyte_array_min_max(indices, restart, restart_index,
+                                   min_index, max_index, count);
+         return;
+      default:
+         unreachable("not reached");
+      }
    }
+#endif
 
-   switch (ib->index_size) {
+   switch (index_size) {
    case 4: {
       const GLuint *ui_indices = (const GLuint *)indices;
       GLuint max_ui = 0;
       GLuint min_ui = ~0U;
       if (restart) {
          for (i = 0; i < count; i++) {
-            if (ui_indices[i] != restartIndex) {
+            if (ui_indices[i] != restart_index) {
                if (ui_indices[i] > max_ui) max_ui = ui_indices[i];
                if (ui_indices[i] < min_ui) min_ui = ui_indices[i];
             }
          }
       }
       else {
-#if defined(USE_SSE41)
-         if (cpu_has_sse4_1) {
-            _mesa_uint_array_min_max(ui_indices, &min_ui, &max_ui, count);
+         for (i = 0; i < count; i++) {
+            if (ui_indices[i] > max_ui) max_ui = ui_indices[i];
+            if (ui_indices[i] < min_ui) min_ui = ui_indices[i];
          }
-         else
-#endif
-            for (i = 0; i < count; i++) {
-               if (ui_indices[i] > max_ui) max_ui = ui_indices[i];
-               if (ui_indices[i] < min_ui) min_ui = ui_indices[i];
-            }
       }
       *min_index = min_ui;
       *max_index = max_ui;
@@ -296,7 +290,7 @@ vbo_get_minmax_index(struct gl_context *ctx,
       GLuint min_us = ~0U;
       if (restart) {
          for (i = 0; i < count; i++) {
-            if (us_indices[i] != restartIndex) {
+            if (us_indices[i] != restart_index) {
                if (us_indices[i] > max_us) max_us = us_indices[i];
                if (us_indices[i] < min_us) min_us = us_indices[i];
             }
@@ -318,7 +312,7 @@ vbo_get_minmax_index(struct gl_context *ctx,
       GLuint min_ub = ~0U;
       if (restart) {
          for (i = 0; i < count; i++) {
-            if (ub_indices[i] != restartIndex) {
+            if (ub_indices[i] != restart_index) {
                if (ub_indices[i] > max_ub) max_ub = ub_indices[i];
                if (ub_indices[i] < min_ub) min_ub = ub_indices[i];
             }
@@ -337,6 +331,123 @@ vbo_get_minmax_index(struct gl_context *ctx,
    default:
       unreachable("not reached");
    }
+}
+
+
+/** One part of a minmax scan that is split between threads. */
+struct minmax_job {
+   struct util_queue_fence fence;
+   const char *indices;
+   unsigned index_size;
+   bool restart;
+   unsigned restart_index;
+   unsigned count;
+   unsigned min_index;
+   unsigned max_index;
+};
+
+static void
+vbo_minmax_job_execute(void *data, int thread_index)
+{
+   struct minmax_job *job = data;
+
+   vbo_scan_minmax(job->indices, job->index_size, job->restart,
+                   job->restart_index, job->count,
+                   &job->min_index, &job->max_index);
+}
+
+/**
+ * Scan huge index arrays with the helper threads in addition to this one.
+ * Returns false if the threads aren't available.
+ */
+static bool
+vbo_scan_minmax_threaded(struct gl_context *ctx, const char *indices,
+                         unsigned index_size, bool restart,
+                         unsigned restart_index, unsigned count,
+                         unsigned *min_index, unsigned *max_index)
+{
+   struct vbo_context *vbo = vbo_context(ctx);
+   struct minmax_job jobs[VBO_MINMAX_THREADS + 1];
+   const unsigned num_jobs = ARRAY_SIZE(jobs);
+   /* Keep the chunks aligned for the SIMD loops. */
+   const unsigned chunk = ALIGN(DIV_ROUND_UP(count, num_jobs), 64);
+   unsigned i;
+
+   if (!util_queue_is_initialized(&vbo->minmax_queue) &&
+       !util_queue_init(&vbo->minmax_queue, "minmax", VBO_MINMAX_THREADS,
+                        VBO_MINMAX_THREADS, 0))
+      return false;
+
+   for (i = 0; i < num_jobs; i++) {
+      unsigned start = MIN2(i * chunk, count);
+
+      jobs[i].indices = indices + (size_t)start * index_size;
+      jobs[i].index_size = index_size;
+      jobs[i].restart = restart;
+      jobs[i].restart_index = restart_index;
+      jobs[i].count = MIN2(chunk, count - start);
+      util_queue_fence_init(&jobs[i].fence);
+
+      /* The last part is done by this thread while the others run. */
+      if (i < num_jobs - 1) {
+         util_queue_add_job(&vbo->minmax_queue, &jobs[i], &jobs[i].fence,
+                            vbo_minmax_job_execute, NULL);
+      }
+   }
+
+   vbo_minmax_job_execute(&jobs[num_jobs - 1], 0);
+
+   *min_index = ~0U;
+   *max_index = 0;
+   for (i = 0; i < num_jobs; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+      *min_index = MIN2(*min_index, jobs[i].min_index);
+      *max_index = MAX2(*max_index, jobs[i].max_index);
+   }
+   return true;
+}
+
+
+/**
+ * Compute min and max elements by scanning the index buffer for
+ * glDraw[Range]Elements() calls.
+ * If primitive restart is enabled, we need to ignore restart
+ * indexes when computing min/max.
+ */
+static void
+vbo_get_minmax_index(struct gl_context *ctx,
+                     const struct _mesa_prim *prim,
+                     const struct _mesa_index_buffer *ib,
+                     GLuint *min_index, GLuint *max_index,
+                     const GLuint count)
+{
+   const GLboolean restart = ctx->Array._PrimitiveRestart;
+   const GLuint restartIndex =
+      _mesa_primitive_restart_index(ctx, ib->index_size);
+   const char *indices;
+   GLintptr offset = 0;
+
+   indices = (char *) ib->ptr + prim->start * ib->index_size;
+   if (_mesa_is_bufferobj(ib->obj)) {
+      GLsizeiptr size = MIN2(count * ib->index_size, ib->obj->Size);
+
+      if (vbo_get_minmax_cached(ib->obj, ib->index_size, (GLintptr) indices,
+                                count, min_index, max_index))
+         return;
+
+      offset = (GLintptr) indices;
+      indices = ctx->Driver.MapBufferRange(ctx, offset, size,
+                                           GL_MAP_READ_BIT, ib->obj,
+                                           MAP_INTERNAL);
+   }
+
+   if (count < VBO_MINMAX_THREADED_COUNT ||
+       !vbo_scan_minmax_threaded(ctx, indices, ib->index_size, restart,
+                                 restartIndex, count, min_index, max_index)) {
+      vbo_scan_minmax(indices, ib->index_size, restart, restartIndex, count,
+                      min_index, max_index);
+   }
 
    if (_mesa_is_bufferobj(ib->obj)) {
       vbo_minmax_cache_store(ctx, ib->obj, ib->index_size, offset,
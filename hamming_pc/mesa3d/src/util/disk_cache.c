@@ -39,8 +39,11 @@
 #include <dirent.h>
 #include "zlib.h"
 
+#include "c11/threads.h"
 #include "util/crc32.h"
 #include "util/debug.h"
+#include "util/hash_table.h"
+#include "util/lz4_block.h"
 #include "util/rand_xor.h"
 #include "util/u_atomic.h"
 #include "util/u_queue.h"
@@ -71,7 +74,70 @@
  * - There is no strict requirement that cache versions be backwards
  *   compatible but effort should be taken to limit disruption where possible.
  */
-#define CACHE_VERSION 1
+#define CACHE_VERSION 2
+
+/* Compression codecs, the codec of an entry is recorded in its header. */
+enum cache_codec {
+   CACHE_CODEC_ZLIB = 0,
+   CACHE_CODEC_LZ4 = 1,
+};
+
+/* Upper bound for the memory held by entries loaded by disk_cache_prefetch()
+ * that haven't been fetched with disk_cache_get() yet.
+ */
+#define PREFETCH_MAX_SIZE (64 * 1024 * 1024)
+
+/* Packed cache database (MESA_GLSL_CACHE_PACKED).
+ *
+ * Instead of one file per entry, entries are appended to a single data file,
+ * packed.db. Each entry there is the cache key followed by the same bytes a
+ * per-entry file would contain. The data file is indexed by packed.idx, a
+ * fixed-size hash table that is mmapped shared just like the key index, so
+ * looking an entry up doesn't need any syscalls besides the read of the
+ * entry itself.
+ *
+ * Writers (puts, removes, evictions and compaction) hold an flock on the
+ * index file. Readers don't lock at all: a reader racing with a writer may
+ * read an entry that was just evicted or moved, but the key stored in front
+ * of every entry and the CRC of the data catch that, and the read is simply
+ * a cache miss.
+ */
+#define PACKED_INDEX_MAGIC 0x6b63706d /* "mpck" */
+#define PACKED_INDEX_VERSION 1
+
+/* Number of slots in the index hash table. Like CACHE_INDEX_KEY_BITS, the
+ * slot is picked with the low bits of the key.
+ */
+#define PACKED_INDEX_SLOTS (1 << 16)
+
+/* Number of consecutive slots an entry may live in. If all of them are
+ * taken, the least recently used one is replaced.
+ */
+#define PACKED_INDEX_PROBES 8
+
+struct packed_index_header {
+   uint32_t magic;
+   uint32_t version;
+
+   /* End of the data written to packed.db, new entries are appended here. */
+   uint64_t data_end;
+
+   /* Total size of the entries the index still refers to. */
+   uint64_t live_size;
+
+   /* Incremented on every access, used as the LRU timestamp of entries. */
+   uint64_t lru_clock;
+};
+
+struct packed_index_slot {
+   cache_key key;
+
+   /* Size of the entry in packed.db, 0 for a free slot. */
+   uint32_t size;
+
+   uint64_t offset;
+   uint64_t last_access;
+};
 
 struct disk_cache {
    /* The path to the cache directory. */
@@ -99,6 +165,54 @@ struct disk_cache {
    /* Driver cache keys. */
    uint8_t *driver_keys_blob;
    size_t driver_keys_blob_size;
+
+   /* Packed cache database, only used if packed is true. */
+   bool packed;
+   int packed_data_fd;
+   int packed_index_fd;
+   struct packed_index_header *packed_header;
+   struct packed_index_slot *packed_slots;
+   size_t packed_index_size;
+
+   /* The flock on packed_index_fd only excludes other processes, this
+    * serializes the writers within this one.
+    */
+   mtx_t packed_mutex;
+
+   /* Codec used to compress new entries. */
+   enum cache_codec codec;
+
+   /* Entries loaded by disk_cache_prefetch() and not fetched yet, keyed by
+    * cache key, and their total uncompressed size.
+    */
+   mtx_t prefetch_mutex;
+   struct hash_table *prefetched;
+   size_t prefetched_size;
+
+   /* Bumped by every get or remove of a key, in the slot picked by the
+    * key's first byte.  A prefetch only keeps what it loaded if its slot
+    * didn't change in the meantime, so it can't bring back an entry that
+    * was fetched or removed while it was reading it.
+    */
+   unsigned prefetch_generation[256];
+};
+
+/* An entry loaded by disk_cache_prefetch(). */
+struct prefetched_entry {
+   cache_key key;
+
+   /* Uncompressed data and its size. */
+   void *data;
+   size_t size;
+};
+
+struct disk_cache_prefetch_job {
+   struct util_queue_fence fence;
+
+   struct disk_cache *cache;
+
+   unsigned num_keys;
+   cache_key keys[];
 };
 
 struct disk_cache_put_job {
@@ -177,6 +291,100 @@ concatenate_and_mkdir(void *ctx, const char *path, const char *name)
       return NULL;
 }
 
+/* Open (creating them as needed) the packed cache database files.
+ *
+ * Returns: true if the packed cache can be used.
+ */
+static bool
+packed_open(struct disk_cache *cache, void *mem_ctx)
+{
+   char *path;
+   struct stat sb;
+   size_t size;
+
+   cache->packed_data_fd = -1;
+   cache->packed_index_fd = -1;
+
+   path = ralloc_asprintf(mem_ctx, "%s/packed.db", cache->path);
+   if (path == NULL)
+      return false;
+
+   cache->packed_data_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (cache->packed_data_fd == -1)
+      goto fail;
+
+   path = ralloc_asprintf(mem_ctx, "%s/packed.idx", cache->path);
+   if (path == NULL)
+      goto fail;
+
+   cache->packed_index_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (cache->packed_index_fd == -1)
+      goto fail;
+
+   if (flock(cache->packed_index_fd, LOCK_EX) == -1)
+      goto fail;
+
+   if (fstat(cache->packed_index_fd, &sb) == -1)
+      goto fail_unlock;
+
+   size = sizeof(struct packed_index_header) +
+          PACKED_INDEX_SLOTS * sizeof(struct packed_index_slot);
+   if (sb.st_size != size) {
+      if (ftruncate(cache->packed_index_fd, size) == -1)
+         goto fail_unlock;
+   }
+
+   cache->packed_header = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                               MAP_SHARED, cache->packed_index_fd, 0);
+   if (cache->packed_header == MAP_FAILED)
+      goto fail_unlock;
+   cache->packed_index_size = size;
+   cache->packed_slots = (struct packed_index_slot *)
+      (cache->packed_header + 1);
+
+   /* A new index (or one written by an incompatible version) doesn't
+    * describe anything in the data file, so start both from scratch.
+    */
+   if (cache->packed_header->magic != PACKED_INDEX_MAGIC ||
+       cache->packed_header->version != PACKED_INDEX_VERSION) {
+      if (ftruncate(cache->packed_data_fd, 0) == -1) {
+         munmap(cache->packed_header, size);
+         goto fail_unlock;
+      }
+      memset(cache->packed_header, 0, size);
+      cache->packed_header->magic = PACKED_INDEX_MAGIC;
+      cache->packed_header->version = PACKED_INDEX_VERSION;
+   }
+
+   flock(cache->packed_index_fd, LOCK_UN);
+
+   mtx_init(&cache->packed_mutex, mtx_plain);
+
+   return true;
+
+ fail_unlock:
+   flock(cache->packed_index_fd, LOCK_UN);
+ fail:
+   if (cache->packed_index_fd != -1)
+      close(cache->packed_index_fd);
+   if (cache->packed_data_fd != -1)
+      close(cache->packed_data_fd);
+
+   return false;
+}
+
+static uint32_t
+prefetched_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, CACHE_KEY_SIZE);
+}
+
+static bool
+prefetched_key_equals(const void *a, const void *b)
+{
+   return memcmp(a, b, CACHE_KEY_SIZE) == 0;
+}
+
 #define DRV_KEY_CPY(_dst, _src, _src_size) \
 do {                                       \
    memcpy(_dst, _src, _src_size);          \
@@ -401,6 +609,32 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
    DRV_KEY_CPY(drv_key_blob, &ptr_size, ptr_size_size)
    DRV_KEY_CPY(drv_key_blob, &driver_flags, driver_flags_size)
 
+   /* zlib compresses better, LZ4 compresses and in particular decompresses
+    * a lot faster. Entries record their codec, so this only affects new
+    * entries.
+    */
+   const char *codec = getenv("MESA_GLSL_CACHE_CODEC");
+   if (codec && strcmp(codec, "lz4") == 0)
+      cache->codec = CACHE_CODEC_LZ4;
+   else
+      cache->codec = CACHE_CODEC_ZLIB;
+
+   cache->prefetched = _mesa_hash_table_create(cache, prefetched_key_hash,
+                                               prefetched_key_equals);
+   if (!cache->prefetched)
+      goto fail;
+   cache->prefetched_size = 0;
+   memset(cache->prefetch_generation, 0, sizeof(cache->prefetch_generation));
+   mtx_init(&cache->prefetch_mutex, mtx_plain);
+
+   /* Fall back to one file per entry if the packed database can't be
+    * opened.
+    */
+   if (env_var_as_boolean("MESA_GLSL_CACHE_PACKED", false))
+      cache->packed = packed_open(cache, local);
+   else
+      cache->packed = false;
+
    /* Seed our rand function */
    s_rand_xorshift128plus(cache->seed_xorshift128plus, true);
 
@@ -418,12 +652,31 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
    return NULL;
 }
 
+static void
+free_prefetched_entry(struct hash_entry *entry)
+{
+   struct prefetched_entry *prefetched = entry->data;
+
+   free(prefetched->data);
+   free(prefetched);
+}
+
 void
 disk_cache_destroy(struct disk_cache *cache)
 {
    if (cache) {
       util_queue_destroy(&cache->cache_queue);
       munmap(cache->index_mmap, cache->index_mmap_size);
+
+      if (cache->packed) {
+         munmap(cache->packed_header, cache->packed_index_size);
+         close(cache->packed_index_fd);
+         close(cache->packed_data_fd);
+         mtx_destroy(&cache->packed_mutex);
+      }
+
+      _mesa_hash_table_destroy(cache->prefetched, free_prefetched_entry);
+      mtx_destroy(&cache->prefetch_mutex);
    }
 
    ralloc_free(cache);
@@ -650,11 +903,159 @@ evict_lru_item(struct disk_cache *cache)
       p_atomic_add(cache->size, - (uint64_t)size);
 }
 
+/* Removes the entry for key from the prefetched entries and returns its
+ * data, or NULL if it wasn't prefetched.
+ */
+static void *
+take_prefetched_entry(struct disk_cache *cache, const cache_key key,
+                      size_t *size)
+{
+   struct hash_entry *entry;
+   void *data = NULL;
+
+   mtx_lock(&cache->prefetch_mutex);
+
+   cache->prefetch_generation[key[0]]++;
+
+   entry = _mesa_hash_table_search(cache->prefetched, key);
+   if (entry) {
+      struct prefetched_entry *prefetched = entry->data;
+
+      _mesa_hash_table_remove(cache->prefetched, entry);
+      cache->prefetched_size -= prefetched->size;
+
+      data = prefetched->data;
+      if (size)
+         *size = prefetched->size;
+      free(prefetched);
+   }
+
+   mtx_unlock(&cache->prefetch_mutex);
+
+   return data;
+}
+
+/* Takes the lock protecting the packed index against other writers, in this
+ * process and others.
+ */
+static bool
+packed_lock(struct disk_cache *cache)
+{
+   mtx_lock(&cache->packed_mutex);
+   if (flock(cache->packed_index_fd, LOCK_EX) == -1) {
+      mtx_unlock(&cache->packed_mutex);
+      return false;
+   }
+   return true;
+}
+
+static void
+packed_unlock(struct disk_cache *cache)
+{
+   flock(cache->packed_index_fd, LOCK_UN);
+   mtx_unlock(&cache->packed_mutex);
+}
+
+/* Returns the index slot holding 'key', or NULL if the key isn't in the
+ * packed cache. Can be called without holding the lock, in which case the
+ * slot may change at any time.
+ */
+static struct packed_index_slot *
+packed_find_slot(struct disk_cache *cache, const cache_key key)
+{
+   const uint32_t *key_chunk = (const uint32_t *) key;
+   uint32_t start = CPU_TO_LE32(*key_chunk);
+
+   for (unsigned i = 0; i < PACKED_INDEX_PROBES; i++) {
+      struct packed_index_slot *slot =
+         &cache->packed_slots[(start + i) & (PACKED_INDEX_SLOTS - 1)];
+
+      if (slot->size && memcmp(slot->key, key, CACHE_KEY_SIZE) == 0)
+         return slot;
+   }
+
+   return NULL;
+}
+
+/* Drops an entry from the packed index. Its space in the data file is
+ * reclaimed the next time the file is compacted.
+ */
+static void
+packed_free_slot(struct disk_cache *cache, struct packed_index_slot *slot)
+{
+   cache->packed_header->live_size -= slot->size;
+   slot->size = 0;
+}
+
+/* Returns a free slot for 'key', replacing the least recently used entry
+ * that 'key' can go to if there is none.
+ */
+static struct packed_index_slot *
+packed_claim_slot(struct disk_cache *cache, const cache_key key)
+{
+   const uint32_t *key_chunk = (const uint32_t *) key;
+   uint32_t start = CPU_TO_LE32(*key_chunk);
+   struct packed_index_slot *lru = NULL;
+
+   for (unsigned i = 0; i < PACKED_INDEX_PROBES; i++) {
+      struct packed_index_slot *slot =
+         &cache->packed_slots[(start + i) & (PACKED_INDEX_SLOTS - 1)];
+
+      if (slot->size == 0)
+         return slot;
+
+      if (lru == NULL || slot->last_access < lru->last_access)
+         lru = slot;
+   }
+
+   packed_free_slot(cache, lru);
+   return lru;
+}
+
+/* Evicts the least recently used entry of the packed cache. Returns false
+ * if the cache is empty.
+ */
+static bool
+packed_evict_lru(struct disk_cache *cache)
+{
+   struct packed_index_slot *lru = NULL;
+
+   for (unsigned i = 0; i < PACKED_INDEX_SLOTS; i++) {
+      struct packed_index_slot *slot = &cache->packed_slots[i];
+
+      if (slot->size &&
+          (lru == NULL || slot->last_access < lru->last_access))
+         lru = slot;
+   }
+
+   if (lru == NULL)
+      return false;
+
+   packed_free_slot(cache, lru);
+   return true;
+}
+
 void
 disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
    struct stat sb;
 
+   free(take_prefetched_entry(cache, key, NULL));
+
+   if (cache->packed) {
+      struct packed_index_slot *slot;
+
+      if (!packed_lock(cache))
+         return;
+
+      slot = packed_find_slot(cache, key);
+      if (slot)
+         packed_free_slot(cache, slot);
+
+      packed_unlock(cache);
+      return;
+   }
+
    char *filename = get_cache_file(cache, key);
    if (filename == NULL) {
       return;
@@ -702,6 +1103,36 @@ write_all(int fd, const void *buf, size_t count)
    return done;
 }
 
+static ssize_t
+pread_all(int fd, void *buf, size_t count, off_t offset)
+{
+   char *in = buf;
+   ssize_t read_ret;
+   size_t done;
+
+   for (done = 0; done < count; done += read_ret) {
+      read_ret = pread(fd, in + done, count - done, offset + done);
+      if (read_ret == -1 || read_ret == 0)
+         return -1;
+   }
+   return done;
+}
+
+static ssize_t
+pwrite_all(int fd, const void *buf, size_t count, off_t offset)
+{
+   const char *out = buf;
+   ssize_t written;
+   size_t done;
+
+   for (done = 0; done < count; done += written) {
+      written = pwrite(fd, out + done, count - done, offset + done);
+      if (written == -1)
+         return -1;
+   }
+   return done;
+}
+
 /* From the zlib docs:
  *    "If the memory is available, buffers sizes on the order of 128K or 256K
  *    bytes should be used."
@@ -713,8 +1144,7 @@ write_all(int fd, const void *buf, size_t count)
  * of the data written to disk.
  */
 static size_t
-deflate_and_write_to_disk(const void *in_data, size_t in_data_size, int dest,
-                          const char *filename)
+deflate_and_write_to_disk(const void *in_data, size_t in_data_size, int dest)
 {
    unsigned char out[BUFSIZE];
 
@@ -771,6 +1201,91 @@ deflate_and_write_to_disk(const void *in_data, size_t in_data_size, int dest,
    return compressed_size;
 }
 
+/**
+ * Decompresses cache entry, returns true if successful.
+ */
+static bool
+inflate_cache_data(const uint8_t *in_data, size_t in_data_size,
+                   uint8_t *out_data, size_t out_data_size)
+{
+   z_stream strm;
+
+   /* allocate inflate state */
+   strm.zalloc = Z_NULL;
+   strm.zfree = Z_NULL;
+   strm.opaque = Z_NULL;
+   strm.next_in = (uint8_t *) in_data;
+   strm.avail_in = in_data_size;
+   strm.next_out = out_data;
+   strm.avail_out = out_data_size;
+
+   int ret = inflateInit(&strm);
+   if (ret != Z_OK)
+      return false;
+
+   ret = inflate(&strm, Z_NO_FLUSH);
+   assert(ret != Z_STREAM_ERROR);  /* state not clobbered */
+
+   /* Unless there was an error we should have decompressed everything in one
+    * go as we know the uncompressed file size.
+    */
+   if (ret != Z_STREAM_END) {
+      (void)inflateEnd(&strm);
+      return false;
+   }
+   assert(strm.avail_out == 0);
+
+   /* clean up and return */
+   (void)inflateEnd(&strm);
+   return true;
+}
+
+/**
+ * Compresses cache entry with LZ4 and writes it to disk. Returns the size of
+ * the data written to disk.
+ */
+static size_t
+lz4_compress_and_write_to_disk(const void *in_data, size_t in_data_size,
+                               int dest)
+{
+   size_t bound = lz4_block_compress_bound(in_data_size);
+   uint8_t *out = malloc(bound);
+   if (!out)
+      return 0;
+
+   size_t compressed_size = lz4_block_compress(in_data, in_data_size,
+                                               out, bound);
+   if (compressed_size && write_all(dest, out, compressed_size) == -1)
+      compressed_size = 0;
+
+   free(out);
+   return compressed_size;
+}
+
+static bool
+lz4_decompress_cache_data(const uint8_t *in_data, size_t in_data_size,
+                          uint8_t *out_data, size_t out_data_size)
+{
+   return lz4_block_decompress(in_data, in_data_size,
+                               out_data, out_data_size);
+}
+
+static const struct {
+   /* Compresses in_data and writes it to dest. Returns the size of the data
+    * written, 0 on failure.
+    */
+   size_t (*compress_and_write)(const void *in_data, size_t in_data_size,
+                                int dest);
+
+   /* Decompresses exactly out_data_size bytes, returns true if successful. */
+   bool (*decompress)(const uint8_t *in_data, size_t in_data_size,
+                      uint8_t *out_data, size_t out_data_size);
+} cache_codecs[] = {
+   [CACHE_CODEC_ZLIB] = { deflate_and_write_to_disk, inflate_cache_data },
+   [CACHE_CODEC_LZ4] = { lz4_compress_and_write_to_disk,
+                         lz4_decompress_cache_data },
+};
+
 static struct disk_cache_put_job *
 create_put_job(struct disk_cache *cache, const cache_key key,
                const void *data, size_t size,
@@ -830,10 +1345,213 @@ destroy_put_job(void *job, int thread_index)
 struct cache_entry_file_data {
    uint32_t crc32;
    uint32_t uncompressed_size;
+   uint32_t codec;
 };
 
-static void
-cache_put(void *job, int thread_index)
+/**
+ * Writes a complete cache entry for the job to fd. Returns the number of
+ * bytes written, or 0 on failure.
+ */
+static size_t
+write_cache_entry(struct disk_cache_put_job *dc_job, int fd)
+{
+   ssize_t ret;
+   size_t entry_size = 0;
+
+   /* Write the driver_keys_blob, this can be used find information about the
+    * mesa version that produced the entry or deal with hash collisions,
+    * should that ever become a real problem.
+    */
+   ret = write_all(fd, dc_job->cache->driver_keys_blob,
+                   dc_job->cache->driver_keys_blob_size);
+   if (ret == -1)
+      return 0;
+   entry_size += ret;
+
+   /* Write the cache item metadata. This data can be used to deal with
+    * hash collisions, as well as providing useful information to 3rd party
+    * tools reading the cache files.
+    */
+   ret = write_all(fd, &dc_job->cache_item_metadata.type,
+                   sizeof(uint32_t));
+   if (ret == -1)
+      return 0;
+   entry_size += ret;
+
+   if (dc_job->cache_item_metadata.type == CACHE_ITEM_TYPE_GLSL) {
+      ret = write_all(fd, &dc_job->cache_item_metadata.num_keys,
+                      sizeof(uint32_t));
+      if (ret == -1)
+         return 0;
+      entry_size += ret;
+
+      ret = write_all(fd, dc_job->cache_item_metadata.keys[0],
+                      dc_job->cache_item_metadata.num_keys *
+                      sizeof(cache_key));
+      if (ret == -1)
+         return 0;
+      entry_size += ret;
+   }
+
+   /* Create CRC of the data. We will read this when restoring the cache and
+    * use it to check for corruption.
+    */
+   struct cache_entry_file_data cf_data;
+   cf_data.crc32 = util_hash_crc32(dc_job->data, dc_job->size);
+   cf_data.uncompressed_size = dc_job->size;
+   cf_data.codec = dc_job->cache->codec;
+
+   ret = write_all(fd, &cf_data, sizeof(cf_data));
+   if (ret == -1)
+      return 0;
+   entry_size += ret;
+
+   /* Now, finally, write out the contents. */
+   size_t compressed_size =
+      cache_codecs[cf_data.codec].compress_and_write(dc_job->data,
+                                                     dc_job->size, fd);
+   if (compressed_size == 0)
+      return 0;
+
+   return entry_size + compressed_size;
+}
+
+static int
+compare_slot_offsets(const void *a, const void *b)
+{
+   const struct packed_index_slot *slot_a =
+      *(const struct packed_index_slot **) a;
+   const struct packed_index_slot *slot_b =
+      *(const struct packed_index_slot **) b;
+
+   if (slot_a->offset < slot_b->offset)
+      return -1;
+   return slot_a->offset > slot_b->offset;
+}
+
+/* Moves all entries still in the packed index to the start of the data file
+ * and truncates it. Entries only ever move towards the start of the file,
+ * so an entry's data is never overwritten before it has been copied.
+ */
+static void
+packed_compact(struct disk_cache *cache)
+{
+   struct packed_index_slot **live;
+   unsigned num_live = 0;
+   uint64_t dst = 0;
+   uint8_t *buf;
+
+   live = malloc(PACKED_INDEX_SLOTS * sizeof(*live));
+   buf = malloc(BUFSIZE);
+   if (live == NULL || buf == NULL)
+      goto done;
+
+   for (unsigned i = 0; i < PACKED_INDEX_SLOTS; i++) {
+      if (cache->packed_slots[i].size)
+         live[num_live++] = &cache->packed_slots[i];
+   }
+
+   qsort(live, num_live, sizeof(*live), compare_slot_offsets);
+
+   for (unsigned i = 0; i < num_live; i++) {
+      struct packed_index_slot *slot = live[i];
+
+      if (slot->offset != dst) {
+         size_t chunk;
+
+         for (size_t done = 0; done < slot->size; done += chunk) {
+            chunk = MIN2(slot->size - done, BUFSIZE);
+
+            if (pread_all(cache->packed_data_fd, buf, chunk,
+                          slot->offset + done) == -1 ||
+                pwrite_all(cache->packed_data_fd, buf, chunk,
+                           dst + done) == -1) {
+               /* This entry may be partially overwritten now, but the ones
+                * after it haven't been touched and stay where they are.
+                */
+               packed_free_slot(cache, slot);
+               goto done;
+            }
+         }
+
+         slot->offset = dst;
+      }
+
+      dst += slot->size;
+   }
+
+   cache->packed_header->data_end = dst;
+   ftruncate(cache->packed_data_fd, dst);
+
+ done:
+   free(buf);
+   free(live);
+}
+
+static void
+packed_put(struct disk_cache_put_job *dc_job)
+{
+   struct disk_cache *cache = dc_job->cache;
+   struct packed_index_header *header = cache->packed_header;
+   struct packed_index_slot *slot;
+   uint64_t offset;
+   size_t entry_size;
+
+   if (!packed_lock(cache))
+      return;
+
+   /* Another process may have added the entry in the meantime. */
+   if (packed_find_slot(cache, dc_job->key))
+      goto done;
+
+   /* Evictions only drop entries from the index. Compact the data file
+    * once at least half of it is unused, which keeps it below twice the
+    * maximum cache size while copying each byte a bounded number of times.
+    */
+   if (header->data_end + dc_job->size > cache->max_size &&
+       header->data_end - header->live_size > header->data_end / 2)
+      packed_compact(cache);
+
+   /* Append the entry. Until the index points at it, a failed or partial
+    * write just leaves garbage after data_end that the next put overwrites.
+    */
+   offset = header->data_end;
+   if (lseek(cache->packed_data_fd, offset, SEEK_SET) == -1)
+      goto done;
+
+   if (write_all(cache->packed_data_fd, dc_job->key, CACHE_KEY_SIZE) == -1)
+      goto done;
+
+   entry_size = write_cache_entry(dc_job, cache->packed_data_fd);
+   if (entry_size == 0)
+      goto done;
+
+   entry_size += CACHE_KEY_SIZE;
+   if (entry_size > UINT32_MAX)
+      goto done;
+
+   /* If the cache is too large, evict something else. The new entry isn't
+    * in the index yet, so it can't be picked.
+    */
+   while (header->live_size + entry_size > cache->max_size &&
+          packed_evict_lru(cache))
+      ;
+
+   slot = packed_claim_slot(cache, dc_job->key);
+   memcpy(slot->key, dc_job->key, CACHE_KEY_SIZE);
+   slot->offset = offset;
+   slot->last_access = p_atomic_inc_return(&header->lru_clock);
+   slot->size = entry_size;
+
+   header->data_end = offset + entry_size;
+   header->live_size += entry_size;
+
+ done:
+   packed_unlock(cache);
+}
+
+static void
+cache_put(void *job, int thread_index)
 {
    assert(job);
 
@@ -842,6 +1560,11 @@ cache_put(void *job, int thread_index)
    char *filename = NULL, *filename_tmp = NULL;
    struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
 
+   if (dc_job->cache->packed) {
+      packed_put(dc_job);
+      return;
+   }
+
    filename = get_cache_file(dc_job->cache, dc_job->key);
    if (filename == NULL)
       goto done;
@@ -898,67 +1621,12 @@ cache_put(void *job, int thread_index)
    /* OK, we're now on the hook to write out a file that we know is
     * not in the cache, and is also not being written out to the cache
     * by some other process.
+    *
+    * Write out the entry to the temporary file, then rename it
+    * atomically to the destination filename, and also perform an atomic
+    * increment of the total cache size.
     */
-
-   /* Write the driver_keys_blob, this can be used find information about the
-    * mesa version that produced the entry or deal with hash collisions,
-    * should that ever become a real problem.
-    */
-   ret = write_all(fd, dc_job->cache->driver_keys_blob,
-                   dc_job->cache->driver_keys_blob_size);
-   if (ret == -1) {
-      unlink(filename_tmp);
-      goto done;
-   }
-
-   /* Write the cache item metadata. This data can be used to deal with
-    * hash collisions, as well as providing useful information to 3rd party
-    * tools reading the cache files.
-    */
-   ret = write_all(fd, &dc_job->cache_item_metadata.type,
-                   sizeof(uint32_t));
-   if (ret == -1) {
-      unlink(filename_tmp);
-      goto done;
-   }
-
-   if (dc_job->cache_item_metadata.type == CACHE_ITEM_TYPE_GLSL) {
-      ret = write_all(fd, &dc_job->cache_item_metadata.num_keys,
-                      sizeof(uint32_t));
-      if (ret == -1) {
-         unlink(filename_tmp);
-         goto done;
-      }
-
-      ret = write_all(fd, dc_job->cache_item_metadata.keys[0],
-                      dc_job->cache_item_metadata.num_keys *
-                      sizeof(cache_key));
-      if (ret == -1) {
-         unlink(filename_tmp);
-         goto done;
-      }
-   }
-
-   /* Create CRC of the data. We will read this when restoring the cache and
-    * use it to check for corruption.
-    */
-   struct cache_entry_file_data cf_data;
-   cf_data.crc32 = util_hash_crc32(dc_job->data, dc_job->size);
-   cf_data.uncompressed_size = dc_job->size;
-
-   size_t cf_data_size = sizeof(cf_data);
-   ret = write_all(fd, &cf_data, cf_data_size);
-   if (ret == -1) {
-      unlink(filename_tmp);
-      goto done;
-   }
-
-   /* Now, finally, write out the contents to the temporary file, then
-    * rename them atomically to the destination filename, and also
-    * perform an atomic increment of the total cache size.
-    */
-   size_t file_size = deflate_and_write_to_disk(dc_job->data, dc_job->size,
-                                                fd, filename_tmp);
+   size_t file_size = write_cache_entry(dc_job, fd);
    if (file_size == 0) {
       unlink(filename_tmp);
       goto done;
@@ -998,110 +1666,50 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
    struct disk_cache_put_job *dc_job =
       create_put_job(cache, key, data, size, cache_item_metadata);
 
+   /* Writes are never waited for, so let prefetches go first. */
    if (dc_job) {
       util_queue_fence_init(&dc_job->fence);
-      util_queue_add_job(&cache->cache_queue, dc_job, &dc_job->fence,
-                         cache_put, destroy_put_job);
+      util_queue_add_job_with_priority(&cache->cache_queue, dc_job,
+                                       &dc_job->fence, cache_put,
+                                       destroy_put_job,
+                                       UTIL_QUEUE_PRIORITY_LOW);
    }
 }
 
 /**
- * Decompresses cache entry, returns true if successful.
+ * Checks and decompresses a cache entry read into memory. Returns the
+ * uncompressed data, or NULL if the entry is invalid.
  */
-static bool
-inflate_cache_data(uint8_t *in_data, size_t in_data_size,
-                   uint8_t *out_data, size_t out_data_size)
+static void *
+parse_cache_entry(struct disk_cache *cache, const uint8_t *entry,
+                  size_t entry_size, size_t *size)
 {
-   z_stream strm;
-
-   /* allocate inflate state */
-   strm.zalloc = Z_NULL;
-   strm.zfree = Z_NULL;
-   strm.opaque = Z_NULL;
-   strm.next_in = in_data;
-   strm.avail_in = in_data_size;
-   strm.next_out = out_data;
-   strm.avail_out = out_data_size;
-
-   int ret = inflateInit(&strm);
-   if (ret != Z_OK)
-      return false;
-
-   ret = inflate(&strm, Z_NO_FLUSH);
-   assert(ret != Z_STREAM_ERROR);  /* state not clobbered */
-
-   /* Unless there was an error we should have decompressed everything in one
-    * go as we know the uncompressed file size.
-    */
-   if (ret != Z_STREAM_END) {
-      (void)inflateEnd(&strm);
-      return false;
-   }
-   assert(strm.avail_out == 0);
-
-   /* clean up and return */
-   (void)inflateEnd(&strm);
-   return true;
-}
-
-void *
-disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
-{
-   int fd = -1, ret;
-   struct stat sb;
-   char *filename = NULL;
-   uint8_t *data = NULL;
+   const uint8_t *end = entry + entry_size;
    uint8_t *uncompressed_data = NULL;
-   uint8_t *file_header = NULL;
-
-   if (size)
-      *size = 0;
-
-   filename = get_cache_file(cache, key);
-   if (filename == NULL)
-      goto fail;
-
-   fd = open(filename, O_RDONLY | O_CLOEXEC);
-   if (fd == -1)
-      goto fail;
-
-   if (fstat(fd, &sb) == -1)
-      goto fail;
-
-   data = malloc(sb.st_size);
-   if (data == NULL)
-      goto fail;
 
    size_t ck_size = cache->driver_keys_blob_size;
-   file_header = malloc(ck_size);
-   if (!file_header)
-      goto fail;
-
-   if (sb.st_size < ck_size)
-      goto fail;
-
-   ret = read_all(fd, file_header, ck_size);
-   if (ret == -1)
-      goto fail;
+   if (entry_size < ck_size)
+      return NULL;
 
    /* Check for extremely unlikely hash collisions */
-   if (memcmp(cache->driver_keys_blob, file_header, ck_size) != 0) {
+   if (memcmp(cache->driver_keys_blob, entry, ck_size) != 0) {
       assert(!"Mesa cache keys mismatch!");
-      goto fail;
+      return NULL;
    }
+   entry += ck_size;
 
-   size_t cache_item_md_size = sizeof(uint32_t);
    uint32_t md_type;
-   ret = read_all(fd, &md_type, cache_item_md_size);
-   if (ret == -1)
-      goto fail;
+   if (end - entry < sizeof(uint32_t))
+      return NULL;
+   memcpy(&md_type, entry, sizeof(uint32_t));
+   entry += sizeof(uint32_t);
 
    if (md_type == CACHE_ITEM_TYPE_GLSL) {
       uint32_t num_keys;
-      cache_item_md_size += sizeof(uint32_t);
-      ret = read_all(fd, &num_keys, sizeof(uint32_t));
-      if (ret == -1)
-         goto fail;
+      if (end - entry < sizeof(uint32_t))
+         return NULL;
+      memcpy(&num_keys, entry, sizeof(uint32_t));
+      entry += sizeof(uint32_t);
 
       /* The cache item metadata is currently just used for distributing
        * precompiled shaders, they are not used by Mesa so just skip them for
@@ -1109,30 +1717,29 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
        * TODO: pass the metadata back to the caller and do some basic
        * validation.
        */
-      cache_item_md_size += num_keys * sizeof(cache_key);
-      ret = lseek(fd, num_keys * sizeof(cache_key), SEEK_CUR);
-      if (ret == -1)
-         goto fail;
+      if ((end - entry) / sizeof(cache_key) < num_keys)
+         return NULL;
+      entry += num_keys * sizeof(cache_key);
    }
 
    /* Load the CRC that was created when the file was written. */
    struct cache_entry_file_data cf_data;
-   size_t cf_data_size = sizeof(cf_data);
-   ret = read_all(fd, &cf_data, cf_data_size);
-   if (ret == -1)
-      goto fail;
+   if (end - entry < sizeof(cf_data))
+      return NULL;
+   memcpy(&cf_data, entry, sizeof(cf_data));
+   entry += sizeof(cf_data);
 
-   /* Load the actual cache data. */
-   size_t cache_data_size =
-      sb.st_size - cf_data_size - ck_size - cache_item_md_size;
-   ret = read_all(fd, data, cache_data_size);
-   if (ret == -1)
-      goto fail;
+   if (cf_data.codec >= ARRAY_SIZE(cache_codecs))
+      return NULL;
 
    /* Uncompress the cache data */
    uncompressed_data = malloc(cf_data.uncompressed_size);
-   if (!inflate_cache_data(data, cache_data_size, uncompressed_data,
-                           cf_data.uncompressed_size))
+   if (!uncompressed_data)
+      return NULL;
+
+   if (!cache_codecs[cf_data.codec].decompress(entry, end - entry,
+                                               uncompressed_data,
+                                               cf_data.uncompressed_size))
       goto fail;
 
    /* Check the data for corruption */
@@ -1140,29 +1747,196 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
                                         cf_data.uncompressed_size))
       goto fail;
 
-   free(data);
-   free(filename);
-   free(file_header);
-   close(fd);
-
    if (size)
       *size = cf_data.uncompressed_size;
 
    return uncompressed_data;
 
  fail:
-   if (data)
-      free(data);
-   if (uncompressed_data)
-      free(uncompressed_data);
-   if (filename)
-      free(filename);
-   if (file_header)
-      free(file_header);
+   free(uncompressed_data);
+
+   return NULL;
+}
+
+static void *
+packed_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   struct packed_index_slot *slot;
+   uint64_t offset;
+   uint32_t entry_size;
+   uint8_t *entry;
+   void *data = NULL;
+
+   slot = packed_find_slot(cache, key);
+   if (slot == NULL)
+      return NULL;
+
+   /* The slot may be reused while we read the entry, so work on a copy and
+    * check that the data file still has our key at that offset.
+    */
+   offset = slot->offset;
+   entry_size = slot->size;
+   if (entry_size <= CACHE_KEY_SIZE)
+      return NULL;
+
+   entry = malloc(entry_size);
+   if (entry == NULL)
+      return NULL;
+
+   if (pread_all(cache->packed_data_fd, entry, entry_size, offset) == -1 ||
+       memcmp(entry, key, CACHE_KEY_SIZE) != 0)
+      goto done;
+
+   data = parse_cache_entry(cache, entry + CACHE_KEY_SIZE,
+                            entry_size - CACHE_KEY_SIZE, size);
+   if (data) {
+      slot->last_access =
+         p_atomic_inc_return(&cache->packed_header->lru_clock);
+   }
+
+ done:
+   free(entry);
+
+   return data;
+}
+
+/* Reads and decompresses the entry for key from disk. */
+static void *
+load_cache_entry(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   int fd = -1;
+   struct stat sb;
+   char *filename = NULL;
+   uint8_t *entry = NULL;
+   void *data = NULL;
+
+   if (cache->packed)
+      return packed_get(cache, key, size);
+
+   filename = get_cache_file(cache, key);
+   if (filename == NULL)
+      goto done;
+
+   fd = open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd == -1)
+      goto done;
+
+   if (fstat(fd, &sb) == -1)
+      goto done;
+
+   entry = malloc(sb.st_size);
+   if (entry == NULL)
+      goto done;
+
+   if (read_all(fd, entry, sb.st_size) == -1)
+      goto done;
+
+   data = parse_cache_entry(cache, entry, sb.st_size, size);
+
+ done:
+   free(entry);
+   free(filename);
    if (fd != -1)
       close(fd);
 
-   return NULL;
+   return data;
+}
+
+void *
+disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   void *data;
+
+   if (size)
+      *size = 0;
+
+   data = take_prefetched_entry(cache, key, size);
+   if (data)
+      return data;
+
+   return load_cache_entry(cache, key, size);
+}
+
+static void
+cache_prefetch(void *job, int thread_index)
+{
+   struct disk_cache_prefetch_job *dc_job =
+      (struct disk_cache_prefetch_job *) job;
+   struct disk_cache *cache = dc_job->cache;
+
+   for (unsigned i = 0; i < dc_job->num_keys; i++) {
+      struct prefetched_entry *prefetched;
+      unsigned generation;
+      bool skip;
+
+      mtx_lock(&cache->prefetch_mutex);
+      skip = cache->prefetched_size >= PREFETCH_MAX_SIZE ||
+             _mesa_hash_table_search(cache->prefetched, dc_job->keys[i]);
+      generation = cache->prefetch_generation[dc_job->keys[i][0]];
+      mtx_unlock(&cache->prefetch_mutex);
+
+      if (skip)
+         continue;
+
+      prefetched = malloc(sizeof(*prefetched));
+      if (!prefetched)
+         return;
+
+      memcpy(prefetched->key, dc_job->keys[i], CACHE_KEY_SIZE);
+      prefetched->data = load_cache_entry(cache, prefetched->key,
+                                          &prefetched->size);
+      if (!prefetched->data) {
+         free(prefetched);
+         continue;
+      }
+
+      /* Another job may have loaded the same entry in the meantime, or it
+       * may have been fetched or removed already.
+       */
+      mtx_lock(&cache->prefetch_mutex);
+      if (cache->prefetched_size + prefetched->size <= PREFETCH_MAX_SIZE &&
+          cache->prefetch_generation[prefetched->key[0]] == generation &&
+          !_mesa_hash_table_search(cache->prefetched, prefetched->key)) {
+         _mesa_hash_table_insert(cache->prefetched, prefetched->key,
+                                 prefetched);
+         cache->prefetched_size += prefetched->size;
+         prefetched = NULL;
+      }
+      mtx_unlock(&cache->prefetch_mutex);
+
+      if (prefetched) {
+         free(prefetched->data);
+         free(prefetched);
+      }
+   }
+}
+
+static void
+destroy_prefetch_job(void *job, int thread_index)
+{
+   free(job);
+}
+
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+   struct disk_cache_prefetch_job *dc_job;
+
+   if (num_keys == 0)
+      return;
+
+   dc_job = malloc(sizeof(*dc_job) + num_keys * sizeof(cache_key));
+   if (!dc_job)
+      return;
+
+   dc_job->cache = cache;
+   dc_job->num_keys = num_keys;
+   memcpy(dc_job->keys, keys, num_keys * sizeof(cache_key));
+
+   util_queue_fence_init(&dc_job->fence);
+   util_queue_add_job(&cache->cache_queue, dc_job, &dc_job->fence,
+                      cache_prefetch, destroy_prefetch_job);
 }
 
 void
@@ -175,6 +175,18 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
 void *
 disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size);
 
+/**
+ * Start loading the items stored under the \num_keys names in \keys.
+ *
+ * The items are read and decompressed on the cache's thread and kept in
+ * memory, so that a later disk_cache_get() for one of them doesn't have to
+ * touch the disk. Names that are not in the cache are ignored. Prefetched
+ * items are dropped once they have been retrieved.
+ */
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys);
+
 /**
  * Store the name \key within the cache, (without any associated data).
  *
@@ -241,6 +253,13 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return NULL;
 }
 
+static inline void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+   return;
+}
+
 static inline void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
@@ -0,0 +1,219 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lz4_block.h"
+#include "macros.h"
+
+#define MIN_MATCH 4
+
+/* The format requires the last 5 bytes to be literals and the last match
+ * to start at least 12 bytes before the end of the block.
+ */
+#define LAST_LITERALS 5
+#define MF_LIMIT 12
+
+/* Offsets are stored in 16 bits. */
+#define MAX_DISTANCE 65535
+
+#define HASH_BITS 12
+
+static inline uint32_t
+read32(const uint8_t *p)
+{
+   uint32_t v;
+   memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+static inline uint32_t
+hash32(uint32_t v)
+{
+   return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint8_t *
+write_length(uint8_t *op, size_t len)
+{
+   while (len >= 255) {
+      *op++ = 255;
+      len -= 255;
+   }
+   *op++ = len;
+   return op;
+}
+
+static uint8_t *
+write_literals(uint8_t *op, uint8_t *token, const uint8_t *literals,
+               size_t len)
+{
+   *token = MIN2(len, 15) << 4;
+   if (len >= 15)
+      op = write_length(op, len - 15);
+
+   memcpy(op, literals, len);
+   return op + len;
+}
+
+size_t
+lz4_block_compress(const void *src, size_t src_size,
+                   void *dst, size_t dst_capacity)
+{
+   const uint8_t *base = src;
+   const uint8_t *ip = base, *anchor = base;
+   const uint8_t *end = base + src_size;
+   uint8_t *op = dst;
+   uint32_t table[1 << HASH_BITS];
+
+   if (dst_capacity < lz4_block_compress_bound(src_size))
+      return 0;
+
+   /* Greedy parse: look up the previous position with the same 4 bytes
+    * through a small hash table and take the match if there is one.
+    */
+   if (src_size > MF_LIMIT) {
+      const uint8_t *mf_limit = end - MF_LIMIT;
+      const uint8_t *match_limit = end - LAST_LITERALS;
+
+      memset(table, 0, sizeof(table));
+
+      while (ip < mf_limit) {
+         uint32_t seq = read32(ip);
+         uint32_t h = hash32(seq);
+         const uint8_t *ref = base + table[h];
+
+         table[h] = ip - base;
+
+         if (ref >= ip || ip - ref > MAX_DISTANCE || read32(ref) != seq) {
+            /* Skip faster through data that doesn't compress. */
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+         }
+
+         while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+            ip--;
+            ref--;
+         }
+
+         const uint8_t *match_end = ip + MIN_MATCH;
+         const uint8_t *ref_end = ref + MIN_MATCH;
+         while (match_end < match_limit && *match_end == *ref_end) {
+            match_end++;
+            ref_end++;
+         }
+
+         uint8_t *token = op++;
+         op = write_literals(op, token, anchor, ip - anchor);
+
+         uint16_t offset = ip - ref;
+         *op++ = offset & 0xff;
+         *op++ = offset >> 8;
+
+         size_t match_len = match_end - ip - MIN_MATCH;
+         *token |= MIN2(match_len, 15);
+         if (match_len >= 15)
+            op = write_length(op, match_len - 15);
+
+         ip = anchor = match_end;
+      }
+   }
+
+   /* The block always ends with a sequence of literals only. */
+   uint8_t *token = op++;
+   op = write_literals(op, token, anchor, end - anchor);
+
+   return op - (uint8_t *) dst;
+}
+
+/* Reads the extra bytes of a length whose 4 bit field was 15. */
+static bool
+read_length(const uint8_t **ip, const uint8_t *end, size_t *len)
+{
+   uint8_t b;
+
+   do {
+      if (*ip >= end)
+         return false;
+      b = *(*ip)++;
+      *len += b;
+   } while (b == 255);
+
+   return true;
+}
+
+bool
+lz4_block_decompress(const void *src, size_t src_size,
+                     void *dst, size_t dst_size)
+{
+   const uint8_t *ip = src;
+   const uint8_t *end = ip + src_size;
+   uint8_t *base = dst;
+   uint8_t *op = base;
+   uint8_t *oend = base + dst_size;
+
+   while (ip < end) {
+      unsigned token = *ip++;
+
+      size_t len = token >> 4;
+      if (len == 15 && !read_length(&ip, end, &len))
+         return false;
+      if (len > end - ip || len > oend - op)
+         return false;
+
+      memcpy(op, ip, len);
+      op += len;
+      ip += len;
+
+      /* The last sequence has no match. */
+      if (ip == end)
+         break;
+
+      if (end - ip < 2)
+         return false;
+      size_t offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > op - base)
+         return false;
+
+      len = token & 15;
+      if (len == 15 && !read_length(&ip, end, &len))
+         return false;
+      len += MIN_MATCH;
+      if (len > oend - op)
+         return false;
+
+      const uint8_t *ref = op - offset;
+      if (offset >= len) {
+         memcpy(op, ref, len);
+         op += len;
+      } else {
+         /* Overlapping match, repeats the last offset bytes. */
+         while (len--)
+            *op++ = *ref++;
+      }
+   }
+
+   return op == oend;
+}
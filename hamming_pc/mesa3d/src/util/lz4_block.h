@@ -0,0 +1,78 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Compressor and decompressor for the LZ4 block format.
+ *
+ * LZ4 trades compression ratio for speed, decompression in particular is
+ * several times faster than zlib's inflate. Only single blocks are
+ * supported, the caller has to keep track of the uncompressed size.
+ */
+
+#ifndef LZ4_BLOCK_H
+#define LZ4_BLOCK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Returns the size of the buffer lz4_block_compress() needs for \size bytes
+ * of input in the worst case.
+ */
+static inline size_t
+lz4_block_compress_bound(size_t size)
+{
+   return size + size / 255 + 16;
+}
+
+/**
+ * Compresses \src_size bytes at \src into \dst, which must have room for at
+ * least lz4_block_compress_bound(src_size) bytes.
+ *
+ * \return The size of the compressed data, or 0 if \dst is too small.
+ */
+size_t
+lz4_block_compress(const void *src, size_t src_size,
+                   void *dst, size_t dst_capacity);
+
+/**
+ * Decompresses a block produced by lz4_block_compress().
+ *
+ * \return true if \src decompressed to exactly \dst_size bytes. Corrupt
+ * input is detected and never makes the decompressor read or write out of
+ * bounds.
+ */
+bool
+lz4_block_decompress(const void *src, size_t src_size,
+                     void *dst, size_t dst_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LZ4_BLOCK_H */
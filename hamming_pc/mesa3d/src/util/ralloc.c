@@ -76,12 +76,58 @@ struct
    struct ralloc_header *next;
 
    void (*destructor)(void *);
+
+   /* The pool size class this block was carved from, or NULL if it was
+    * allocated with malloc.  On 64-bit release builds this fits in what
+    * used to be padding, so the header doesn't grow.
+    */
+   struct ralloc_pool_bucket *bucket;
 };
 
 typedef struct ralloc_header ralloc_header;
 
+#define ALIGN_POT(x, y) (((x) + (y) - 1) & ~((y) - 1))
+
+/* Pooled blocks, header included, are rounded up to 16 bytes and sorted
+ * into size classes, each with its own free list.  Blocks that are larger
+ * than the largest class come from malloc as usual.
+ */
+#define POOL_GRANULE 16
+#define POOL_NUM_BUCKETS 64
+#define POOL_MIN_CHUNK_SIZE 4096
+#define POOL_MAX_CHUNK_SIZE (64 * 1024)
+
+struct ralloc_pool_bucket {
+   struct ralloc_pool *pool;
+   ralloc_header *free_list;
+   unsigned size;
+};
+
+struct ralloc_pool_chunk {
+   struct ralloc_pool_chunk *next;
+};
+
+struct ralloc_pool {
+   struct ralloc_pool_bucket buckets[POOL_NUM_BUCKETS];
+
+   /* Chunks we carve new blocks from; only the first one has space left. */
+   struct ralloc_pool_chunk *chunks;
+   char *next, *end;
+   size_t chunk_size;
+
+   /* Blocks handed out and not yet freed.  A destroyed pool stays around
+    * until the last of them is gone.
+    */
+   size_t live_blocks;
+   bool destroyed;
+
+   struct ralloc_pool_stats stats;
+};
+
 static void unlink_block(ralloc_header *info);
 static void unsafe_free(ralloc_header *info);
+static ralloc_header *pool_block_alloc(struct ralloc_pool *pool, size_t size);
+static void pool_block_free(ralloc_header *info);
 
 static ralloc_header *
 get_header(const void *ptr)
@@ -115,17 +161,11 @@ ralloc_context(const void *ctx)
    return ralloc_size(ctx, 0);
 }
 
-void *
-ralloc_size(const void *ctx, size_t size)
+static void *
+init_header(const void *ctx, ralloc_header *info)
 {
-   void *block = malloc(size + sizeof(ralloc_header));
-   ralloc_header *info;
    ralloc_header *parent;
 
-   if (unlikely(block == NULL))
-      return NULL;
-
-   info = (ralloc_header *) block;
    /* measurements have shown that calloc is slower (because of
     * the multiplication overflow checking?), so clear things
     * manually
@@ -147,6 +187,21 @@ ralloc_size(const void *ctx, size_t size)
    return PTR_FROM_HEADER(info);
 }
 
+void *
+ralloc_size(const void *ctx, size_t size)
+{
+   void *block = malloc(size + sizeof(ralloc_header));
+   ralloc_header *info;
+
+   if (unlikely(block == NULL))
+      return NULL;
+
+   info = (ralloc_header *) block;
+   info->bucket = NULL;
+
+   return init_header(ctx, info);
+}
+
 void *
 rzalloc_size(const void *ctx, size_t size)
 {
@@ -165,10 +220,32 @@ resize(void *ptr, size_t size)
    ralloc_header *child, *old, *info;
 
    old = get_header(ptr);
-   info = realloc(old, size + sizeof(ralloc_header));
 
-   if (info == NULL)
-      return NULL;
+   if (old->bucket != NULL) {
+      struct ralloc_pool_bucket *bucket = old->bucket;
+
+      /* Pooled blocks can't grow in place, but they can shrink. */
+      if (size + sizeof(ralloc_header) <= bucket->size)
+         return ptr;
+
+      info = pool_block_alloc(bucket->pool, size);
+      if (info == NULL) {
+         info = malloc(size + sizeof(ralloc_header));
+         if (info == NULL)
+            return NULL;
+         info->bucket = NULL;
+      }
+
+      struct ralloc_pool_bucket *new_bucket = info->bucket;
+      memcpy(info, old, bucket->size);
+      info->bucket = new_bucket;
+      pool_block_free(old);
+   } else {
+      info = realloc(old, size + sizeof(ralloc_header));
+
+      if (info == NULL)
+         return NULL;
+   }
 
    /* Update parent and sibling's links to the reallocated node. */
    if (info != old && info->parent != NULL) {
@@ -273,7 +350,10 @@ unsafe_free(ralloc_header *info)
    if (info->destructor != NULL)
       info->destructor(PTR_FROM_HEADER(info));
 
-   free(info);
+   if (info->bucket != NULL)
+      pool_block_free(info);
+   else
+      free(info);
 }
 
 void
@@ -535,6 +615,172 @@ ralloc_vasprintf_rewrite_tail(char **str, size_t *start, const char *fmt,
    return true;
 }
 
+/***************************************************************************
+ * Pool allocator.
+ ***************************************************************************
+ *
+ * A pool hands out ordinary ralloc blocks (they can be parents, be stolen
+ * and be freed like any other), but takes their memory from chunks it owns
+ * instead of malloc.  Freed blocks go on a free list for their size class
+ * and are reused by the next allocation of that class, so a workload that
+ * keeps creating and dropping objects of a few sizes stops hitting malloc
+ * at all.  Chunk memory is only returned once the pool has been destroyed
+ * and every block carved from it has been freed.
+ *
+ * Pools are not thread-safe, the same as the ralloc trees they feed.
+ */
+
+struct ralloc_pool *
+ralloc_pool_create(void)
+{
+   struct ralloc_pool *pool = calloc(1, sizeof(*pool));
+   if (pool == NULL)
+      return NULL;
+
+   for (unsigned i = 0; i < POOL_NUM_BUCKETS; i++) {
+      pool->buckets[i].pool = pool;
+      pool->buckets[i].size = (i + 1) * POOL_GRANULE;
+   }
+   pool->chunk_size = POOL_MIN_CHUNK_SIZE;
+
+   return pool;
+}
+
+static void
+pool_release(struct ralloc_pool *pool)
+{
+   struct ralloc_pool_chunk *chunk = pool->chunks;
+   while (chunk != NULL) {
+      struct ralloc_pool_chunk *next = chunk->next;
+      free(chunk);
+      chunk = next;
+   }
+   free(pool);
+}
+
+void
+ralloc_pool_destroy(struct ralloc_pool *pool)
+{
+   if (pool == NULL)
+      return;
+
+   pool->destroyed = true;
+   if (pool->live_blocks == 0)
+      pool_release(pool);
+}
+
+void
+ralloc_pool_get_stats(const struct ralloc_pool *pool,
+                      struct ralloc_pool_stats *stats)
+{
+   *stats = pool->stats;
+}
+
+/* Starts carving blocks from a new chunk of at least \p size bytes.  The
+ * tail of the previous chunk is lost, which is fine since chunks are much
+ * larger than the largest block.
+ */
+static bool
+pool_add_chunk(struct ralloc_pool *pool, size_t size)
+{
+   size_t header = ALIGN_POT(sizeof(struct ralloc_pool_chunk), POOL_GRANULE);
+
+   size = ALIGN_POT(size, POOL_GRANULE);
+   struct ralloc_pool_chunk *chunk = malloc(header + size);
+   if (chunk == NULL)
+      return false;
+
+   chunk->next = pool->chunks;
+   pool->chunks = chunk;
+   pool->next = (char *) chunk + header;
+   pool->end = pool->next + size;
+   pool->stats.chunk_bytes += header + size;
+
+   /* Small shaders, say, shouldn't pay for a big chunk up front. */
+   if (pool->chunk_size < POOL_MAX_CHUNK_SIZE)
+      pool->chunk_size *= 2;
+
+   return true;
+}
+
+void
+ralloc_pool_reserve(struct ralloc_pool *pool, size_t size)
+{
+   if (pool->destroyed || (size_t) (pool->end - pool->next) >= size)
+      return;
+
+   pool_add_chunk(pool, MAX2(size, pool->chunk_size));
+}
+
+/* Returns NULL if the block is too big for the pool. */
+static ralloc_header *
+pool_block_alloc(struct ralloc_pool *pool, size_t size)
+{
+   size_t bytes = ALIGN_POT(size + sizeof(ralloc_header), POOL_GRANULE);
+   size_t index = bytes / POOL_GRANULE - 1;
+   ralloc_header *info;
+
+   if (pool->destroyed || index >= POOL_NUM_BUCKETS)
+      return NULL;
+
+   struct ralloc_pool_bucket *bucket = &pool->buckets[index];
+
+   if (bucket->free_list != NULL) {
+      info = bucket->free_list;
+      bucket->free_list = info->next;
+      pool->stats.reused_blocks++;
+   } else {
+      if ((size_t) (pool->end - pool->next) < bytes &&
+          !pool_add_chunk(pool, pool->chunk_size))
+         return NULL;
+
+      info = (ralloc_header *) pool->next;
+      pool->next += bytes;
+      pool->stats.new_blocks++;
+   }
+
+   info->bucket = bucket;
+   pool->live_blocks++;
+
+   return info;
+}
+
+static void
+pool_block_free(ralloc_header *info)
+{
+   struct ralloc_pool_bucket *bucket = info->bucket;
+   struct ralloc_pool *pool = bucket->pool;
+
+   info->next = bucket->free_list;
+   bucket->free_list = info;
+
+   assert(pool->live_blocks > 0);
+   if (--pool->live_blocks == 0 && pool->destroyed)
+      pool_release(pool);
+}
+
+void *
+ralloc_pool_size(struct ralloc_pool *pool, const void *ctx, size_t size)
+{
+   ralloc_header *info = pool_block_alloc(pool, size);
+
+   if (info == NULL)
+      return ralloc_size(ctx, size);
+
+   return init_header(ctx, info);
+}
+
+void *
+rzalloc_pool_size(struct ralloc_pool *pool, const void *ctx, size_t size)
+{
+   void *ptr = ralloc_pool_size(pool, ctx, size);
+
+   if (likely(ptr))
+      memset(ptr, 0, size);
+
+   return ptr;
+}
+
 /***************************************************************************
  * Linear allocator for short-lived allocations.
  ***************************************************************************
@@ -553,8 +799,6 @@ ralloc_vasprintf_rewrite_tail(char **str, size_t *start, const char *fmt,
  * other buffers.
  */
 
-#define ALIGN_POT(x, y) (((x) + (y) - 1) & ~((y) - 1))
-
 #define MIN_LINEAR_BUFSIZE 2048
 #define SUBALLOC_ALIGNMENT sizeof(uintptr_t)
 #define LMAGIC 0x87b9c7d3
@@ -535,6 +535,68 @@ bool linear_vasprintf_rewrite_tail(void *parent, char **str, size_t *start,
                                    const char *fmt, va_list args);
 bool linear_strcat(void *parent, char **dest, const char *str);
 
+/**
+ * \defgroup pool Pool Allocator @{
+ *
+ * A pool is an optional source of memory for ralloc blocks.  Blocks
+ * allocated from a pool behave exactly like any other ralloc block, but
+ * their memory is carved out of large chunks and recycled through free
+ * lists kept per size class, which avoids malloc and free for workloads
+ * that create and drop lots of small objects of similar sizes.
+ *
+ * The pool isn't part of the ralloc hierarchy.  Its memory is released
+ * once ralloc_pool_destroy has been called and every block allocated from
+ * it has been freed, in any order.  A pool must only be used from one
+ * thread at a time.
+ */
+
+struct ralloc_pool;
+
+struct ralloc_pool_stats {
+   /** Bytes of chunk memory the pool got from malloc */
+   size_t chunk_bytes;
+   /** Blocks carved out of a chunk */
+   size_t new_blocks;
+   /** Blocks taken from a free list */
+   size_t reused_blocks;
+};
+
+/**
+ * Create an empty pool.
+ */
+struct ralloc_pool *ralloc_pool_create(void);
+
+/**
+ * Destroy a pool.  The memory stays around until the last block allocated
+ * from the pool is freed.  No new blocks can be allocated from it.
+ */
+void ralloc_pool_destroy(struct ralloc_pool *pool);
+
+/**
+ * Same as ralloc_size, but takes the memory from \p pool.  Blocks too big
+ * for the pool fall back to ralloc_size.
+ */
+void *ralloc_pool_size(struct ralloc_pool *pool, const void *ctx,
+                       size_t size) MALLOCLIKE;
+
+/**
+ * Same as rzalloc_size, but takes the memory from \p pool.
+ */
+void *rzalloc_pool_size(struct ralloc_pool *pool, const void *ctx,
+                        size_t size) MALLOCLIKE;
+
+/**
+ * Make sure the next \p size bytes of new blocks can be carved out of a
+ * single chunk.  Useful when the caller knows it's about to allocate lots
+ * of blocks, like when deserializing a shader.  This is only a hint: blocks
+ * taken from the free lists don't use the reserved space.
+ */
+void ralloc_pool_reserve(struct ralloc_pool *pool, size_t size);
+
+void ralloc_pool_get_stats(const struct ralloc_pool *pool,
+                           struct ralloc_pool_stats *stats);
+/// @}
+
 #ifdef __cplusplus
 } /* end of extern "C" */
 #endif
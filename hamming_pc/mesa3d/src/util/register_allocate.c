@@ -68,15 +68,25 @@
  * up front and stored in a 2-dimensional array, so that the cost of
  * coloring a node is constant with the number of registers.  We do
  * this during ra_set_finalize().
+ *
+ * The q totals are kept up to date as nodes are added to the graph and
+ * removed from it during simplification, and the nodes that pass the pq
+ * test are tracked in a worklist, so simplifying the graph doesn't have to
+ * rescan every node each time it pushes one onto the stack.
  */
 
 #include <stdbool.h>
+#include <stdio.h>
 
+#include "c11/threads.h"
 #include "ralloc.h"
 #include "main/imports.h"
 #include "main/macros.h"
 #include "main/mtypes.h"
+#include "util/bitscan.h"
 #include "util/bitset.h"
+#include "util/os_time.h"
+#include "util/u_atomic.h"
 #include "register_allocate.h"
 
 #define NO_REG ~0U
@@ -106,6 +116,14 @@ struct ra_class {
     */
    BITSET_WORD *regs;
 
+   /**
+    * The range of words of \c regs that have any register of the class,
+    * computed by ra_set_finalize().  Only those words need looking at when
+    * picking a register for a node of this class.
+    */
+   unsigned int regs_start_word;
+   unsigned int regs_end_word;
+
    /**
     * p(B) in Runeson/Nyström paper.
     *
@@ -127,7 +145,6 @@ struct ra_node {
     * List of which nodes this node interferes with.  This should be
     * symmetric with the other node.
     */
-   BITSET_WORD *adjacency;
    unsigned int *adjacency_list;
    unsigned int adjacency_list_size;
    unsigned int adjacency_count;
@@ -166,6 +183,12 @@ struct ra_graph {
    struct ra_node *nodes;
    unsigned int count; /**< count of nodes. */
 
+   /**
+    * Which pairs of nodes interfere, as the lower triangle of the
+    * adjacency matrix.  See ra_adjacency_bit().
+    */
+   BITSET_WORD *adjacency;
+
    unsigned int *stack;
    unsigned int stack_count;
 
@@ -302,6 +325,66 @@ ra_make_reg_conflicts_transitive(struct ra_regs *regs, unsigned int r)
    }
 }
 
+/**
+ * Makes every pair of registers whose ranges of units overlap conflict,
+ * given the range of each register in the set.
+ *
+ * This is what adding conflicts between each register and the base
+ * registers it is made of and then making the base registers' conflicts
+ * transitive ends up with, without the cost of going through every
+ * conflict of every base register.  Two ranges overlap when each starts
+ * before the other one ends, so each register's conflicts are the
+ * intersection of the registers starting before its end and the ones
+ * ending after its start, and those sets are built once for every unit.
+ */
+void
+ra_add_range_conflicts(struct ra_regs *regs, const struct ra_reg_range *ranges)
+{
+   const unsigned int words = BITSET_WORDS(regs->count);
+   unsigned int unit_count = 0;
+   BITSET_WORD *starts_before, *ends_after;
+   unsigned int r, u, i;
+
+   for (r = 0; r < regs->count; r++)
+      unit_count = MAX2(unit_count, ranges[r].start + ranges[r].count);
+
+   /* starts_before[u] is the set of registers starting before unit u, and
+    * ends_after[u] the set of registers ending after it.
+    */
+   starts_before = calloc((size_t)(unit_count + 1) * words * 2,
+                          sizeof(BITSET_WORD));
+   ends_after = starts_before + (size_t)(unit_count + 1) * words;
+
+   for (r = 0; r < regs->count; r++) {
+      BITSET_SET(&starts_before[(ranges[r].start + 1) * words], r);
+      BITSET_SET(&ends_after[(ranges[r].start + ranges[r].count - 1) * words],
+                 r);
+   }
+
+   for (u = 1; u <= unit_count; u++) {
+      for (i = 0; i < words; i++)
+         starts_before[u * words + i] |= starts_before[(u - 1) * words + i];
+   }
+   for (u = unit_count; u-- > 0;) {
+      for (i = 0; i < words; i++)
+         ends_after[u * words + i] |= ends_after[(u + 1) * words + i];
+   }
+
+   for (r = 0; r < regs->count; r++) {
+      const BITSET_WORD *before =
+         &starts_before[(ranges[r].start + ranges[r].count) * words];
+      const BITSET_WORD *after = &ends_after[ranges[r].start * words];
+
+      assert(ranges[r].count > 0);
+      assert(!regs->regs[r].conflict_list);
+
+      for (i = 0; i < words; i++)
+         regs->regs[r].conflicts[i] |= before[i] & after[i];
+   }
+
+   free(starts_before);
+}
+
 unsigned int
 ra_alloc_reg_class(struct ra_regs *regs)
 {
@@ -385,17 +468,49 @@ ra_set_finalize(struct ra_regs *regs, unsigned int **q_values)
       }
    }
 
+   for (b = 0; b < regs->class_count; b++) {
+      struct ra_class *class = regs->classes[b];
+      unsigned int words = BITSET_WORDS(regs->count);
+
+      class->regs_start_word = 0;
+      while (class->regs_start_word < words &&
+             !class->regs[class->regs_start_word])
+         class->regs_start_word++;
+
+      class->regs_end_word = words;
+      while (class->regs_end_word > class->regs_start_word &&
+             !class->regs[class->regs_end_word - 1])
+         class->regs_end_word--;
+   }
+
    for (b = 0; b < regs->count; b++) {
       ralloc_free(regs->regs[b].conflict_list);
       regs->regs[b].conflict_list = NULL;
    }
 }
 
+/**
+ * Returns the bit of the adjacency matrix for the interference between two
+ * different nodes.  Interference is symmetric, so only the lower triangle
+ * is stored: row n holds the n nodes numbered below it.
+ */
+static inline size_t
+ra_adjacency_bit(unsigned int n1, unsigned int n2)
+{
+   assert(n1 != n2);
+
+   if (n1 < n2) {
+      unsigned int tmp = n1;
+      n1 = n2;
+      n2 = tmp;
+   }
+
+   return (size_t)n1 * (n1 - 1) / 2 + n2;
+}
+
 static void
 ra_add_node_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
 {
-   BITSET_SET(g->nodes[n1].adjacency, n2);
-
    assert(n1 != n2);
 
    int n1_class = g->nodes[n1].class;
@@ -404,7 +519,8 @@ ra_add_node_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
 
    if (g->nodes[n1].adjacency_count >=
        g->nodes[n1].adjacency_list_size) {
-      g->nodes[n1].adjacency_list_size *= 2;
+      g->nodes[n1].adjacency_list_size =
+         MAX2(g->nodes[n1].adjacency_list_size * 2, 4);
       g->nodes[n1].adjacency_list = reralloc(g, g->nodes[n1].adjacency_list,
                                              unsigned int,
                                              g->nodes[n1].adjacency_list_size);
@@ -425,20 +541,16 @@ ra_alloc_interference_graph(struct ra_regs *regs, unsigned int count)
    g->nodes = rzalloc_array(g, struct ra_node, count);
    g->count = count;
 
-   g->stack = rzalloc_array(g, unsigned int, count);
-
-   for (i = 0; i < count; i++) {
-      int bitset_count = BITSET_WORDS(count);
-      g->nodes[i].adjacency = rzalloc_array(g, BITSET_WORD, bitset_count);
+   g->adjacency = rzalloc_array(g, BITSET_WORD,
+                                BITSET_WORDS((size_t)count * count / 2));
 
-      g->nodes[i].adjacency_list_size = 4;
-      g->nodes[i].adjacency_list =
-         ralloc_array(g, unsigned int, g->nodes[i].adjacency_list_size);
-      g->nodes[i].adjacency_count = 0;
-      g->nodes[i].q_total = 0;
+   g->stack = rzalloc_array(g, unsigned int, count);
 
+   /* The adjacency lists are allocated when the first interference is
+    * added, since large shaders have many nodes that interfere with little.
+    */
+   for (i = 0; i < count; i++)
       g->nodes[i].reg = NO_REG;
-   }
 
    return g;
 }
@@ -464,9 +576,14 @@ void
 ra_add_node_interference(struct ra_graph *g,
                          unsigned int n1, unsigned int n2)
 {
-   if (n1 != n2 && !BITSET_TEST(g->nodes[n1].adjacency, n2)) {
-      ra_add_node_adjacency(g, n1, n2);
-      ra_add_node_adjacency(g, n2, n1);
+   if (n1 != n2) {
+      size_t bit = ra_adjacency_bit(n1, n2);
+
+      if (!BITSET_TEST(g->adjacency, bit)) {
+         BITSET_SET(g->adjacency, bit);
+         ra_add_node_adjacency(g, n1, n2);
+         ra_add_node_adjacency(g, n2, n1);
+      }
    }
 }
 
@@ -478,8 +595,43 @@ pq_test(struct ra_graph *g, unsigned int n)
    return g->nodes[n].q_total < g->regs->classes[n_class]->p;
 }
 
+/**
+ * The state of ra_simplify(), in terms of the nodes that haven't been pushed
+ * onto the stack yet and weren't assigned a register up front.
+ */
+struct ra_simplify_state {
+   /** The nodes still in the graph. */
+   BITSET_WORD *remaining;
+
+   /** The nodes still in the graph that pass the pq test. */
+   BITSET_WORD *worklist;
+
+   /** @{
+    * The node with the lowest q total for each word of \c remaining, or -1
+    * if the word is empty, for picking optimistic nodes without looking at
+    * every node.  Words with a node whose q total changed are marked dirty
+    * and looked at again the next time a node is picked.
+    */
+   int *min_q_node;
+   bool *min_q_dirty;
+   /** @} */
+};
+
+static void
+ra_simplify_state_remove(struct ra_simplify_state *state, unsigned int n)
+{
+   BITSET_CLEAR(state->remaining, n);
+   BITSET_CLEAR(state->worklist, n);
+   state->min_q_dirty[BITSET_BITWORD(n)] = true;
+}
+
+/**
+ * Removes node n from the graph by lowering the q totals of its neighbors
+ * that are still in it, and adds the neighbors that become trivially
+ * colorable to the worklist.
+ */
 static void
-decrement_q(struct ra_graph *g, unsigned int n)
+decrement_q(struct ra_graph *g, unsigned int n, struct ra_simplify_state *state)
 {
    unsigned int i;
    int n_class = g->nodes[n].class;
@@ -491,8 +643,88 @@ decrement_q(struct ra_graph *g, unsigned int n)
       if (!g->nodes[n2].in_stack) {
          assert(g->nodes[n2].q_total >= g->regs->classes[n2_class]->q[n_class]);
          g->nodes[n2].q_total -= g->regs->classes[n2_class]->q[n_class];
+
+         if (g->nodes[n2].reg == NO_REG) {
+            if (pq_test(g, n2))
+               BITSET_SET(state->worklist, n2);
+            state->min_q_dirty[BITSET_BITWORD(n2)] = true;
+         }
+      }
+   }
+}
+
+static void
+ra_push_node(struct ra_graph *g, unsigned int n,
+             struct ra_simplify_state *state)
+{
+   decrement_q(g, n, state);
+   g->stack[g->stack_count] = n;
+   g->stack_count++;
+   g->nodes[n].in_stack = true;
+   ra_simplify_state_remove(state, n);
+}
+
+/**
+ * Returns the highest-numbered node in the set below \p end, or -1 if there
+ * isn't any.
+ */
+static int
+ra_last_set_below(const BITSET_WORD *set, unsigned int end)
+{
+   unsigned int w;
+   BITSET_WORD word;
+
+   if (end == 0)
+      return -1;
+
+   w = BITSET_BITWORD(end - 1);
+   word = set[w] & (~0u >> (BITSET_WORDBITS - 1 - (end - 1) % BITSET_WORDBITS));
+
+   while (!word) {
+      if (w == 0)
+         return -1;
+      word = set[--w];
+   }
+
+   return w * BITSET_WORDBITS + util_last_bit(word) - 1;
+}
+
+/**
+ * Returns the remaining node with the lowest q total, preferring the
+ * highest-numbered one on ties like the passes in ra_simplify() do.
+ */
+static int
+ra_pick_optimistic_node(struct ra_graph *g, struct ra_simplify_state *state)
+{
+   unsigned int lowest_q_total = ~0;
+   int best = -1;
+   unsigned int w;
+
+   for (w = 0; w < BITSET_WORDS(g->count); w++) {
+      if (state->min_q_dirty[w]) {
+         BITSET_WORD word = state->remaining[w];
+         unsigned int word_q_total = ~0;
+
+         state->min_q_node[w] = -1;
+         while (word) {
+            int n = w * BITSET_WORDBITS + u_bit_scan(&word);
+
+            if (g->nodes[n].q_total <= word_q_total) {
+               state->min_q_node[w] = n;
+               word_q_total = g->nodes[n].q_total;
+            }
+         }
+         state->min_q_dirty[w] = false;
+      }
+
+      if (state->min_q_node[w] >= 0 &&
+          g->nodes[state->min_q_node[w]].q_total <= lowest_q_total) {
+         best = state->min_q_node[w];
+         lowest_q_total = g->nodes[best].q_total;
       }
    }
+
+   return best;
 }
 
 /**
@@ -504,69 +736,70 @@ decrement_q(struct ra_graph *g, unsigned int n)
  * we optimistically choose a node and push it on the stack. We heuristically
  * push the node with the lowest total q value, since it has the fewest
  * neighbors and therefore is most likely to be allocated.
+ *
+ * The nodes are visited in passes from the highest-numbered down, and a
+ * node that only becomes trivially colorable once the pass is below it is
+ * left for the next pass.  Rather than testing every node on every pass,
+ * the nodes that pass the pq test are kept in a worklist, so each step
+ * only has to find the next one below the current position.
  */
 static void
 ra_simplify(struct ra_graph *g)
 {
-   bool progress = true;
    unsigned int stack_optimistic_start = UINT_MAX;
-   int i;
-
-   while (progress) {
-      unsigned int best_optimistic_node = ~0;
-      unsigned int lowest_q_total = ~0;
-
-      progress = false;
-
-      for (i = g->count - 1; i >= 0; i--) {
-	 if (g->nodes[i].in_stack || g->nodes[i].reg != NO_REG)
-	    continue;
-
-	 if (pq_test(g, i)) {
-	    decrement_q(g, i);
-	    g->stack[g->stack_count] = i;
-	    g->stack_count++;
-	    g->nodes[i].in_stack = true;
-	    progress = true;
-	 } else {
-	    unsigned int new_q_total = g->nodes[i].q_total;
-	    if (new_q_total < lowest_q_total) {
-	       best_optimistic_node = i;
-	       lowest_q_total = new_q_total;
-	    }
-	 }
-      }
+   unsigned int words = BITSET_WORDS(g->count);
+   struct ra_simplify_state state;
+   unsigned int remaining_count = 0;
+   unsigned int pass_start = g->count;
+   bool progress = false;
+   unsigned int i;
 
-      if (!progress && best_optimistic_node != ~0U) {
-         if (stack_optimistic_start == UINT_MAX)
-            stack_optimistic_start = g->stack_count;
+   state.remaining = calloc(words * 2, sizeof(BITSET_WORD));
+   state.worklist = state.remaining + words;
+   state.min_q_node = malloc(words * sizeof(int));
+   state.min_q_dirty = malloc(words * sizeof(bool));
+   memset(state.min_q_dirty, true, words * sizeof(bool));
 
-	 decrement_q(g, best_optimistic_node);
-	 g->stack[g->stack_count] = best_optimistic_node;
-	 g->stack_count++;
-	 g->nodes[best_optimistic_node].in_stack = true;
-	 progress = true;
-      }
+   for (i = 0; i < g->count; i++) {
+      if (g->nodes[i].in_stack || g->nodes[i].reg != NO_REG)
+         continue;
+
+      BITSET_SET(state.remaining, i);
+      remaining_count++;
+      if (pq_test(g, i))
+         BITSET_SET(state.worklist, i);
    }
 
-   g->stack_optimistic_start = stack_optimistic_start;
-}
+   for (; remaining_count > 0; remaining_count--) {
+      int n = ra_last_set_below(state.worklist, pass_start);
 
-static bool
-ra_any_neighbors_conflict(struct ra_graph *g, unsigned int n, unsigned int r)
-{
-   unsigned int i;
+      if (n < 0 && progress) {
+         /* Start another pass from the top. */
+         n = ra_last_set_below(state.worklist, g->count);
+      }
 
-   for (i = 0; i < g->nodes[n].adjacency_count; i++) {
-      unsigned int n2 = g->nodes[n].adjacency_list[i];
+      if (n >= 0) {
+         progress = true;
+         pass_start = n;
+      } else {
+         n = ra_pick_optimistic_node(g, &state);
 
-      if (!g->nodes[n2].in_stack &&
-          BITSET_TEST(g->regs->regs[r].conflicts, g->nodes[n2].reg)) {
-         return true;
+         if (stack_optimistic_start == UINT_MAX)
+            stack_optimistic_start = g->stack_count;
+
+         /* The next pass starts over from the top. */
+         progress = false;
+         pass_start = g->count;
       }
+
+      ra_push_node(g, n, &state);
    }
 
-   return false;
+   free(state.remaining);
+   free(state.min_q_node);
+   free(state.min_q_dirty);
+
+   g->stack_optimistic_start = stack_optimistic_start;
 }
 
 /* Computes a bitfield of what regs are available for a given register
@@ -579,24 +812,25 @@ static bool
 ra_compute_available_regs(struct ra_graph *g, unsigned int n, BITSET_WORD *regs)
 {
    struct ra_class *c = g->regs->classes[g->nodes[n].class];
+   const unsigned int start = c->regs_start_word, end = c->regs_end_word;
 
    /* Populate with the set of regs that are in the node's class. */
    memcpy(regs, c->regs, BITSET_WORDS(g->regs->count) * sizeof(BITSET_WORD));
 
    /* Remove any regs that conflict with nodes that we're adjacent to and have
-    * already colored.
+    * already colored.  Words outside of the class are already empty.
     */
    for (int i = 0; i < g->nodes[n].adjacency_count; i++) {
       unsigned int n2 = g->nodes[n].adjacency_list[i];
       unsigned int r = g->nodes[n2].reg;
 
       if (!g->nodes[n2].in_stack) {
-         for (int j = 0; j < BITSET_WORDS(g->regs->count); j++)
+         for (unsigned int j = start; j < end; j++)
             regs[j] &= ~g->regs->regs[r].conflicts[j];
       }
    }
 
-   for (int i = 0; i < BITSET_WORDS(g->regs->count); i++) {
+   for (unsigned int i = start; i < end; i++) {
       if (regs[i])
          return true;
    }
@@ -604,6 +838,33 @@ ra_compute_available_regs(struct ra_graph *g, unsigned int n, BITSET_WORD *regs)
    return false;
 }
 
+/**
+ * Returns the first register in the set at or after \p start, wrapping
+ * around to the start of the set, or NO_REG if it is empty.
+ */
+static unsigned int
+ra_find_reg_from(const BITSET_WORD *regs, unsigned int count,
+                 unsigned int start)
+{
+   const unsigned int words = BITSET_WORDS(count);
+   unsigned int w;
+
+   if (start >= count)
+      start = 0;
+
+   w = BITSET_BITWORD(start);
+   if (regs[w] & ~(BITSET_BIT(start) - 1))
+      return w * BITSET_WORDBITS + ffs(regs[w] & ~(BITSET_BIT(start) - 1)) - 1;
+
+   for (unsigned int i = 1; i <= words; i++) {
+      unsigned int word = (w + i) % words;
+      if (regs[word])
+         return word * BITSET_WORDBITS + ffs(regs[word]) - 1;
+   }
+
+   return NO_REG;
+}
+
 /**
  * Pops nodes from the stack back into the graph, coloring them with
  * registers as they go.
@@ -615,44 +876,31 @@ static bool
 ra_select(struct ra_graph *g)
 {
    int start_search_reg = 0;
-   BITSET_WORD *select_regs = NULL;
+   BITSET_WORD *select_regs;
 
-   if (g->select_reg_callback)
-      select_regs = malloc(BITSET_WORDS(g->regs->count) * sizeof(BITSET_WORD));
+   select_regs = malloc(BITSET_WORDS(g->regs->count) * sizeof(BITSET_WORD));
 
    while (g->stack_count != 0) {
-      unsigned int ri;
-      unsigned int r = -1;
+      unsigned int r;
       int n = g->stack[g->stack_count - 1];
-      struct ra_class *c = g->regs->classes[g->nodes[n].class];
 
       /* set this to false even if we return here so that
        * ra_get_best_spill_node() considers this node later.
        */
       g->nodes[n].in_stack = false;
 
-      if (g->select_reg_callback) {
-         if (!ra_compute_available_regs(g, n, select_regs)) {
-            free(select_regs);
-            return false;
-         }
+      if (!ra_compute_available_regs(g, n, select_regs)) {
+         free(select_regs);
+         return false;
+      }
 
+      if (g->select_reg_callback) {
          r = g->select_reg_callback(g, select_regs, g->select_reg_callback_data);
       } else {
          /* Find the lowest-numbered reg which is not used by a member
           * of the graph adjacent to us.
           */
-         for (ri = 0; ri < g->regs->count; ri++) {
-            r = (start_search_reg + ri) % g->regs->count;
-            if (!reg_belongs_to_class(r, c))
-               continue;
-
-            if (!ra_any_neighbors_conflict(g, n, r))
-               break;
-         }
-
-         if (ri >= g->regs->count)
-            return false;
+         r = ra_find_reg_from(select_regs, g->regs->count, start_search_reg);
       }
 
       g->nodes[n].reg = r;
@@ -677,9 +925,116 @@ ra_select(struct ra_graph *g)
    return true;
 }
 
+/**
+ * Writes the register set and the interference graph as text, in the
+ * format that src/util/tests/register_allocate/ra_bench.c replays.
+ *
+ * Register conflicts and interferences are symmetric, so each one is only
+ * listed once, with the higher-numbered register or node.
+ */
+void
+ra_dump_graph(struct ra_graph *g, FILE *fp)
+{
+   struct ra_regs *regs = g->regs;
+   unsigned int i, j, count;
+
+   fprintf(fp, "ra_graph 1\nregs %u %u %u\n", regs->count, regs->round_robin,
+           regs->class_count);
+
+   for (i = 0; i < regs->count; i++) {
+      count = 0;
+      for (j = i + 1; j < regs->count; j++)
+         count += !!BITSET_TEST(regs->regs[i].conflicts, j);
+
+      fprintf(fp, "r %u %u", i, count);
+      for (j = i + 1; j < regs->count; j++) {
+         if (BITSET_TEST(regs->regs[i].conflicts, j))
+            fprintf(fp, " %u", j);
+      }
+      fprintf(fp, "\n");
+   }
+
+   for (i = 0; i < regs->class_count; i++) {
+      struct ra_class *c = regs->classes[i];
+
+      count = 0;
+      for (j = 0; j < regs->count; j++)
+         count += reg_belongs_to_class(j, c);
+
+      fprintf(fp, "c %u %u", i, count);
+      for (j = 0; j < regs->count; j++) {
+         if (reg_belongs_to_class(j, c))
+            fprintf(fp, " %u", j);
+      }
+      fprintf(fp, "\nq");
+      for (j = 0; j < regs->class_count; j++)
+         fprintf(fp, " %u", c->q[j]);
+      fprintf(fp, "\n");
+   }
+
+   fprintf(fp, "nodes %u\n", g->count);
+   for (i = 0; i < g->count; i++) {
+      struct ra_node *node = &g->nodes[i];
+
+      count = 0;
+      for (j = 0; j < node->adjacency_count; j++)
+         count += node->adjacency_list[j] > i;
+
+      fprintf(fp, "n %u %u %d %.9g %u", i, node->class,
+              node->reg == NO_REG ? -1 : (int)node->reg, node->spill_cost,
+              count);
+      for (j = 0; j < node->adjacency_count; j++) {
+         if (node->adjacency_list[j] > i)
+            fprintf(fp, " %u", node->adjacency_list[j]);
+      }
+      fprintf(fp, "\n");
+   }
+}
+
+/**
+ * Writes every graph that gets allocated to a file of its own in the
+ * directory named by MESA_RA_RECORD_DIR, to collect graphs from real
+ * applications for benchmarking the allocator.
+ */
+static once_flag ra_record_once_flag = ONCE_FLAG_INIT;
+static const char *ra_record_dir;
+static int64_t ra_record_start_time;
+
+static void
+ra_record_init(void)
+{
+   ra_record_dir = getenv("MESA_RA_RECORD_DIR");
+   ra_record_start_time = os_time_get_nano();
+}
+
+static void
+ra_record_graph(struct ra_graph *g)
+{
+   static unsigned int graph_count;
+   char *path;
+   FILE *fp;
+
+   /* Allocation runs on compiler threads too */
+   call_once(&ra_record_once_flag, ra_record_init);
+
+   if (!ra_record_dir)
+      return;
+
+   path = ralloc_asprintf(NULL, "%s/ra-%" PRId64 "-%u.txt", ra_record_dir,
+                          ra_record_start_time,
+                          p_atomic_inc_return(&graph_count));
+   fp = fopen(path, "w");
+   if (fp) {
+      ra_dump_graph(g, fp);
+      fclose(fp);
+   }
+   ralloc_free(path);
+}
+
 bool
 ra_allocate(struct ra_graph *g)
 {
+   ra_record_graph(g);
    ra_simplify(g);
    return ra_select(g);
 }
@@ -29,6 +29,8 @@
 #define REGISTER_ALLOCATE_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include "util/bitset.h"
 
 #ifdef __cplusplus
@@ -39,6 +41,15 @@ extern "C" {
 struct ra_class;
 struct ra_regs;
 
+/**
+ * A register made of the units [start, start + count), such as a block of
+ * contiguous hardware registers.  See ra_add_range_conflicts().
+ */
+struct ra_reg_range {
+   uint16_t start;
+   uint16_t count;
+};
+
 /* @{
  * Register set setup.
  *
@@ -56,6 +67,8 @@ void ra_add_reg_conflict(struct ra_regs *regs,
 void ra_add_transitive_reg_conflict(struct ra_regs *regs,
 				    unsigned int base_reg, unsigned int reg);
 void ra_make_reg_conflicts_transitive(struct ra_regs *regs, unsigned int reg);
+void ra_add_range_conflicts(struct ra_regs *regs,
+                            const struct ra_reg_range *ranges);
 void ra_class_add_reg(struct ra_regs *regs, unsigned int c, unsigned int reg);
 void ra_set_num_conflicts(struct ra_regs *regs, unsigned int class_a,
                           unsigned int class_b, unsigned int num_conflicts);
@@ -93,6 +106,8 @@ void ra_set_node_spill_cost(struct ra_graph *g, unsigned int n, float cost);
 int ra_get_best_spill_node(struct ra_graph *g);
 /** @} */
 
+void ra_dump_graph(struct ra_graph *g, FILE *fp);
+
 
 #ifdef __cplusplus
 }  // extern "C"
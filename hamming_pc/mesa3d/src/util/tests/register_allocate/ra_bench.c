@@ -0,0 +1,477 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Replays interference graphs through the register allocator, checks that
+ * every successful allocation is a valid coloring, and reports how long it
+ * took to build the graphs and to color them.
+ *
+ * The graphs are the files given on the command line, as written by
+ * ra_dump_graph() (running a driver with MESA_RA_RECORD_DIR set records
+ * one file per ra_allocate() call), or, without any, a set of random graphs
+ * of overlapping live ranges over a register set laid out like the Intel
+ * FS one:
+ *
+ *    ra_bench [-n <random graphs>] [-r <repeats>] [-v] [graph...]
+ *
+ * With -v a hash of each graph's assignment is printed, which makes it easy
+ * to check that two versions of the allocator color the graphs the same way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/bitset.h"
+#include "util/macros.h"
+#include "util/os_time.h"
+#include "util/ralloc.h"
+#include "util/register_allocate.h"
+
+struct bench_graph {
+   struct ra_regs *regs;
+
+   /* Which registers conflict, as a reg_count x reg_count bit matrix. */
+   unsigned reg_count;
+   BITSET_WORD *conflicts;
+
+   unsigned node_count;
+   unsigned *node_class;
+   unsigned *node_reg;
+   float *spill_cost;
+
+   /* Interferences as pairs of nodes. */
+   unsigned *edges;
+   unsigned edge_count;
+};
+
+struct stats {
+   unsigned graphs;
+   unsigned nodes;
+   unsigned edges;
+   unsigned failed;
+   int64_t build;
+   int64_t allocate;
+};
+
+static void
+add_conflict(struct bench_graph *bg, unsigned r1, unsigned r2)
+{
+   BITSET_SET(bg->conflicts, r1 * bg->reg_count + r2);
+   BITSET_SET(bg->conflicts, r2 * bg->reg_count + r1);
+}
+
+static bool
+read_list(FILE *fp, unsigned count, unsigned *list)
+{
+   for (unsigned i = 0; i < count; i++) {
+      if (fscanf(fp, "%u", &list[i]) != 1)
+         return false;
+   }
+   return true;
+}
+
+/* Reads a graph in the format written by ra_dump_graph(). */
+static bool
+load_graph(void *mem_ctx, const char *path, struct bench_graph *bg)
+{
+   FILE *fp = fopen(path, "r");
+   unsigned version, reg_count, round_robin, class_count, count;
+   unsigned *list;
+   bool ok = false;
+
+   if (!fp) {
+      fprintf(stderr, "Failed to open %s\n", path);
+      return false;
+   }
+
+   if (fscanf(fp, " ra_graph %u", &version) != 1 || version != 1 ||
+       fscanf(fp, " regs %u %u %u", &reg_count, &round_robin,
+              &class_count) != 3)
+      goto out;
+
+   list = ralloc_array(mem_ctx, unsigned, reg_count);
+   bg->regs = ra_alloc_reg_set(mem_ctx, reg_count, false);
+   bg->reg_count = reg_count;
+   bg->conflicts = rzalloc_array(mem_ctx, BITSET_WORD,
+                                 BITSET_WORDS(reg_count * reg_count));
+   if (round_robin)
+      ra_set_allocate_round_robin(bg->regs);
+
+   for (unsigned r = 0; r < reg_count; r++) {
+      unsigned reg;
+      if (fscanf(fp, " r %u %u", &reg, &count) != 2 || reg != r ||
+          count > reg_count || !read_list(fp, count, list))
+         goto out;
+      for (unsigned i = 0; i < count; i++) {
+         if (list[i] >= reg_count)
+            goto out;
+         ra_add_reg_conflict(bg->regs, r, list[i]);
+         add_conflict(bg, r, list[i]);
+      }
+   }
+
+   unsigned **q_values = ralloc_array(mem_ctx, unsigned *, class_count);
+   for (unsigned c = 0; c < class_count; c++) {
+      unsigned class;
+      if (fscanf(fp, " c %u %u", &class, &count) != 2 || class != c ||
+          count > reg_count || !read_list(fp, count, list))
+         goto out;
+      ra_alloc_reg_class(bg->regs);
+      for (unsigned i = 0; i < count; i++) {
+         if (list[i] >= reg_count)
+            goto out;
+         ra_class_add_reg(bg->regs, c, list[i]);
+      }
+
+      q_values[c] = ralloc_array(q_values, unsigned, class_count);
+      if (fscanf(fp, " q") != 0 || !read_list(fp, class_count, q_values[c]))
+         goto out;
+   }
+   ra_set_finalize(bg->regs, q_values);
+
+   if (fscanf(fp, " nodes %u", &bg->node_count) != 1)
+      goto out;
+
+   bg->node_class = ralloc_array(mem_ctx, unsigned, bg->node_count);
+   bg->node_reg = ralloc_array(mem_ctx, unsigned, bg->node_count);
+   bg->spill_cost = ralloc_array(mem_ctx, float, bg->node_count);
+   bg->edges = NULL;
+   bg->edge_count = 0;
+
+   unsigned edges_size = 0;
+   list = reralloc(mem_ctx, list, unsigned, bg->node_count);
+   for (unsigned n = 0; n < bg->node_count; n++) {
+      unsigned node;
+      int reg;
+      if (fscanf(fp, " n %u %u %d %f %u", &node, &bg->node_class[n], &reg,
+                 &bg->spill_cost[n], &count) != 5 || node != n ||
+          bg->node_class[n] >= class_count || count > bg->node_count ||
+          !read_list(fp, count, list) ||
+          (reg >= 0 && (unsigned)reg >= reg_count))
+         goto out;
+      bg->node_reg[n] = reg;
+
+      if (bg->edge_count + count > edges_size) {
+         edges_size = MAX2(edges_size * 2, bg->edge_count + count);
+         bg->edges = reralloc(mem_ctx, bg->edges, unsigned, edges_size * 2);
+      }
+      for (unsigned i = 0; i < count; i++) {
+         if (list[i] >= bg->node_count)
+            goto out;
+         bg->edges[bg->edge_count * 2 + 0] = n;
+         bg->edges[bg->edge_count * 2 + 1] = list[i];
+         bg->edge_count++;
+      }
+   }
+   ok = true;
+
+out:
+   if (!ok)
+      fprintf(stderr, "%s is not a register allocation graph\n", path);
+   fclose(fp);
+   return ok;
+}
+
+/* A register set like the Intel FS one on gen7+: 128 GRFs and a class for
+ * each size of contiguous block from 1 to 16 registers.
+ */
+static void
+create_fs_like_regs(void *mem_ctx, struct bench_graph *bg)
+{
+   const unsigned base_reg_count = 128, class_count = 16;
+   unsigned reg_count = 0;
+
+   for (unsigned i = 0; i < class_count; i++)
+      reg_count += base_reg_count - i;
+
+   struct ra_regs *regs = ra_alloc_reg_set(mem_ctx, reg_count, false);
+   ra_set_allocate_round_robin(regs);
+
+   unsigned *first_grf = ralloc_array(mem_ctx, unsigned, reg_count);
+   unsigned *last_grf = ralloc_array(mem_ctx, unsigned, reg_count);
+
+   unsigned **q_values = ralloc_array(mem_ctx, unsigned *, class_count);
+   unsigned reg = 0;
+   for (unsigned i = 0; i < class_count; i++) {
+      unsigned c = ra_alloc_reg_class(regs);
+
+      q_values[i] = ralloc_array(q_values, unsigned, class_count);
+      for (unsigned j = 0; j < class_count; j++)
+         q_values[i][j] = (i + 1) + (j + 1) - 1;
+
+      for (unsigned j = 0; j < base_reg_count - i; j++) {
+         ra_class_add_reg(regs, c, reg);
+         first_grf[reg] = j;
+         last_grf[reg] = j + i;
+         for (unsigned base_reg = j; base_reg <= j + i; base_reg++)
+            ra_add_reg_conflict(regs, base_reg, reg);
+         reg++;
+      }
+   }
+
+   for (unsigned r = 0; r < base_reg_count; r++)
+      ra_make_reg_conflicts_transitive(regs, r);
+
+   ra_set_finalize(regs, q_values);
+   ralloc_free(q_values);
+
+   bg->regs = regs;
+   bg->reg_count = reg_count;
+   bg->conflicts = rzalloc_array(mem_ctx, BITSET_WORD,
+                                 BITSET_WORDS(reg_count * reg_count));
+   for (unsigned r1 = 0; r1 < reg_count; r1++) {
+      for (unsigned r2 = 0; r2 < reg_count; r2++) {
+         if (first_grf[r1] <= last_grf[r2] && first_grf[r2] <= last_grf[r1])
+            BITSET_SET(bg->conflicts, r1 * reg_count + r2);
+      }
+   }
+
+   ralloc_free(first_grf);
+   ralloc_free(last_grf);
+}
+
+/* Random live ranges over a program of a few thousand instructions, mostly
+ * scalars with some vectors and texture results, where every pair of
+ * overlapping ranges interferes.  The first few nodes are precolored to the
+ * payload registers.
+ */
+static void
+create_random_graph(void *mem_ctx, const struct bench_graph *regs,
+                    unsigned seed, struct bench_graph *bg)
+{
+   static const unsigned sizes[] = {
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 4, 4, 8
+   };
+   const unsigned payload = 4;
+
+   srand(seed);
+
+   unsigned node_count = 500 + rand() % 4000;
+   unsigned length = node_count * (2 + rand() % 4);
+   unsigned *start = ralloc_array(mem_ctx, unsigned, node_count);
+   unsigned *end = ralloc_array(mem_ctx, unsigned, node_count);
+
+   bg->regs = regs->regs;
+   bg->reg_count = regs->reg_count;
+   bg->conflicts = regs->conflicts;
+   bg->node_count = node_count;
+   bg->node_class = ralloc_array(mem_ctx, unsigned, node_count);
+   bg->node_reg = ralloc_array(mem_ctx, unsigned, node_count);
+   bg->spill_cost = ralloc_array(mem_ctx, float, node_count);
+
+   /* Nodes are numbered in order of their definitions, like VGRFs. */
+   unsigned ip = 0;
+   for (unsigned n = 0; n < node_count; n++) {
+      if (n < payload) {
+         start[n] = 0;
+         bg->node_class[n] = 0;
+         bg->node_reg[n] = n;
+      } else {
+         ip += rand() % 2;
+         start[n] = MIN2(ip, length - 1);
+         bg->node_class[n] = sizes[rand() % ARRAY_SIZE(sizes)] - 1;
+         bg->node_reg[n] = ~0u;
+      }
+
+      unsigned live = rand() % 8 ? 1 + rand() % 12 : 1 + rand() % (40 + seed * 10);
+      end[n] = MIN2(start[n] + live, length);
+      bg->spill_cost[n] = (float)(end[n] - start[n]);
+   }
+
+   unsigned edges_size = node_count * 16;
+   bg->edges = ralloc_array(mem_ctx, unsigned, edges_size * 2);
+   bg->edge_count = 0;
+
+   for (unsigned i = 0; i < node_count; i++) {
+      for (unsigned j = i + 1; j < node_count && start[j] < end[i]; j++) {
+         if (bg->edge_count == edges_size) {
+            edges_size *= 2;
+            bg->edges = reralloc(mem_ctx, bg->edges, unsigned,
+                                 edges_size * 2);
+         }
+         bg->edges[bg->edge_count * 2 + 0] = i;
+         bg->edges[bg->edge_count * 2 + 1] = j;
+         bg->edge_count++;
+      }
+   }
+
+   ralloc_free(start);
+   ralloc_free(end);
+}
+
+static struct ra_graph *
+build_graph(const struct bench_graph *bg)
+{
+   struct ra_graph *g = ra_alloc_interference_graph(bg->regs, bg->node_count);
+
+   for (unsigned n = 0; n < bg->node_count; n++) {
+      ra_set_node_class(g, n, bg->node_class[n]);
+      if (bg->node_reg[n] != ~0u)
+         ra_set_node_reg(g, n, bg->node_reg[n]);
+      ra_set_node_spill_cost(g, n, bg->spill_cost[n]);
+   }
+
+   for (unsigned i = 0; i < bg->edge_count; i++)
+      ra_add_node_interference(g, bg->edges[i * 2], bg->edges[i * 2 + 1]);
+
+   return g;
+}
+
+/* Returns false if the assignment isn't a valid coloring of the graph. */
+static bool
+check_graph(const struct bench_graph *bg, struct ra_graph *g,
+            uint32_t *hash)
+{
+   const unsigned hash_prime = 16777619;
+   bool ok = true;
+
+   for (unsigned n = 0; n < bg->node_count; n++)
+      *hash = (*hash ^ ra_get_node_reg(g, n)) * hash_prime;
+
+   for (unsigned n = 0; n < bg->node_count; n++) {
+      if (bg->node_reg[n] != ~0u && ra_get_node_reg(g, n) != bg->node_reg[n]) {
+         fprintf(stderr, "precolored node %u moved to register %u\n",
+                 n, ra_get_node_reg(g, n));
+         ok = false;
+      }
+   }
+
+   for (unsigned i = 0; i < bg->edge_count; i++) {
+      unsigned a = bg->edges[i * 2], b = bg->edges[i * 2 + 1];
+      unsigned ra = ra_get_node_reg(g, a), rb = ra_get_node_reg(g, b);
+      if (BITSET_TEST(bg->conflicts, ra * bg->reg_count + rb)) {
+         fprintf(stderr, "interfering nodes %u and %u got conflicting "
+                 "registers %u and %u\n", a, b, ra, rb);
+         ok = false;
+      }
+   }
+
+   return ok;
+}
+
+static bool
+run_graph(const char *name, const struct bench_graph *bg, unsigned repeats,
+          bool verbose, struct stats *stats)
+{
+   uint32_t hash = 2166136261u;
+   bool colored = false, ok = true;
+
+   for (unsigned r = 0; r < repeats; r++) {
+      int64_t t0 = os_time_get_nano();
+      struct ra_graph *g = build_graph(bg);
+      int64_t t1 = os_time_get_nano();
+      colored = ra_allocate(g);
+      int64_t t2 = os_time_get_nano();
+
+      stats->build += t1 - t0;
+      stats->allocate += t2 - t1;
+
+      if (r == 0) {
+         if (colored)
+            ok = check_graph(bg, g, &hash);
+         else
+            hash = ra_get_best_spill_node(g);
+      }
+
+      ralloc_free(g);
+   }
+
+   stats->graphs++;
+   stats->nodes += bg->node_count;
+   stats->edges += bg->edge_count;
+   stats->failed += !colored;
+
+   if (verbose) {
+      printf("%s: %u nodes, %u edges, %s %08x\n", name, bg->node_count,
+             bg->edge_count, colored ? "colored" : "spill", hash);
+   }
+
+   return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned random_graphs = 20, repeats = 3;
+   bool verbose = false;
+   struct stats stats = { 0 };
+   bool ok = true;
+   int i;
+
+   for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+      if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+         random_graphs = atoi(argv[++i]);
+      } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+         repeats = atoi(argv[++i]);
+      } else if (!strcmp(argv[i], "-v")) {
+         verbose = true;
+      } else {
+         fprintf(stderr, "usage: %s [-n <random graphs>] [-r <repeats>] [-v] "
+                 "[graph...]\n", argv[0]);
+         return 1;
+      }
+   }
+
+   repeats = MAX2(repeats, 1);
+
+   if (i < argc) {
+      for (; i < argc; i++) {
+         void *mem_ctx = ralloc_context(NULL);
+         struct bench_graph bg;
+
+         if (load_graph(mem_ctx, argv[i], &bg))
+            ok &= run_graph(argv[i], &bg, repeats, verbose, &stats);
+         else
+            ok = false;
+
+         ralloc_free(mem_ctx);
+      }
+   } else {
+      void *regs_ctx = ralloc_context(NULL);
+      struct bench_graph regs;
+
+      create_fs_like_regs(regs_ctx, &regs);
+
+      for (unsigned g = 0; g < random_graphs; g++) {
+         void *mem_ctx = ralloc_context(NULL);
+         struct bench_graph bg;
+         char name[32];
+
+         snprintf(name, sizeof(name), "random %u", g);
+         create_random_graph(mem_ctx, &regs, g, &bg);
+         ok &= run_graph(name, &bg, repeats, verbose, &stats);
+
+         ralloc_free(mem_ctx);
+      }
+
+      ralloc_free(regs_ctx);
+   }
+
+   printf("%u graphs, %u nodes, %u edges, %u needed spilling\n",
+          stats.graphs, stats.nodes, stats.edges, stats.failed);
+   printf("build:    %8.3f ms\n", stats.build / 1e6 / repeats);
+   printf("allocate: %8.3f ms\n", stats.allocate / 1e6 / repeats);
+
+   return ok ? 0 : 1;
+}
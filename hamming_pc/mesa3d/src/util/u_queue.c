@@ -230,6 +230,95 @@ struct thread_input {
    int thread_index;
 };
 
+static void
+lane_push(struct util_queue_lane *lane, const struct util_queue_job *job)
+{
+   if (lane->write_idx - lane->read_idx == lane->size) {
+      /* The lane is full, make it larger. How many jobs can be queued is
+       * limited by util_queue::max_jobs, not by the size of the lanes.
+       */
+      unsigned new_size = lane->size * 2;
+      struct util_queue_job *jobs =
+         (struct util_queue_job*)calloc(new_size,
+                                        sizeof(struct util_queue_job));
+      assert(jobs);
+
+      for (unsigned i = lane->read_idx; i != lane->write_idx; i++)
+         jobs[i & (new_size - 1)] = lane->jobs[i & (lane->size - 1)];
+
+      free(lane->jobs);
+      lane->jobs = jobs;
+      lane->size = new_size;
+   }
+
+   lane->jobs[lane->write_idx & (lane->size - 1)] = *job;
+   p_atomic_set(&lane->write_idx, lane->write_idx + 1);
+}
+
+static bool
+lane_is_empty(struct util_queue_lane *lane)
+{
+   return p_atomic_read(&lane->write_idx) == p_atomic_read(&lane->read_idx);
+}
+
+/* Takes the oldest job of the highest priority, looking at the lanes of
+ * thread_index first and at the lanes of the other threads after that.
+ */
+static bool
+get_job(struct util_queue *queue, int thread_index,
+        struct util_queue_job *job, enum util_queue_priority *priority,
+        bool *stolen)
+{
+   for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES; p++) {
+      for (unsigned i = 0; i < queue->num_threads; i++) {
+         unsigned victim = (thread_index + i) % queue->num_threads;
+         struct util_queue_thread *thread = &queue->per_thread[victim];
+         struct util_queue_lane *lane = &thread->lanes[p];
+
+         /* Don't bother with the lock if there is nothing to take. */
+         if (lane_is_empty(lane))
+            continue;
+
+         mtx_lock(&thread->lock);
+         if (lane->read_idx != lane->write_idx) {
+            struct util_queue_job *ptr =
+               &lane->jobs[lane->read_idx & (lane->size - 1)];
+
+            *job = *ptr;
+            memset(ptr, 0, sizeof(*ptr));
+            p_atomic_set(&lane->read_idx, lane->read_idx + 1);
+            mtx_unlock(&thread->lock);
+
+            *priority = p;
+            *stolen = victim != thread_index;
+            return true;
+         }
+         mtx_unlock(&thread->lock);
+      }
+   }
+
+   return false;
+}
+
+static void
+update_stats(struct util_queue_thread *thread,
+             const struct util_queue_job *job,
+             enum util_queue_priority priority, bool stolen,
+             int64_t start_time, int64_t end_time)
+{
+   uint64_t wait = MAX2(start_time - job->add_time, 0);
+
+   mtx_lock(&thread->lock);
+   thread->stats.num_jobs[priority]++;
+   thread->stats.total_wait_nano[priority] += wait;
+   thread->stats.max_wait_nano[priority] =
+      MAX2(thread->stats.max_wait_nano[priority], wait);
+   thread->stats.total_execute_nano += end_time - start_time;
+   if (stolen)
+      thread->stats.num_stolen++;
+   mtx_unlock(&thread->lock);
+}
+
 static int
 util_queue_thread_func(void *input)
 {
@@ -246,47 +335,47 @@ util_queue_thread_func(void *input)
 
    while (1) {
       struct util_queue_job job;
+      enum util_queue_priority priority;
+      bool stolen;
 
-      mtx_lock(&queue->lock);
-      assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
-
-      /* wait if the queue is empty */
-      while (!queue->kill_threads && queue->num_queued == 0)
-         cnd_wait(&queue->has_queued_cond, &queue->lock);
+      if (p_atomic_read(&queue->kill_threads))
+         break;
 
-      if (queue->kill_threads) {
+      if (!get_job(queue, thread_index, &job, &priority, &stolen)) {
+         /* Wait until a job is added. num_queued is incremented after a job
+          * is added to a lane, and num_idle is checked after that, so either
+          * we see the job here or the thread adding it sees us waiting.
+          */
+         mtx_lock(&queue->lock);
+         p_atomic_inc(&queue->num_idle);
+         while (!queue->kill_threads && p_atomic_read(&queue->num_queued) == 0)
+            cnd_wait(&queue->has_queued_cond, &queue->lock);
+         p_atomic_dec(&queue->num_idle);
          mtx_unlock(&queue->lock);
-         break;
+         continue;
       }
 
-      job = queue->jobs[queue->read_idx];
-      memset(&queue->jobs[queue->read_idx], 0, sizeof(struct util_queue_job));
-      queue->read_idx = (queue->read_idx + 1) % queue->max_jobs;
-
-      queue->num_queued--;
-      cnd_signal(&queue->has_space_cond);
-      mtx_unlock(&queue->lock);
+      p_atomic_dec(&queue->num_queued);
+      if (p_atomic_read(&queue->num_waiting_for_space)) {
+         mtx_lock(&queue->lock);
+         cnd_signal(&queue->has_space_cond);
+         mtx_unlock(&queue->lock);
+      }
 
+      /* Dropped jobs are cleared and treated as no-ops. */
       if (job.job) {
+         int64_t start_time = os_time_get_nano();
+
          job.execute(job.job, thread_index);
          util_queue_fence_signal(job.fence);
          if (job.cleanup)
             job.cleanup(job.job, thread_index);
-      }
-   }
 
-   /* signal remaining jobs before terminating */
-   mtx_lock(&queue->lock);
-   for (unsigned i = queue->read_idx; i != queue->write_idx;
-        i = (i + 1) % queue->max_jobs) {
-      if (queue->jobs[i].job) {
-         util_queue_fence_signal(queue->jobs[i].fence);
-         queue->jobs[i].job = NULL;
+         update_stats(&queue->per_thread[thread_index], &job, priority,
+                      stolen, start_time, os_time_get_nano());
       }
    }
-   queue->read_idx = queue->write_idx;
-   queue->num_queued = 0;
-   mtx_unlock(&queue->lock);
+
    return 0;
 }
 
@@ -297,7 +386,7 @@ util_queue_init(struct util_queue *queue,
                 unsigned num_threads,
                 unsigned flags)
 {
-   unsigned i;
+   unsigned i, lane_size;
 
    memset(queue, 0, sizeof(*queue));
    queue->name = name;
@@ -305,17 +394,37 @@ util_queue_init(struct util_queue *queue,
    queue->num_threads = num_threads;
    queue->max_jobs = max_jobs;
 
-   queue->jobs = (struct util_queue_job*)
-                 calloc(max_jobs, sizeof(struct util_queue_job));
-   if (!queue->jobs)
-      goto fail;
-
    (void) mtx_init(&queue->lock, mtx_plain);
 
    queue->num_queued = 0;
    cnd_init(&queue->has_queued_cond);
    cnd_init(&queue->has_space_cond);
 
+   /* Jobs are spread over the lanes of all threads. */
+   lane_size = 4;
+   while (lane_size * num_threads < max_jobs)
+      lane_size *= 2;
+
+   queue->per_thread = (struct util_queue_thread*)
+                       calloc(num_threads, sizeof(struct util_queue_thread));
+   if (!queue->per_thread)
+      goto fail;
+   queue->num_per_thread = num_threads;
+
+   for (i = 0; i < num_threads; i++) {
+      struct util_queue_thread *thread = &queue->per_thread[i];
+
+      (void) mtx_init(&thread->lock, mtx_plain);
+      for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES; p++) {
+         thread->lanes[p].size = lane_size;
+         thread->lanes[p].jobs = (struct util_queue_job*)
+                                 calloc(lane_size,
+                                        sizeof(struct util_queue_job));
+         if (!thread->lanes[p].jobs)
+            goto fail;
+      }
+   }
+
    queue->threads = (thrd_t*) calloc(num_threads, sizeof(thrd_t));
    if (!queue->threads)
       goto fail;
@@ -336,7 +445,10 @@ util_queue_init(struct util_queue *queue,
             /* no threads created, fail */
             goto fail;
          } else {
-            /* at least one thread created, so use it */
+            /* At least one thread created, so use it. The threads that
+             * are running may still look at the lanes of the others, so
+             * those are kept until util_queue_destroy.
+             */
             queue->num_threads = i;
             break;
          }
@@ -363,11 +475,16 @@ util_queue_init(struct util_queue *queue,
 fail:
    free(queue->threads);
 
-   if (queue->jobs) {
-      cnd_destroy(&queue->has_space_cond);
-      cnd_destroy(&queue->has_queued_cond);
-      mtx_destroy(&queue->lock);
-      free(queue->jobs);
+   cnd_destroy(&queue->has_space_cond);
+   cnd_destroy(&queue->has_queued_cond);
+   mtx_destroy(&queue->lock);
+
+   if (queue->per_thread) {
+      for (i = 0; i < num_threads; i++) {
+         for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES; p++)
+            free(queue->per_thread[i].lanes[p].jobs);
+      }
+      free(queue->per_thread);
    }
    /* also util_queue_is_initialized can be used to check for success */
    memset(queue, 0, sizeof(*queue));
@@ -381,12 +498,38 @@ util_queue_killall_and_wait(struct util_queue *queue)
 
    /* Signal all threads to terminate. */
    mtx_lock(&queue->lock);
-   queue->kill_threads = 1;
+   p_atomic_set(&queue->kill_threads, 1);
    cnd_broadcast(&queue->has_queued_cond);
+   cnd_broadcast(&queue->has_space_cond);
    mtx_unlock(&queue->lock);
 
    for (i = 0; i < queue->num_threads; i++)
       thrd_join(queue->threads[i], NULL);
+
+   /* Signal remaining jobs. Jobs can't be added anymore, see
+    * util_queue_add_job_with_priority.
+    */
+   for (i = 0; i < queue->num_threads; i++) {
+      struct util_queue_thread *thread = &queue->per_thread[i];
+
+      mtx_lock(&thread->lock);
+      for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES; p++) {
+         struct util_queue_lane *lane = &thread->lanes[p];
+
+         for (; lane->read_idx != lane->write_idx; lane->read_idx++) {
+            struct util_queue_job *job =
+               &lane->jobs[lane->read_idx & (lane->size - 1)];
+
+            if (job->job) {
+               util_queue_fence_signal(job->fence);
+               job->job = NULL;
+            }
+         }
+      }
+      mtx_unlock(&thread->lock);
+   }
+   queue->num_queued = 0;
+
    queue->num_threads = 0;
 }
 
@@ -399,7 +542,12 @@ util_queue_destroy(struct util_queue *queue)
    cnd_destroy(&queue->has_space_cond);
    cnd_destroy(&queue->has_queued_cond);
    mtx_destroy(&queue->lock);
-   free(queue->jobs);
+   for (unsigned i = 0; i < queue->num_per_thread; i++) {
+      mtx_destroy(&queue->per_thread[i].lock);
+      for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES; p++)
+         free(queue->per_thread[i].lanes[p].jobs);
+   }
+   free(queue->per_thread);
    free(queue->threads);
 }
 
@@ -410,11 +558,56 @@ util_queue_add_job(struct util_queue *queue,
                    util_queue_execute_func execute,
                    util_queue_execute_func cleanup)
 {
-   struct util_queue_job *ptr;
+   util_queue_add_job_with_priority(queue, job, fence, execute, cleanup,
+                                    UTIL_QUEUE_PRIORITY_NORMAL);
+}
 
-   mtx_lock(&queue->lock);
-   if (queue->kill_threads) {
+void
+util_queue_add_job_with_priority(struct util_queue *queue,
+                                 void *job,
+                                 struct util_queue_fence *fence,
+                                 util_queue_execute_func execute,
+                                 util_queue_execute_func cleanup,
+                                 enum util_queue_priority priority)
+{
+   struct util_queue_thread *thread;
+   struct util_queue_job new_job;
+   unsigned thread_index;
+   int num_queued;
+
+   assert(priority < UTIL_QUEUE_NUM_PRIORITIES);
+
+   if (!(queue->flags & UTIL_QUEUE_INIT_RESIZE_IF_FULL) &&
+       p_atomic_read(&queue->num_queued) >= queue->max_jobs) {
+      /* Wait until there is a free slot. Like for num_idle, the threads
+       * check num_waiting_for_space after decrementing num_queued.
+       */
+      mtx_lock(&queue->lock);
+      p_atomic_inc(&queue->num_waiting_for_space);
+      while (!queue->kill_threads &&
+             p_atomic_read(&queue->num_queued) >= queue->max_jobs)
+         cnd_wait(&queue->has_space_cond, &queue->lock);
+      p_atomic_dec(&queue->num_waiting_for_space);
       mtx_unlock(&queue->lock);
+   }
+
+   thread_index = queue->num_threads > 1 ?
+      p_atomic_inc_return(&queue->next_thread) % queue->num_threads : 0;
+   thread = &queue->per_thread[thread_index];
+
+   new_job.job = job;
+   new_job.fence = fence;
+   new_job.execute = execute;
+   new_job.cleanup = cleanup;
+   new_job.add_time = os_time_get_nano();
+
+   mtx_lock(&thread->lock);
+   /* util_queue_killall_and_wait signals the jobs left in the lanes after
+    * setting kill_threads, so checking it with the lane locked ensures the
+    * fence of every added job gets signalled.
+    */
+   if (queue->kill_threads) {
+      mtx_unlock(&thread->lock);
       /* well no good option here, but any leaks will be
        * short-lived as things are shutting down..
        */
@@ -422,54 +615,25 @@ util_queue_add_job(struct util_queue *queue,
    }
 
    util_queue_fence_reset(fence);
+   lane_push(&thread->lanes[priority], &new_job);
+   mtx_unlock(&thread->lock);
 
-   assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
+   num_queued = p_atomic_inc_return(&queue->num_queued);
 
-   if (queue->num_queued == queue->max_jobs) {
-      if (queue->flags & UTIL_QUEUE_INIT_RESIZE_IF_FULL) {
-         /* If the queue is full, make it larger to avoid waiting for a free
-          * slot.
-          */
-         unsigned new_max_jobs = queue->max_jobs + 8;
-         struct util_queue_job *jobs =
-            (struct util_queue_job*)calloc(new_max_jobs,
-                                           sizeof(struct util_queue_job));
-         assert(jobs);
-
-         /* Copy all queued jobs into the new list. */
-         unsigned num_jobs = 0;
-         unsigned i = queue->read_idx;
-
-         do {
-            jobs[num_jobs++] = queue->jobs[i];
-            i = (i + 1) % queue->max_jobs;
-         } while (i != queue->write_idx);
-
-         assert(num_jobs == queue->num_queued);
-
-         free(queue->jobs);
-         queue->jobs = jobs;
-         queue->read_idx = 0;
-         queue->write_idx = num_jobs;
-         queue->max_jobs = new_max_jobs;
-      } else {
-         /* Wait until there is a free slot. */
-         while (queue->num_queued == queue->max_jobs)
-            cnd_wait(&queue->has_space_cond, &queue->lock);
-      }
+   /* Track the highest occupancy of the queue. */
+   int max_queued = p_atomic_read(&queue->max_queued);
+   while (num_queued > max_queued) {
+      int old = p_atomic_cmpxchg(&queue->max_queued, max_queued, num_queued);
+      if (old == max_queued)
+         break;
+      max_queued = old;
    }
 
-   ptr = &queue->jobs[queue->write_idx];
-   assert(ptr->job == NULL);
-   ptr->job = job;
-   ptr->fence = fence;
-   ptr->execute = execute;
-   ptr->cleanup = cleanup;
-   queue->write_idx = (queue->write_idx + 1) % queue->max_jobs;
-
-   queue->num_queued++;
-   cnd_signal(&queue->has_queued_cond);
-   mtx_unlock(&queue->lock);
+   if (p_atomic_read(&queue->num_idle)) {
+      mtx_lock(&queue->lock);
+      cnd_signal(&queue->has_queued_cond);
+      mtx_unlock(&queue->lock);
+   }
 }
 
 /**
@@ -490,20 +654,29 @@ util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
    if (util_queue_fence_is_signalled(fence))
       return;
 
-   mtx_lock(&queue->lock);
-   for (unsigned i = queue->read_idx; i != queue->write_idx;
-        i = (i + 1) % queue->max_jobs) {
-      if (queue->jobs[i].fence == fence) {
-         if (queue->jobs[i].cleanup)
-            queue->jobs[i].cleanup(queue->jobs[i].job, -1);
-
-         /* Just clear it. The threads will treat as a no-op job. */
-         memset(&queue->jobs[i], 0, sizeof(queue->jobs[i]));
-         removed = true;
-         break;
+   for (unsigned i = 0; i < queue->num_threads && !removed; i++) {
+      struct util_queue_thread *thread = &queue->per_thread[i];
+
+      mtx_lock(&thread->lock);
+      for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES && !removed; p++) {
+         struct util_queue_lane *lane = &thread->lanes[p];
+
+         for (unsigned j = lane->read_idx; j != lane->write_idx; j++) {
+            struct util_queue_job *job = &lane->jobs[j & (lane->size - 1)];
+
+            if (job->fence == fence) {
+               if (job->cleanup)
+                  job->cleanup(job->job, -1);
+
+               /* Just clear it. The threads will treat as a no-op job. */
+               memset(job, 0, sizeof(*job));
+               removed = true;
+               break;
+            }
+         }
       }
+      mtx_unlock(&thread->lock);
    }
-   mtx_unlock(&queue->lock);
 
    if (removed)
       util_queue_fence_signal(fence);
@@ -529,9 +702,15 @@ util_queue_finish(struct util_queue *queue)
 
    util_barrier_init(&barrier, queue->num_threads);
 
+   /* The barrier jobs have the lowest priority, so every thread only gets
+    * to one of them once there are no other jobs left that were added
+    * before.
+    */
    for (unsigned i = 0; i < queue->num_threads; ++i) {
       util_queue_fence_init(&fences[i]);
-      util_queue_add_job(queue, &barrier, &fences[i], util_queue_finish_execute, NULL);
+      util_queue_add_job_with_priority(queue, &barrier, &fences[i],
+                                       util_queue_finish_execute, NULL,
+                                       UTIL_QUEUE_PRIORITY_LOW);
    }
 
    for (unsigned i = 0; i < queue->num_threads; ++i) {
@@ -553,3 +732,27 @@ util_queue_get_thread_time_nano(struct util_queue *queue, unsigned thread_index)
 
    return u_thread_get_time_nano(queue->threads[thread_index]);
 }
+
+void
+util_queue_get_stats(struct util_queue *queue, struct util_queue_stats *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+
+   for (unsigned i = 0; i < queue->num_threads; i++) {
+      struct util_queue_thread *thread = &queue->per_thread[i];
+
+      mtx_lock(&thread->lock);
+      for (unsigned p = 0; p < UTIL_QUEUE_NUM_PRIORITIES; p++) {
+         stats->num_jobs[p] += thread->stats.num_jobs[p];
+         stats->total_wait_nano[p] += thread->stats.total_wait_nano[p];
+         stats->max_wait_nano[p] = MAX2(stats->max_wait_nano[p],
+                                        thread->stats.max_wait_nano[p]);
+      }
+      stats->total_execute_nano += thread->stats.total_execute_nano;
+      stats->num_stolen += thread->stats.num_stolen;
+      mtx_unlock(&thread->lock);
+   }
+
+   stats->num_queued = MAX2(p_atomic_read(&queue->num_queued), 0);
+   stats->max_queued = p_atomic_read(&queue->max_queued);
+}
@@ -190,27 +190,80 @@ util_queue_fence_wait_timeout(struct util_queue_fence *fence,
 
 typedef void (*util_queue_execute_func)(void *job, int thread_index);
 
+/* Jobs of a higher priority are always started before queued jobs of a
+ * lower priority. Jobs of the same priority are started in the order they
+ * were added, so a queue with a single thread executes them in order.
+ */
+enum util_queue_priority {
+   UTIL_QUEUE_PRIORITY_HIGH,
+   UTIL_QUEUE_PRIORITY_NORMAL,
+   UTIL_QUEUE_PRIORITY_LOW,
+   UTIL_QUEUE_NUM_PRIORITIES
+};
+
 struct util_queue_job {
    void *job;
    struct util_queue_fence *fence;
    util_queue_execute_func execute;
    util_queue_execute_func cleanup;
+   int64_t add_time;
+};
+
+/* A FIFO of jobs of one priority. */
+struct util_queue_lane {
+   struct util_queue_job *jobs;
+   unsigned size; /* power of two */
+   unsigned read_idx, write_idx; /* free-running, wrap with size - 1 */
+};
+
+struct util_queue_stats {
+   /* Jobs executed, per priority. */
+   uint64_t num_jobs[UTIL_QUEUE_NUM_PRIORITIES];
+
+   /* Time jobs spent queued before they started, per priority. */
+   uint64_t total_wait_nano[UTIL_QUEUE_NUM_PRIORITIES];
+   uint64_t max_wait_nano[UTIL_QUEUE_NUM_PRIORITIES];
+
+   /* Time spent executing jobs. */
+   uint64_t total_execute_nano;
+
+   /* Jobs a thread took from the lanes of another thread. */
+   uint64_t num_stolen;
+
+   /* Jobs queued right now, and the most that were ever queued at once. */
+   unsigned num_queued;
+   unsigned max_queued;
+};
+
+/* Every thread has its own lanes, so adding and taking jobs mostly doesn't
+ * contend on a lock shared by all threads. Jobs are spread over the threads
+ * round-robin and a thread that runs out of jobs takes them from the lanes
+ * of the other threads.
+ */
+struct util_queue_thread {
+   mtx_t lock; /* protects lanes and stats */
+   struct util_queue_lane lanes[UTIL_QUEUE_NUM_PRIORITIES];
+   struct util_queue_stats stats;
 };
 
 /* Put this into your context. */
 struct util_queue {
    const char *name;
-   mtx_t lock;
+   mtx_t lock; /* only used for sleeping and waking up */
    cnd_t has_queued_cond;
    cnd_t has_space_cond;
    thrd_t *threads;
+   struct util_queue_thread *per_thread;
+   unsigned num_per_thread; /* can be more than num_threads */
    unsigned flags;
    int num_queued;
+   int max_queued;
    unsigned num_threads;
    int kill_threads;
    int max_jobs;
-   int write_idx, read_idx; /* ring buffer pointers */
-   struct util_queue_job *jobs;
+   unsigned next_thread; /* thread whose lanes get the next job */
+   int num_idle; /* threads waiting for jobs */
+   int num_waiting_for_space; /* threads waiting in util_queue_add_job */
 
    /* for cleanup at exit(), protected by exit_mutex */
    struct list_head head;
@@ -229,6 +282,12 @@ void util_queue_add_job(struct util_queue *queue,
                         struct util_queue_fence *fence,
                         util_queue_execute_func execute,
                         util_queue_execute_func cleanup);
+void util_queue_add_job_with_priority(struct util_queue *queue,
+                                      void *job,
+                                      struct util_queue_fence *fence,
+                                      util_queue_execute_func execute,
+                                      util_queue_execute_func cleanup,
+                                      enum util_queue_priority priority);
 void util_queue_drop_job(struct util_queue *queue,
                          struct util_queue_fence *fence);
 
@@ -237,6 +296,9 @@ void util_queue_finish(struct util_queue *queue);
 int64_t util_queue_get_thread_time_nano(struct util_queue *queue,
                                         unsigned thread_index);
 
+void util_queue_get_stats(struct util_queue *queue,
+                          struct util_queue_stats *stats);
+
 /* util_queue needs to be cleared to zeroes for this to work */
 static inline bool
 util_queue_is_initialized(struct util_queue *queue)